@@ -479,20 +479,23 @@ inline Try<std::string> decode(const std::string& s)
 }
 
 
-// Sends a blocking HTTP GET request to the process with the given upid.
-// Returns the HTTP response from the process, read asynchronously.
+// Asynchronously sends an HTTP GET request to the process with the
+// given upid and returns the HTTP response from the process.
 //
-// TODO(bmahler): Have the request sent asynchronously as well.
-// TODO(bmahler): For efficiency, this should properly use the ResponseDecoder
-// on the read stream, rather than parsing the full string response at the end.
+// Requests are sent on persistent (keep-alive) connections that are
+// pooled per server: a request goes out on an idle connection if
+// there is one, otherwise on a new connection, up to a limit after
+// which requests get pipelined on the existing connections. Idle
+// connections are closed after a while.
 Future<Response> get(
     const UPID& upid,
     const Option<std::string>& path = None(),
     const Option<std::string>& query = None());
 
 
-// Sends a blocking HTTP POST request to the process with the given upid.
-// Returns the HTTP response from the process, read asyncronously.
+// Asynchronously sends an HTTP POST request to the process with the
+// given upid and returns the HTTP response from the process. See
+// 'get' above for how the connections are managed.
 Future<Response> post(
     const UPID& upid,
     const Option<std::string>& path = None(),
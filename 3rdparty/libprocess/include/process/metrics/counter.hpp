@@ -41,12 +41,30 @@ public:
     return c;
   }
 
+  Counter& operator -- ()
+  {
+    return *this -= 1;
+  }
+
+  Counter operator -- (int)
+  {
+    Counter c(*this);
+    --(*this);
+    return c;
+  }
+
   Counter& operator += (int64_t v)
   {
     __sync_fetch_and_add(&data->v, v);
     return *this;
   }
 
+  Counter& operator -= (int64_t v)
+  {
+    __sync_fetch_and_sub(&data->v, v);
+    return *this;
+  }
+
 private:
   struct Data
   {
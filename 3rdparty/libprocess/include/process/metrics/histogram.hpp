@@ -0,0 +1,189 @@
+#ifndef __PROCESS_METRICS_HISTOGRAM_HPP__
+#define __PROCESS_METRICS_HISTOGRAM_HPP__
+
+#include <stdint.h>
+
+#include <limits>
+#include <string>
+
+#include <process/future.hpp>
+
+#include <process/metrics/metric.hpp>
+
+#include <stout/hashmap.hpp>
+
+namespace process {
+namespace metrics {
+
+// A Metric that represents the distribution of the (non-negative
+// integer) values recorded, e.g., latencies. The value of the metric
+// is the number of values recorded while a snapshot includes
+// '<name>/count', '<name>/min', '<name>/max' and the percentiles
+// '<name>/p50', '<name>/p90', '<name>/p99' and '<name>/p999'.
+//
+// The values are counted in fixed buckets (similar to an HDR
+// histogram): each power of two is split into 16 linear buckets so
+// the percentiles are within ~6% of the recorded values. Recording a
+// value only involves atomic operations so that it can be done from
+// any thread without taking a lock.
+class Histogram : public Metric
+{
+public:
+  // The values reported in a snapshot are multiplied by 'scale',
+  // e.g., to record nanoseconds but report milliseconds.
+  explicit Histogram(const std::string& name, double scale = 1.0)
+    : Metric(name),
+      data(new Data(scale)) {}
+
+  virtual ~Histogram() {}
+
+  virtual Future<double> value() const
+  {
+    return static_cast<double>(data->count);
+  }
+
+  virtual Future<hashmap<std::string, double> > values() const
+  {
+    // Take a copy of the buckets first so that the percentiles are
+    // consistent with each other even while values are recorded.
+    int64_t buckets[BUCKETS];
+    int64_t count = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+      buckets[i] = data->buckets[i];
+      count += buckets[i];
+    }
+
+    hashmap<std::string, double> result;
+    result[name() + "/count"] = static_cast<double>(count);
+
+    if (count == 0) {
+      return result;
+    }
+
+    const uint64_t min = data->min;
+    const uint64_t max = data->max;
+
+    result[name() + "/min"] = min * data->scale;
+    result[name() + "/max"] = max * data->scale;
+
+    const int PERCENTILES = 4;
+    const double percentiles[PERCENTILES] = { 0.5, 0.9, 0.99, 0.999 };
+    const char* names[PERCENTILES] = { "/p50", "/p90", "/p99", "/p999" };
+
+    int bucket = 0;
+    int64_t cumulative = buckets[0];
+
+    for (int i = 0; i < PERCENTILES; i++) {
+      // The rank of the percentile, i.e., the number of values that
+      // are less than or equal to it.
+      int64_t rank = static_cast<int64_t>(percentiles[i] * count + 0.5);
+      if (rank < 1) {
+        rank = 1;
+      }
+
+      while (cumulative < rank && bucket < BUCKETS - 1) {
+        cumulative += buckets[++bucket];
+      }
+
+      // Use the middle of the bucket, bounded by the extremes.
+      double value = lower(bucket) + (width(bucket) - 1) / 2.0;
+      if (value < min) {
+        value = min;
+      } else if (value > max) {
+        value = max;
+      }
+
+      result[name() + names[i]] = value * data->scale;
+    }
+
+    return result;
+  }
+
+  void record(uint64_t value)
+  {
+    // Update the extremes first so that they include every value
+    // which is counted in a bucket when taking a snapshot.
+    uint64_t min = data->min;
+    while (value < min &&
+           !__sync_bool_compare_and_swap(&data->min, min, value)) {
+      min = data->min;
+    }
+
+    uint64_t max = data->max;
+    while (value > max &&
+           !__sync_bool_compare_and_swap(&data->max, max, value)) {
+      max = data->max;
+    }
+
+    __sync_fetch_and_add(&data->buckets[index(value)], 1);
+    __sync_fetch_and_add(&data->count, 1);
+  }
+
+private:
+  // Each power of two is split into 2^SUB_BUCKET_BITS buckets, the
+  // values below 2^SUB_BUCKET_BITS get a bucket each.
+  static const int SUB_BUCKET_BITS = 4;
+  static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  static int index(uint64_t value)
+  {
+    if (value < static_cast<uint64_t>(SUB_BUCKETS)) {
+      return static_cast<int>(value);
+    }
+
+    // The number of low bits that are dropped, i.e., the width of
+    // the buckets for this power of two is 2^shift.
+    const int shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+
+    return (shift + 1) * SUB_BUCKETS +
+      static_cast<int>(value >> shift) - SUB_BUCKETS;
+  }
+
+  static uint64_t lower(int index)
+  {
+    if (index < SUB_BUCKETS) {
+      return index;
+    }
+
+    const int shift = index / SUB_BUCKETS - 1;
+    return static_cast<uint64_t>(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+  }
+
+  static uint64_t width(int index)
+  {
+    if (index < SUB_BUCKETS) {
+      return 1;
+    }
+
+    return static_cast<uint64_t>(1) << (index / SUB_BUCKETS - 1);
+  }
+
+  struct Data
+  {
+    explicit Data(double _scale)
+      : scale(_scale),
+        count(0),
+        min(std::numeric_limits<uint64_t>::max()),
+        max(0)
+    {
+      for (int i = 0; i < BUCKETS; i++) {
+        buckets[i] = 0;
+      }
+    }
+
+    const double scale;
+
+    volatile int64_t count;
+    volatile uint64_t min;
+    volatile uint64_t max;
+    volatile int64_t buckets[BUCKETS];
+  };
+
+  boost::shared_ptr<Data> data;
+};
+
+}  // namespace metrics {
+}  // namespace process {
+
+#endif  // __PROCESS_METRICS_HISTOGRAM_HPP__
@@ -7,6 +7,9 @@
 
 #include <process/future.hpp>
 
+#include <stout/hashmap.hpp>
+#include <stout/lambda.hpp>
+
 namespace process {
 namespace metrics {
 
@@ -17,6 +20,14 @@ public:
 
   virtual Future<double> value() const = 0;
 
+  // Returns the values to include in a snapshot keyed by their name.
+  // By default this is just 'value' keyed by 'name' but metrics that
+  // summarize several values (e.g., Histogram) can report more.
+  virtual Future<hashmap<std::string, double> > values() const
+  {
+    return value().then(lambda::bind(&Metric::_values, name(), lambda::_1));
+  }
+
   const std::string& name() const { return data->name; }
 
 protected:
@@ -25,6 +36,15 @@ protected:
     : data(new Data(name)) {}
 
 private:
+  static hashmap<std::string, double> _values(
+      const std::string& name,
+      double value)
+  {
+    hashmap<std::string, double> values;
+    values[name] = value;
+    return values;
+  }
+
   struct Data {
     explicit Data(const std::string& _name) : name(_name) {}
 
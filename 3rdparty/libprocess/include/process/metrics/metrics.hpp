@@ -1,6 +1,7 @@
 #ifndef __PROCESS_METRICS_METRICS_HPP__
 #define __PROCESS_METRICS_METRICS_HPP__
 
+#include <list>
 #include <string>
 
 #include <process/dispatch.hpp>
@@ -42,7 +43,7 @@ private:
   Future<http::Response> snapshot(const http::Request& request);
   static Future<http::Response> _snapshot(
       const http::Request& request,
-      const hashmap<std::string, Future<double> >& metrics);
+      const std::list<Future<hashmap<std::string, double> > >& metrics);
 
   // The Owned<Metric> is an explicit copy of the Metric passed to 'add'.
   hashmap<std::string, Owned<Metric> > metrics;
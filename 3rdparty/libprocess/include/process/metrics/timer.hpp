@@ -0,0 +1,55 @@
+#ifndef __PROCESS_METRICS_TIMER_HPP__
+#define __PROCESS_METRICS_TIMER_HPP__
+
+#include <string>
+
+#include <process/future.hpp>
+
+#include <process/metrics/histogram.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/lambda.hpp>
+#include <stout/stopwatch.hpp>
+
+namespace process {
+namespace metrics {
+
+// A Histogram of durations, reported in milliseconds.
+class Timer : public Histogram
+{
+public:
+  // The durations are recorded in nanoseconds.
+  explicit Timer(const std::string& name)
+    : Histogram(name, 1.0 / Milliseconds(1).ns()) {}
+
+  virtual ~Timer() {}
+
+  void record(const Duration& duration)
+  {
+    Histogram::record(duration > Duration::zero() ? duration.ns() : 0);
+  }
+
+  // Records the time it takes for the future to complete (i.e., to
+  // become ready, failed or discarded) and returns the future.
+  template <typename T>
+  Future<T> time(const Future<T>& future)
+  {
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    future.onAny(lambda::bind(&Timer::_time, *this, stopwatch));
+
+    return future;
+  }
+
+private:
+  static void _time(Timer timer, const Stopwatch& stopwatch)
+  {
+    timer.record(stopwatch.elapsed());
+  }
+};
+
+}  // namespace metrics {
+}  // namespace process {
+
+#endif  // __PROCESS_METRICS_TIMER_HPP__
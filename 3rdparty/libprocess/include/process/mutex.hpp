@@ -38,17 +38,26 @@ public:
 
   void unlock()
   {
+    // NOTE: The promise of the next waiter gets set outside of the
+    // critical section since setting it might invoke callbacks which
+    // unlock (or lock) this mutex again.
+    Owned<Promise<Nothing> > promise;
+
     internal::acquire(&data->lock);
     {
       if (!data->promises.empty()) {
         // TODO(benh): Skip a future that has been discarded?
-        data->promises.front()->set(Nothing());
+        promise = data->promises.front();
         data->promises.pop();
       } else {
         data->locked = false;
       }
     }
     internal::release(&data->lock);
+
+    if (promise.get() != NULL) {
+      promise->set(Nothing());
+    }
   }
 
 private:
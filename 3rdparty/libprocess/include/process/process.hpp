@@ -22,6 +22,10 @@
 
 namespace process {
 
+// Forward declaration.
+template <typename T>
+class Mailbox;
+
 class ProcessBase : public EventVisitor
 {
 public:
@@ -176,9 +180,15 @@ private:
     BLOCKED,
     TERMINATING,
     TERMINATED
-  } state;
+  };
 
-  // Mutex protecting internals.
+  // Current state, transitions from BLOCKED to READY are done with a
+  // compare-and-swap by whichever thread enqueues an event first (see
+  // ProcessBase::enqueue), all other transitions are done by the
+  // thread running (or cleaning up) the process.
+  volatile int state;
+
+  // Mutex protecting 'events' (but not the mailbox).
   // TODO(benh): Consider replacing with a spinlock, on multi-core systems.
   pthread_mutex_t m;
   void lock() { pthread_mutex_lock(&m); }
@@ -187,7 +197,12 @@ private:
   // Enqueue the specified message, request, or function call.
   void enqueue(Event* event, bool inject = false);
 
-  // Queue of received events.
+  // Events enqueued on the process that have yet to be moved into
+  // 'events', enqueueing does not require holding the lock.
+  Mailbox<Event*>* mailbox;
+
+  // Queue of received events, drained from the mailbox in batches
+  // while holding the lock (see ProcessManager::resume).
   std::deque<Event*> events;
 
   // Delegates for messages.
@@ -212,6 +227,10 @@ private:
   // Active references.
   int refs;
 
+  // Worker thread that last ran this process, or -1 if it has not
+  // been run by a worker thread yet (see ProcessManager::enqueue).
+  int worker;
+
   // Process PID.
   UPID pid;
 };
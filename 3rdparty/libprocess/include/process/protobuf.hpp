@@ -6,6 +6,8 @@
 #include <google/protobuf/message.h>
 #include <google/protobuf/repeated_field.h>
 
+#include <boost/shared_ptr.hpp>
+
 #include <set>
 #include <vector>
 
@@ -61,15 +63,43 @@ const T& convert(const T& t)
 }
 
 
+// Repeated fields can be passed to a handler either as a
+// 'std::vector<T>' (which copies each item) or, to avoid the copies,
+// as a 'const RepeatedPtrField<T>&'.
 template <typename T>
-std::vector<T> convert(const google::protobuf::RepeatedPtrField<T>& items)
+class RepeatedPtrFieldConverter
 {
-  std::vector<T> result;
-  for (int i = 0; i < items.size(); i++) {
-    result.push_back(items.Get(i));
+public:
+  explicit RepeatedPtrFieldConverter(
+      const google::protobuf::RepeatedPtrField<T>& _items)
+    : items(_items) {}
+
+  operator std::vector<T> () const
+  {
+    std::vector<T> result;
+    result.reserve(items.size());
+    for (int i = 0; i < items.size(); i++) {
+      result.push_back(items.Get(i));
+    }
+
+    return result;
+  }
+
+  operator const google::protobuf::RepeatedPtrField<T>& () const
+  {
+    return items;
   }
 
-  return result;
+private:
+  const google::protobuf::RepeatedPtrField<T>& items;
+};
+
+
+template <typename T>
+RepeatedPtrFieldConverter<T> convert(
+    const google::protobuf::RepeatedPtrField<T>& items)
+{
+  return RepeatedPtrFieldConverter<T>(items);
 }
 
 }} // namespace google { namespace protobuf {
@@ -84,14 +114,38 @@ public:
 protected:
   virtual void visit(const process::MessageEvent& event)
   {
-    if (protobufHandlers.count(event.message->name) > 0) {
-      from = event.message->from; // For 'reply'.
-      protobufHandlers[event.message->name](
-          event.message->from, event.message->body);
-      from = process::UPID();
-    } else {
+    typename hashmap<std::string, ProtobufHandler>::iterator iterator =
+      protobufHandlers.find(event.message->name);
+
+    if (iterator == protobufHandlers.end()) {
       process::Process<T>::visit(event);
+      return;
+    }
+
+    ProtobufHandler& handler = iterator->second;
+
+    if (handler.parse) {
+      // Parse straight out of the message body into the message kept
+      // for this handler. Parsing first clears the message but keeps
+      // the memory it allocated for earlier messages (strings,
+      // repeated fields, sub-messages) around to be reused.
+      const std::string& body = event.message->body;
+      if (!handler.message->ParsePartialFromArray(body.data(), body.size())) {
+        LOG(WARNING) << "Failed to parse " << handler.message->GetTypeName()
+                     << " from " << event.message->from;
+        return;
+      }
+
+      if (!handler.message->IsInitialized()) {
+        LOG(WARNING) << "Initialization errors: "
+                     << handler.message->InitializationErrorString();
+        return;
+      }
     }
+
+    from = event.message->from; // For 'reply'.
+    handler.handler(event.message->from, *handler.message);
+    from = process::UPID();
   }
 
   void send(const process::UPID& to,
@@ -108,8 +162,6 @@ protected:
   void reply(const google::protobuf::Message& message)
   {
     CHECK(from) << "Attempting to reply without a sender";
-    std::string data;
-    message.SerializeToString(&data);
     send(from, message);
   }
 
@@ -117,25 +169,21 @@ protected:
   template <typename M>
   void install(void (T::*method)(const process::UPID&, const M&))
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&handlerM<M>,
-                   t, method,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&handlerM<M>,
+                     t, method,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M>
   void install(void (T::*method)(const process::UPID&))
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&handler0,
-                   t, method,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), false,
+        lambda::bind(&handler0,
+                     t, method,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M,
@@ -144,13 +192,11 @@ protected:
       void (T::*method)(const process::UPID&, P1C),
       P1 (M::*param1)() const)
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&handler1<M, P1, P1C>,
-                   t, method, param1,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&handler1<M, P1, P1C>,
+                     t, method, param1,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M,
@@ -161,13 +207,11 @@ protected:
       P1 (M::*p1)() const,
       P2 (M::*p2)() const)
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&handler2<M, P1, P1C, P2, P2C>,
-                   t, method, p1, p2,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&handler2<M, P1, P1C, P2, P2C>,
+                     t, method, p1, p2,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M,
@@ -180,13 +224,11 @@ protected:
       P2 (M::*p2)() const,
       P3 (M::*p3)() const)
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&handler3<M, P1, P1C, P2, P2C, P3, P3C>,
-                   t, method, p1, p2, p3,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&handler3<M, P1, P1C, P2, P2C, P3, P3C>,
+                     t, method, p1, p2, p3,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M,
@@ -201,13 +243,11 @@ protected:
       P3 (M::*p3)() const,
       P4 (M::*p4)() const)
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&handler4<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C>,
-                   t, method, p1, p2, p3, p4,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&handler4<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C>,
+                     t, method, p1, p2, p3, p4,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M,
@@ -224,38 +264,32 @@ protected:
       P4 (M::*p4)() const,
       P5 (M::*p5)() const)
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&handler5<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C, P5, P5C>,
-                   t, method, p1, p2, p3, p4, p5,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&handler5<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C, P5, P5C>,
+                     t, method, p1, p2, p3, p4, p5,
+                     lambda::_1, lambda::_2));
   }
 
   // Installs that do not take the sender.
   template <typename M>
   void install(void (T::*method)(const M&))
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&_handlerM<M>,
-                   t, method,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&_handlerM<M>,
+                     t, method,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M>
   void install(void (T::*method)())
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&_handler0,
-                   t, method,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), false,
+        lambda::bind(&_handler0,
+                     t, method,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M,
@@ -264,13 +298,11 @@ protected:
       void (T::*method)(P1C),
       P1 (M::*param1)() const)
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&_handler1<M, P1, P1C>,
-                   t, method, param1,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&_handler1<M, P1, P1C>,
+                     t, method, param1,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M,
@@ -281,13 +313,11 @@ protected:
       P1 (M::*p1)() const,
       P2 (M::*p2)() const)
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&_handler2<M, P1, P1C, P2, P2C>,
-                   t, method, p1, p2,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&_handler2<M, P1, P1C, P2, P2C>,
+                     t, method, p1, p2,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M,
@@ -300,13 +330,11 @@ protected:
       P2 (M::*p2)() const,
       P3 (M::*p3)() const)
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&_handler3<M, P1, P1C, P2, P2C, P3, P3C>,
-                   t, method, p1, p2, p3,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&_handler3<M, P1, P1C, P2, P2C, P3, P3C>,
+                     t, method, p1, p2, p3,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M,
@@ -321,13 +349,11 @@ protected:
       P3 (M::*p3)() const,
       P4 (M::*p4)() const)
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&_handler4<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C>,
-                   t, method, p1, p2, p3, p4,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&_handler4<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C>,
+                     t, method, p1, p2, p3, p4,
+                     lambda::_1, lambda::_2));
   }
 
   template <typename M,
@@ -344,41 +370,62 @@ protected:
       P4 (M::*p4)() const,
       P5 (M::*p5)() const)
   {
-    google::protobuf::Message* m = new M();
     T* t = static_cast<T*>(this);
-    protobufHandlers[m->GetTypeName()] =
-      lambda::bind(&_handler5<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C, P5, P5C>,
-                   t, method, p1, p2, p3, p4, p5,
-                   lambda::_1, lambda::_2);
-    delete m;
+    installHandler(new M(), true,
+        lambda::bind(&_handler5<M, P1, P1C, P2, P2C, P3, P3C, P4, P4C, P5, P5C>,
+                     t, method, p1, p2, p3, p4, p5,
+                     lambda::_1, lambda::_2));
   }
 
   using process::Process<T>::install;
 
 private:
+  typedef lambda::function<
+    void(const process::UPID&, const google::protobuf::Message&)> Handler;
+
+  // A handler along with the message it gets invoked with. Note that
+  // the message is reused for every message of its type (a process
+  // handles one message at a time) so a handler must copy anything it
+  // wants to keep after it returns.
+  struct ProtobufHandler
+  {
+    ProtobufHandler() : parse(false) {}
+
+    boost::shared_ptr<google::protobuf::Message> message;
+    bool parse; // False if the handler ignores the message.
+    Handler handler;
+  };
+
+  void installHandler(
+      google::protobuf::Message* message,
+      bool parse,
+      const Handler& handler)
+  {
+    ProtobufHandler& protobufHandler =
+      protobufHandlers[message->GetTypeName()];
+
+    protobufHandler.message.reset(message);
+    protobufHandler.parse = parse;
+    protobufHandler.handler = handler;
+  }
+
   // Handlers that take the sender as the first argument.
   template <typename M>
   static void handlerM(
       T* t,
       void (T::*method)(const process::UPID&, const M&),
       const process::UPID& sender,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(sender, m);
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(sender, m);
   }
 
   static void handler0(
       T* t,
       void (T::*method)(const process::UPID&),
       const process::UPID& sender,
-      const std::string& data)
+      const google::protobuf::Message&)
   {
     (t->*method)(sender);
   }
@@ -390,16 +437,10 @@ private:
       void (T::*method)(const process::UPID&, P1C),
       P1 (M::*p1)() const,
       const process::UPID& sender,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(sender, google::protobuf::convert((&m->*p1)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(sender, google::protobuf::convert((&m->*p1)()));
   }
 
   template <typename M,
@@ -411,18 +452,12 @@ private:
       P1 (M::*p1)() const,
       P2 (M::*p2)() const,
       const process::UPID& sender,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(sender,
-                   google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(sender,
+                 google::protobuf::convert((&m->*p1)()),
+                 google::protobuf::convert((&m->*p2)()));
   }
 
   template <typename M,
@@ -436,19 +471,13 @@ private:
       P2 (M::*p2)() const,
       P3 (M::*p3)() const,
       const process::UPID& sender,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(sender,
-                   google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(sender,
+                 google::protobuf::convert((&m->*p1)()),
+                 google::protobuf::convert((&m->*p2)()),
+                 google::protobuf::convert((&m->*p3)()));
   }
 
   template <typename M,
@@ -464,20 +493,14 @@ private:
       P3 (M::*p3)() const,
       P4 (M::*p4)() const,
       const process::UPID& sender,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(sender,
-                   google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()),
-                   google::protobuf::convert((&m->*p4)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(sender,
+                 google::protobuf::convert((&m->*p1)()),
+                 google::protobuf::convert((&m->*p2)()),
+                 google::protobuf::convert((&m->*p3)()),
+                 google::protobuf::convert((&m->*p4)()));
   }
 
   template <typename M,
@@ -495,21 +518,15 @@ private:
       P4 (M::*p4)() const,
       P5 (M::*p5)() const,
       const process::UPID& sender,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(sender,
-                   google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()),
-                   google::protobuf::convert((&m->*p4)()),
-                   google::protobuf::convert((&m->*p5)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(sender,
+                 google::protobuf::convert((&m->*p1)()),
+                 google::protobuf::convert((&m->*p2)()),
+                 google::protobuf::convert((&m->*p3)()),
+                 google::protobuf::convert((&m->*p4)()),
+                 google::protobuf::convert((&m->*p5)()));
   }
 
   // Handlers that ignore the sender.
@@ -518,23 +535,17 @@ private:
       T* t,
       void (T::*method)(const M&),
       const process::UPID&,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(m);
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(m);
   }
 
   static void _handler0(
       T* t,
       void (T::*method)(),
       const process::UPID&,
-      const std::string& data)
+      const google::protobuf::Message&)
   {
     (t->*method)();
   }
@@ -546,16 +557,10 @@ private:
       void (T::*method)(P1C),
       P1 (M::*p1)() const,
       const process::UPID&,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(google::protobuf::convert((&m->*p1)()));
   }
 
   template <typename M,
@@ -567,17 +572,11 @@ private:
       P1 (M::*p1)() const,
       P2 (M::*p2)() const,
       const process::UPID&,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(google::protobuf::convert((&m->*p1)()),
+                 google::protobuf::convert((&m->*p2)()));
   }
 
   template <typename M,
@@ -591,18 +590,12 @@ private:
       P2 (M::*p2)() const,
       P3 (M::*p3)() const,
       const process::UPID&,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(google::protobuf::convert((&m->*p1)()),
+                 google::protobuf::convert((&m->*p2)()),
+                 google::protobuf::convert((&m->*p3)()));
   }
 
   template <typename M,
@@ -618,19 +611,13 @@ private:
       P3 (M::*p3)() const,
       P4 (M::*p4)() const,
       const process::UPID&,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()),
-                   google::protobuf::convert((&m->*p4)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(google::protobuf::convert((&m->*p1)()),
+                 google::protobuf::convert((&m->*p2)()),
+                 google::protobuf::convert((&m->*p3)()),
+                 google::protobuf::convert((&m->*p4)()));
   }
 
   template <typename M,
@@ -648,25 +635,17 @@ private:
       P4 (M::*p4)() const,
       P5 (M::*p5)() const,
       const process::UPID&,
-      const std::string& data)
-  {
-    M m;
-    m.ParseFromString(data);
-    if (m.IsInitialized()) {
-      (t->*method)(google::protobuf::convert((&m->*p1)()),
-                   google::protobuf::convert((&m->*p2)()),
-                   google::protobuf::convert((&m->*p3)()),
-                   google::protobuf::convert((&m->*p4)()),
-                   google::protobuf::convert((&m->*p5)()));
-    } else {
-      LOG(WARNING) << "Initialization errors: "
-                   << m.InitializationErrorString();
-    }
+      const google::protobuf::Message& message)
+  {
+    const M& m = static_cast<const M&>(message);
+    (t->*method)(google::protobuf::convert((&m->*p1)()),
+                 google::protobuf::convert((&m->*p2)()),
+                 google::protobuf::convert((&m->*p3)()),
+                 google::protobuf::convert((&m->*p4)()),
+                 google::protobuf::convert((&m->*p5)()));
   }
 
-  typedef lambda::function<
-      void(const process::UPID&, const std::string&)> handler;
-  hashmap<std::string, handler> protobufHandlers;
+  hashmap<std::string, ProtobufHandler> protobufHandlers;
 
   // Sender of "current" message, inaccessible by subclasses.
   // This is only used for reply().
@@ -50,6 +50,8 @@ public:
   }
 
 private:
+  friend size_t hash_value(const Timer&);
+
   Timer(long _id,
         const Timeout& _t,
         const process::UPID& _pid,
@@ -71,6 +73,13 @@ private:
   lambda::function<void(void)> thunk;
 };
 
+
+// For using Timers in hashmaps and hashsets.
+inline size_t hash_value(const Timer& timer)
+{
+  return static_cast<size_t>(timer.id);
+}
+
 } // namespace process {
 
 #endif // __PROCESS_TIMER_HPP__
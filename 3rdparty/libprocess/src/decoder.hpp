@@ -2,28 +2,43 @@
 #define __DECODER_HPP__
 
 #include <http_parser.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <arpa/inet.h>
 
 #include <deque>
 #include <string>
 #include <vector>
 
 #include <process/http.hpp>
+#include <process/message.hpp>
 #include <process/socket.hpp>
 
 #include <stout/foreach.hpp>
 #include <stout/gzip.hpp>
 #include <stout/try.hpp>
 
+#include "encoder.hpp"
+
 
 // TODO(bmahler): Upgrade our http_parser to the latest version.
 namespace process {
 
+// The largest binary frame (see MessageEncoder::frame) a DataDecoder
+// accepts. The lengths in a frame header come straight from the peer
+// so without a bound a single bogus header would make the decoder
+// buffer up to 16GB before failing. Protocol buffers refuse to parse
+// messages larger than 64MB anyway.
+const size_t MAX_BINARY_FRAME_SIZE = 64 * 1024 * 1024;
+
+
 // TODO: Make DataDecoder abstract and make RequestDecoder a concrete subclass.
 class DataDecoder
 {
 public:
   explicit DataDecoder(const Socket& _s)
-    : s(_s), failure(false), request(NULL)
+    : s(_s), failure(false), binary(false), request(NULL)
   {
     settings.on_message_begin = &DataDecoder::on_message_begin;
     settings.on_header_field = &DataDecoder::on_header_field;
@@ -46,9 +61,36 @@ public:
 
   std::deque<http::Request*> decode(const char* data, size_t length)
   {
+    if (failure) {
+      return std::deque<http::Request*>();
+    }
+
+    if (binary) {
+      decodeFrames(data, length);
+      return std::deque<http::Request*>();
+    }
+
     size_t parsed = http_parser_execute(&parser, &settings, data, length);
 
-    if (parsed != length) {
+    if (parser.upgrade) {
+      // Only switch protocols for a libprocess upgrade request (see
+      // MessageEncoder::upgrade), which is the last request decoded.
+      if (requests.empty() ||
+          requests.back()->headers.get("Upgrade") !=
+            BINARY_MESSAGES_PROTOCOL) {
+        failure = true;
+      } else {
+        binary = true;
+
+        // NOTE: Our version of http_parser stops on (rather than
+        // after) the final LF of the upgrade request.
+        if (parsed < length && data[parsed] == '\n') {
+          parsed++;
+        }
+
+        decodeFrames(data + parsed, length - parsed);
+      }
+    } else if (parsed != length) {
       failure = true;
     }
 
@@ -61,6 +103,16 @@ public:
     return std::deque<http::Request*>();
   }
 
+  // Returns the messages decoded from binary frames since the
+  // previous call. Note that the 'to' of each message only has its
+  // 'id' set.
+  std::deque<Message*> messages()
+  {
+    std::deque<Message*> result = frames;
+    frames.clear();
+    return result;
+  }
+
   bool failed() const
   {
     return failure;
@@ -72,6 +124,54 @@ public:
   }
 
 private:
+  // Decodes as many binary frames (see MessageEncoder::frame) as
+  // possible, buffering any partial frame. Fails the decoder if a
+  // frame is larger than MAX_BINARY_FRAME_SIZE.
+  void decodeFrames(const char* data, size_t length)
+  {
+    buffer.append(data, length);
+
+    size_t index = 0;
+
+    while (buffer.size() - index >= sizeof(uint32_t) * 4) {
+      uint32_t lengths[4];
+      memcpy(lengths, buffer.data() + index, sizeof(lengths));
+
+      size_t size = sizeof(lengths);
+      for (int i = 0; i < 4; i++) {
+        lengths[i] = ntohl(lengths[i]);
+        size += lengths[i];
+      }
+
+      if (size > MAX_BINARY_FRAME_SIZE) {
+        failure = true;
+        buffer.clear();
+        return;
+      }
+
+      if (buffer.size() - index < size) {
+        break; // Wait for the rest of the frame.
+      }
+
+      const char* next = buffer.data() + index + sizeof(lengths);
+
+      Message* message = new Message();
+      message->to.id.assign(next, lengths[0]);
+      next += lengths[0];
+      message->from = UPID(std::string(next, lengths[1]));
+      next += lengths[1];
+      message->name.assign(next, lengths[2]);
+      next += lengths[2];
+      message->body.assign(next, lengths[3]);
+
+      frames.push_back(message);
+
+      index += size;
+    }
+
+    buffer.erase(0, index);
+  }
+
   static int on_message_begin(http_parser* p)
   {
     DataDecoder* decoder = (DataDecoder*) p->data;
@@ -252,9 +352,17 @@ private:
   std::string value;
   std::string query;
 
+  // Whether the connection was upgraded to binary framed messages.
+  bool binary;
+
+  // Data from a partially received binary frame.
+  std::string buffer;
+
   http::Request* request;
 
   std::deque<http::Request*> requests;
+
+  std::deque<Message*> frames;
 };
 
 
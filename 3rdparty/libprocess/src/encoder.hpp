@@ -3,8 +3,15 @@
 
 #include <stdint.h>
 
+#include <arpa/inet.h>
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <deque>
 #include <map>
 #include <sstream>
+#include <vector>
 
 #include <process/http.hpp>
 #include <process/process.hpp>
@@ -52,47 +59,169 @@ private:
 class DataEncoder : public Encoder
 {
 public:
-  DataEncoder(const Socket& s, const std::string& _data)
-    : Encoder(s), data(_data), index(0) {}
+  DataEncoder(const Socket& s, const std::string& data)
+    : Encoder(s), index(0), offset(0), size(0)
+  {
+    append(data);
+  }
 
-  virtual ~DataEncoder() {}
+  virtual ~DataEncoder()
+  {
+    foreach (DataEncoder* encoder, chained) {
+      delete encoder;
+    }
+  }
 
   virtual Sender sender()
   {
     return send_data;
   }
 
-  virtual const char* next(size_t* length)
+  // Fills in (up to 'count' of) the buffers that remain to be sent
+  // and returns how many were filled in.
+  virtual size_t buffers(struct iovec* iov, size_t count) const
   {
-    size_t temp = index;
-    index = data.size();
-    *length = data.size() - temp;
-    return data.data() + temp;
+    size_t filled = 0;
+
+    for (size_t i = index; i < segments.size() && filled < count; i++) {
+      iov[filled] = segments[i];
+
+      if (i == index) {
+        iov[filled].iov_base = (char*) segments[i].iov_base + offset;
+        iov[filled].iov_len -= offset;
+      }
+
+      filled++;
+    }
+
+    return filled;
   }
 
-  virtual void backup(size_t length)
+  // Marks the specified number of bytes as sent.
+  virtual void advance(size_t length)
   {
-    if (index >= length) {
-      index -= length;
+    size -= std::min(length, size);
+
+    while (length > 0 && index < segments.size()) {
+      size_t available = segments[index].iov_len - offset;
+      if (length < available) {
+        offset += length;
+        break;
+      }
+
+      length -= available;
+      index++;
+      offset = 0;
     }
   }
 
   virtual size_t remaining() const
   {
-    return data.size() - index;
+    return size;
+  }
+
+  // Appends the data that remains to be sent by the specified
+  // encoder (without copying it) and takes ownership of the encoder.
+  void chain(DataEncoder* encoder)
+  {
+    for (size_t i = encoder->index; i < encoder->segments.size(); i++) {
+      struct iovec iov = encoder->segments[i];
+
+      if (i == encoder->index) {
+        iov.iov_base = (char*) iov.iov_base + encoder->offset;
+        iov.iov_len -= encoder->offset;
+      }
+
+      segments.push_back(iov);
+    }
+
+    size += encoder->size;
+
+    chained.push_back(encoder);
+  }
+
+protected:
+  explicit DataEncoder(const Socket& s)
+    : Encoder(s), index(0), offset(0), size(0) {}
+
+  // Appends a copy of the data to be sent.
+  void append(const std::string& data)
+  {
+    if (!data.empty()) {
+      strings.push_back(data);
+      reference(strings.back().data(), data.size());
+    }
+  }
+
+  // Appends data to be sent without copying it. The data must stay
+  // valid for the lifetime of this encoder.
+  void reference(const char* data, size_t length)
+  {
+    if (length > 0) {
+      struct iovec iov;
+      iov.iov_base = (void*) data;
+      iov.iov_len = length;
+      segments.push_back(iov);
+      size += length;
+    }
   }
 
 private:
-  const std::string data;
+  // The copies made by 'append'. We use a deque because it does not
+  // move its elements when appending.
+  std::deque<std::string> strings;
+
+  // The data to be sent, in order.
+  std::vector<struct iovec> segments;
+
+  // The segment being sent and how much of it has been sent.
   size_t index;
+  size_t offset;
+
+  // The number of bytes that remain to be sent.
+  size_t size;
+
+  // Encoders whose data was appended via 'chain'.
+  std::vector<DataEncoder*> chained;
 };
 
 
+// The protocol (i.e., the value of the 'Upgrade' header) used to
+// switch a connection to binary framed messages, see MessageEncoder.
+const std::string BINARY_MESSAGES_PROTOCOL = "libprocess-binary/1";
+
+// The header a libprocess includes in its HTTP messages to advertise
+// that it accepts binary framed messages.
+const std::string BINARY_MESSAGES_HEADER = "Libprocess-Framing";
+
+
 class MessageEncoder : public DataEncoder
 {
 public:
-  MessageEncoder(const Socket& s, Message* _message)
-    : DataEncoder(s, encode(_message)), message(_message) {}
+  // How a message gets encoded on the wire. Every libprocess can
+  // receive HTTP framed messages. Binary framed messages avoid
+  // formatting and parsing HTTP headers but are only sent after the
+  // receiving node has advertised that it accepts them, and only
+  // after an upgrade request has switched the connection over.
+  enum Framing
+  {
+    HTTP,      // An HTTP/1.0 POST.
+    ADVERTISE, // An HTTP/1.0 POST advertising binary framing.
+    UPGRADE,   // An upgrade request followed by a BINARY message.
+    BINARY     // A length prefixed binary frame (see 'frame').
+  };
+
+  MessageEncoder(const Socket& s, Message* _message, Framing framing = HTTP)
+    : DataEncoder(s), message(_message)
+  {
+    // NOTE: We reference the body rather than copying it since the
+    // message lives as long as this encoder.
+    if (message != NULL) {
+      append(header(message, framing));
+      reference(message->body.data(), message->body.size());
+      append(trailer(message, framing));
+    }
+  }
 
   virtual ~MessageEncoder()
   {
@@ -101,31 +230,105 @@ public:
     }
   }
 
-  static std::string encode(Message* message)
+  static std::string encode(Message* message, Framing framing = HTTP)
+  {
+    if (message == NULL) {
+      return std::string();
+    }
+
+    return header(message, framing) +
+      message->body +
+      trailer(message, framing);
+  }
+
+  // Returns the encoding of the message that precedes its body.
+  static std::string header(Message* message, Framing framing)
   {
+    switch (framing) {
+      case BINARY:
+        return frame(message);
+      case UPGRADE:
+        return upgrade(message->from) + frame(message);
+      default:
+        break;
+    }
+
     std::ostringstream out;
 
-    if (message != NULL) {
-      out << "POST /" << message->to.id << "/" << message->name
-          << " HTTP/1.0\r\n"
-          << "User-Agent: libprocess/" << message->from << "\r\n"
-          << "Connection: Keep-Alive\r\n";
-
-      if (message->body.size() > 0) {
-        out << "Transfer-Encoding: chunked\r\n\r\n"
-            << std::hex << message->body.size() << "\r\n";
-        out.write(message->body.data(), message->body.size());
-        out << "\r\n"
-            << "0\r\n"
-            << "\r\n";
-      } else {
-        out << "\r\n";
-      }
+    out << "POST /" << message->to.id << "/" << message->name
+        << " HTTP/1.0\r\n"
+        << "User-Agent: libprocess/" << message->from << "\r\n"
+        << "Connection: Keep-Alive\r\n";
+
+    if (framing == ADVERTISE) {
+      out << BINARY_MESSAGES_HEADER << ": " << BINARY_MESSAGES_PROTOCOL
+          << "\r\n";
+    }
+
+    if (message->body.size() > 0) {
+      out << "Transfer-Encoding: chunked\r\n\r\n"
+          << std::hex << message->body.size() << "\r\n";
+    } else {
+      out << "\r\n";
     }
 
     return out.str();
   }
 
+  // Returns the encoding of the message that follows its body.
+  static std::string trailer(Message* message, Framing framing)
+  {
+    if ((framing == HTTP || framing == ADVERTISE) &&
+        message->body.size() > 0) {
+      return "\r\n0\r\n\r\n";
+    }
+
+    return std::string();
+  }
+
+  // Returns the request that switches a connection to binary framed
+  // messages. Everything sent after it must be binary framed.
+  static std::string upgrade(const UPID& from)
+  {
+    std::ostringstream out;
+
+    out << "POST / HTTP/1.1\r\n"
+        << "User-Agent: libprocess/" << from << "\r\n"
+        << "Connection: Upgrade\r\n"
+        << "Upgrade: " << BINARY_MESSAGES_PROTOCOL << "\r\n"
+        << "\r\n";
+
+    return out.str();
+  }
+
+  // Returns the binary frame for the message (without the body): the
+  // lengths of the 'to' id, 'from', 'name' and 'body' as 32-bit
+  // unsigned integers in network byte order followed by each of them.
+  static std::string frame(Message* message)
+  {
+    const std::string from = message->from;
+
+    const uint32_t lengths[] = {
+      htonl(message->to.id.size()),
+      htonl(from.size()),
+      htonl(message->name.size()),
+      htonl(message->body.size())
+    };
+
+    std::string data;
+    data.reserve(sizeof(lengths) +
+                 message->to.id.size() +
+                 from.size() +
+                 message->name.size());
+
+    data.append((const char*) lengths, sizeof(lengths));
+    data.append(message->to.id);
+    data.append(from);
+    data.append(message->name);
+
+    return data;
+  }
+
 private:
   Message* message;
 };
@@ -1,25 +1,46 @@
 #include <arpa/inet.h>
 
+#include <netinet/in.h>
+
 #include <stdint.h>
 
+#include <sys/socket.h>
+
 #include <cstring>
 #include <deque>
 #include <iostream>
+#include <list>
 #include <string>
+#include <utility>
 
+#include <glog/logging.h>
+
+#include <process/defer.hpp>
+#include <process/delay.hpp>
+#include <process/dispatch.hpp>
 #include <process/future.hpp>
 #include <process/http.hpp>
+#include <process/id.hpp>
 #include <process/io.hpp>
+#include <process/once.hpp>
+#include <process/process.hpp>
 
+#include <stout/duration.hpp>
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
 #include <stout/lambda.hpp>
+#include <stout/memory.hpp>
 #include <stout/nothing.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
+#include <stout/strings.hpp>
 #include <stout/try.hpp>
 
 #include "decoder.hpp"
 
 using std::deque;
+using std::list;
 using std::string;
 
 using process::http::Request;
@@ -33,29 +54,448 @@ hashmap<uint16_t, string> statuses;
 
 namespace internal {
 
-Future<Response> decode(const string& buffer)
+// The maximum number of connections kept open to a single server.
+// Once they are all busy new requests get pipelined on the connection
+// with the fewest outstanding responses.
+const size_t MAX_CONNECTIONS = 8;
+
+// How often idle connections are closed, i.e., a connection gets
+// closed once it was idle for between one and two intervals.
+const Duration IDLE_INTERVAL = Seconds(30);
+
+
+// A request whose response has not been received yet.
+struct Pending
 {
-  ResponseDecoder decoder;
-  deque<Response*> responses = decoder.decode(buffer.c_str(), buffer.length());
+  Promise<Response>* promise;
 
-  if (decoder.failed() || responses.empty()) {
-    for (size_t i = 0; i < responses.size(); ++i) {
-      delete responses[i];
+  // The request as written, kept so that it can be resent.
+  string data;
+
+  // Whether the request gets resent on a new connection if this one
+  // fails before any of the response arrives.
+  bool retry;
+};
+
+
+// A persistent (keep-alive) connection to a server. Requests are
+// written as soon as they are made (i.e., they are pipelined) and the
+// responses are decoded as they arrive and matched to the requests
+// in order.
+struct Connection
+{
+  explicit Connection(int _s)
+    : s(_s), closed(false), requests(0), swept(0), received(0) {}
+
+  ~Connection()
+  {
+    CHECK(pending.empty());
+    if (s >= 0) {
+      os::close(s);
     }
-    return Failure("Failed to decode HTTP response:\n" + buffer + "\n");
-  } else if (responses.size() > 1) {
-    PLOG(ERROR) << "Received more than 1 HTTP Response";
   }
 
-  Response response = *responses[0];
-  for (size_t i = 0; i < responses.size(); ++i) {
-    delete responses[i];
+  // Set to -1 once the socket is closed (see ClientProcess::remove).
+  int s;
+
+  ResponseDecoder decoder;
+
+  // The requests whose responses have not been received yet.
+  deque<Pending> pending;
+
+  // The last write, subsequent writes are chained to it.
+  Future<Nothing> writing;
+
+  // Once set no more requests are sent on this connection.
+  bool closed;
+
+  // The number of requests sent so far and at the last sweep for
+  // idle connections.
+  uint64_t requests;
+  uint64_t swept;
+
+  // The number of bytes received since the connection was last idle.
+  size_t received;
+
+  char buffer[16384];
+};
+
+
+Future<Nothing> connected(int s)
+{
+  int error = 0;
+  socklen_t length = sizeof(error);
+
+  if (getsockopt(s, SOL_SOCKET, SO_ERROR, &error, &length) < 0) {
+    return Failure(string("Failed to get socket error: ") + strerror(errno));
+  } else if (error != 0) {
+    return Failure(string("Failed to connect: ") + strerror(error));
   }
 
-  return response;
+  return Nothing();
+}
+
+
+Future<Nothing> write(
+    const memory::shared_ptr<Connection>& connection,
+    const string& data)
+{
+  // Note that the connection (and thus the socket) is kept alive by
+  // being bound into this continuation.
+  return io::write(connection->s, data);
 }
 
 
+// Used to keep a connection alive until a future completes.
+void release(const memory::shared_ptr<Connection>& connection) {}
+
+
+class ClientProcess : public Process<ClientProcess>
+{
+public:
+  ClientProcess() : ProcessBase(ID::generate("__http_client__")) {}
+
+  virtual ~ClientProcess() {}
+
+  Future<Response> request(
+      const UPID& upid,
+      const string& data,
+      bool idempotent)
+  {
+    Promise<Response>* promise = new Promise<Response>();
+    Future<Response> future = promise->future();
+
+    send(Endpoint(upid.ip, upid.port), promise, data, idempotent);
+
+    return future;
+  }
+
+protected:
+  virtual void initialize()
+  {
+    delay(IDLE_INTERVAL, self(), &ClientProcess::sweep);
+  }
+
+private:
+  typedef std::pair<uint32_t, uint16_t> Endpoint;
+
+  // Sends the request on a pooled connection. An idempotent request
+  // sent on a reused connection is resent (once) if the connection
+  // fails before any of the response arrives, since the server may
+  // have closed the idle connection just as the request was sent.
+  void send(
+      const Endpoint& endpoint,
+      Promise<Response>* promise,
+      const string& data,
+      bool idempotent)
+  {
+    Try<memory::shared_ptr<Connection> > connection = get(endpoint);
+    if (connection.isError()) {
+      promise->fail(connection.error());
+      delete promise;
+      return;
+    }
+
+    Pending pending;
+    pending.promise = promise;
+    pending.data = data;
+
+    // The connection was reused if it already received a response.
+    pending.retry = idempotent &&
+      connection.get()->requests > connection.get()->pending.size();
+
+    connection.get()->pending.push_back(pending);
+    connection.get()->requests++;
+
+    connection.get()->writing = connection.get()->writing
+      .then(lambda::bind(&internal::write, connection.get(), data));
+
+    // NOTE: Only a weak pointer is bound since 'writing' (i.e., the
+    // connection itself) keeps this callback even after the write
+    // completes, which would otherwise keep the connection alive.
+    connection.get()->writing
+      .onFailed(defer(self(),
+                      &ClientProcess::failed,
+                      endpoint,
+                      memory::weak_ptr<Connection>(connection.get()),
+                      lambda::_1));
+  }
+
+  // Returns the connection to send the next request to the endpoint
+  // on: an idle one if possible, otherwise a new one unless there
+  // are already MAX_CONNECTIONS open ones, in which case the least
+  // busy one.
+  Try<memory::shared_ptr<Connection> > get(const Endpoint& endpoint)
+  {
+    memory::shared_ptr<Connection> least;
+
+    if (connections.contains(endpoint)) {
+      // Closed connections are only kept until their outstanding
+      // read completes, they don't count towards MAX_CONNECTIONS.
+      size_t open = 0;
+
+      foreach (const memory::shared_ptr<Connection>& connection,
+               connections[endpoint]) {
+        if (connection->closed) {
+          continue;
+        }
+
+        open++;
+
+        if (connection->pending.empty()) {
+          return connection;
+        } else if (!least ||
+                   connection->pending.size() < least->pending.size()) {
+          least = connection;
+        }
+      }
+
+      if (least && open >= MAX_CONNECTIONS) {
+        return least;
+      }
+    }
+
+    return connect(endpoint);
+  }
+
+  Try<memory::shared_ptr<Connection> > connect(const Endpoint& endpoint)
+  {
+    Try<int> socket = process::socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+
+    if (socket.isError()) {
+      return Error("Failed to create socket: " + socket.error());
+    }
+
+    int s = socket.get();
+
+    Try<Nothing> cloexec = os::cloexec(s);
+    if (!cloexec.isSome()) {
+      os::close(s);
+      return Error("Failed to cloexec: " + cloexec.error());
+    }
+
+    Try<Nothing> nonblock = os::nonblock(s);
+    if (!nonblock.isSome()) {
+      os::close(s);
+      return Error("Failed to set nonblock: " + nonblock.error());
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(endpoint.second);
+    addr.sin_addr.s_addr = endpoint.first;
+
+    if (::connect(s, (sockaddr*) &addr, sizeof(addr)) < 0 &&
+        errno != EINPROGRESS) {
+      ErrnoError error("Failed to connect");
+      os::close(s);
+      return error;
+    }
+
+    memory::shared_ptr<Connection> connection(new Connection(s));
+
+    // The connection is established once the socket is writable, the
+    // requests are written after that.
+    connection->writing = io::poll(s, io::WRITE)
+      .then(lambda::bind(&internal::connected, s));
+
+    connection->writing
+      .onAny(defer(self(),
+                   &ClientProcess::_connect,
+                   endpoint,
+                   connection,
+                   lambda::_1));
+
+    connections[endpoint].push_back(connection);
+
+    return connection;
+  }
+
+  void _connect(
+      const Endpoint& endpoint,
+      const memory::shared_ptr<Connection>& connection,
+      const Future<Nothing>& connected)
+  {
+    if (!connected.isReady()) {
+      fail(endpoint, connection, connected.isFailed()
+           ? connected.failure()
+           : "Failed to connect: discarded");
+      remove(endpoint, connection);
+      return;
+    }
+
+    read(endpoint, connection);
+  }
+
+  // Keeps reading from the connection for as long as it is open,
+  // including while it is idle so that it gets removed as soon as
+  // the server closes it.
+  void read(
+      const Endpoint& endpoint,
+      const memory::shared_ptr<Connection>& connection)
+  {
+    io::read(connection->s, connection->buffer, sizeof(connection->buffer))
+      .onAny(defer(self(),
+                   &ClientProcess::_read,
+                   endpoint,
+                   connection,
+                   lambda::_1));
+  }
+
+  void _read(
+      const Endpoint& endpoint,
+      const memory::shared_ptr<Connection>& connection,
+      const Future<size_t>& length)
+  {
+    if (!length.isReady()) {
+      fail(endpoint, connection, "Failed to read response: " +
+           (length.isFailed() ? length.failure() : "discarded"));
+      remove(endpoint, connection);
+      return;
+    }
+
+    // Decoding zero bytes signals the end of file to the decoder,
+    // which completes a response whose body ends with the connection.
+    deque<Response*> responses =
+      connection->decoder.decode(connection->buffer, length.get());
+
+    connection->received += length.get();
+
+    foreach (Response* response, responses) {
+      if (connection->pending.empty()) {
+        delete response;
+        fail(endpoint, connection, "Received an unexpected HTTP response");
+        remove(endpoint, connection);
+        return;
+      }
+
+      // The server closes the connection after this response.
+      Option<string> header = response->headers.get("Connection");
+      if (header.isSome() && strings::lower(header.get()) == "close") {
+        connection->closed = true;
+      }
+
+      Promise<Response>* promise = connection->pending.front().promise;
+      connection->pending.pop_front();
+      promise->set(*response);
+      delete promise;
+      delete response;
+    }
+
+    if (connection->pending.empty()) {
+      connection->received = 0;
+    }
+
+    if (connection->decoder.failed()) {
+      fail(endpoint, connection, "Failed to decode HTTP response");
+      remove(endpoint, connection);
+      return;
+    } else if (length.get() == 0) {
+      fail(endpoint,
+           connection,
+           "Connection closed before receiving HTTP response");
+      remove(endpoint, connection);
+      return;
+    } else if (connection->closed && connection->pending.empty()) {
+      remove(endpoint, connection);
+      return;
+    }
+
+    read(endpoint, connection);
+  }
+
+  void failed(
+      const Endpoint& endpoint,
+      const memory::weak_ptr<Connection>& connection,
+      const string& message)
+  {
+    // The connection is gone if it has already been removed.
+    memory::shared_ptr<Connection> shared = connection.lock();
+
+    // The outstanding read fails (or returns end of file) once the
+    // connection is shut down, which removes the connection.
+    if (shared) {
+      fail(endpoint, shared, "Failed to write request: " + message);
+    }
+  }
+
+  // Fails the outstanding requests (or resends those that can be
+  // retried, see 'send') and shuts down the connection.
+  void fail(
+      const Endpoint& endpoint,
+      const memory::shared_ptr<Connection>& connection,
+      const string& message)
+  {
+    if (!connection->closed) {
+      connection->closed = true;
+      shutdown(connection->s, SHUT_RDWR);
+    }
+
+    while (!connection->pending.empty()) {
+      Pending pending = connection->pending.front();
+      connection->pending.pop_front();
+
+      if (pending.retry && connection->received == 0) {
+        VLOG(1) << "Resending HTTP request: " << message;
+        send(endpoint, pending.promise, pending.data, false);
+      } else {
+        pending.promise->fail(message);
+        delete pending.promise;
+      }
+    }
+  }
+
+  // Removes the connection from the pool and closes its socket. If a
+  // write is still outstanding the socket (which has been shut down
+  // by then) is only closed once the write fails.
+  void remove(
+      const Endpoint& endpoint,
+      const memory::shared_ptr<Connection>& connection)
+  {
+    if (connections.contains(endpoint)) {
+      connections[endpoint].remove(connection);
+      if (connections[endpoint].empty()) {
+        connections.erase(endpoint);
+      }
+    }
+
+    if (connection->writing.isPending()) {
+      connection->writing
+        .onAny(lambda::bind(&internal::release, connection));
+    } else if (connection->s >= 0) {
+      os::close(connection->s);
+      connection->s = -1;
+    }
+  }
+
+  // Closes the connections that have not been used since the last
+  // sweep.
+  void sweep()
+  {
+    foreachpair (const Endpoint& endpoint,
+                 const list<memory::shared_ptr<Connection> >& pool,
+                 connections) {
+      foreach (const memory::shared_ptr<Connection>& connection, pool) {
+        if (connection->pending.empty() &&
+            connection->requests == connection->swept) {
+          fail(endpoint, connection, "Connection idle");
+        }
+        connection->swept = connection->requests;
+      }
+    }
+
+    delay(IDLE_INTERVAL, self(), &ClientProcess::sweep);
+  }
+
+  hashmap<Endpoint, list<memory::shared_ptr<Connection> > > connections;
+};
+
+
+// Global client, which keeps the connections.
+static ClientProcess* client = NULL;
+
+
 Future<Response> request(
     const UPID& upid,
     const string& method,
@@ -64,30 +504,15 @@ Future<Response> request(
     const Option<string>& body,
     const Option<string>& contentType)
 {
-  Try<int> socket = process::socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  static Once* initialized = new Once();
 
-  if (socket.isError()) {
-    return Failure("Failed to create socket: " + socket.error());
+  if (!initialized->once()) {
+    client = new ClientProcess();
+    spawn(client);
+    initialized->done();
   }
 
-  int s = socket.get();
-
-  Try<Nothing> cloexec = os::cloexec(s);
-  if (!cloexec.isSome()) {
-    os::close(s);
-    return Failure("Failed to cloexec: " + cloexec.error());
-  }
-
-  sockaddr_in addr;
-  memset(&addr, 0, sizeof(addr));
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(upid.port);
-  addr.sin_addr.s_addr = upid.ip;
-
-  if (connect(s, (sockaddr*) &addr, sizeof(addr)) < 0) {
-    os::close(s);
-    return Failure(string("Failed to connect: ") + strerror(errno));
-  }
+  CHECK_NOTNULL(client);
 
   std::ostringstream out;
 
@@ -107,11 +532,10 @@ Future<Response> request(
   char ip[INET_ADDRSTRLEN];
   PCHECK(inet_ntop(AF_INET, (in_addr *) &upid.ip, ip, INET_ADDRSTRLEN) != NULL);
 
-  out << "Host: " << ip << ":" << upid.port << "\r\n"
-      << "Connection: close\r\n";
+  // The connection is kept alive, which is the default for HTTP/1.1.
+  out << "Host: " << ip << ":" << upid.port << "\r\n";
 
   if (body.isNone() && contentType.isSome()) {
-    os::close(s);
     return Failure("Attempted to do a POST with a Content-Type but no body");
   }
 
@@ -127,19 +551,14 @@ Future<Response> request(
         << body.get();
   }
 
-  Try<Nothing> nonblock = os::nonblock(s);
-  if (!nonblock.isSome()) {
-    os::close(s);
-    return Failure("Failed to set nonblock: " + nonblock.error());
-  }
-
-  // Need to disambiguate the io::read we want when binding below.
-  Future<string> (*read)(int) = io::read;
+  // Requests with these methods can safely be resent, see RFC 2616
+  // section 9.1.2.
+  const bool idempotent =
+    method == "GET" || method == "HEAD" || method == "PUT" ||
+    method == "DELETE" || method == "OPTIONS" || method == "TRACE";
 
-  return io::write(s, out.str())
-    .then(lambda::bind(read, s))
-    .then(lambda::bind(&internal::decode, lambda::_1))
-    .onAny(lambda::bind(&os::close, s));
+  return dispatch(
+      client, &ClientProcess::request, upid, out.str(), idempotent);
 }
 
 
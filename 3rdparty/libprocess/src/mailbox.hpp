@@ -0,0 +1,159 @@
+#ifndef __MAILBOX_HPP__
+#define __MAILBOX_HPP__
+
+#include <deque>
+#include <vector>
+
+namespace process {
+
+// A multi-producer single-consumer queue for the events of a process.
+// Producers push onto a lock-free stack with a single compare-and-swap
+// and the consumer takes the entire stack at once (see 'drain'),
+// which means producers never contend with the consumer on a lock
+// and the consumer only touches the shared stack once per batch of
+// items. Since the consumer only ever swaps out the entire stack (it
+// never pops an individual node) the stack is not subject to the ABA
+// problem.
+//
+// Injected items are kept on a separate stack and are drained ahead
+// of all the other items, the most recently injected first.
+template <typename T>
+class Mailbox
+{
+public:
+  Mailbox() : items(NULL), injected(NULL) {}
+  ~Mailbox();
+
+  // Enqueues the item at the back of the mailbox. Can be called from
+  // any thread.
+  void enqueue(const T& t);
+
+  // Enqueues the item at the front of the mailbox. Can be called from
+  // any thread.
+  void inject(const T& t);
+
+  // Moves all the enqueued items onto the back of 'queue' (in the
+  // order they were enqueued) and all the injected items onto the
+  // front of 'queue'. Returns the number of items moved.
+  //
+  // NOTE: Only one thread at a time may drain the mailbox.
+  size_t drain(std::deque<T>* queue);
+
+  // Returns true if there are no items in the mailbox. Can be called
+  // from any thread, but only the consumer can rely on the mailbox
+  // staying non-empty.
+  bool empty() const { return items == NULL && injected == NULL; }
+
+  // Returns true if there are injected items in the mailbox.
+  bool prioritized() const { return injected != NULL; }
+
+private:
+  struct Node
+  {
+    explicit Node(const T& _t) : t(_t), next(NULL) {}
+
+    T t;
+    Node* next;
+  };
+
+  // Non-copyable, non-assignable.
+  Mailbox(const Mailbox&);
+  Mailbox& operator = (const Mailbox&);
+
+  static void push(Node* volatile* head, Node* node);
+
+  // Stacks of the enqueued and injected items, most recent first.
+  Node* volatile items;
+  Node* volatile injected;
+};
+
+
+template <typename T>
+Mailbox<T>::~Mailbox()
+{
+  // Free the nodes of the items that were never drained (the items
+  // themselves are owned by the caller).
+  Node* stacks[] = { items, injected };
+  for (size_t i = 0; i < 2; i++) {
+    Node* node = stacks[i];
+    while (node != NULL) {
+      Node* next = node->next;
+      delete node;
+      node = next;
+    }
+  }
+}
+
+
+template <typename T>
+void Mailbox<T>::enqueue(const T& t)
+{
+  push(&items, new Node(t));
+}
+
+
+template <typename T>
+void Mailbox<T>::inject(const T& t)
+{
+  push(&injected, new Node(t));
+}
+
+
+template <typename T>
+size_t Mailbox<T>::drain(std::deque<T>* queue)
+{
+  size_t size = 0;
+
+  // The injected stack is already in the right order for pushing
+  // onto the front of the queue, i.e., the most recently injected
+  // item ends up first.
+  if (injected != NULL) {
+    Node* node = __sync_lock_test_and_set(&injected, (Node*) NULL);
+    std::vector<T> front;
+    while (node != NULL) {
+      Node* next = node->next;
+      front.push_back(node->t);
+      delete node;
+      node = next;
+    }
+    queue->insert(queue->begin(), front.begin(), front.end());
+    size += front.size();
+  }
+
+  // The stack of enqueued items is in reverse order.
+  if (items != NULL) {
+    Node* node = __sync_lock_test_and_set(&items, (Node*) NULL);
+    Node* reversed = NULL;
+    while (node != NULL) {
+      Node* next = node->next;
+      node->next = reversed;
+      reversed = node;
+      node = next;
+    }
+
+    while (reversed != NULL) {
+      Node* next = reversed->next;
+      queue->push_back(reversed->t);
+      delete reversed;
+      reversed = next;
+      size++;
+    }
+  }
+
+  return size;
+}
+
+
+template <typename T>
+void Mailbox<T>::push(Node* volatile* head, Node* node)
+{
+  Node* next;
+  do {
+    next = *head;
+    node->next = next;
+  } while (!__sync_bool_compare_and_swap(head, next, node));
+}
+
+} // namespace process {
+
+#endif // __MAILBOX_HPP__
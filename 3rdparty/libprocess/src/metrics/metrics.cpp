@@ -81,27 +81,30 @@ Future<Nothing> MetricsProcess::remove(const std::string& name)
 // TODO(dhamon): Allow querying by context and context/name.
 Future<http::Response> MetricsProcess::snapshot(const http::Request& request)
 {
-  hashmap<string, Future<double> > futures;
+  list<Future<hashmap<string, double> > > futures;
 
-  foreachkey (const string& metric, metrics) {
-    CHECK_NOTNULL(metrics[metric].get());
-    futures[metric] = metrics[metric]->value();
+  foreachvalue (const Owned<Metric>& metric, metrics) {
+    CHECK_NOTNULL(metric.get());
+    futures.push_back(metric->values());
   }
 
-  return await(futures.values())
+  return await(futures)
     .then(lambda::bind(_snapshot, request, futures));
 }
 
 
 Future<http::Response> MetricsProcess::_snapshot(
     const http::Request& request,
-    const hashmap<string, Future<double> >& metrics)
+    const list<Future<hashmap<string, double> > >& metrics)
 {
   JSON::Object object;
 
-  foreachpair (const string& key, const Future<double>& value, metrics) {
-    if (value.isReady()) {
-      object.values[key] = value.get();
+  list<Future<hashmap<string, double> > >::const_iterator iterator;
+  for (iterator = metrics.begin(); iterator != metrics.end(); ++iterator) {
+    if (iterator->isReady()) {
+      foreachpair (const string& key, double value, iterator->get()) {
+        object.values[key] = value;
+      }
     }
   }
 
@@ -55,6 +55,9 @@
 #include <process/id.hpp>
 #include <process/io.hpp>
 #include <process/logging.hpp>
+#include <process/metrics/counter.hpp>
+#include <process/metrics/metrics.hpp>
+#include <process/metrics/timer.hpp>
 #include <process/mime.hpp>
 #include <process/process.hpp>
 #include <process/profiler.hpp>
@@ -69,8 +72,11 @@
 #include <stout/lambda.hpp>
 #include <stout/memory.hpp> // TODO(benh): Replace shared_ptr with unique_ptr.
 #include <stout/net.hpp>
+#include <stout/numify.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
 #include <stout/strings.hpp>
 #include <stout/thread.hpp>
 #include <stout/unreachable.hpp>
@@ -79,7 +85,10 @@
 #include "decoder.hpp"
 #include "encoder.hpp"
 #include "gate.hpp"
+#include "mailbox.hpp"
+#include "runq.hpp"
 #include "synchronized.hpp"
+#include "timer_wheel.hpp"
 
 using process::wait; // Necessary on some OS's to disambiguate.
 
@@ -381,7 +390,15 @@ public:
   void exited(const Node& node);
   void exited(ProcessBase* process);
 
+  // Records that the node of the specified process accepts binary
+  // framed messages.
+  void binary(const UPID& pid);
+
 private:
+  // Returns how to frame the next message sent on the socket. Must
+  // be called while holding the lock.
+  MessageEncoder::Framing framing(int s);
+
   // Map from UPID (local/remote) to process.
   map<UPID, set<ProcessBase*> > links;
 
@@ -410,6 +427,11 @@ private:
   // Map from socket to outgoing queue.
   map<int, queue<Encoder*> > outgoing;
 
+  // Nodes that have advertised that they accept binary framed
+  // messages and the sockets that have been upgraded to them.
+  set<Node> binaryNodes;
+  set<int> binarySockets;
+
   // HTTP proxies.
   map<int, HttpProxy*> proxies;
 
@@ -421,7 +443,7 @@ private:
 class ProcessManager
 {
 public:
-  explicit ProcessManager(const string& delegate);
+  ProcessManager(const string& delegate, size_t workers, bool locality);
   ~ProcessManager();
 
   ProcessReference use(const UPID& pid);
@@ -466,12 +488,91 @@ private:
   // Gates for waiting threads (protected by synchronizable(processes)).
   map<ProcessBase*, Gate*> gates;
 
-  // Queue of runnable processes (implemented using list).
-  list<ProcessBase*> runq;
-  synchronizable(runq);
+  // Queues of runnable processes, one per worker thread. The run
+  // queue also counts the running processes to support the
+  // Clock::settle operation.
+  RunQueue<ProcessBase*> runq;
+
+  // Whether to enqueue a process on the queue of the worker that last
+  // ran it (rather than that of the worker enqueueing it).
+  const bool locality;
+
+  // Next queue to use when enqueueing from a non-worker thread.
+  volatile size_t next;
+
+  struct Metrics
+  {
+    Metrics()
+      : mailbox_depth("libprocess/mailbox_depth"),
+        events_served("libprocess/events_served"),
+        event_service_time_ms("libprocess/event_service_time_ms") {}
+
+    // Number of events enqueued on all the processes that have yet
+    // to be served (or dropped).
+    metrics::Counter mailbox_depth;
+
+    // Number of events served.
+    metrics::Counter events_served;
+
+    // Distribution of the time spent serving an event.
+    metrics::Timer event_service_time_ms;
+  } metrics;
+
+  friend class ProcessBase;
+  friend void initialize(const string&);
+};
+
+
+// An I/O loop is a libev event loop, run by its own thread, that
+// handles the I/O watchers of the file descriptors assigned to it
+// (see 'io_loop' below). The number of I/O loops can be set via the
+// environment variable LIBPROCESS_IO_LOOPS. The first I/O loop is
+// the default loop which also handles the timers and accepts new
+// connections.
+class IOLoop
+{
+public:
+  IOLoop(struct ev_loop* loop, int index);
+  ~IOLoop();
+
+  // Enqueues the watcher to be started by this loop and interrupts
+  // the loop. Can be called from any thread.
+  void start(ev_io* watcher);
+
+  struct ev_loop* loop() const { return _loop; }
+
+private:
+  static void handle_async(struct ev_loop* loop, ev_async* _, int revents);
+
+  // Starts all the enqueued watchers, called on the loop's thread.
+  void started();
+
+  struct ev_loop* _loop;
+
+  // Asynchronous watcher for interrupting the loop.
+  ev_async async_watcher;
+
+  // Queue of I/O watchers to start (protected by synchronizable(this)).
+  queue<ev_io*> watchers;
+
+  struct Metrics
+  {
+    explicit Metrics(int index)
+      : watchers_started(
+            "libprocess/io_loops/" + stringify(index) + "/watchers_started"),
+        wakeups(
+            "libprocess/io_loops/" + stringify(index) + "/wakeups") {}
+
+    // Number of I/O watchers started by the loop.
+    metrics::Counter watchers_started;
 
-  // Number of running processes, to support Clock::settle operation.
-  int running;
+    // Number of times the loop was interrupted to start watchers.
+    metrics::Counter wakeups;
+  } metrics;
+
+  friend void initialize(const string&);
+
+  synchronizable(this);
 };
 
 
@@ -537,16 +638,22 @@ static uint32_t __ip__ = 0;
 // Local port.
 static uint16_t __port__ = 0;
 
+// Whether to send binary framed messages to the nodes that accept
+// them (see MessageEncoder::Framing), set via the environment
+// variable LIBPROCESS_BINARY_MESSAGES.
+static bool __binary__ = false;
+
 // Active SocketManager (eventually will probably be thread-local).
 static SocketManager* socket_manager = NULL;
 
 // Active ProcessManager (eventually will probably be thread-local).
 static ProcessManager* process_manager = NULL;
 
-// Event loop.
+// Default event loop.
 static struct ev_loop* loop = NULL;
 
-// Asynchronous watcher for interrupting loop.
+// Asynchronous watcher for interrupting the default loop to update
+// the timer.
 static ev_async async_watcher;
 
 // Watcher for timeouts.
@@ -555,14 +662,23 @@ static ev_timer timeouts_watcher;
 // Server watcher for accepting connections.
 static ev_io server_watcher;
 
-// Queue of I/O watchers.
-static queue<ev_io*>* watchers = new queue<ev_io*>();
-static synchronizable(watchers) = SYNCHRONIZED_INITIALIZER;
+// I/O loops, the first one runs the default event loop.
+static vector<IOLoop*>* loops = new vector<IOLoop*>();
+
+
+// Returns the I/O loop that handles the specified file descriptor.
+// All watchers for a file descriptor are handled by the same loop so
+// the sockets never need to be handed off between loops.
+static IOLoop* io_loop(int fd)
+{
+  CHECK(!loops->empty());
+  CHECK(fd >= 0);
+  return (*loops)[fd % loops->size()];
+}
 
-// We store the timers in a map of lists indexed by the timeout of the
-// timer so that we can have two timers that have the same timeout. We
-// exploit that the map is SORTED!
-static map<Time, list<Timer> >* timeouts = new map<Time, list<Timer> >();
+// Pending timers, see TimerWheel. The lock also protects the state of
+// the clock (see Clock).
+static TimerWheel* timeouts = new TimerWheel();
 static synchronizable(timeouts) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
 
 // For supporting Clock::settle(), true if timers have been removed
@@ -594,6 +710,10 @@ ThreadLocal<ProcessBase>* _process_ = new ThreadLocal<ProcessBase>();
 // Per thread executor pointer.
 ThreadLocal<Executor>* _executor_ = new ThreadLocal<Executor>();
 
+// Per thread worker index, only set for worker threads (see
+// 'schedule').
+static ThreadLocal<size_t>* _worker_ = new ThreadLocal<size_t>();
+
 const Duration LIBPROCESS_STATISTICS_WINDOW = Days(1);
 
 
@@ -849,22 +969,66 @@ static Message* parse(Request* request)
 }
 
 
-void handle_async(struct ev_loop* loop, ev_async* _, int revents)
+IOLoop::IOLoop(struct ev_loop* loop, int index)
+  : _loop(loop),
+    metrics(index)
 {
-  synchronized (watchers) {
+  synchronizer(this) = SYNCHRONIZED_INITIALIZER;
+
+  ev_async_init(&async_watcher, &IOLoop::handle_async);
+  async_watcher.data = this;
+  ev_async_start(_loop, &async_watcher);
+}
+
+
+IOLoop::~IOLoop()
+{
+  ev_async_stop(_loop, &async_watcher);
+}
+
+
+void IOLoop::start(ev_io* watcher)
+{
+  synchronized (this) {
+    watchers.push(watcher);
+  }
+
+  ev_async_send(_loop, &async_watcher);
+}
+
+
+void IOLoop::handle_async(struct ev_loop* loop, ev_async* _, int revents)
+{
+  IOLoop* self = (IOLoop*) _->data;
+  CHECK(self->_loop == loop);
+  self->started();
+}
+
+
+void IOLoop::started()
+{
+  ++metrics.wakeups;
+
+  synchronized (this) {
     // Start all the new I/O watchers.
-    while (!watchers->empty()) {
-      ev_io* watcher = watchers->front();
-      watchers->pop();
-      ev_io_start(loop, watcher);
+    while (!watchers.empty()) {
+      ev_io* watcher = watchers.front();
+      watchers.pop();
+      ev_io_start(_loop, watcher);
+      ++metrics.watchers_started;
     }
   }
+}
+
 
+void handle_async(struct ev_loop* loop, ev_async* _, int revents)
+{
   synchronized (timeouts) {
     if (update_timer) {
-      if (!timeouts->empty()) {
+      Option<Time> next = timeouts->next();
+      if (next.isSome()) {
         // Determine when the next timer should fire.
-        timeouts_watcher.repeat = (timeouts->begin()->first - Clock::now()).secs();
+        timeouts_watcher.repeat = (next.get() - Clock::now()).secs();
 
         if (timeouts_watcher.repeat <= 0) {
           // Feed the event now!
@@ -898,33 +1062,26 @@ void handle_timeouts(struct ev_loop* loop, ev_timer* _, int revents)
 
     VLOG(3) << "Handling timeouts up to " << now;
 
-    foreachkey (const Time& timeout, *timeouts) {
-      if (timeout > now) {
-        break;
-      }
+    // Remove all the timers that timed out (in order of their timeout).
+    timedout = timeouts->expire(now);
 
-      VLOG(3) << "Have timeout(s) at " << timeout;
+    if (!timedout.empty()) {
+      VLOG(3) << "Have " << timedout.size() << " timeout(s)";
 
       // Record that we have pending timers to execute so the
       // Clock::settle() operation can wait until we're done.
       pending_timers = true;
-
-      foreach (const Timer& timer, (*timeouts)[timeout]) {
-        timedout.push_back(timer);
-      }
     }
 
-    // Now erase the range of timeouts that timed out.
-    timeouts->erase(timeouts->begin(), timeouts->upper_bound(now));
+    Option<Time> next = timeouts->next();
 
     // Okay, so the timeout for the next timer should not have fired.
-    CHECK(timeouts->empty() || (timeouts->begin()->first > now));
+    CHECK(next.isNone() || next.get() > now);
 
     // Update the timer as necessary.
-    if (!timeouts->empty()) {
+    if (next.isSome()) {
       // Determine when the next timer should fire.
-      timeouts_watcher.repeat =
-        (timeouts->begin()->first - Clock::now()).secs();
+      timeouts_watcher.repeat = (next.get() - Clock::now()).secs();
 
       if (timeouts_watcher.repeat <= 0) {
         // Feed the event now!
@@ -1015,14 +1172,25 @@ void recv_data(struct ev_loop* loop, ev_io* watcher, int revents)
     } else {
       CHECK(length > 0);
 
-      // Decode as much of the data as possible into HTTP requests.
+      // Decode as much of the data as possible into HTTP requests
+      // and, once the connection has been upgraded, messages.
       const deque<Request*>& requests = decoder->decode(data, length);
+      const deque<Message*>& messages = decoder->messages();
 
-      if (!requests.empty()) {
-        foreach (Request* request, requests) {
-          process_manager->handle(decoder->socket(), request);
-        }
-      } else if (requests.empty() && decoder->failed()) {
+      foreach (Request* request, requests) {
+        process_manager->handle(decoder->socket(), request);
+      }
+
+      foreach (Message* message, messages) {
+        message->to.ip = __ip__;
+        message->to.port = __port__;
+        process_manager->deliver(message->to, new MessageEvent(message));
+      }
+
+      // NOTE: The decoder might have failed after decoding some
+      // requests or messages from the same data (e.g., because of
+      // an oversized binary frame), it can not decode anything else.
+      if (decoder->failed()) {
         VLOG(1) << "Decoder error while receiving";
         socket_manager->close(s);
         delete decoder;
@@ -1042,21 +1210,23 @@ void send_data(struct ev_loop* loop, ev_io* watcher, int revents)
   int s = watcher->fd;
 
   while (true) {
-    const void* data;
-    size_t size;
+    // Send as many of the (possibly coalesced, see
+    // SocketManager::next) buffers as possible with a single call.
+    struct iovec iov[64];
 
-    data = encoder->next(&size);
-    CHECK(size > 0);
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = iov;
+    message.msg_iovlen = encoder->buffers(iov, 64);
+    CHECK(message.msg_iovlen > 0);
 
-    ssize_t length = send(s, data, size, MSG_NOSIGNAL);
+    ssize_t length = sendmsg(s, &message, MSG_NOSIGNAL);
 
     if (length < 0 && (errno == EINTR)) {
       // Interrupted, try again now.
-      encoder->backup(size);
       continue;
     } else if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
       // Might block, try again later.
-      encoder->backup(size);
       break;
     } else if (length <= 0) {
       // Socket error or closed.
@@ -1075,7 +1245,7 @@ void send_data(struct ev_loop* loop, ev_io* watcher, int revents)
       CHECK(length > 0);
 
       // Update the encoder with the amount sent.
-      encoder->backup(size - length);
+      encoder->advance(length);
 
       // See if there is any more of the message to send.
       if (encoder->remaining() == 0) {
@@ -1264,7 +1434,7 @@ void accept(struct ev_loop* loop, ev_io* watcher, int revents)
     watcher->data = decoder;
 
     ev_io_init(watcher, recv_data, s, EV_READ);
-    ev_io_start(loop, watcher);
+    io_loop(s)->start(watcher);
   }
 }
 
@@ -1290,6 +1460,11 @@ void* serve(void* arg)
 
 void* schedule(void* arg)
 {
+  // NOTE: The index of the worker is passed by value, this thread
+  // never returns so the address of 'worker' stays valid.
+  size_t worker = (size_t) arg;
+  *_worker_ = &worker;
+
   do {
     ProcessBase* process = process_manager->dequeue();
     if (process == NULL) {
@@ -1375,9 +1550,7 @@ void initialize(const string& delegate)
   signal(SIGPIPE, SIG_IGN);
 #endif // __sun__
 
-  // Create a new ProcessManager and SocketManager.
-  process_manager = new ProcessManager(delegate);
-  socket_manager = new SocketManager();
+  char* value;
 
   // Setup processing threads.
   // We create no fewer than 8 threads because some tests require
@@ -1389,11 +1562,44 @@ void initialize(const string& delegate)
   // Allocating a static number of threads can cause starvation if
   // there are more waiting Processes than the number of worker
   // threads.
-  long cpus = std::max(8L, sysconf(_SC_NPROCESSORS_ONLN));
+  const long MIN_WORKER_THREADS = 8;
+
+  long cpus = std::max(MIN_WORKER_THREADS, sysconf(_SC_NPROCESSORS_ONLN));
+
+  // Check environment for the number of worker threads, which is
+  // still no fewer than the minimum above.
+  value = getenv("LIBPROCESS_NUM_WORKER_THREADS");
+  if (value != NULL) {
+    Try<int> result = numify<int>(value);
+    if (result.isError() || result.get() < 1) {
+      LOG(FATAL) << "LIBPROCESS_NUM_WORKER_THREADS=" << value
+                 << " is not a valid number of worker threads";
+    }
+
+    if (result.get() < MIN_WORKER_THREADS) {
+      LOG(WARNING) << "Ignoring LIBPROCESS_NUM_WORKER_THREADS=" << value
+                   << " and using the minimum of " << MIN_WORKER_THREADS
+                   << " worker threads";
+    }
+
+    cpus = std::max(MIN_WORKER_THREADS, (long) result.get());
+  }
+
+  // Check environment for whether to resume processes on the worker
+  // thread that last ran them.
+  bool locality = false;
+  value = getenv("LIBPROCESS_WORKER_LOCALITY");
+  if (value != NULL) {
+    locality = string(value) == "1" || string(value) == "true";
+  }
+
+  // Create a new ProcessManager and SocketManager.
+  process_manager = new ProcessManager(delegate, cpus, locality);
+  socket_manager = new SocketManager();
 
-  for (int i = 0; i < cpus; i++) {
+  for (long i = 0; i < cpus; i++) {
     pthread_t thread; // For now, not saving handles on our threads.
-    if (pthread_create(&thread, NULL, schedule, NULL) != 0) {
+    if (pthread_create(&thread, NULL, schedule, (void*) i) != 0) {
       LOG(FATAL) << "Failed to initialize, pthread_create";
     }
   }
@@ -1401,8 +1607,6 @@ void initialize(const string& delegate)
   __ip__ = 0;
   __port__ = 0;
 
-  char* value;
-
   // Check environment for ip.
   value = getenv("LIBPROCESS_IP");
   if (value != NULL) {
@@ -1424,6 +1628,24 @@ void initialize(const string& delegate)
     __port__ = result;
   }
 
+  // Check environment for whether to send binary framed messages.
+  value = getenv("LIBPROCESS_BINARY_MESSAGES");
+  if (value != NULL) {
+    __binary__ = string(value) == "1" || string(value) == "true";
+  }
+
+  // Check environment for the number of I/O loops.
+  int count = 1;
+  value = getenv("LIBPROCESS_IO_LOOPS");
+  if (value != NULL) {
+    Try<int> result = numify<int>(value);
+    if (result.isError() || result.get() < 1) {
+      LOG(FATAL) << "LIBPROCESS_IO_LOOPS=" << value
+                 << " is not a valid number of I/O loops";
+    }
+    count = result.get();
+  }
+
   // Create a "server" socket for communicating with other nodes.
   if ((__s__ = ::socket(AF_INET, SOCK_STREAM, 0)) < 0) {
     PLOG(FATAL) << "Failed to initialize, socket";
@@ -1496,11 +1718,13 @@ void initialize(const string& delegate)
 
   // Setup event loop.
 #ifdef __sun__
-  loop = ev_default_loop(EVBACKEND_POLL | EVBACKEND_SELECT);
+  const unsigned int flags = EVBACKEND_POLL | EVBACKEND_SELECT;
 #else
-  loop = ev_default_loop(EVFLAG_AUTO);
+  const unsigned int flags = EVFLAG_AUTO;
 #endif // __sun__
 
+  loop = ev_default_loop(flags);
+
   ev_async_init(&async_watcher, handle_async);
   ev_async_start(loop, &async_watcher);
 
@@ -1525,9 +1749,23 @@ void initialize(const string& delegate)
 //   sigaddset (&sa.sa_mask, w->signum);
 //   sigprocmask (SIG_UNBLOCK, &sa.sa_mask, 0);
 
-  pthread_t thread; // For now, not saving handles on our threads.
-  if (pthread_create(&thread, NULL, serve, loop) != 0) {
-    LOG(FATAL) << "Failed to initialize, pthread_create";
+  // Setup the I/O loops, the first one is the default loop and the
+  // rest each get their own event loop.
+  loops->push_back(new IOLoop(loop, 0));
+
+  for (int i = 1; i < count; i++) {
+    struct ev_loop* io = ev_loop_new(flags);
+    if (io == NULL) {
+      LOG(FATAL) << "Failed to initialize, ev_loop_new";
+    }
+    loops->push_back(new IOLoop(io, i));
+  }
+
+  foreach (IOLoop* io, *loops) {
+    pthread_t thread; // For now, not saving handles on our threads.
+    if (pthread_create(&thread, NULL, serve, io->loop()) != 0) {
+      LOG(FATAL) << "Failed to initialize, pthread_create";
+    }
   }
 
   // Need to set initialzing here so that we can actually invoke
@@ -1553,6 +1791,17 @@ void initialize(const string& delegate)
   // Create the global system statistics process.
   spawn(new System(), true);
 
+  // Expose the metrics of the I/O loops.
+  foreach (IOLoop* io, *loops) {
+    metrics::add(io->metrics.watchers_started);
+    metrics::add(io->metrics.wakeups);
+  }
+
+  // Expose the metrics of the process mailboxes.
+  metrics::add(process_manager->metrics.mailbox_depth);
+  metrics::add(process_manager->metrics.events_served);
+  metrics::add(process_manager->metrics.event_service_time_ms);
+
   // Create the global statistics.
   value = getenv("LIBPROCESS_STATISTICS_WINDOW");
   if (value != NULL) {
@@ -1936,12 +2185,7 @@ void SocketManager::link(ProcessBase* process, const UPID& to)
       }
 
       // Enqueue the watcher.
-      synchronized (watchers) {
-        watchers->push(watcher);
-      }
-
-      // Interrupt the loop.
-      ev_async_send(loop, &async_watcher);
+      io_loop(s)->start(watcher);
     }
 
     links[to].insert(process);
@@ -2005,11 +2249,7 @@ void SocketManager::send(Encoder* encoder, bool persist)
 
         ev_io_init(watcher, encoder->sender(), encoder->socket(), EV_WRITE);
 
-        synchronized (watchers) {
-          watchers->push(watcher);
-        }
-
-        ev_async_send(loop, &async_watcher);
+        io_loop(encoder->socket())->start(watcher);
       }
     } else {
       VLOG(1) << "Attempting to send on a no longer valid socket!";
@@ -2051,7 +2291,7 @@ void SocketManager::send(Message* message)
     if (persist || temp) {
       int s = persist ? persists[node] : temps[node];
       CHECK(sockets.count(s) > 0);
-      send(new MessageEncoder(sockets[s], message), persist);
+      send(new MessageEncoder(sockets[s], message, framing(s)), persist);
     } else {
       // No peristent or temporary socket to the node currently
       // exists, so we create a temporary one.
@@ -2083,7 +2323,7 @@ void SocketManager::send(Message* message)
 
       // Allocate and initialize the watcher.
       ev_io* watcher = new ev_io();
-      watcher->data = new MessageEncoder(sockets[s], message);
+      watcher->data = new MessageEncoder(sockets[s], message, framing(s));
 
       // Try and connect to the node using this socket.
       sockaddr_in addr;
@@ -2105,16 +2345,36 @@ void SocketManager::send(Message* message)
       }
 
       // Enqueue the watcher.
-      synchronized (watchers) {
-        watchers->push(watcher);
-      }
-
-      ev_async_send(loop, &async_watcher);
+      io_loop(s)->start(watcher);
     }
   }
 }
 
 
+MessageEncoder::Framing SocketManager::framing(int s)
+{
+  if (!__binary__) {
+    return MessageEncoder::HTTP;
+  } else if (binarySockets.count(s) > 0) {
+    return MessageEncoder::BINARY;
+  } else if (nodes.count(s) > 0 && binaryNodes.count(nodes[s]) > 0) {
+    // Everything we send on this socket from now on is binary framed.
+    binarySockets.insert(s);
+    return MessageEncoder::UPGRADE;
+  }
+
+  return MessageEncoder::ADVERTISE;
+}
+
+
+void SocketManager::binary(const UPID& pid)
+{
+  synchronized (this) {
+    binaryNodes.insert(Node(pid.ip, pid.port));
+  }
+}
+
+
 Encoder* SocketManager::next(int s)
 {
   HttpProxy* proxy = NULL; // Non-null if needs to be terminated.
@@ -2140,6 +2400,24 @@ Encoder* SocketManager::next(int s)
         // More messages!
         Encoder* encoder = outgoing[s].front();
         outgoing[s].pop();
+
+        // Coalesce the data queued behind this encoder (up to the
+        // next file) so that it gets sent with fewer system calls.
+        DataEncoder* data = dynamic_cast<DataEncoder*>(encoder);
+        if (data != NULL) {
+          for (size_t i = 0; i < 1024 && !outgoing[s].empty(); i++) {
+            DataEncoder* next =
+              dynamic_cast<DataEncoder*>(outgoing[s].front());
+
+            if (next == NULL) {
+              break;
+            }
+
+            data->chain(next);
+            outgoing[s].pop();
+          }
+        }
+
         return encoder;
       } else {
         // No more messages ... erase the outgoing queue.
@@ -2153,6 +2431,10 @@ Encoder* SocketManager::next(int s)
             const Node& node = nodes[s];
             CHECK(temps.count(node) > 0 && temps[node] == s);
             temps.erase(node);
+
+            // See the comment in SocketManager::close.
+            binaryNodes.erase(node);
+
             nodes.erase(s);
           }
 
@@ -2161,6 +2443,7 @@ Encoder* SocketManager::next(int s)
             proxies.erase(s);
           }
 
+          binarySockets.erase(s);
           dispose.erase(s);
           sockets.erase(s);
 
@@ -2211,6 +2494,14 @@ void SocketManager::close(int s)
       if (nodes.count(s) > 0) {
         const Node& node = nodes[s];
 
+        // The node might come back as a libprocess that does not
+        // accept binary framed messages (and then fails to decode
+        // them and closes the socket). Forget its advertisement
+        // whenever a socket to it goes away so that the next socket
+        // falls back to HTTP until it advertises binary framing
+        // again.
+        binaryNodes.erase(node);
+
         // Don't bother invoking exited unless socket was persistant.
         if (persists.count(node) > 0 && persists[node] == s) {
           persists.erase(node);
@@ -2228,6 +2519,7 @@ void SocketManager::close(int s)
         proxies.erase(s);
       }
 
+      binarySockets.erase(s);
       dispose.erase(s);
       sockets.erase(s);
     }
@@ -2317,13 +2609,16 @@ void SocketManager::exited(ProcessBase* process)
 }
 
 
-ProcessManager::ProcessManager(const string& _delegate)
-  : delegate(_delegate)
+ProcessManager::ProcessManager(
+    const string& _delegate,
+    size_t workers,
+    bool _locality)
+  : delegate(_delegate),
+    runq(workers),
+    locality(_locality),
+    next(0)
 {
   synchronizer(processes) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
-  synchronizer(runq) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
-  running = 0;
-  __sync_synchronize(); // Ensure write to 'running' visible in other threads.
 }
 
 
@@ -2358,7 +2653,26 @@ bool ProcessManager::handle(
   if (libprocess(request)) {
     Message* message = parse(request);
     if (message != NULL) {
+      // The upgrade request (see MessageEncoder::upgrade) only
+      // switches the connection to binary framed messages, which
+      // implies that the sender also accepts them.
+      bool upgrade =
+        request->headers.get("Upgrade") == BINARY_MESSAGES_PROTOCOL;
+
+      if (__binary__ &&
+          (upgrade ||
+           request->headers.get(BINARY_MESSAGES_HEADER) ==
+             BINARY_MESSAGES_PROTOCOL)) {
+        socket_manager->binary(message->from);
+      }
+
       delete request;
+
+      if (upgrade) {
+        delete message;
+        return true;
+      }
+
       // TODO(benh): Use the sender PID in order to capture
       // happens-before timing relationships for testing.
       return deliver(message->to, new MessageEvent(message));
@@ -2530,11 +2844,23 @@ void ProcessManager::resume(ProcessBase* process)
 {
   __process__ = process;
 
+  // Remember the worker so that we can enqueue the process on it
+  // again (see ProcessManager::enqueue).
+  size_t* worker = *_worker_;
+  if (worker != NULL) {
+    process->worker = *worker;
+  }
+
   VLOG(2) << "Resuming " << process->pid << " at " << Clock::now();
 
   bool terminate = false;
   bool blocked = false;
 
+  // Number of events taken off the queue and served, added to the
+  // metrics after each batch rather than after each event.
+  int64_t dequeued = 0;
+  int64_t served = 0;
+
   CHECK(process->state == ProcessBase::BOTTOM ||
         process->state == ProcessBase::READY);
 
@@ -2542,6 +2868,8 @@ void ProcessManager::resume(ProcessBase* process)
     process->state = ProcessBase::RUNNING;
     try { process->initialize(); }
     catch (...) { terminate = true; }
+  } else {
+    process->state = ProcessBase::RUNNING;
   }
 
   while (!terminate && !blocked) {
@@ -2549,19 +2877,43 @@ void ProcessManager::resume(ProcessBase* process)
 
     process->lock();
     {
-      if (process->events.size() > 0) {
+      // Move the next batch of events out of the mailbox once we've
+      // served the current batch, or immediately if there are
+      // injected events which need to be served first.
+      if (process->events.empty() || process->mailbox->prioritized()) {
+        if (dequeued > 0) {
+          metrics.mailbox_depth -= dequeued;
+          metrics.events_served += served;
+          dequeued = served = 0;
+        }
+
+        process->mailbox->drain(&process->events);
+      }
+
+      if (!process->events.empty()) {
         event = process->events.front();
         process->events.pop_front();
-        process->state = ProcessBase::RUNNING;
+        dequeued++;
       } else {
+        // Block and then check the mailbox again in case an event got
+        // enqueued after we drained it but before we blocked (in
+        // which case the enqueuer saw us RUNNING and did not enqueue
+        // us on the run queue). If the compare-and-swap fails the
+        // enqueuer has already enqueued us on the run queue instead.
         process->state = ProcessBase::BLOCKED;
-        blocked = true;
+        __sync_synchronize();
+        if (process->mailbox->empty() ||
+            !__sync_bool_compare_and_swap(
+                &process->state,
+                ProcessBase::BLOCKED,
+                ProcessBase::RUNNING)) {
+          blocked = true;
+        }
       }
     }
     process->unlock();
 
-    if (!blocked) {
-      CHECK(event != NULL);
+    if (event != NULL) {
 
       // Determine if we should filter this event.
       synchronized (filterer) {
@@ -2607,6 +2959,9 @@ void ProcessManager::resume(ProcessBase* process)
       terminate = event->is<TerminateEvent>();
 
       // Now service the event.
+      Stopwatch stopwatch;
+      stopwatch.start();
+
       try {
         process->serve(*event);
       } catch (const std::exception& e) {
@@ -2620,6 +2975,10 @@ void ProcessManager::resume(ProcessBase* process)
         terminate = true;
       }
 
+      metrics.event_service_time_ms.record(stopwatch.elapsed());
+
+      served++;
+
       delete event;
 
       if (terminate) {
@@ -2628,10 +2987,12 @@ void ProcessManager::resume(ProcessBase* process)
     }
   }
 
+  metrics.mailbox_depth -= dequeued;
+  metrics.events_served += served;
+
   __process__ = NULL;
 
-  CHECK_GE(running, 1);
-  __sync_fetch_and_sub(&running, 1);
+  runq.done();
 }
 
 
@@ -2654,12 +3015,15 @@ void ProcessManager::cleanup(ProcessBase* process)
   process->lock();
   {
     process->state = ProcessBase::TERMINATING;
+    __sync_synchronize();
+    process->mailbox->drain(&process->events);
     events = process->events;
     process->events.clear();
   }
   process->unlock();
 
   // Delete pending events.
+  metrics.mailbox_depth -= events.size();
   while (!events.empty()) {
     Event* event = events.front();
     events.pop_front();
@@ -2679,7 +3043,12 @@ void ProcessManager::cleanup(ProcessBase* process)
 
     process->lock();
     {
+      // An event might have been enqueued after the process started
+      // terminating by a thread that saw the process before it was
+      // terminating, we delete those below (once we've stopped using
+      // the process) since there can be no more enqueuers now.
       CHECK(process->events.empty());
+      process->mailbox->drain(&events);
 
       processes.erase(process->pid.id);
  
@@ -2733,6 +3102,14 @@ void ProcessManager::cleanup(ProcessBase* process)
       gate->open();
     }
   }
+
+  // Delete events enqueued while terminating (see above).
+  metrics.mailbox_depth -= events.size();
+  while (!events.empty()) {
+    Event* event = events.front();
+    events.pop_front();
+    delete event;
+  }
 }
 
 
@@ -2815,15 +3192,9 @@ bool ProcessManager::wait(const UPID& pid)
       // Check if it is runnable in order to donate this thread.
       if (process->state == ProcessBase::BOTTOM ||
           process->state == ProcessBase::READY) {
-        synchronized (runq) {
-          list<ProcessBase*>::iterator it =
-            find(runq.begin(), runq.end(), process);
-          if (it != runq.end()) {
-            runq.erase(it);
-          } else {
-            // Another thread has resumed the process ...
-            process = NULL;
-          }
+        if (!runq.remove(process)) {
+          // Another thread has resumed the process ...
+          process = NULL;
         }
       } else {
         // Process is not runnable, so no need to donate ...
@@ -2835,7 +3206,6 @@ bool ProcessManager::wait(const UPID& pid)
   if (process != NULL) {
     VLOG(2) << "Donating thread to " << process->pid << " while waiting";
     ProcessBase* donator = __process__;
-    __sync_fetch_and_add(&running, 1);
     process_manager->resume(process);
     __process__ = donator;
   }
@@ -2862,41 +3232,38 @@ void ProcessManager::enqueue(ProcessBase* process)
 {
   CHECK(process != NULL);
 
-  // TODO(benh): Check and see if this process has it's own thread. If
-  // it does, push it on that threads runq, and wake up that thread if
-  // it's not running. Otherwise, check and see which thread this
-  // process was last running on, and put it on that threads runq.
-
-  synchronized (runq) {
-    CHECK(find(runq.begin(), runq.end(), process) == runq.end());
-    runq.push_back(process);
+  // Put the process on the queue of the worker that last ran it (if
+  // requested), otherwise on the queue of the current worker so that
+  // a chain of dispatches tends to stay on one thread. Non-worker
+  // threads (e.g., the I/O loops) spread the processes across the
+  // queues. Idle workers steal from the other queues.
+  size_t* worker = *_worker_;
+
+  if (locality && process->worker >= 0) {
+    runq.enqueue(process->worker, process);
+  } else if (worker != NULL) {
+    runq.enqueue(*worker, process);
+  } else {
+    runq.enqueue(__sync_fetch_and_add(&next, 1), process);
   }
-    
-  // Wake up the processing thread if necessary.
-  gate->open();
+
+  // Wake up a waiting worker thread (if any) in case the worker
+  // owning the queue is busy.
+  gate->open(false);
 }
 
 
 ProcessBase* ProcessManager::dequeue()
 {
-  // TODO(benh): Remove a process from this thread's runq. If there
-  // are no processes to run, and this is not a dedicated thread, then
-  // steal one from another threads runq.
+  size_t* worker = *_worker_;
+  CHECK_NOTNULL(worker);
 
-  ProcessBase* process = NULL;
+  // Note that the run queue counts the process as running until
+  // 'resume' is done in order to support the Clock::settle()
+  // operation.
+  Option<ProcessBase*> process = runq.dequeue(*worker);
 
-  synchronized (runq) {
-    if (!runq.empty()) {
-      process = runq.front();
-      runq.pop_front();
-      // Increment the running count of processes in order to support
-      // the Clock::settle() operation (this must be done atomically
-      // with removing the process from the runq).
-      __sync_fetch_and_add(&running, 1);
-    }
-  }
-
-  return process;
+  return process.isSome() ? process.get() : NULL;
 }
 
 
@@ -2906,28 +3273,22 @@ void ProcessManager::settle()
   do {
     os::sleep(Milliseconds(10));
     done = true;
-    // Hopefully this is the only place we acquire both these locks.
-    synchronized (runq) {
-      synchronized (timeouts) {
-        CHECK(Clock::paused()); // Since another thread could resume the clock!
-
-        if (!runq.empty()) {
-          done = false;
-        }
+    // Hopefully this is the only place we acquire both the timeouts
+    // lock and the run queue locks.
+    synchronized (timeouts) {
+      CHECK(Clock::paused()); // Since another thread could resume the clock!
 
-        __sync_synchronize(); // Read barrier for 'running'.
-        if (running > 0) {
-          done = false;
-        }
+      if (!runq.idle()) {
+        done = false;
+      }
 
-        if (timeouts->size() > 0 &&
-            timeouts->begin()->first <= clock::current) {
-          done = false;
-        }
+      Option<Time> next = timeouts->next();
+      if (next.isSome() && next.get() <= clock::current) {
+        done = false;
+      }
 
-        if (pending_timers) {
-          done = false;
-        }
+      if (pending_timers) {
+        done = false;
       }
     }
   } while (!done);
@@ -3003,6 +3364,7 @@ Future<Response> ProcessManager::__processes__(const Request&)
 
       process->lock();
       {
+        process->mailbox->drain(&process->events);
         foreach (Event* event, process->events) {
           event->visit(&visitor);
         }
@@ -3035,16 +3397,12 @@ Timer Timer::create(
 
   // Add the timer.
   synchronized (timeouts) {
-    if (timeouts->size() == 0 ||
-        timer.timeout().time() < timeouts->begin()->first) {
+    Option<Time> next = timeouts->next();
+    timeouts->add(timer);
+    if (next.isNone() || timer.timeout().time() < next.get()) {
       // Need to interrupt the loop to update/set timer repeat.
-      (*timeouts)[timer.timeout().time()].push_back(timer);
       update_timer = true;
       ev_async_send(loop, &async_watcher);
-    } else {
-      // Timer repeat is adequate, just add the timeout.
-      CHECK(timeouts->size() >= 1);
-      (*timeouts)[timer.timeout().time()].push_back(timer);
     }
   }
 
@@ -3056,17 +3414,8 @@ bool Timer::cancel(const Timer& timer)
 {
   bool canceled = false;
   synchronized (timeouts) {
-    // Check if the timeout is still pending, and if so, erase it. In
-    // addition, erase an empty list if we just removed the last
-    // timeout.
-    Time time = timer.timeout().time();
-    if (timeouts->count(time) > 0) {
-      canceled = true;
-      (*timeouts)[time].remove(timer);
-      if ((*timeouts)[time].empty()) {
-        timeouts->erase(time);
-      }
-    }
+    // Check if the timer is still pending, and if so, remove it.
+    canceled = timeouts->cancel(timer);
   }
 
   return canceled;
@@ -3079,12 +3428,16 @@ ProcessBase::ProcessBase(const string& id)
 
   state = ProcessBase::BOTTOM;
 
+  worker = -1;
+
   pthread_mutexattr_t attr;
   pthread_mutexattr_init(&attr);
   pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
   pthread_mutex_init(&m, &attr);
   pthread_mutexattr_destroy(&attr);
 
+  mailbox = new Mailbox<Event*>();
+
   refs = 0;
 
   pid.id = id != "" ? id : ID::generate();
@@ -3108,35 +3461,45 @@ ProcessBase::ProcessBase(const string& id)
 }
 
 
-ProcessBase::~ProcessBase() {}
+ProcessBase::~ProcessBase()
+{
+  // The mailbox is empty unless the process was never spawned.
+  deque<Event*> events;
+  process_manager->metrics.mailbox_depth -= mailbox->drain(&events);
+  foreach (Event* event, events) {
+    delete event;
+  }
+  delete mailbox;
+}
 
 
 void ProcessBase::enqueue(Event* event, bool inject)
 {
   CHECK(event != NULL);
 
-  lock();
-  {
-    if (state != TERMINATING && state != TERMINATED) {
-      if (!inject) {
-        events.push_back(event);
-      } else {
-        events.push_front(event);
-      }
+  // Drop the event if the process is terminating. Note that an event
+  // can still get enqueued after the process starts terminating if we
+  // race with ProcessManager::cleanup, in which case it gets deleted
+  // during cleanup instead.
+  if (state == TERMINATING || state == TERMINATED) {
+    delete event;
+    return;
+  }
 
-      if (state == BLOCKED) {
-        state = READY;
-        process_manager->enqueue(this);
-      }
+  ++process_manager->metrics.mailbox_depth;
 
-      CHECK(state == BOTTOM ||
-            state == READY ||
-            state == RUNNING);
-    } else {
-      delete event;
-    }
+  if (!inject) {
+    mailbox->enqueue(event);
+  } else {
+    mailbox->inject(event);
+  }
+
+  // Enqueue the process on the run queue if it was blocked waiting
+  // for events (see ProcessManager::resume), if more than one thread
+  // enqueues an event at the same time only one of them succeeds.
+  if (__sync_bool_compare_and_swap(&state, BLOCKED, READY)) {
+    process_manager->enqueue(this);
   }
-  unlock();
 }
 
 
@@ -3614,12 +3977,7 @@ Future<short> poll(int fd, short events)
   ev_io_init(watcher, polled, fd, events);
 
   // Enqueue the watcher.
-  synchronized (watchers) {
-    watchers->push(watcher);
-  }
-
-  // Interrupt the loop.
-  ev_async_send(loop, &async_watcher);
+  io_loop(fd)->start(watcher);
 
   return future;
 }
@@ -0,0 +1,237 @@
+#ifndef __RUNQ_HPP__
+#define __RUNQ_HPP__
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <stout/foreach.hpp>
+#include <stout/option.hpp>
+
+namespace process {
+
+// A run queue made up of a queue per worker thread. Workers dequeue
+// from their own queue and steal from the queues of the other
+// workers when their own queue is empty. Each queue has its own lock
+// which is only contended when a worker steals from it or an item is
+// enqueued from another thread (rather than one global lock that
+// every worker contends on).
+//
+// The run queue also counts the items that have been dequeued but
+// not yet finished (see 'done') so that 'idle' can tell when all the
+// work has settled.
+template <typename T>
+class RunQueue
+{
+public:
+  explicit RunQueue(size_t workers);
+  ~RunQueue();
+
+  size_t workers() const { return queues.size(); }
+
+  // Enqueues the item on the queue of the specified worker.
+  void enqueue(size_t worker, const T& t);
+
+  // Dequeues the next item for the specified worker, stealing it
+  // from another worker if necessary. The item is active until
+  // 'done' is called.
+  Option<T> dequeue(size_t worker);
+
+  // Removes the specified item from whichever queue it is enqueued
+  // on, returns false if it is not enqueued. Like 'dequeue', the item
+  // is active until 'done' is called.
+  bool remove(const T& t);
+
+  // Marks an item returned by 'dequeue' or 'remove' as finished.
+  void done();
+
+  // Returns true if all the queues are empty and there are no active
+  // items.
+  bool idle();
+
+private:
+  struct Queue
+  {
+    Queue() : size(0)
+    {
+      pthread_mutex_init(&mutex, NULL);
+    }
+
+    ~Queue()
+    {
+      pthread_mutex_destroy(&mutex);
+    }
+
+    void lock() { pthread_mutex_lock(&mutex); }
+    void unlock() { pthread_mutex_unlock(&mutex); }
+
+    pthread_mutex_t mutex;
+    std::deque<T> items;
+
+    // Number of items, read without holding the lock so that empty
+    // queues can be skipped when stealing.
+    volatile size_t size;
+  };
+
+  // Non-copyable, non-assignable.
+  RunQueue(const RunQueue&);
+  RunQueue& operator = (const RunQueue&);
+
+  // Pops the first item of the queue if it has one, must be called
+  // while holding the queue's lock.
+  Option<T> pop(Queue* queue);
+
+  std::vector<Queue*> queues;
+
+  // Number of items dequeued (or removed) but not yet done.
+  volatile int active;
+};
+
+
+template <typename T>
+RunQueue<T>::RunQueue(size_t workers)
+  : active(0)
+{
+  CHECK_GT(workers, 0u);
+  for (size_t i = 0; i < workers; i++) {
+    queues.push_back(new Queue());
+  }
+}
+
+
+template <typename T>
+RunQueue<T>::~RunQueue()
+{
+  foreach (Queue* queue, queues) {
+    delete queue;
+  }
+}
+
+
+template <typename T>
+void RunQueue<T>::enqueue(size_t worker, const T& t)
+{
+  Queue* queue = queues[worker % queues.size()];
+
+  queue->lock();
+  {
+    queue->items.push_back(t);
+    queue->size = queue->items.size();
+  }
+  queue->unlock();
+}
+
+
+template <typename T>
+Option<T> RunQueue<T>::dequeue(size_t worker)
+{
+  // Start with our own queue and then try and steal from the rest
+  // (in order, starting with our neighbor).
+  for (size_t i = 0; i < queues.size(); i++) {
+    Queue* queue = queues[(worker + i) % queues.size()];
+
+    if (queue->size == 0) {
+      continue;
+    }
+
+    queue->lock();
+    Option<T> t = pop(queue);
+    queue->unlock();
+
+    if (t.isSome()) {
+      return t;
+    }
+  }
+
+  return None();
+}
+
+
+template <typename T>
+bool RunQueue<T>::remove(const T& t)
+{
+  foreach (Queue* queue, queues) {
+    queue->lock();
+    {
+      typename std::deque<T>::iterator it =
+        std::find(queue->items.begin(), queue->items.end(), t);
+
+      if (it != queue->items.end()) {
+        queue->items.erase(it);
+        queue->size = queue->items.size();
+        __sync_fetch_and_add(&active, 1);
+        queue->unlock();
+        return true;
+      }
+    }
+    queue->unlock();
+  }
+
+  return false;
+}
+
+
+template <typename T>
+void RunQueue<T>::done()
+{
+  CHECK_GT(active, 0);
+  __sync_fetch_and_sub(&active, 1);
+}
+
+
+template <typename T>
+bool RunQueue<T>::idle()
+{
+  // Hold all the locks at once so we check a consistent snapshot,
+  // i.e., an item can not be moved from a queue we have yet to check
+  // to an active worker that enqueues onto a queue we already checked.
+  foreach (Queue* queue, queues) {
+    queue->lock();
+  }
+
+  bool idle = true;
+
+  foreach (Queue* queue, queues) {
+    if (!queue->items.empty()) {
+      idle = false;
+    }
+  }
+
+  __sync_synchronize(); // Read barrier for 'active'.
+  if (active > 0) {
+    idle = false;
+  }
+
+  foreach (Queue* queue, queues) {
+    queue->unlock();
+  }
+
+  return idle;
+}
+
+
+template <typename T>
+Option<T> RunQueue<T>::pop(Queue* queue)
+{
+  if (queue->items.empty()) {
+    return None();
+  }
+
+  T t = queue->items.front();
+  queue->items.pop_front();
+  queue->size = queue->items.size();
+
+  // Count the item as active while still holding the lock so that
+  // 'idle' never sees an item that is neither enqueued nor active.
+  __sync_fetch_and_add(&active, 1);
+
+  return t;
+}
+
+} // namespace process {
+
+#endif // __RUNQ_HPP__
@@ -1,13 +1,18 @@
 #include <gmock/gmock.h>
 
+#include <sys/uio.h>
+
 #include <deque>
 #include <string>
 #include <vector>
 
 #include <process/http.hpp>
+#include <process/message.hpp>
 #include <process/socket.hpp>
 
 #include <stout/gtest.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
 
 #include "encoder.hpp"
 #include "decoder.hpp"
@@ -15,7 +20,9 @@
 using namespace process;
 using namespace process::http;
 
+using std::cout;
 using std::deque;
+using std::endl;
 using std::string;
 using std::vector;
 
@@ -90,3 +97,262 @@ TEST(Encoder, AcceptableEncodings)
       << gzipRequest.headers.get("Accept-Encoding").get() << "'";
   }
 }
+
+
+TEST(Encoder, Message)
+{
+  Message message;
+  message.name = "name";
+  message.from = UPID("from", 1, 2);
+  message.to = UPID("to", 3, 4);
+  message.body = "body";
+
+  // Encode the same message with each framing, the upgrade switches
+  // the connection so the binary frame must follow it.
+  string data =
+    MessageEncoder::encode(&message, MessageEncoder::HTTP) +
+    MessageEncoder::encode(&message, MessageEncoder::ADVERTISE) +
+    MessageEncoder::encode(&message, MessageEncoder::UPGRADE) +
+    MessageEncoder::encode(&message, MessageEncoder::BINARY);
+
+  DataDecoder decoder = DataDecoder(Socket());
+
+  deque<Request*> requests = decoder.decode(data.data(), data.length());
+  ASSERT_FALSE(decoder.failed());
+  ASSERT_EQ(3, requests.size());
+
+  EXPECT_EQ("/to/name", requests[0]->path);
+  EXPECT_EQ("body", requests[0]->body);
+  EXPECT_SOME_EQ("libprocess/" + stringify(message.from),
+                 requests[0]->headers.get("User-Agent"));
+  EXPECT_NONE(requests[0]->headers.get(BINARY_MESSAGES_HEADER));
+
+  EXPECT_EQ("/to/name", requests[1]->path);
+  EXPECT_SOME_EQ(BINARY_MESSAGES_PROTOCOL,
+                 requests[1]->headers.get(BINARY_MESSAGES_HEADER));
+
+  EXPECT_SOME_EQ(BINARY_MESSAGES_PROTOCOL,
+                 requests[2]->headers.get("Upgrade"));
+
+  foreach (Request* request, requests) {
+    delete request;
+  }
+
+  deque<Message*> messages = decoder.messages();
+  ASSERT_EQ(2, messages.size());
+
+  foreach (Message* decoded, messages) {
+    EXPECT_EQ("name", decoded->name);
+    EXPECT_EQ(message.from, decoded->from);
+    EXPECT_EQ("to", decoded->to.id);
+    EXPECT_EQ("body", decoded->body);
+    delete decoded;
+  }
+}
+
+
+TEST(Encoder, PartialBinaryFrames)
+{
+  Message message;
+  message.name = "name";
+  message.from = UPID("from", 1, 2);
+  message.to = UPID("to", 3, 4);
+  message.body = string(1024, 'x');
+
+  string data =
+    MessageEncoder::encode(&message, MessageEncoder::UPGRADE) +
+    MessageEncoder::encode(&message, MessageEncoder::BINARY);
+
+  DataDecoder decoder = DataDecoder(Socket());
+
+  // Feed the data one byte at a time.
+  deque<Request*> requests;
+  deque<Message*> messages;
+  for (size_t i = 0; i < data.size(); i++) {
+    foreach (Request* request, decoder.decode(data.data() + i, 1)) {
+      requests.push_back(request);
+    }
+
+    foreach (Message* decoded, decoder.messages()) {
+      messages.push_back(decoded);
+    }
+
+    ASSERT_FALSE(decoder.failed());
+  }
+
+  ASSERT_EQ(1, requests.size());
+  delete requests[0];
+
+  ASSERT_EQ(2, messages.size());
+  foreach (Message* decoded, messages) {
+    EXPECT_EQ(message.body, decoded->body);
+    delete decoded;
+  }
+}
+
+
+TEST(Encoder, OversizedBinaryFrame)
+{
+  Message message;
+  message.name = "name";
+  message.from = UPID("from", 1, 2);
+  message.to = UPID("to", 3, 4);
+  message.body = "body";
+
+  // A frame header claiming a body larger than the decoder accepts,
+  // without any of the (claimed) body following it.
+  string frame = MessageEncoder::encode(&message, MessageEncoder::BINARY);
+
+  const uint32_t length = htonl(MAX_BINARY_FRAME_SIZE);
+  frame.replace(sizeof(uint32_t) * 3, sizeof(uint32_t),
+                (const char*) &length, sizeof(uint32_t));
+
+  string data =
+    MessageEncoder::encode(&message, MessageEncoder::UPGRADE) +
+    frame.substr(0, sizeof(uint32_t) * 4);
+
+  DataDecoder decoder = DataDecoder(Socket());
+
+  deque<Request*> requests = decoder.decode(data.data(), data.length());
+  ASSERT_EQ(1, requests.size());
+  delete requests[0];
+
+  // The frame before the oversized one is still decoded.
+  deque<Message*> messages = decoder.messages();
+  ASSERT_EQ(1, messages.size());
+  EXPECT_EQ("body", messages[0]->body);
+  delete messages[0];
+
+  // The decoder fails as soon as it sees the header, rather than
+  // buffering the frame, and does not decode anything else.
+  EXPECT_TRUE(decoder.failed());
+
+  string next = MessageEncoder::encode(&message, MessageEncoder::BINARY);
+  EXPECT_TRUE(decoder.decode(next.data(), next.length()).empty());
+  EXPECT_TRUE(decoder.messages().empty());
+  EXPECT_TRUE(decoder.failed());
+}
+
+
+// Returns the data that remains to be sent by the encoder.
+static string remaining(const DataEncoder& encoder)
+{
+  struct iovec iov[64];
+  size_t count = encoder.buffers(iov, 64);
+
+  string data;
+  for (size_t i = 0; i < count; i++) {
+    data.append((const char*) iov[i].iov_base, iov[i].iov_len);
+  }
+
+  return data;
+}
+
+
+TEST(Encoder, Chain)
+{
+  Message* message1 = new Message();
+  message1->name = "name";
+  message1->to = UPID("to", 3, 4);
+  message1->body = "body1";
+
+  Message* message2 = new Message(*message1);
+  message2->body = "body2";
+
+  const string encoded1 = MessageEncoder::encode(message1);
+  const string encoded2 = MessageEncoder::encode(message2);
+
+  MessageEncoder* encoder1 = new MessageEncoder(Socket(), message1);
+  MessageEncoder* encoder2 = new MessageEncoder(Socket(), message2);
+
+  // The body is referenced rather than copied.
+  struct iovec iov[64];
+  ASSERT_EQ(3u, encoder1->buffers(iov, 64));
+  EXPECT_EQ(message1->body.data(), iov[1].iov_base);
+
+  EXPECT_EQ(encoded1, remaining(*encoder1));
+  EXPECT_EQ(encoded1.size(), encoder1->remaining());
+
+  // Partially send the first encoder, then chain the second.
+  encoder1->advance(encoded1.size() - 3);
+  EXPECT_EQ(encoded1.substr(encoded1.size() - 3), remaining(*encoder1));
+
+  encoder1->chain(encoder2);
+
+  EXPECT_EQ(encoded1.substr(encoded1.size() - 3) + encoded2,
+            remaining(*encoder1));
+  EXPECT_EQ(3 + encoded2.size(), encoder1->remaining());
+
+  // Send across the boundary between the two encoders.
+  encoder1->advance(5);
+  EXPECT_EQ(encoded2.substr(2), remaining(*encoder1));
+
+  encoder1->advance(encoded2.size() - 2);
+  EXPECT_EQ(0u, encoder1->remaining());
+  EXPECT_EQ(0u, encoder1->buffers(iov, 64));
+
+  // Deletes the chained encoder too.
+  delete encoder1;
+}
+
+
+// Compares encoding and decoding messages with HTTP framing to
+// binary framing.
+TEST(Encoder_BENCHMARK_Test, Message)
+{
+  const size_t count = 10000;
+
+  Message message;
+  message.name = "mesos.internal.StatusUpdateMessage";
+  message.from = UPID("slave(1)", 1, 5051);
+  message.to = UPID("master", 2, 5050);
+  message.body = string(256, 'x');
+
+  const MessageEncoder::Framing framings[] =
+    { MessageEncoder::HTTP, MessageEncoder::BINARY };
+
+  foreach (MessageEncoder::Framing framing, framings) {
+    const string name = framing == MessageEncoder::HTTP ? "HTTP" : "binary";
+
+    DataDecoder decoder = DataDecoder(Socket());
+
+    // Binary frames are only decoded after an upgrade.
+    if (framing == MessageEncoder::BINARY) {
+      const string& upgrade = MessageEncoder::upgrade(message.from);
+      foreach (Request* request,
+               decoder.decode(upgrade.data(), upgrade.size())) {
+        delete request;
+      }
+    }
+
+    Stopwatch watch;
+    watch.start();
+
+    string data;
+    for (size_t i = 0; i < count; i++) {
+      data += MessageEncoder::encode(&message, framing);
+    }
+
+    cout << "Encoded " << count << " " << name << " messages in "
+         << watch.elapsed() << endl;
+
+    watch.start();
+
+    size_t decoded = 0;
+
+    foreach (Request* request, decoder.decode(data.data(), data.size())) {
+      decoded++;
+      delete request;
+    }
+
+    foreach (Message* message, decoder.messages()) {
+      decoded++;
+      delete message;
+    }
+
+    ASSERT_EQ(count, decoded);
+
+    cout << "Decoded " << count << " " << name << " messages in "
+         << watch.elapsed() << endl;
+  }
+}
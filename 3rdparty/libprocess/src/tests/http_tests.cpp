@@ -1,22 +1,32 @@
 #include <arpa/inet.h>
+#include <limits.h>
 
 #include <gmock/gmock.h>
 
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
+#include <poll.h>
+#include <unistd.h>
+
 #include <string>
+#include <vector>
 
+#include <process/clock.hpp>
 #include <process/future.hpp>
 #include <process/gmock.hpp>
 #include <process/gtest.hpp>
 #include <process/http.hpp>
 #include <process/io.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/gtest.hpp>
 #include <stout/none.hpp>
 #include <stout/nothing.hpp>
+#include <stout/numify.hpp>
 #include <stout/os.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
 
 #include "encoder.hpp"
 
@@ -281,3 +291,403 @@ TEST(HTTP, Post)
   terminate(process);
   wait(process);
 }
+
+
+http::Response echo(const http::Request& request)
+{
+  return http::OK(request.query.get("i").get());
+}
+
+
+// Sends more concurrent requests than there are pooled connections
+// so that the requests get pipelined and checks that each request
+// gets its own response.
+TEST(HTTP, Pipelining)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  HttpProcess process;
+
+  spawn(process);
+
+  EXPECT_CALL(process, get(_))
+    .WillRepeatedly(Invoke(echo));
+
+  std::vector<Future<http::Response> > futures;
+  for (int i = 0; i < 100; i++) {
+    futures.push_back(
+        http::get(process.self(), "get", "i=" + stringify(i)));
+  }
+
+  for (int i = 0; i < 100; i++) {
+    AWAIT_READY(futures[i]);
+    EXPECT_EQ(http::statuses[200], futures[i].get().status);
+    EXPECT_EQ(stringify(i), futures[i].get().body);
+  }
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Reads an HTTP request (without a body) from the socket, waiting
+// at most 'timeout' for the data.
+static Option<string> readRequest(int s, const Duration& timeout)
+{
+  string request;
+
+  while (!strings::contains(request, "\r\n\r\n")) {
+    pollfd pfd;
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    if (::poll(&pfd, 1, timeout.ms()) <= 0) {
+      return None();
+    }
+
+    char buffer[1024];
+    ssize_t length = ::read(s, buffer, sizeof(buffer));
+    if (length <= 0) {
+      return None();
+    }
+
+    request.append(buffer, length);
+  }
+
+  return request;
+}
+
+
+// Uses a plain socket as the server to check that requests reuse a
+// connection and that a closed connection gets replaced.
+TEST(HTTP, PersistentConnection)
+{
+  int server = ::socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  ASSERT_LE(0, server);
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = 0;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ASSERT_EQ(0, ::bind(server, (sockaddr*) &addr, sizeof(addr)));
+  ASSERT_EQ(0, ::listen(server, 16));
+
+  socklen_t length = sizeof(addr);
+  ASSERT_EQ(0, getsockname(server, (sockaddr*) &addr, &length));
+
+  UPID upid("server", addr.sin_addr.s_addr, ntohs(addr.sin_port));
+
+  Future<http::Response> future = http::get(upid, "first");
+
+  int s = ::accept(server, NULL, NULL);
+  ASSERT_LE(0, s);
+
+  Option<string> request = readRequest(s, Seconds(10));
+  ASSERT_SOME(request);
+  EXPECT_TRUE(strings::startsWith(request.get(), "GET /server/first "));
+  EXPECT_FALSE(strings::contains(request.get(), "Connection: close"));
+
+  ASSERT_SOME(os::write(s, "HTTP/1.1 200 OK\r\n"
+                           "Content-Length: 5\r\n"
+                           "\r\n"
+                           "first"));
+
+  AWAIT_READY(future);
+  EXPECT_EQ("first", future.get().body);
+
+  // The second request is sent on the same connection.
+  future = http::get(upid, "second");
+
+  request = readRequest(s, Seconds(10));
+  ASSERT_SOME(request);
+  EXPECT_TRUE(strings::startsWith(request.get(), "GET /server/second "));
+
+  // A response delimited by closing the connection, written in parts.
+  ASSERT_SOME(os::write(s, "HTTP/1.1 200 OK\r\n"
+                           "Connection: close\r\n"
+                           "\r\n"
+                           "sec"));
+  ASSERT_SOME(os::write(s, "ond"));
+  ASSERT_SOME(os::close(s));
+
+  AWAIT_READY(future);
+  EXPECT_EQ("second", future.get().body);
+
+  // The closed connection gets replaced by a new one.
+  future = http::get(upid, "third");
+
+  s = ::accept(server, NULL, NULL);
+  ASSERT_LE(0, s);
+
+  request = readRequest(s, Seconds(10));
+  ASSERT_SOME(request);
+  EXPECT_TRUE(strings::startsWith(request.get(), "GET /server/third "));
+
+  // Closing the connection fails the outstanding request.
+  ASSERT_SOME(os::close(s));
+
+  AWAIT_FAILED(future);
+
+  ASSERT_SOME(os::close(server));
+}
+
+
+// Returns what the file descriptor links to (e.g., 'socket:[1234]'),
+// which identifies a socket even after it got disconnected.
+static Option<string> link(int fd)
+{
+  char buffer[PATH_MAX];
+  const string path = "/proc/self/fd/" + stringify(fd);
+
+  ssize_t length = ::readlink(path.c_str(), buffer, sizeof(buffer));
+  if (length < 0) {
+    return None();
+  }
+
+  return string(buffer, length);
+}
+
+
+// Returns the socket of this process that is bound to the local
+// 'port' (see 'link' above).
+static Option<string> bound(uint16_t port)
+{
+  foreach (const string& entry, os::ls("/proc/self/fd")) {
+    Try<int> fd = numify<int>(entry);
+    if (fd.isError()) {
+      continue;
+    }
+
+    sockaddr_in addr;
+    socklen_t length = sizeof(addr);
+    if (getsockname(fd.get(), (sockaddr*) &addr, &length) == 0 &&
+        addr.sin_family == AF_INET &&
+        ntohs(addr.sin_port) == port) {
+      return link(fd.get());
+    }
+  }
+
+  return None();
+}
+
+
+// Returns whether this process still has the socket open, waiting
+// at most 'timeout' for it to get closed.
+static bool isOpen(const string& socket, const Duration& timeout)
+{
+  Duration waited = Duration::zero();
+
+  while (true) {
+    bool open = false;
+
+    foreach (const string& entry, os::ls("/proc/self/fd")) {
+      Try<int> fd = numify<int>(entry);
+      if (fd.isSome() && link(fd.get()) == socket) {
+        open = true;
+        break;
+      }
+    }
+
+    if (!open || waited >= timeout) {
+      return open;
+    }
+
+    os::sleep(Milliseconds(10));
+    waited += Milliseconds(10);
+  }
+}
+
+
+// Checks that the client closes its socket once the server closes
+// the connection and once the connection is closed for being idle.
+TEST(HTTP, CloseConnection)
+{
+  int server = ::socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  ASSERT_LE(0, server);
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = 0;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ASSERT_EQ(0, ::bind(server, (sockaddr*) &addr, sizeof(addr)));
+  ASSERT_EQ(0, ::listen(server, 16));
+
+  socklen_t length = sizeof(addr);
+  ASSERT_EQ(0, getsockname(server, (sockaddr*) &addr, &length));
+
+  UPID upid("server", addr.sin_addr.s_addr, ntohs(addr.sin_port));
+
+  Future<http::Response> future = http::get(upid, "first");
+
+  int s = ::accept(server, (sockaddr*) &addr, &length);
+  ASSERT_LE(0, s);
+
+  // The client's socket.
+  Option<string> client = bound(ntohs(addr.sin_port));
+  ASSERT_SOME(client);
+
+  ASSERT_SOME(readRequest(s, Seconds(10)));
+  ASSERT_SOME(os::write(s, "HTTP/1.1 200 OK\r\n"
+                           "Content-Length: 5\r\n"
+                           "\r\n"
+                           "first"));
+
+  AWAIT_READY(future);
+  EXPECT_EQ("first", future.get().body);
+
+  // The idle connection is kept open until the server closes it.
+  EXPECT_TRUE(isOpen(client.get(), Duration::zero()));
+
+  ASSERT_SOME(os::close(s));
+
+  EXPECT_FALSE(isOpen(client.get(), Seconds(10)));
+
+  future = http::get(upid, "second");
+
+  length = sizeof(addr);
+  s = ::accept(server, (sockaddr*) &addr, &length);
+  ASSERT_LE(0, s);
+
+  client = bound(ntohs(addr.sin_port));
+  ASSERT_SOME(client);
+
+  ASSERT_SOME(readRequest(s, Seconds(10)));
+  ASSERT_SOME(os::write(s, "HTTP/1.1 200 OK\r\n"
+                           "Content-Length: 6\r\n"
+                           "\r\n"
+                           "second"));
+
+  AWAIT_READY(future);
+  EXPECT_EQ("second", future.get().body);
+
+  // A connection is closed once it was idle for an entire sweep
+  // interval (i.e., after at most two sweeps, which run every 30
+  // seconds).
+  Clock::pause();
+
+  for (int i = 0; i < 3; i++) {
+    Clock::advance(Seconds(30));
+    Clock::settle();
+  }
+
+  EXPECT_FALSE(isOpen(client.get(), Seconds(10)));
+
+  Clock::resume();
+
+  ASSERT_SOME(os::close(s));
+  ASSERT_SOME(os::close(server));
+}
+
+
+// Checks that an idempotent request is resent on a new connection if
+// a reused connection gets closed before any of the response arrives,
+// as happens when the server closes an idle connection.
+TEST(HTTP, RetryRequest)
+{
+  int server = ::socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  ASSERT_LE(0, server);
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = 0;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ASSERT_EQ(0, ::bind(server, (sockaddr*) &addr, sizeof(addr)));
+  ASSERT_EQ(0, ::listen(server, 16));
+
+  socklen_t length = sizeof(addr);
+  ASSERT_EQ(0, getsockname(server, (sockaddr*) &addr, &length));
+
+  UPID upid("server", addr.sin_addr.s_addr, ntohs(addr.sin_port));
+
+  Future<http::Response> future = http::get(upid, "first");
+
+  int s = ::accept(server, NULL, NULL);
+  ASSERT_LE(0, s);
+
+  ASSERT_SOME(readRequest(s, Seconds(10)));
+  ASSERT_SOME(os::write(s, "HTTP/1.1 200 OK\r\n"
+                           "Content-Length: 5\r\n"
+                           "\r\n"
+                           "first"));
+
+  AWAIT_READY(future);
+  EXPECT_EQ("first", future.get().body);
+
+  // The server closes the connection instead of responding.
+  future = http::get(upid, "second");
+
+  Option<string> request = readRequest(s, Seconds(10));
+  ASSERT_SOME(request);
+  EXPECT_TRUE(strings::startsWith(request.get(), "GET /server/second "));
+
+  ASSERT_SOME(os::close(s));
+
+  // The request is resent on a new connection.
+  pollfd pfd;
+  pfd.fd = server;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  ASSERT_EQ(1, ::poll(&pfd, 1, Seconds(10).ms()));
+
+  s = ::accept(server, NULL, NULL);
+  ASSERT_LE(0, s);
+
+  request = readRequest(s, Seconds(10));
+  ASSERT_SOME(request);
+  EXPECT_TRUE(strings::startsWith(request.get(), "GET /server/second "));
+
+  ASSERT_SOME(os::write(s, "HTTP/1.1 200 OK\r\n"
+                           "Content-Length: 6\r\n"
+                           "\r\n"
+                           "second"));
+
+  AWAIT_READY(future);
+  EXPECT_EQ("second", future.get().body);
+
+  // A POST is not resent.
+  future = http::post(upid, "third", "third", "text/plain");
+
+  request = readRequest(s, Seconds(10));
+  ASSERT_SOME(request);
+  EXPECT_TRUE(strings::startsWith(request.get(), "POST /server/third "));
+
+  ASSERT_SOME(os::close(s));
+
+  AWAIT_FAILED(future);
+
+  future = http::get(upid, "fourth");
+
+  s = ::accept(server, NULL, NULL);
+  ASSERT_LE(0, s);
+
+  ASSERT_SOME(readRequest(s, Seconds(10)));
+  ASSERT_SOME(os::write(s, "HTTP/1.1 200 OK\r\n"
+                           "Content-Length: 6\r\n"
+                           "\r\n"
+                           "fourth"));
+
+  AWAIT_READY(future);
+  EXPECT_EQ("fourth", future.get().body);
+
+  // Nor is a request once part of its response has arrived.
+  future = http::get(upid, "fifth");
+
+  request = readRequest(s, Seconds(10));
+  ASSERT_SOME(request);
+  EXPECT_TRUE(strings::startsWith(request.get(), "GET /server/fifth "));
+
+  ASSERT_SOME(os::write(s, "HTTP/1.1 200 OK\r\n"));
+  ASSERT_SOME(os::close(s));
+
+  AWAIT_FAILED(future);
+
+  ASSERT_SOME(os::close(server));
+}
@@ -0,0 +1,230 @@
+#include <gmock/gmock.h>
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+#include <stout/foreach.hpp>
+#include <stout/stopwatch.hpp>
+
+#include "mailbox.hpp"
+
+using namespace process;
+
+using std::cout;
+using std::deque;
+using std::endl;
+using std::vector;
+
+
+TEST(Mailbox, Drain)
+{
+  Mailbox<int> mailbox;
+
+  deque<int> queue;
+  EXPECT_TRUE(mailbox.empty());
+  EXPECT_EQ(0u, mailbox.drain(&queue));
+  EXPECT_TRUE(queue.empty());
+
+  mailbox.enqueue(1);
+  mailbox.enqueue(2);
+  mailbox.enqueue(3);
+
+  EXPECT_FALSE(mailbox.empty());
+  EXPECT_FALSE(mailbox.prioritized());
+
+  EXPECT_EQ(3u, mailbox.drain(&queue));
+  EXPECT_TRUE(mailbox.empty());
+
+  ASSERT_EQ(3u, queue.size());
+  EXPECT_EQ(1, queue[0]);
+  EXPECT_EQ(2, queue[1]);
+  EXPECT_EQ(3, queue[2]);
+
+  // Injected items go ahead of everything, including the items that
+  // have already been drained, the most recently injected first.
+  mailbox.enqueue(4);
+  mailbox.inject(5);
+  mailbox.inject(6);
+
+  EXPECT_TRUE(mailbox.prioritized());
+
+  EXPECT_EQ(3u, mailbox.drain(&queue));
+  EXPECT_TRUE(mailbox.empty());
+  EXPECT_FALSE(mailbox.prioritized());
+
+  ASSERT_EQ(6u, queue.size());
+  EXPECT_EQ(6, queue[0]);
+  EXPECT_EQ(5, queue[1]);
+  EXPECT_EQ(1, queue[2]);
+  EXPECT_EQ(2, queue[3]);
+  EXPECT_EQ(3, queue[4]);
+  EXPECT_EQ(4, queue[5]);
+}
+
+
+namespace {
+
+struct Producer
+{
+  Mailbox<int>* mailbox;
+  int index;
+  int count;
+};
+
+
+// Enqueues 'count' items that encode the producer and a sequence
+// number so the consumer can check the order of each producer.
+void* produce(void* arg)
+{
+  Producer* producer = (Producer*) arg;
+
+  for (int i = 0; i < producer->count; i++) {
+    producer->mailbox->enqueue(producer->index * producer->count + i);
+  }
+
+  return NULL;
+}
+
+} // namespace {
+
+
+TEST(Mailbox, Producers)
+{
+  const int producers = 8;
+  const int count = 10000;
+
+  Mailbox<int> mailbox;
+
+  vector<pthread_t> pthreads(producers);
+  vector<Producer> arguments(producers);
+
+  for (int i = 0; i < producers; i++) {
+    arguments[i].mailbox = &mailbox;
+    arguments[i].index = i;
+    arguments[i].count = count;
+    ASSERT_EQ(0, pthread_create(&pthreads[i], NULL, produce, &arguments[i]));
+  }
+
+  // Consume concurrently with the producers.
+  vector<int> next(producers, 0);
+  int consumed = 0;
+
+  while (consumed < producers * count) {
+    deque<int> queue;
+    mailbox.drain(&queue);
+
+    foreach (int item, queue) {
+      int producer = item / count;
+      ASSERT_EQ(next[producer], item % count);
+      next[producer]++;
+      consumed++;
+    }
+  }
+
+  foreach (pthread_t pthread, pthreads) {
+    ASSERT_EQ(0, pthread_join(pthread, NULL));
+  }
+
+  EXPECT_TRUE(mailbox.empty());
+}
+
+
+namespace {
+
+// A queue protected by a mutex for comparison, i.e., how the events
+// of a process used to be enqueued.
+struct LockedQueue
+{
+  LockedQueue() { pthread_mutex_init(&mutex, NULL); }
+  ~LockedQueue() { pthread_mutex_destroy(&mutex); }
+
+  pthread_mutex_t mutex;
+  deque<int> items;
+};
+
+
+struct Enqueuer
+{
+  Mailbox<int>* mailbox;
+  LockedQueue* queue;
+  int count;
+};
+
+
+void* enqueue(void* arg)
+{
+  Enqueuer* enqueuer = (Enqueuer*) arg;
+
+  for (int i = 0; i < enqueuer->count; i++) {
+    if (enqueuer->mailbox != NULL) {
+      enqueuer->mailbox->enqueue(i);
+    } else {
+      pthread_mutex_lock(&enqueuer->queue->mutex);
+      enqueuer->queue->items.push_back(i);
+      pthread_mutex_unlock(&enqueuer->queue->mutex);
+    }
+  }
+
+  return NULL;
+}
+
+} // namespace {
+
+
+TEST(Mailbox_BENCHMARK_Test, Enqueue)
+{
+  // Divisible by the number of producer threads.
+  const int count = 960000;
+
+  const int threads[] = { 1, 8, 32 };
+
+  foreach (int producers, threads) {
+    for (int locked = 0; locked < 2; locked++) {
+      Mailbox<int> mailbox;
+      LockedQueue queue;
+
+      vector<pthread_t> pthreads(producers);
+      vector<Enqueuer> arguments(producers);
+
+      Stopwatch watch;
+      watch.start();
+
+      for (int i = 0; i < producers; i++) {
+        arguments[i].mailbox = locked ? NULL : &mailbox;
+        arguments[i].queue = &queue;
+        arguments[i].count = count / producers;
+        ASSERT_EQ(0, pthread_create(
+            &pthreads[i], NULL, enqueue, &arguments[i]));
+      }
+
+      // Consume one item at a time from the locked queue (like
+      // resume used to) and in batches from the mailbox.
+      deque<int> items;
+      int consumed = 0;
+      while (consumed < count) {
+        if (locked) {
+          pthread_mutex_lock(&queue.mutex);
+          if (!queue.items.empty()) {
+            queue.items.pop_front();
+            consumed++;
+          }
+          pthread_mutex_unlock(&queue.mutex);
+        } else {
+          consumed += mailbox.drain(&items);
+          items.clear();
+        }
+      }
+
+      foreach (pthread_t pthread, pthreads) {
+        ASSERT_EQ(0, pthread_join(pthread, NULL));
+      }
+
+      cout << "Enqueued and consumed " << count << " items with "
+           << producers << " producer threads and a "
+           << (locked ? "locked queue" : "mailbox") << " in "
+           << watch.elapsed() << endl;
+    }
+  }
+}
@@ -2,15 +2,99 @@
 
 #include <gmock/gmock.h>
 
+#include <iostream>
+#include <string>
+
 #include <process/gmock.hpp>
 #include <process/gtest.hpp>
 #include <process/process.hpp>
 
+#include <stout/flags.hpp>
+#include <stout/strings.hpp>
+
+using std::string;
+
+
+class Flags : public virtual flags::FlagsBase
+{
+public:
+  Flags()
+  {
+    add(&Flags::benchmark,
+        "benchmark",
+        "Run the benchmark tests (and skip other tests)",
+        false);
+  }
+
+  bool benchmark;
+};
+
+
+// Updates the gtest filter so that the benchmark tests (i.e., those
+// with 'BENCHMARK_' in their test case name) are only run, and then
+// exclusively, when asked for (like the Mesos tests, see
+// src/tests/environment.cpp).
+static void filter(bool benchmark)
+{
+  const string& filter = ::testing::GTEST_FLAG(filter);
+
+  // An empty filter indicates no tests should be run.
+  if (filter.empty()) {
+    return;
+  }
+
+  string enabled;
+  string disabled;
+
+  size_t dash = filter.find('-');
+  if (dash != string::npos) {
+    enabled = filter.substr(0, dash);
+    disabled = filter.substr(dash + 1);
+  } else {
+    enabled = filter;
+  }
+
+  if (benchmark) {
+    // Unless tests were explicitly selected run all benchmarks.
+    if (enabled.empty() || enabled == "*") {
+      enabled = "*BENCHMARK_*";
+    }
+  } else {
+    if (enabled.empty()) {
+      enabled = "*";
+    }
+
+    if (!disabled.empty() && !strings::endsWith(disabled, ":")) {
+      disabled += ":";
+    }
+
+    disabled += "*BENCHMARK_*";
+  }
+
+  ::testing::GTEST_FLAG(filter) = enabled + "-" + disabled;
+}
+
+
 int main(int argc, char** argv)
 {
+  Flags flags;
+
+  // Load flags from environment and command line but allow unknown
+  // flags (since we might have gtest/gmock flags as well).
+  Try<Nothing> load = flags.load("LIBPROCESS_", argc, argv, true);
+
+  if (load.isError()) {
+    std::cerr << load.error() << std::endl
+              << "Usage: " << argv[0] << " [...]" << std::endl
+              << flags.usage();
+    return 1;
+  }
+
   // Initialize Google Mock/Test.
   testing::InitGoogleMock(&argc, argv);
 
+  filter(flags.benchmark);
+
   // Initialize libprocess.
   process::initialize();
 
@@ -8,7 +8,12 @@
 
 #include <process/metrics/counter.hpp>
 #include <process/metrics/gauge.hpp>
+#include <process/metrics/histogram.hpp>
 #include <process/metrics/metrics.hpp>
+#include <process/metrics/timer.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/hashmap.hpp>
 
 
 using process::Deferred;
@@ -16,11 +21,14 @@ using process::Failure;
 using process::Future;
 using process::PID;
 using process::Process;
+using process::Promise;
 
 using process::metrics::add;
 using process::metrics::remove;
 using process::metrics::Counter;
 using process::metrics::Gauge;
+using process::metrics::Histogram;
+using process::metrics::Timer;
 
 
 class GaugeProcess : public Process<GaugeProcess>
@@ -50,6 +58,14 @@ TEST(MetricsTest, Counter)
   c += 42;
   EXPECT_FLOAT_EQ(42.0, c.value().get());
 
+  --c;
+  EXPECT_FLOAT_EQ(41.0, c.value().get());
+  c--;
+  EXPECT_FLOAT_EQ(40.0, c.value().get());
+
+  c -= 40;
+  EXPECT_FLOAT_EQ(0.0, c.value().get());
+
   AWAIT_READY(remove(c));
 }
 
@@ -79,3 +95,82 @@ TEST(MetricsTest, Gauge)
   terminate(process);
   wait(process);
 }
+
+
+TEST(MetricsTest, Histogram)
+{
+  Histogram h("test/histogram");
+  AWAIT_READY(add(h));
+
+  Future<hashmap<std::string, double> > values = h.values();
+  AWAIT_READY(values);
+  EXPECT_EQ(1u, values.get().size());
+  EXPECT_SOME_EQ(0.0, values.get().get("test/histogram/count"));
+
+  for (uint64_t i = 1; i <= 1000; i++) {
+    h.record(i);
+  }
+
+  EXPECT_FLOAT_EQ(1000.0, h.value().get());
+
+  values = h.values();
+  AWAIT_READY(values);
+
+  hashmap<std::string, double> snapshot = values.get();
+  EXPECT_FLOAT_EQ(1000.0, snapshot["test/histogram/count"]);
+  EXPECT_FLOAT_EQ(1.0, snapshot["test/histogram/min"]);
+  EXPECT_FLOAT_EQ(1000.0, snapshot["test/histogram/max"]);
+
+  // The percentiles are approximate (to within the width of a bucket).
+  EXPECT_NEAR(500.0, snapshot["test/histogram/p50"], 500.0 / 16);
+  EXPECT_NEAR(900.0, snapshot["test/histogram/p90"], 900.0 / 16);
+  EXPECT_NEAR(990.0, snapshot["test/histogram/p99"], 990.0 / 16);
+  EXPECT_NEAR(999.0, snapshot["test/histogram/p999"], 999.0 / 16);
+
+  // Small values are recorded exactly.
+  Histogram small("test/small");
+  small.record(0);
+  small.record(3);
+  small.record(3);
+
+  values = small.values();
+  AWAIT_READY(values);
+
+  snapshot = values.get();
+  EXPECT_FLOAT_EQ(0.0, snapshot["test/small/min"]);
+  EXPECT_FLOAT_EQ(3.0, snapshot["test/small/p50"]);
+  EXPECT_FLOAT_EQ(3.0, snapshot["test/small/max"]);
+
+  AWAIT_READY(remove(h));
+}
+
+
+TEST(MetricsTest, Timer)
+{
+  Timer t("test/timer");
+  AWAIT_READY(add(t));
+
+  t.record(Milliseconds(10));
+  t.record(Seconds(1));
+
+  Future<hashmap<std::string, double> > values = t.values();
+  AWAIT_READY(values);
+
+  hashmap<std::string, double> snapshot = values.get();
+  EXPECT_FLOAT_EQ(2.0, snapshot["test/timer/count"]);
+  EXPECT_FLOAT_EQ(10.0, snapshot["test/timer/min"]);
+  EXPECT_FLOAT_EQ(1000.0, snapshot["test/timer/max"]);
+
+  // Time a future.
+  Promise<int> promise;
+  Future<int> future = t.time(promise.future());
+
+  EXPECT_FLOAT_EQ(2.0, t.value().get());
+
+  promise.set(42);
+  AWAIT_EXPECT_EQ(42, future);
+
+  EXPECT_FLOAT_EQ(3.0, t.value().get());
+
+  AWAIT_READY(remove(t));
+}
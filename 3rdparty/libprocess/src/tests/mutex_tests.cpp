@@ -3,6 +3,8 @@
 #include <process/future.hpp>
 #include <process/mutex.hpp>
 
+#include <stout/lambda.hpp>
+
 using namespace process;
 
 TEST(Mutex, lock)
@@ -63,3 +65,26 @@ TEST(Mutex, queue)
 
   EXPECT_TRUE(locked2.isReady());
 }
+
+
+TEST(Mutex, unlockFromCallback)
+{
+  Mutex mutex;
+
+  EXPECT_TRUE(mutex.lock().isReady());
+
+  // Unlocking the mutex as soon as it gets acquired (i.e., from a
+  // callback invoked by 'unlock') should not deadlock.
+  Future<Nothing> locked1 = mutex.lock();
+  locked1.onAny(lambda::bind(&Mutex::unlock, mutex));
+
+  Future<Nothing> locked2 = mutex.lock();
+
+  EXPECT_TRUE(locked1.isPending());
+  EXPECT_TRUE(locked2.isPending());
+
+  mutex.unlock();
+
+  EXPECT_TRUE(locked1.isReady());
+  EXPECT_TRUE(locked2.isReady());
+}
@@ -5,6 +5,8 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
+#include <poll.h>
+
 #include <string>
 #include <sstream>
 
@@ -20,17 +22,21 @@
 #include <process/gc.hpp>
 #include <process/gmock.hpp>
 #include <process/gtest.hpp>
+#include <process/io.hpp>
 #include <process/limiter.hpp>
 #include <process/process.hpp>
 #include <process/run.hpp>
+#include <process/subprocess.hpp>
 #include <process/time.hpp>
 
 #include <stout/duration.hpp>
 #include <stout/gtest.hpp>
 #include <stout/lambda.hpp>
 #include <stout/nothing.hpp>
+#include <stout/option.hpp>
 #include <stout/os.hpp>
 #include <stout/stringify.hpp>
+#include <stout/strings.hpp>
 #include <stout/stopwatch.hpp>
 #include <stout/try.hpp>
 #include <stout/tuple.hpp>
@@ -1418,6 +1424,170 @@ TEST(Process, remote)
 }
 
 
+// Reads from the socket until 'delimiter' has been read or the
+// other end closes it, waiting at most 'timeout' for any data.
+static string readUntil(
+    int s,
+    const string& delimiter,
+    const Duration& timeout)
+{
+  string data;
+
+  while (delimiter.empty() || !strings::contains(data, delimiter)) {
+    pollfd pfd;
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    if (::poll(&pfd, 1, timeout.ms()) <= 0) {
+      break;
+    }
+
+    char buffer[1024];
+    ssize_t length = ::read(s, buffer, sizeof(buffer));
+    if (length <= 0) {
+      break;
+    }
+
+    data.append(buffer, length);
+  }
+
+  return data;
+}
+
+
+// Satisfies a future once its handler got invoked.
+class HandlerProcess : public Process<HandlerProcess>
+{
+public:
+  HandlerProcess()
+  {
+    install("handler", &HandlerProcess::handler);
+  }
+
+  Future<Nothing> handled()
+  {
+    return promise.future();
+  }
+
+private:
+  void handler(const UPID& from, const string& body)
+  {
+    promise.set(Nothing());
+  }
+
+  Promise<Nothing> promise;
+};
+
+
+// Checks that a node forgets that a peer accepts binary framed
+// messages once a (temporary) socket to it goes away, so that a peer
+// that comes back without binary framing gets HTTP messages again.
+TEST(Process, BinaryFramingFallback)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  // Binary framing is enabled when libprocess gets initialized, so
+  // the test reruns itself in a process that has it enabled.
+  if (os::getenv("LIBPROCESS_BINARY_MESSAGES", false) != "1") {
+    Result<string> path = os::realpath("/proc/self/exe");
+    ASSERT_SOME(path);
+
+    Try<Subprocess> test = subprocess(
+        "LIBPROCESS_BINARY_MESSAGES=1 exec " + path.get() +
+        " --gtest_filter=Process.BinaryFramingFallback 2>&1");
+
+    ASSERT_SOME(test);
+    ASSERT_SOME(os::nonblock(test.get().out()));
+
+    Future<string> output = io::read(test.get().out());
+
+    AWAIT_READY_FOR(test.get().status(), Seconds(60));
+    AWAIT_READY(output);
+
+    EXPECT_SOME_EQ(0, test.get().status().get()) << output.get();
+    return;
+  }
+
+  // A (fake) peer node.
+  int server = ::socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  ASSERT_LE(0, server);
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = 0;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  ASSERT_EQ(0, ::bind(server, (sockaddr*) &addr, sizeof(addr)));
+  ASSERT_EQ(0, ::listen(server, 16));
+
+  socklen_t length = sizeof(addr);
+  ASSERT_EQ(0, getsockname(server, (sockaddr*) &addr, &length));
+
+  UPID peer("peer", addr.sin_addr.s_addr, ntohs(addr.sin_port));
+
+  HandlerProcess process;
+  spawn(process);
+
+  // The peer advertises that it accepts binary framed messages.
+  int s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  ASSERT_LE(0, s);
+
+  addr.sin_port = htons(process.self().port);
+  addr.sin_addr.s_addr = process.self().ip;
+
+  ASSERT_EQ(0, connect(s, (sockaddr*) &addr, sizeof(addr)));
+
+  Message message;
+  message.name = "handler";
+  message.from = peer;
+  message.to = process.self();
+
+  const string& data =
+    MessageEncoder::encode(&message, MessageEncoder::ADVERTISE);
+
+  ASSERT_SOME(os::write(s, data));
+
+  AWAIT_READY(process.handled());
+
+  ASSERT_SOME(os::close(s));
+
+  // The next message is sent on a temporary socket that gets
+  // upgraded to binary framing.
+  post(peer, "first");
+
+  s = ::accept(server, NULL, NULL);
+  ASSERT_LE(0, s);
+
+  string request = readUntil(s, "first", Seconds(10));
+  EXPECT_TRUE(strings::startsWith(request, "POST / HTTP/1.1\r\n"));
+  EXPECT_TRUE(strings::contains(
+      request, "Upgrade: " + BINARY_MESSAGES_PROTOCOL + "\r\n"));
+
+  // Wait for the temporary socket to get closed.
+  readUntil(s, "", Seconds(10));
+  ASSERT_SOME(os::close(s));
+
+  // The peer restarts without binary framing, so the next message
+  // must be sent as HTTP (advertising binary framing) again.
+  post(peer, "second");
+
+  s = ::accept(server, NULL, NULL);
+  ASSERT_LE(0, s);
+
+  request = readUntil(s, "\r\n\r\n", Seconds(10));
+  EXPECT_TRUE(strings::startsWith(request, "POST /peer/second HTTP/1.0\r\n"));
+  EXPECT_TRUE(strings::contains(request, BINARY_MESSAGES_HEADER + ": "));
+
+  ASSERT_SOME(os::close(s));
+  ASSERT_SOME(os::close(server));
+
+  terminate(process);
+  wait(process);
+}
+
+
 int foo()
 {
   return 1;
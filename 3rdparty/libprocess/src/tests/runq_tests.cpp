@@ -0,0 +1,164 @@
+#include <gmock/gmock.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <vector>
+
+#include <stout/foreach.hpp>
+#include <stout/gtest.hpp>
+#include <stout/option.hpp>
+#include <stout/stopwatch.hpp>
+
+#include "runq.hpp"
+
+using namespace process;
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+
+TEST(RunQueue, Dequeue)
+{
+  RunQueue<int> runq(2);
+
+  EXPECT_TRUE(runq.idle());
+  EXPECT_NONE(runq.dequeue(0));
+
+  runq.enqueue(0, 1);
+  runq.enqueue(0, 2);
+  runq.enqueue(1, 3);
+
+  EXPECT_FALSE(runq.idle());
+
+  // Workers dequeue from their own queue in order.
+  EXPECT_SOME_EQ(1, runq.dequeue(0));
+  EXPECT_SOME_EQ(3, runq.dequeue(1));
+
+  // And steal from the other queues once their own is empty.
+  EXPECT_SOME_EQ(2, runq.dequeue(1));
+  EXPECT_NONE(runq.dequeue(0));
+  EXPECT_NONE(runq.dequeue(1));
+
+  // Not idle until all the dequeued items are done.
+  EXPECT_FALSE(runq.idle());
+
+  runq.done();
+  runq.done();
+  EXPECT_FALSE(runq.idle());
+
+  runq.done();
+  EXPECT_TRUE(runq.idle());
+}
+
+
+TEST(RunQueue, Remove)
+{
+  RunQueue<int> runq(4);
+
+  runq.enqueue(2, 1);
+  runq.enqueue(2, 2);
+  runq.enqueue(3, 3);
+
+  EXPECT_TRUE(runq.remove(2));
+  EXPECT_FALSE(runq.remove(2));
+  EXPECT_FALSE(runq.remove(4));
+
+  EXPECT_SOME_EQ(1, runq.dequeue(0));
+  EXPECT_SOME_EQ(3, runq.dequeue(0));
+  EXPECT_NONE(runq.dequeue(0));
+
+  runq.done();
+  runq.done();
+  EXPECT_FALSE(runq.idle());
+
+  runq.done();
+  EXPECT_TRUE(runq.idle());
+}
+
+
+namespace {
+
+struct Worker
+{
+  RunQueue<int>* runq;
+  size_t index;
+  int count;
+};
+
+
+// Simulates a worker thread that resumes processes from the run
+// queue, each of which dispatches to another process (i.e., enqueues
+// it again) until the worker has done its share of the dispatches.
+void* work(void* arg)
+{
+  Worker* worker = (Worker*) arg;
+
+  int dispatched = 0;
+  while (dispatched < worker->count) {
+    Option<int> process = worker->runq->dequeue(worker->index);
+    if (process.isNone()) {
+      sched_yield();
+      continue;
+    }
+
+    worker->runq->enqueue(worker->index, process.get() + 1);
+    worker->runq->done();
+    dispatched++;
+  }
+
+  return NULL;
+}
+
+} // namespace {
+
+
+TEST(RunQueue_BENCHMARK_Test, Dispatch)
+{
+  // Divisible by the number of worker threads.
+  const int count = 960000;
+
+  const size_t workers[] = { 1, 8, 32 };
+
+  foreach (size_t threads, workers) {
+    // Compare a single queue shared by all the workers (i.e., a global
+    // run queue) with a queue per worker.
+    vector<size_t> queues;
+    queues.push_back(1);
+    if (threads > 1) {
+      queues.push_back(threads);
+    }
+
+    foreach (size_t size, queues) {
+      RunQueue<int> runq(size);
+
+      // Start with a few runnable processes per worker.
+      for (size_t i = 0; i < threads * 4; i++) {
+        runq.enqueue(i, 0);
+      }
+
+      vector<pthread_t> pthreads(threads);
+      vector<Worker> arguments(threads);
+
+      Stopwatch watch;
+      watch.start();
+
+      for (size_t i = 0; i < threads; i++) {
+        arguments[i].runq = &runq;
+        arguments[i].index = i;
+        arguments[i].count = count / threads;
+        ASSERT_EQ(0, pthread_create(&pthreads[i], NULL, work, &arguments[i]));
+      }
+
+      foreach (pthread_t pthread, pthreads) {
+        ASSERT_EQ(0, pthread_join(pthread, NULL));
+      }
+
+      cout << "Dispatched " << count << " times with "
+           << threads << " worker threads and " << size
+           << (size == 1 ? " queue" : " queues") << " in "
+           << watch.elapsed() << endl;
+    }
+  }
+}
@@ -0,0 +1,256 @@
+#include <gmock/gmock.h>
+
+#include <list>
+#include <vector>
+
+#include <process/clock.hpp>
+#include <process/process.hpp>
+#include <process/time.hpp>
+#include <process/timer.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+#include <stout/gtest.hpp>
+#include <stout/stopwatch.hpp>
+
+#include "timer_wheel.hpp"
+
+using namespace process;
+
+using std::cout;
+using std::endl;
+using std::list;
+using std::vector;
+
+
+static void nothing() {}
+
+
+// Creates the timers with a paused clock (so that their timeouts are
+// relative to 'Clock::now()') and cancels them on destruction so that
+// none of them ever fire.
+class TimerWheelTest : public ::testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    Clock::pause();
+    start = Clock::now();
+  }
+
+  virtual void TearDown()
+  {
+    foreach (const Timer& timer, timers) {
+      Timer::cancel(timer);
+    }
+    Clock::resume();
+  }
+
+  Timer create(const Duration& duration)
+  {
+    Timer timer = Timer::create(duration, &nothing);
+    timers.push_back(timer);
+    return timer;
+  }
+
+  Time start;
+  vector<Timer> timers;
+};
+
+
+TEST_F(TimerWheelTest, Expire)
+{
+  TimerWheel wheel;
+
+  EXPECT_NONE(wheel.next());
+  EXPECT_TRUE(wheel.expire(start).empty());
+
+  // Timers for each of the levels of the wheel.
+  Timer timer1 = create(Milliseconds(5));
+  Timer timer2 = create(Milliseconds(1));
+  Timer timer3 = create(Seconds(3));
+  Timer timer4 = create(Seconds(70));
+  Timer timer5 = create(Hours(2));
+  Timer timer6 = create(Days(30));
+
+  wheel.add(timer1);
+  wheel.add(timer2);
+  wheel.add(timer3);
+  wheel.add(timer4);
+  wheel.add(timer5);
+  wheel.add(timer6);
+
+  EXPECT_EQ(6u, wheel.size());
+  EXPECT_SOME_EQ(start + Milliseconds(1), wheel.next());
+
+  EXPECT_TRUE(wheel.expire(start).empty());
+
+  // Timers never time out early, even within the same tick.
+  EXPECT_TRUE(wheel.expire(start + Microseconds(999)).empty());
+
+  list<Timer> expired = wheel.expire(start + Milliseconds(1));
+  ASSERT_EQ(1u, expired.size());
+  EXPECT_EQ(timer2, expired.front());
+  EXPECT_SOME_EQ(start + Milliseconds(5), wheel.next());
+
+  expired = wheel.expire(start + Milliseconds(6));
+  ASSERT_EQ(1u, expired.size());
+  EXPECT_EQ(timer1, expired.front());
+
+  expired = wheel.expire(start + Minutes(10));
+  ASSERT_EQ(2u, expired.size());
+  EXPECT_EQ(timer3, expired.front());
+  EXPECT_EQ(timer4, expired.back());
+  EXPECT_SOME_EQ(start + Hours(2), wheel.next());
+
+  expired = wheel.expire(start + Days(60));
+  ASSERT_EQ(2u, expired.size());
+  EXPECT_EQ(timer5, expired.front());
+  EXPECT_EQ(timer6, expired.back());
+
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_NONE(wheel.next());
+}
+
+
+TEST_F(TimerWheelTest, Order)
+{
+  TimerWheel wheel;
+
+  Timer timer1 = create(Seconds(10));
+  Timer timer2 = create(Seconds(10));
+  wheel.add(timer1);
+  wheel.add(timer2);
+
+  // Advance the wheel so the next timers end up in different levels
+  // than the first ones, the timers with the same timeout should
+  // still expire in the order they were added.
+  EXPECT_TRUE(wheel.expire(start + Seconds(9)).empty());
+
+  Timer timer3 = create(Seconds(10));
+  Timer timer4 = create(Seconds(1));
+  wheel.add(timer3);
+  wheel.add(timer4);
+
+  list<Timer> expired = wheel.expire(start + Seconds(10));
+  ASSERT_EQ(4u, expired.size());
+  EXPECT_EQ(timer4, expired.front());
+  expired.pop_front();
+  EXPECT_EQ(timer1, expired.front());
+  expired.pop_front();
+  EXPECT_EQ(timer2, expired.front());
+  expired.pop_front();
+  EXPECT_EQ(timer3, expired.front());
+}
+
+
+TEST_F(TimerWheelTest, Cancel)
+{
+  TimerWheel wheel;
+
+  Timer timer1 = create(Milliseconds(10));
+  Timer timer2 = create(Milliseconds(20));
+  Timer timer3 = create(Minutes(5));
+
+  wheel.add(timer1);
+  wheel.add(timer2);
+  wheel.add(timer3);
+
+  EXPECT_TRUE(wheel.cancel(timer1));
+  EXPECT_FALSE(wheel.cancel(timer1));
+  EXPECT_SOME_EQ(start + Milliseconds(20), wheel.next());
+
+  list<Timer> expired = wheel.expire(start + Seconds(1));
+  ASSERT_EQ(1u, expired.size());
+  EXPECT_EQ(timer2, expired.front());
+
+  // Can't cancel a timer that has already expired.
+  EXPECT_FALSE(wheel.cancel(timer2));
+
+  EXPECT_TRUE(wheel.cancel(timer3));
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_NONE(wheel.next());
+}
+
+
+TEST_F(TimerWheelTest, Jumps)
+{
+  TimerWheel wheel;
+
+  // Beyond the range of the wheel.
+  Timer timer1 = create(Days(900));
+  Timer timer2 = create(Days(2000));
+  Timer timer3 = create(Seconds(1));
+
+  wheel.add(timer1);
+  wheel.add(timer2);
+  wheel.add(timer3);
+
+  EXPECT_SOME_EQ(start + Seconds(1), wheel.next());
+
+  list<Timer> expired = wheel.expire(start + Days(1000));
+  ASSERT_EQ(2u, expired.size());
+  EXPECT_EQ(timer3, expired.front());
+  EXPECT_EQ(timer1, expired.back());
+  EXPECT_SOME_EQ(start + Days(2000), wheel.next());
+
+  // Time going backwards.
+  EXPECT_TRUE(wheel.expire(start).empty());
+  EXPECT_SOME_EQ(start + Days(2000), wheel.next());
+
+  Timer timer4 = create(Seconds(1));
+  wheel.add(timer4);
+
+  EXPECT_SOME_EQ(start + Seconds(1), wheel.next());
+
+  expired = wheel.expire(start + Seconds(1));
+  ASSERT_EQ(1u, expired.size());
+  EXPECT_EQ(timer4, expired.front());
+
+  expired = wheel.expire(start + Days(2000));
+  ASSERT_EQ(1u, expired.size());
+  EXPECT_EQ(timer2, expired.front());
+}
+
+
+class TimerWheel_BENCHMARK_Test : public TimerWheelTest {};
+
+
+TEST_F(TimerWheel_BENCHMARK_Test, AddCancelExpire)
+{
+  const size_t count = 100000;
+
+  TimerWheel wheel;
+
+  for (size_t i = 0; i < count; i++) {
+    create(Milliseconds(i % 60000));
+  }
+
+  Stopwatch watch;
+  watch.start();
+
+  foreach (const Timer& timer, timers) {
+    wheel.add(timer);
+  }
+
+  cout << "Added " << count << " timers in " << watch.elapsed() << endl;
+
+  watch.start();
+
+  for (size_t i = 0; i < count; i += 2) {
+    wheel.cancel(timers[i]);
+  }
+
+  cout << "Canceled " << count / 2 << " timers in " << watch.elapsed() << endl;
+
+  watch.start();
+
+  size_t expired = 0;
+  for (Time time = start; !wheel.empty(); time += Milliseconds(10)) {
+    expired += wheel.expire(time).size();
+  }
+
+  EXPECT_EQ(count / 2, expired);
+
+  cout << "Expired " << expired << " timers in " << watch.elapsed() << endl;
+}
@@ -0,0 +1,353 @@
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <list>
+#include <vector>
+
+#include <process/process.hpp>
+#include <process/time.hpp>
+#include <process/timer.hpp>
+
+#include <stout/foreach.hpp>
+#include <stout/option.hpp>
+
+#include "timer_wheel.hpp"
+
+using std::list;
+using std::vector;
+
+namespace process {
+
+// Returns the index of the most significant bit that is set.
+static inline int msb(uint64_t x)
+{
+  CHECK_NE(x, 0u);
+  return 63 - __builtin_clzll(x);
+}
+
+
+// Returns the index of the least significant bit that is set.
+static inline int lsb(uint64_t x)
+{
+  CHECK_NE(x, 0u);
+  return __builtin_ctzll(x);
+}
+
+
+TimerWheel::Entry::Entry(const Timer& _timer, uint64_t _sequence)
+  : timer(_timer),
+    time(_timer.timeout().time()),
+    tick(TimerWheel::tick(time)),
+    sequence(_sequence),
+    level(-1),
+    slot(-1),
+    prev(NULL),
+    next(NULL) {}
+
+
+bool TimerWheel::Entry::compare(const Entry* left, const Entry* right)
+{
+  if (left->time != right->time) {
+    return left->time < right->time;
+  }
+  return left->sequence < right->sequence;
+}
+
+
+TimerWheel::TimerWheel()
+  : current(0),
+    sequence(0),
+    stale(false)
+{
+  for (int level = 0; level <= LEVELS; level++) {
+    for (int slot = 0; slot < SLOTS; slot++) {
+      slots[level][slot] = NULL;
+    }
+    occupied[level] = 0;
+  }
+}
+
+
+TimerWheel::~TimerWheel()
+{
+  foreachvalue (Entry* entry, entries) {
+    delete entry;
+  }
+}
+
+
+void TimerWheel::add(const Timer& timer)
+{
+  CHECK(!entries.contains(timer));
+
+  Entry* entry = new Entry(timer, sequence++);
+
+  // Restart an empty wheel at the timer if the timer is before the
+  // current tick or beyond the range of the wheel (e.g., when this is
+  // the first timer ever).
+  if (entries.empty() &&
+      (entry->tick < current ||
+       (entry->tick ^ current) >> (BITS * LEVELS) != 0)) {
+    current = entry->tick;
+  }
+
+  entries[timer] = entry;
+  insert(entry);
+
+  if (!stale && (earliest.isNone() || entry->time < earliest.get())) {
+    earliest = entry->time;
+  }
+}
+
+
+bool TimerWheel::cancel(const Timer& timer)
+{
+  Option<Entry*> entry = entries.get(timer);
+  if (entry.isNone()) {
+    return false;
+  }
+
+  unlink(entry.get());
+  entries.erase(timer);
+
+  if (earliest.isSome() && entry.get()->time == earliest.get()) {
+    stale = true;
+  }
+
+  delete entry.get();
+  return true;
+}
+
+
+list<Timer> TimerWheel::expire(const Time& now)
+{
+  if (entries.empty()) {
+    return list<Timer>();
+  }
+
+  const uint64_t tick = TimerWheel::tick(now);
+
+  stale = true;
+
+  vector<Entry*> expired;
+
+  // Time went backwards or jumps beyond the range of the wheel.
+  if (tick < current || (tick ^ current) >> (BITS * LEVELS) != 0) {
+    rebase(now, &expired);
+  } else {
+    advance(now, &expired);
+  }
+
+  // Entries are expired a slot at a time, so order them by their
+  // timeout to fire the timers in the same order as they would have
+  // without the wheel.
+  std::sort(expired.begin(), expired.end(), &Entry::compare);
+
+  list<Timer> timers;
+  foreach (Entry* entry, expired) {
+    timers.push_back(entry->timer);
+    entries.erase(entry->timer);
+    delete entry;
+  }
+
+  return timers;
+}
+
+
+void TimerWheel::advance(const Time& now, vector<Entry*>* expired)
+{
+  const uint64_t tick = TimerWheel::tick(now);
+
+  // Visit the occupied slots in order up to (and including) the slot
+  // of the current tick, the lowest occupied level has the earliest
+  // slot since each level only covers the range up to the next slot
+  // of the level above it.
+  while (true) {
+    int level = 0;
+    while (level < LEVELS && occupied[level] == 0) {
+      level++;
+    }
+
+    if (level == LEVELS) {
+      break;
+    }
+
+    const int slot = lsb(occupied[level]);
+    const uint64_t first = start(level, slot);
+
+    if (first > tick) {
+      break;
+    }
+
+    current = first;
+
+    Entry* entry = take(level, slot);
+    while (entry != NULL) {
+      Entry* next = entry->next;
+
+      if (level > 0) {
+        insert(entry); // Cascade into the lower levels.
+      } else if (entry->time <= now) {
+        expired->push_back(entry);
+      } else {
+        // Times out later within the current tick.
+        CHECK_EQ(first, tick);
+        insert(entry);
+      }
+
+      entry = next;
+    }
+
+    if (level == 0 && first == tick) {
+      break;
+    }
+  }
+
+  current = tick;
+}
+
+
+Option<Time> TimerWheel::next()
+{
+  if (!stale) {
+    return earliest;
+  }
+
+  stale = false;
+  earliest = None();
+
+  // All of the timers of the earliest occupied slot (see 'expire')
+  // time out before any of the timers in the other slots, unless the
+  // wheel is empty, in which case we check the overflow.
+  int level = 0;
+  while (level < LEVELS && occupied[level] == 0) {
+    level++;
+  }
+
+  if (level < LEVELS) {
+    for (Entry* entry = slots[level][lsb(occupied[level])];
+         entry != NULL;
+         entry = entry->next) {
+      if (earliest.isNone() || entry->time < earliest.get()) {
+        earliest = entry->time;
+      }
+    }
+  } else {
+    for (Entry* entry = slots[DISTANT][0];
+         entry != NULL;
+         entry = entry->next) {
+      if (earliest.isNone() || entry->time < earliest.get()) {
+        earliest = entry->time;
+      }
+    }
+  }
+
+  return earliest;
+}
+
+
+uint64_t TimerWheel::tick(const Time& time)
+{
+  return time.duration().ns() / Milliseconds(1).ns();
+}
+
+
+uint64_t TimerWheel::start(int level, int slot) const
+{
+  const int shift = BITS * level;
+  const uint64_t mask = (uint64_t(SLOTS) << shift) - 1;
+  return (current & ~mask) | (uint64_t(slot) << shift);
+}
+
+
+void TimerWheel::insert(Entry* entry)
+{
+  // Timers that have already timed out go into the current slot.
+  const uint64_t tick = std::max(entry->tick, current);
+
+  // The level is determined by the most significant bit in which the
+  // tick differs from the current tick. This guarantees that a slot
+  // of a level is visited before any slot of the levels above it.
+  const uint64_t difference = tick ^ current;
+  const int level = difference == 0 ? 0 : msb(difference) / BITS;
+
+  if (level >= LEVELS) {
+    entry->level = DISTANT;
+    entry->slot = 0;
+  } else {
+    entry->level = level;
+    entry->slot = (tick >> (BITS * level)) & (SLOTS - 1);
+  }
+
+  Entry*& head = slots[entry->level][entry->slot];
+
+  entry->prev = NULL;
+  entry->next = head;
+  if (head != NULL) {
+    head->prev = entry;
+  }
+  head = entry;
+
+  occupied[entry->level] |= uint64_t(1) << entry->slot;
+}
+
+
+void TimerWheel::unlink(Entry* entry)
+{
+  Entry*& head = slots[entry->level][entry->slot];
+
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  } else {
+    CHECK_EQ(head, entry);
+    head = entry->next;
+  }
+
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  }
+
+  if (head == NULL) {
+    occupied[entry->level] &= ~(uint64_t(1) << entry->slot);
+  }
+
+  entry->prev = NULL;
+  entry->next = NULL;
+}
+
+
+TimerWheel::Entry* TimerWheel::take(int level, int slot)
+{
+  Entry* head = slots[level][slot];
+  slots[level][slot] = NULL;
+  occupied[level] &= ~(uint64_t(1) << slot);
+  return head;
+}
+
+
+void TimerWheel::rebase(const Time& now, vector<Entry*>* expired)
+{
+  list<Entry*> pending;
+
+  for (int level = 0; level <= LEVELS; level++) {
+    while (occupied[level] != 0) {
+      Entry* entry = take(level, lsb(occupied[level]));
+      while (entry != NULL) {
+        pending.push_back(entry);
+        entry = entry->next;
+      }
+    }
+  }
+
+  current = tick(now);
+
+  foreach (Entry* entry, pending) {
+    if (entry->time <= now) {
+      expired->push_back(entry);
+    } else {
+      insert(entry);
+    }
+  }
+}
+
+} // namespace process {
@@ -0,0 +1,136 @@
+#ifndef __TIMER_WHEEL_HPP__
+#define __TIMER_WHEEL_HPP__
+
+#include <stdint.h>
+
+#include <list>
+#include <vector>
+
+#include <process/process.hpp>
+#include <process/time.hpp>
+#include <process/timer.hpp>
+
+#include <stout/hashmap.hpp>
+#include <stout/option.hpp>
+
+namespace process {
+
+// A hierarchical timing wheel for the pending timers. Timers are
+// bucketed by the millisecond (the "tick") that they time out in: a
+// timer that times out within the next 64 ticks goes into a slot of
+// the first level, within the next 64^2 ticks into a slot of the
+// second level, and so on. As time advances, the slots of the higher
+// levels are redistributed into the lower levels ("cascaded") until
+// their timers time out. Adding and canceling a timer are O(1) and
+// expiring timers only visits the occupied slots.
+//
+// Timers are expired based on their exact timeout (not the tick) so
+// that a timer never times out early. Timers that are further away
+// than the range of the wheel (about two years) are kept separately.
+//
+// NOTE: This class is not thread-safe.
+class TimerWheel
+{
+public:
+  TimerWheel();
+  ~TimerWheel();
+
+  void add(const Timer& timer);
+
+  // Removes the timer, returns false if it was not pending (i.e., it
+  // has already been expired or canceled).
+  bool cancel(const Timer& timer);
+
+  // Removes and returns all the timers that have timed out at 'now'.
+  std::list<Timer> expire(const Time& now);
+
+  // Returns the earliest timeout of the pending timers, if any.
+  Option<Time> next();
+
+  bool empty() const { return entries.empty(); }
+  size_t size() const { return entries.size(); }
+
+private:
+  // Number of bits of the tick used by each level and the resulting
+  // number of slots per level.
+  static const int BITS = 6;
+  static const int SLOTS = 1 << BITS;
+  static const int LEVELS = 6;
+
+  // Pseudo level for the timers beyond the range of the wheel.
+  static const int DISTANT = LEVELS;
+
+  struct Entry
+  {
+    Entry(const Timer& _timer, uint64_t _sequence);
+
+    // Orders entries by timeout and then by sequence.
+    static bool compare(const Entry* left, const Entry* right);
+
+    Timer timer;
+    Time time; // Cached 'timer.timeout().time()'.
+    uint64_t tick;
+
+    // Order in which the timer was added, used to expire timers with
+    // the same timeout in the order they were added.
+    uint64_t sequence;
+
+    // Location in the wheel.
+    int level;
+    int slot;
+
+    // Doubly linked list of the entries in a slot.
+    Entry* prev;
+    Entry* next;
+  };
+
+  // Non-copyable, non-assignable.
+  TimerWheel(const TimerWheel&);
+  TimerWheel& operator = (const TimerWheel&);
+
+  static uint64_t tick(const Time& time);
+
+  // Returns the first tick of the slot relative to the current tick.
+  uint64_t start(int level, int slot) const;
+
+  // Puts the entry into the slot for its tick relative to the
+  // current tick.
+  void insert(Entry* entry);
+
+  // Takes the entry out of its slot.
+  void unlink(Entry* entry);
+
+  // Takes all the entries out of the slot.
+  Entry* take(int level, int slot);
+
+  // Visits the slots up to 'now', cascading the entries of the higher
+  // levels and collecting the entries that have timed out.
+  void advance(const Time& now, std::vector<Entry*>* expired);
+
+  // Takes all the entries out of the wheel and puts them back
+  // relative to 'now', used when time jumps backwards or beyond the
+  // range of the wheel.
+  void rebase(const Time& now, std::vector<Entry*>* expired);
+
+  // Current tick, all the timers in the wheel are in the slots at or
+  // after the current tick.
+  uint64_t current;
+
+  Entry* slots[LEVELS + 1][SLOTS];
+
+  // Bitmap of the non-empty slots of each level.
+  uint64_t occupied[LEVELS + 1];
+
+  hashmap<Timer, Entry*> entries;
+
+  // Sequence number for the next added timer.
+  uint64_t sequence;
+
+  // Cached earliest timeout, recomputed when 'stale'.
+  Option<Time> earliest;
+  bool stale;
+};
+
+} // namespace process {
+
+#endif // __TIMER_WHEEL_HPP__
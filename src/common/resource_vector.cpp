@@ -0,0 +1,662 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+
+#include "common/lock.hpp"
+#include "common/resource_vector.hpp"
+
+using std::ostream;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace internal {
+
+typedef pair<uint64_t, uint64_t> Range;
+
+
+// The table of interned names and roles. It is shared by every
+// thread (e.g., the master and the allocator) hence the lock.
+struct Interned
+{
+  Interned()
+  {
+    pthread_mutex_init(&mutex, NULL);
+  }
+
+  pthread_mutex_t mutex;
+  hashmap<string, uint32_t> ids;
+  vector<string> strings;
+};
+
+
+static Interned* interned()
+{
+  // NOTE: This is intentionally leaked so that it remains valid
+  // during static destruction.
+  static Interned* singleton = new Interned();
+  return singleton;
+}
+
+
+uint32_t ResourceVector::intern(const string& s)
+{
+  Interned* table = interned();
+
+  Lock lock(&table->mutex);
+
+  hashmap<string, uint32_t>::const_iterator it = table->ids.find(s);
+  if (it != table->ids.end()) {
+    return it->second;
+  }
+
+  uint32_t id = table->strings.size();
+  table->strings.push_back(s);
+  table->ids[s] = id;
+  return id;
+}
+
+
+string ResourceVector::lookup(uint32_t id)
+{
+  Interned* table = interned();
+
+  Lock lock(&table->mutex);
+
+  CHECK_LT(id, table->strings.size());
+  return table->strings[id];
+}
+
+
+template <typename T>
+static bool compare(const T& left, const T& right)
+{
+  return left.key < right.key;
+}
+
+
+// Sorts and coalesces the ranges in place, dropping inverted ones.
+static void coalesce(vector<Range>* ranges)
+{
+  std::sort(ranges->begin(), ranges->end());
+
+  vector<Range> result;
+  foreach (const Range& range, *ranges) {
+    if (range.first > range.second) {
+      continue;
+    }
+
+    if (!result.empty() && range.first <= result.back().second + 1) {
+      result.back().second = std::max(result.back().second, range.second);
+    } else {
+      result.push_back(range);
+    }
+  }
+
+  ranges->swap(result);
+}
+
+
+// Returns the ranges in 'left' that are not in 'right', both of
+// which must be coalesced.
+static vector<Range> subtract(
+    const vector<Range>& left,
+    const vector<Range>& right)
+{
+  vector<Range> result;
+
+  size_t j = 0;
+  foreach (Range range, left) {
+    // Skip the ranges in right that end before this range begins.
+    while (j < right.size() && right[j].second < range.first) {
+      j++;
+    }
+
+    bool empty = false;
+    for (size_t k = j; k < right.size() && right[k].first <= range.second; k++) {
+      if (right[k].first > range.first) {
+        result.push_back(Range(range.first, right[k].first - 1));
+      }
+
+      if (right[k].second >= range.second) {
+        empty = true;
+        break;
+      }
+
+      range.first = right[k].second + 1;
+    }
+
+    if (!empty) {
+      result.push_back(range);
+    }
+  }
+
+  return result;
+}
+
+
+// Returns true if every range in 'left' is contained by a single
+// range in 'right', both of which must be coalesced.
+static bool contained(
+    const vector<Range>& left,
+    const vector<Range>& right)
+{
+  size_t j = 0;
+  foreach (const Range& range, left) {
+    while (j < right.size() && right[j].second < range.first) {
+      j++;
+    }
+
+    if (j == right.size() ||
+        right[j].first > range.first ||
+        right[j].second < range.second) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static void merge(ResourceVector::Scalar* left,
+                  const ResourceVector::Scalar& right)
+{
+  left->value += right.value;
+}
+
+
+static void merge(ResourceVector::Ranges* left,
+                  const ResourceVector::Ranges& right)
+{
+  left->ranges.insert(
+      left->ranges.end(), right.ranges.begin(), right.ranges.end());
+  coalesce(&left->ranges);
+}
+
+
+static void merge(ResourceVector::Set* left,
+                  const ResourceVector::Set& right)
+{
+  vector<string> result;
+  std::set_union(
+      left->items.begin(), left->items.end(),
+      right.items.begin(), right.items.end(),
+      std::back_inserter(result));
+  left->items.swap(result);
+}
+
+
+// Subtracts 'right' from 'left' and returns true if the result is zero.
+static bool remove(ResourceVector::Scalar* left,
+                   const ResourceVector::Scalar& right)
+{
+  left->value -= right.value;
+  return left->value == 0;
+}
+
+
+static bool remove(ResourceVector::Ranges* left,
+                   const ResourceVector::Ranges& right)
+{
+  left->ranges = subtract(left->ranges, right.ranges);
+  return left->ranges.empty();
+}
+
+
+static bool remove(ResourceVector::Set* left,
+                   const ResourceVector::Set& right)
+{
+  vector<string> result;
+  std::set_difference(
+      left->items.begin(), left->items.end(),
+      right.items.begin(), right.items.end(),
+      std::back_inserter(result));
+  left->items.swap(result);
+  return left->items.empty();
+}
+
+
+static bool equal(const ResourceVector::Scalar& left,
+                  const ResourceVector::Scalar& right)
+{
+  return left.value == right.value;
+}
+
+
+static bool equal(const ResourceVector::Ranges& left,
+                  const ResourceVector::Ranges& right)
+{
+  return left.ranges == right.ranges;
+}
+
+
+static bool equal(const ResourceVector::Set& left,
+                  const ResourceVector::Set& right)
+{
+  return left.items == right.items;
+}
+
+
+static bool subset(const ResourceVector::Scalar& left,
+                   const ResourceVector::Scalar& right)
+{
+  return left.value <= right.value;
+}
+
+
+static bool subset(const ResourceVector::Ranges& left,
+                   const ResourceVector::Ranges& right)
+{
+  return contained(left.ranges, right.ranges);
+}
+
+
+static bool subset(const ResourceVector::Set& left,
+                   const ResourceVector::Set& right)
+{
+  return std::includes(
+      right.items.begin(), right.items.end(),
+      left.items.begin(), left.items.end());
+}
+
+
+// Sorts the entries by key and combines entries with the same key.
+template <typename T>
+static void normalize(vector<T>* entries)
+{
+  std::stable_sort(entries->begin(), entries->end(), compare<T>);
+
+  vector<T> result;
+  foreach (const T& entry, *entries) {
+    if (!result.empty() && result.back().key == entry.key) {
+      merge(&result.back(), entry);
+    } else {
+      result.push_back(entry);
+    }
+  }
+
+  entries->swap(result);
+}
+
+
+// Adds the sorted 'right' entries to the sorted 'left' entries.
+template <typename T>
+static void add(vector<T>* left, const vector<T>& right)
+{
+  if (right.empty()) {
+    return;
+  }
+
+  vector<T> result;
+  result.reserve(left->size() + right.size());
+
+  typename vector<T>::const_iterator l = left->begin();
+  typename vector<T>::const_iterator r = right.begin();
+
+  while (l != left->end() || r != right.end()) {
+    if (r == right.end() || (l != left->end() && l->key < r->key)) {
+      result.push_back(*l++);
+    } else if (l == left->end() || r->key < l->key) {
+      result.push_back(*r++);
+    } else {
+      result.push_back(*l++);
+      merge(&result.back(), *r++);
+    }
+  }
+
+  left->swap(result);
+}
+
+
+// Subtracts the sorted 'right' entries from the sorted 'left'
+// entries, dropping the entries that become zero. Entries in 'right'
+// without a matching entry in 'left' are ignored.
+template <typename T>
+static void subtract(vector<T>* left, const vector<T>& right)
+{
+  if (right.empty()) {
+    return;
+  }
+
+  vector<T> result;
+  result.reserve(left->size());
+
+  typename vector<T>::const_iterator r = right.begin();
+
+  foreach (const T& entry, *left) {
+    while (r != right.end() && r->key < entry.key) {
+      ++r;
+    }
+
+    if (r != right.end() && r->key == entry.key) {
+      T difference = entry;
+      if (!remove(&difference, *r)) {
+        result.push_back(difference);
+      }
+    } else {
+      result.push_back(entry);
+    }
+  }
+
+  left->swap(result);
+}
+
+
+template <typename T>
+static bool equal(const vector<T>& left, const vector<T>& right)
+{
+  if (left.size() != right.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < left.size(); i++) {
+    if (!(left[i].key == right[i].key) || !equal(left[i], right[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+template <typename T>
+static bool subset(const vector<T>& left, const vector<T>& right)
+{
+  typename vector<T>::const_iterator r = right.begin();
+
+  foreach (const T& entry, left) {
+    while (r != right.end() && r->key < entry.key) {
+      ++r;
+    }
+
+    if (r == right.end() || !(r->key == entry.key) || !subset(entry, *r)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+template <typename T>
+static vector<T> extract(const vector<T>& entries, uint32_t role)
+{
+  vector<T> result;
+
+  foreach (const T& entry, entries) {
+    if (entry.key.role == role) {
+      result.push_back(entry);
+    }
+  }
+
+  return result;
+}
+
+
+ResourceVector::ResourceVector(const Resources& resources)
+{
+  foreach (const Resource& resource, resources) {
+    Key key(intern(resource.name()), intern(resource.role()), resource.type());
+
+    switch (resource.type()) {
+      case Value::SCALAR:
+        scalars.push_back(Scalar(key, resource.scalar().value()));
+        break;
+      case Value::RANGES: {
+        Ranges entry(key);
+        foreach (const Value::Range& range, resource.ranges().range()) {
+          entry.ranges.push_back(Range(range.begin(), range.end()));
+        }
+        coalesce(&entry.ranges);
+        ranges.push_back(entry);
+        break;
+      }
+      case Value::SET: {
+        Set entry(key);
+        foreach (const string& item, resource.set().item()) {
+          entry.items.push_back(item);
+        }
+        std::sort(entry.items.begin(), entry.items.end());
+        entry.items.erase(
+            std::unique(entry.items.begin(), entry.items.end()),
+            entry.items.end());
+        sets.push_back(entry);
+        break;
+      }
+      default:
+        LOG(FATAL) << "Unexpected Value type: " << resource.type();
+        break;
+    }
+  }
+
+  normalize(&scalars);
+  normalize(&ranges);
+  normalize(&sets);
+}
+
+
+Resources ResourceVector::resources() const
+{
+  Resources result;
+
+  foreach (const Scalar& entry, scalars) {
+    Resource resource;
+    resource.set_name(lookup(entry.key.name));
+    resource.set_role(lookup(entry.key.role));
+    resource.set_type(Value::SCALAR);
+    resource.mutable_scalar()->set_value(entry.value);
+    result += resource;
+  }
+
+  foreach (const Ranges& entry, ranges) {
+    Resource resource;
+    resource.set_name(lookup(entry.key.name));
+    resource.set_role(lookup(entry.key.role));
+    resource.set_type(Value::RANGES);
+    foreach (const Range& range, entry.ranges) {
+      Value::Range* r = resource.mutable_ranges()->add_range();
+      r->set_begin(range.first);
+      r->set_end(range.second);
+    }
+    result += resource;
+  }
+
+  foreach (const Set& entry, sets) {
+    Resource resource;
+    resource.set_name(lookup(entry.key.name));
+    resource.set_role(lookup(entry.key.role));
+    resource.set_type(Value::SET);
+    foreach (const string& item, entry.items) {
+      resource.mutable_set()->add_item(item);
+    }
+    result += resource;
+  }
+
+  return result;
+}
+
+
+ResourceVector ResourceVector::allocatable() const
+{
+  ResourceVector result;
+
+  foreach (const Scalar& entry, scalars) {
+    if (entry.value > 0) {
+      result.scalars.push_back(entry);
+    }
+  }
+
+  // Ranges and sets are kept coalesced and without empty entries
+  // so they are always allocatable.
+  result.ranges = ranges;
+  result.sets = sets;
+
+  return result;
+}
+
+
+ResourceVector ResourceVector::extract(const string& role) const
+{
+  return extract(intern(role));
+}
+
+
+ResourceVector ResourceVector::extract(uint32_t role) const
+{
+  ResourceVector result;
+  result.scalars = internal::extract(scalars, role);
+  result.ranges = internal::extract(ranges, role);
+  result.sets = internal::extract(sets, role);
+  return result;
+}
+
+
+bool ResourceVector::operator == (const ResourceVector& that) const
+{
+  return equal(scalars, that.scalars) &&
+    equal(ranges, that.ranges) &&
+    equal(sets, that.sets);
+}
+
+
+bool ResourceVector::operator != (const ResourceVector& that) const
+{
+  return !(*this == that);
+}
+
+
+bool ResourceVector::operator <= (const ResourceVector& that) const
+{
+  return subset(scalars, that.scalars) &&
+    subset(ranges, that.ranges) &&
+    subset(sets, that.sets);
+}
+
+
+ResourceVector ResourceVector::operator + (const ResourceVector& that) const
+{
+  ResourceVector result(*this);
+  result += that;
+  return result;
+}
+
+
+ResourceVector ResourceVector::operator - (const ResourceVector& that) const
+{
+  ResourceVector result(*this);
+  result -= that;
+  return result;
+}
+
+
+ResourceVector& ResourceVector::operator += (const ResourceVector& that)
+{
+  add(&scalars, that.scalars);
+  add(&ranges, that.ranges);
+  add(&sets, that.sets);
+  return *this;
+}
+
+
+ResourceVector& ResourceVector::operator -= (const ResourceVector& that)
+{
+  subtract(&scalars, that.scalars);
+  subtract(&ranges, that.ranges);
+  subtract(&sets, that.sets);
+  return *this;
+}
+
+
+Option<double> ResourceVector::scalar(uint32_t name) const
+{
+  double total = 0;
+  bool found = false;
+
+  foreach (const Scalar& entry, scalars) {
+    if (entry.key.name == name) {
+      total += entry.value;
+      found = true;
+    } else if (found) {
+      // Entries are sorted by name first.
+      break;
+    }
+  }
+
+  if (found) {
+    return total;
+  }
+
+  return None();
+}
+
+
+Option<double> ResourceVector::cpus() const
+{
+  static const uint32_t CPUS = intern("cpus");
+  return scalar(CPUS);
+}
+
+
+Option<Bytes> ResourceVector::mem() const
+{
+  static const uint32_t MEM = intern("mem");
+
+  Option<double> total = scalar(MEM);
+  if (total.isSome()) {
+    return Megabytes(static_cast<uint64_t>(total.get()));
+  }
+
+  return None();
+}
+
+
+Option<Bytes> ResourceVector::disk() const
+{
+  static const uint32_t DISK = intern("disk");
+
+  Option<double> total = scalar(DISK);
+  if (total.isSome()) {
+    return Megabytes(static_cast<uint64_t>(total.get()));
+  }
+
+  return None();
+}
+
+
+ostream& operator << (ostream& stream, const ResourceVector& resources)
+{
+  return stream << resources.resources();
+}
+
+} // namespace internal {
+} // namespace mesos {
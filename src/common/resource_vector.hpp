@@ -0,0 +1,179 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __COMMON_RESOURCE_VECTOR_HPP__
+#define __COMMON_RESOURCE_VECTOR_HPP__
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mesos/mesos.hpp>
+#include <mesos/resources.hpp>
+
+#include <stout/bytes.hpp>
+#include <stout/option.hpp>
+
+namespace mesos {
+namespace internal {
+
+// A compact, pre-parsed representation of a collection of resources
+// used for the arithmetic done by the master and the allocator. The
+// names and roles of the resources are interned so that matching two
+// resources is an integer comparison, the scalars are kept in a
+// contiguous array and ranges and sets are kept sorted (and ranges
+// coalesced) so that all operations are linear merges.
+//
+// The semantics of the operations are the same as for Resources (see
+// include/mesos/resources.hpp), this is purely an internal
+// representation: convert from Resources when receiving resources
+// and back to Resources only when they need to be put on the wire.
+//
+// NOTE: The order of the resources returned by 'resources()' is not
+// necessarily the order in which they were added.
+class ResourceVector
+{
+public:
+  // Identifies a resource by its interned name and role and type.
+  struct Key
+  {
+    Key() : name(0), role(0), type(Value::SCALAR) {}
+
+    Key(uint32_t _name, uint32_t _role, Value::Type _type)
+      : name(_name), role(_role), type(_type) {}
+
+    bool operator < (const Key& that) const
+    {
+      if (name != that.name) {
+        return name < that.name;
+      } else if (role != that.role) {
+        return role < that.role;
+      }
+      return type < that.type;
+    }
+
+    bool operator == (const Key& that) const
+    {
+      return name == that.name && role == that.role && type == that.type;
+    }
+
+    uint32_t name;
+    uint32_t role;
+    Value::Type type;
+  };
+
+  struct Scalar
+  {
+    Scalar(const Key& _key, double _value) : key(_key), value(_value) {}
+
+    Key key;
+    double value;
+  };
+
+  struct Ranges
+  {
+    explicit Ranges(const Key& _key) : key(_key) {}
+
+    Key key;
+
+    // Sorted and coalesced [begin, end] pairs.
+    std::vector<std::pair<uint64_t, uint64_t> > ranges;
+  };
+
+  struct Set
+  {
+    explicit Set(const Key& _key) : key(_key) {}
+
+    Key key;
+
+    // Sorted and without duplicates.
+    std::vector<std::string> items;
+  };
+
+  ResourceVector() {}
+
+  /*implicit*/ ResourceVector(const Resources& resources);
+
+  // Returns the interned identifier for the name or role, interning
+  // it if necessary. Interned strings are never released.
+  static uint32_t intern(const std::string& s);
+
+  // Returns the string for an identifier returned by 'intern'.
+  static std::string lookup(uint32_t id);
+
+  // Converts back to the protobuf representation.
+  Resources resources() const;
+
+  // Returns only the allocatable resources, see
+  // Resources::allocatable.
+  ResourceVector allocatable() const;
+
+  // Returns all resources that are marked with the specified role.
+  ResourceVector extract(const std::string& role) const;
+
+  // Same as above but for a role that has already been interned,
+  // which avoids taking the lock on the interned table (e.g., when
+  // extracting the same role from many slaves).
+  ResourceVector extract(uint32_t role) const;
+
+  bool empty() const
+  {
+    return scalars.empty() && ranges.empty() && sets.empty();
+  }
+
+  size_t size() const
+  {
+    return scalars.size() + ranges.size() + sets.size();
+  }
+
+  bool operator == (const ResourceVector& that) const;
+  bool operator != (const ResourceVector& that) const;
+  bool operator <= (const ResourceVector& that) const;
+
+  ResourceVector operator + (const ResourceVector& that) const;
+  ResourceVector operator - (const ResourceVector& that) const;
+  ResourceVector& operator += (const ResourceVector& that);
+  ResourceVector& operator -= (const ResourceVector& that);
+
+  // Helpers to get known resource types, see Resources::cpus.
+  Option<double> cpus() const;
+  Option<Bytes> mem() const;
+  Option<Bytes> disk() const;
+
+private:
+  // Returns the sum of all scalars with the given (interned) name,
+  // regardless of role.
+  Option<double> scalar(uint32_t name) const;
+
+  std::vector<Scalar> scalars;
+  std::vector<Ranges> ranges;
+  std::vector<Set> sets;
+};
+
+
+std::ostream& operator << (
+    std::ostream& stream,
+    const ResourceVector& resources);
+
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __COMMON_RESOURCE_VECTOR_HPP__
@@ -41,11 +41,20 @@
 # NOTE: 'update' does not have a fall back implementation and is
 # simply ignored if not implemented within the external containerizer
 # script.
+#
+# When started as 'daemon', this script serves all of the above
+# commands for all containers, receiving them as ExternalRequest
+# protobufs via stdin and answering each with an ExternalResponse
+# protobuf via stdout (see --containerizer_daemon). A 'wait' on an
+# executor launched by the daemon is only answered once the executor
+# has terminated. A 'usage' request without a container asks for the
+# usage of all of the containers of the ExternalUsage it carries.
 
 import os
 import subprocess
 import sys
 import struct
+import threading
 
 import multiprocessing
 import time
@@ -53,15 +62,21 @@ import time
 # Render a string describing how to use this script.
 def use(container, methods):
     out = "Usage: %s <command> <container-id>\n" % container
+    out += "       %s daemon\n" % container
     out += "Valid commands: " + ', '.join(methods.keys())
 
     return out
 
 
-# Read a data chunk prepended by its total size from stdin.
+# Read a data chunk prepended by its total size from stdin. Returns
+# None when stdin has been closed.
 def receive():
     # Read size (size_t = unsigned long long => 8 bytes).
-    size = struct.unpack('Q', sys.stdin.read(8))
+    data = sys.stdin.read(8)
+    if len(data) < 8:
+        return None
+
+    size = struct.unpack('Q', data)
     if size[0] <= 0:
         print >> sys.stderr, "Expected protobuf size over stdin. " \
                              "Received 0 bytes."
@@ -86,137 +101,206 @@ def send(data):
     os.write(1, data)
 
 
+# The executors launched by this instance, by container.
+executors = {}
+
+
 # Start a containerized executor.
-# Expects to receive an ExternalTask protobuf via stdin and will deliver
-# an ExternalStatus protobuf via stdout when successful.
-def launch(container, arguments):
-    try:
-        data = receive()
-        if len(data) == 0:
-            return 1
+# Expects an ExternalTask protobuf and delivers an ExternalStatus
+# protobuf when successful.
+def launch(container, data, environment, directory):
+    external = mesos_pb2.ExternalTask()
+    external.ParseFromString(data)
+
+    if external.task.HasField("executor"):
+        command = ["sh",
+                   "-c",
+                   external.task.executor.command.value]
+    else:
+        print >> sys.stderr, "No executor passed; using mesos_executor!"
+        command = [external.mesos_executor_path,
+                   "sh",
+                   "-c",
+                   external.task.command.value]
+
+    # Don't let the executor inherit our pipes, the slave would not
+    # notice the daemon terminating otherwise.
+    sandbox = directory or os.getcwd()
+    stdin = open(os.devnull)
+    stdout = open(os.path.join(sandbox, "stdout"), "a")
+    stderr = open(os.path.join(sandbox, "stderr"), "a")
+
+    proc = subprocess.Popen(command,
+                            env=environment,
+                            cwd=directory,
+                            stdin=stdin,
+                            stdout=stdout,
+                            stderr=stderr,
+                            close_fds=True)
+
+    for stream in [stdin, stdout, stderr]:
+        stream.close()
+
+    executors[container] = proc
+
+    status = mesos_pb2.ExternalStatus();
+    status.message = "test-containerizer reports on launch."
+    status.pid = proc.pid
+
+    return status.SerializeToString()
 
-        external = mesos_pb2.ExternalTask()
-        external.ParseFromString(data)
 
-        if external.task.HasField("executor"):
-            command = ["sh",
-                       "-c",
-                       external.task.executor.command.value]
-        else:
-            print >> sys.stderr, "No executor passed; using mesos_executor!"
-            command = [external.mesos_executor_path,
-                       "sh",
-                       "-c",
-                       external.task.command.value]
+# Update the container's resources.
+# Expects a ResourceArray protobuf and delivers an ExternalStatus
+# protobuf when successful.
+def update(container, data, environment, directory):
+    resources = mesos_pb2.ResourceArray()
+    resources.ParseFromString(data)
 
-        proc = subprocess.Popen(command, env=os.environ.copy())
+    print >> sys.stderr, "Received " + str(len(resources.resource)) \
+                       + " resource elements."
 
-        status = mesos_pb2.ExternalStatus();
-        status.message = "test-containerizer reports on launch."
-        status.pid = proc.pid
+    status = mesos_pb2.ExternalStatus();
+    status.message = "test-containerizer reports on update.";
 
-        send(status.SerializeToString());
+    return status.SerializeToString()
 
-    except google.protobuf.message.EncodeError:
-        print >> sys.stderr, "Could not serialise ExternalStatus protobuf."
-        return 1
 
-    except google.protobuf.message.DecodeError:
-        print >> sys.stderr, "Could not deserialise ExternalTask protobuf"
-        return 1
+# Cook up some fake resource usage statistics.
+def fake(statistics):
+    statistics.timestamp = time.time();
 
-    except OSError as e:
-        print >> sys.stderr, e.strerror
-        return 1
+    statistics.mem_rss_bytes = 1073741824;
+    statistics.mem_limit_bytes = 1073741824;
+    statistics.cpus_limit = 2;
+    statistics.cpus_user_time_secs = 0.12;
+    statistics.cpus_system_time_secs = 0.5;
 
-    except ValueError:
-        print >> sys.stderr, "Value is invalid"
-        return 1
 
-    return 0
+# Gather resource usage statistics for the containerized executor.
+# Delivers an ResourceStatistics protobuf when successful.
+# When the daemon gets asked for several containers at once, expects
+# and delivers an ExternalUsage protobuf instead.
+def usage(container, data, environment, directory):
+    if data:
+        external = mesos_pb2.ExternalUsage()
+        external.ParseFromString(data)
 
+        for entry in external.containers:
+            fake(entry.statistics)
 
-# Update the container's resources.
-# Expects to receive a ResourceArray protobuf via stdin and will
-# deliver an ExternalStatus protobuf via stdout when successful.
-def update(container, arguments):
-    try:
-        data = receive()
-        if len(data) == 0:
-            return 1
+        return external.SerializeToString()
 
-        resources = mesos_pb2.ResourceArray()
-        resources.ParseFromString(data)
+    statistics = mesos_pb2.ResourceStatistics();
+    fake(statistics)
 
-        print >> sys.stderr, "Received " + str(len(resources.resource)) \
-                           + " resource elements."
+    return statistics.SerializeToString()
+
+
+# Terminate the containerized executor.
+# A complete implementation would deliver an ExternalStatus protobuf
+# when succesful.
+def destroy(container, data, environment, directory):
+    return ""
+
+
+# Get the containerized executor's Termination.
+# A complete implementation would deliver a Termination protobuf
+# filled with the information gathered from launch's waitpid.
+def wait(container, data, environment, directory):
+    return ""
 
-        status = mesos_pb2.ExternalStatus();
-        status.message = "test-containerizer reports on update.";
 
-        send(status.SerializeToString());
+# Run a command, returning its result and an error message if it
+# failed.
+def invoke(method, container, data, environment, directory):
+    try:
+        return method(container, data, environment, directory), None
 
     except google.protobuf.message.EncodeError:
-        print >> sys.stderr, "Could not serialise ExternalStatus protobuf."
-        return 1
+        return None, "Could not serialise result protobuf."
 
     except google.protobuf.message.DecodeError:
-        print >> sys.stderr, "Could not deserialise ResourceArray protobuf."
-        return 1
+        return None, "Could not deserialise input protobuf."
 
     except OSError as e:
-        print >> sys.stderr, e.strerror
-        return 1
+        return None, e.strerror
 
     except ValueError:
-        print >> sys.stderr, "Value is invalid"
-        return 1
-
-    return 0
+        return None, "Value is invalid"
 
 
-# Gather resource usage statistics for the containerized executor.
-# Delivers an ResourceStatistics protobut via stdout when
-# successful.
-def usage(container, arguments):
-    try:
-        statistics = mesos_pb2.ResourceStatistics();
+# Answer a 'wait' request of the daemon with the Termination of the
+# executor once it has terminated.
+def terminated(request, executor, lock):
+    executor.wait()
 
-        statistics.timestamp = time.time();
+    termination = containerizer_pb2.Termination()
+    termination.killed = False
+    termination.message = "test-containerizer reports on wait."
 
-        # Cook up some fake data.
-        statistics.mem_rss_bytes = 1073741824;
-        statistics.mem_limit_bytes = 1073741824;
-        statistics.cpus_limit = 2;
-        statistics.cpus_user_time_secs = 0.12;
-        statistics.cpus_system_time_secs = 0.5;
+    # Deliver a waitpid-result, just like the slave's reaper does.
+    if executor.returncode < 0:
+        termination.status = -executor.returncode
+    else:
+        termination.status = executor.returncode << 8
 
-        send(statistics.SerializeToString());
+    response = mesos_pb2.ExternalResponse()
+    response.id = request.id
+    response.data = termination.SerializeToString()
 
-    except google.protobuf.message.EncodeError:
-        print >> sys.stderr, "Could not serialise ResourceStatistics protobuf."
-        return 1
-
-    except OSError as e:
-        print >> sys.stderr, e.strerror
-        return 1
+    with lock:
+        send(response.SerializeToString())
 
-    return 0
 
+# Serve the commands for all containers until stdin gets closed.
+def daemon(methods):
+    # Responses to 'wait' get sent from their own threads.
+    lock = threading.Lock()
 
-# Terminate the containerized executor.
-# A complete implementation would deliver an ExternalStatus protobuf
-# when succesful.
-def destroy(container, arguments):
-    return 0
+    while True:
+        data = receive()
+        if data is None:
+            return 0
+
+        request = mesos_pb2.ExternalRequest()
+        request.ParseFromString(data)
+
+        response = mesos_pb2.ExternalResponse()
+        response.id = request.id
+
+        environment = dict((variable.name, variable.value)
+                           for variable in request.environment.variables)
+
+        # Keep waiting on the executors launched by this instance of
+        # the daemon, the slave falls back to reaping all others (e.g.,
+        # after the daemon got restarted).
+        if request.command == "wait" and \
+           request.container_id.value in executors:
+            thread = threading.Thread(
+                target=terminated,
+                args=(request,
+                      executors.pop(request.container_id.value),
+                      lock))
+            thread.daemon = True
+            thread.start()
+            continue
+
+        if request.command not in methods:
+            response.error = "Unknown command '%s'" % request.command
+        else:
+            result, error = invoke(methods[request.command],
+                                   request.container_id.value,
+                                   request.data,
+                                   environment,
+                                   request.directory)
+            if error is not None:
+                response.error = error
+            else:
+                response.data = result
 
-
-# Get the containerized executor's Termination.
-# A complete implementation would deliver a Termination protobuf
-# filled with the information gathered from launch's waitpid via
-# stdout.
-def wait(container, arguments):
-    return 0
+        with lock:
+            send(response.SerializeToString())
 
 
 if __name__ == "__main__":
@@ -230,6 +314,14 @@ if __name__ == "__main__":
         print use(sys.argv[0], methods)
         sys.exit(0)
 
+    import mesos
+    import mesos_pb2
+    import containerizer_pb2
+    import google
+
+    if sys.argv[1:2] == ["daemon"]:
+        sys.exit(daemon(methods))
+
     if len(sys.argv) < 3:
         print >> sys.stderr, "Please pass a command and a container-id"
         print >> sys.stderr, use(sys.argv[0], methods)
@@ -241,10 +333,24 @@ if __name__ == "__main__":
         print >> sys.stderr, use(sys.argv[0], methods)
         sys.exit(2)
 
-    method = methods.get(command)
+    # Only 'launch' and 'update' receive a protobuf via stdin.
+    data = ""
+    if command in ["launch", "update"]:
+        data = receive()
+        if not data:
+            sys.exit(1)
 
-    import mesos
-    import mesos_pb2
-    import google
+    result, error = invoke(methods.get(command),
+                           sys.argv[2],
+                           data,
+                           os.environ.copy(),
+                           None)
+
+    if error is not None:
+        print >> sys.stderr, error
+        sys.exit(1)
+
+    if len(result) > 0:
+        send(result)
 
-    sys.exit(method(sys.argv[2], sys.argv[3:]))
+    sys.exit(0)
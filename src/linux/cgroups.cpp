@@ -17,10 +17,12 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <fts.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <sys/syscall.h>
@@ -2033,6 +2035,125 @@ Try<hashmap<string, uint64_t> > stat(
 }
 
 
+Try<Control*> Control::create(
+    const string& hierarchy,
+    const string& cgroup,
+    const string& control)
+{
+  Option<Error> error = verify(hierarchy, cgroup, control);
+  if (error.isSome()) {
+    return error.get();
+  }
+
+  const string& path = path::join(hierarchy, cgroup, control);
+
+  Try<int> fd = os::open(path, O_RDONLY);
+  if (fd.isError()) {
+    return Error("Failed to open '" + path + "': " + fd.error());
+  }
+
+  Try<Nothing> cloexec = os::cloexec(fd.get());
+  if (cloexec.isError()) {
+    os::close(fd.get());
+    return Error("Failed to cloexec '" + path + "': " + cloexec.error());
+  }
+
+  return new Control(path, fd.get());
+}
+
+
+Control::Control(const string& _path, int _fd)
+  : path(_path), fd(_fd) {}
+
+
+Control::~Control()
+{
+  os::close(fd);
+}
+
+
+Try<string> Control::read() const
+{
+  // NOTE: Control files are generated when read and report a size of
+  // zero (or one page) so we read until we hit the end of the file.
+  // Reading from offset zero (rather than seeking back) lets the
+  // kernel regenerate the contents on each read.
+  string result;
+  char buffer[4096];
+  off_t offset = 0;
+
+  while (true) {
+    ssize_t length = ::pread(fd, buffer, sizeof(buffer), offset);
+    if (length < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return ErrnoError("Failed to read '" + path + "'");
+    } else if (length == 0) {
+      break;
+    }
+
+    result.append(buffer, length);
+    offset += length;
+  }
+
+  return result;
+}
+
+
+Try<vector<Option<uint64_t> > > Control::stat(
+    const vector<string>& names) const
+{
+  Try<string> contents = read();
+  if (contents.isError()) {
+    return Error(contents.error());
+  }
+
+  vector<Option<uint64_t> > result(names.size());
+
+  const char* begin = contents.get().data();
+  const char* end = begin + contents.get().size();
+
+  while (begin < end) {
+    const char* newline = (const char*) ::memchr(begin, '\n', end - begin);
+    const char* eol = newline != NULL ? newline : end;
+
+    // Expected line format: "%s %llu".
+    const char* space = (const char*) ::memchr(begin, ' ', eol - begin);
+
+    if (space != NULL) {
+      const size_t length = space - begin;
+
+      for (size_t i = 0; i < names.size(); i++) {
+        if (names[i].size() == length &&
+            ::memcmp(names[i].data(), begin, length) == 0) {
+          // NOTE: 'strtoull' stops at the newline (or the terminating
+          // NULL of the contents).
+          char* last = NULL;
+          errno = 0;
+          unsigned long long value = ::strtoull(space + 1, &last, 10);
+
+          if (errno != 0 || last == space + 1) {
+            return Error("Unexpected line format in '" + path + "': " +
+                         string(begin, eol - begin));
+          }
+
+          result[i] = value;
+          break;
+        }
+      }
+    } else if (strings::trim(string(begin, eol - begin)) != "") {
+      return Error("Unexpected line format in '" + path + "': " +
+                   string(begin, eol - begin));
+    }
+
+    begin = eol + 1;
+  }
+
+  return result;
+}
+
+
 namespace cpu {
 
 Try<Nothing> shares(
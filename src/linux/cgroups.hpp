@@ -424,6 +424,50 @@ Try<hashmap<std::string, uint64_t> > stat(
     const std::string& file);
 
 
+// A handle on a control file of a cgroup which keeps the file open
+// so that it can be read repeatedly (e.g., when periodically
+// collecting resource statistics) without verifying the hierarchy
+// and opening the file each time.
+// NOTE: The handle becomes stale once the cgroup is removed.
+class Control
+{
+public:
+  // Verifies the hierarchy, the cgroup and the control and opens the
+  // control file for reading.
+  // @param   hierarchy   Path to the hierarchy root.
+  // @param   cgroup      Path to the cgroup relative to the hierarchy root.
+  // @param   control     Name of the control file (Ex: "memory.stat").
+  // @return  The handle on the control file.
+  //          Error if the control file cannot be opened.
+  static Try<Control*> create(
+      const std::string& hierarchy,
+      const std::string& cgroup,
+      const std::string& control);
+
+  ~Control();
+
+  // Reads the whole control file from the beginning.
+  Try<std::string> read() const;
+
+  // Reads the control file as a stat file (see 'stat' above) and
+  // returns the values of the given names, in the same order, where
+  // none means that the stat file didn't contain the name. Unlike
+  // 'stat' this only parses the requested entries.
+  Try<std::vector<Option<uint64_t> > > stat(
+      const std::vector<std::string>& names) const;
+
+private:
+  Control(const std::string& path, int fd);
+
+  // Not copyable, not assignable.
+  Control(const Control&);
+  Control& operator = (const Control&);
+
+  const std::string path;
+  const int fd;
+};
+
+
 // Cpu controls.
 namespace cpu {
 
@@ -18,14 +18,23 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <list>
 
 #include <process/collect.hpp>
 #include <process/id.hpp>
+#include <process/limiter.hpp>
+#include <process/owned.hpp>
 #include <process/process.hpp>
 #include <process/timer.hpp>
 
+#include <process/metrics/counter.hpp>
+#include <process/metrics/metrics.hpp>
+
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
 #include <stout/lambda.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/stringify.hpp>
 
 #include "log/catchup.hpp"
@@ -167,10 +176,39 @@ static Future<uint64_t> catchup(
 }
 
 
-// TODO(jieyu): Our current implementation catches-up each position in
-// the set sequentially. In the future, we may want to parallelize it
-// to improve the performance. Also, we may want to implement rate
-// control here so that we don't saturate the network or disk.
+// Metrics of the catch-up operations of this process, which can be
+// used to track the progress of recovering a replica.
+struct Metrics
+{
+  Metrics()
+    : positions_remaining("log/catchup/positions_remaining"),
+      positions_caught_up("log/catchup/positions_caught_up")
+  {
+    process::metrics::add(positions_remaining);
+    process::metrics::add(positions_caught_up);
+  }
+
+  // Number of positions the ongoing catch-ups have yet to catch-up.
+  process::metrics::Counter positions_remaining;
+
+  // Total number of positions caught up, the rate of catching up can
+  // be derived by sampling it.
+  process::metrics::Counter positions_caught_up;
+};
+
+
+static Metrics* metrics()
+{
+  static Metrics* metrics = new Metrics();
+  return metrics;
+}
+
+
+// Catches-up a set of positions, running at most 'concurrency' single
+// position catch-ups at a time. If a 'rate' is specified, at most
+// that many catch-ups are started each second so that catching up a
+// replica that is far behind doesn't saturate the network or the
+// disks of the other replicas.
 class BulkCatchUpProcess : public Process<BulkCatchUpProcess>
 {
 public:
@@ -179,15 +217,28 @@ public:
       const Shared<Replica>& _replica,
       const Shared<Network>& _network,
       uint64_t _proposal,
-      const Interval<uint64_t>& _positions,
-      const Duration& _timeout)
+      const IntervalSet<uint64_t>& _positions,
+      const Duration& _timeout,
+      size_t _concurrency,
+      const Option<size_t>& _rate)
     : ProcessBase(ID::generate("log-bulk-catch-up")),
       quorum(_quorum),
       replica(_replica),
       network(_network),
-      positions(_positions),
       timeout(_timeout),
-      proposal(_proposal) {}
+      concurrency(_concurrency),
+      proposal(_proposal),
+      positions(_positions),
+      total(_positions.size()),
+      remaining(_positions.size()),
+      acquiring(false)
+  {
+    CHECK_GT(concurrency, 0u);
+
+    if (_rate.isSome()) {
+      limiter = Owned<RateLimiter>(new RateLimiter(_rate.get(), Seconds(1)));
+    }
+  }
 
   virtual ~BulkCatchUpProcess() {}
 
@@ -200,17 +251,24 @@ protected:
     promise.future().onDiscard(lambda::bind(
         static_cast<void(*)(const UPID&, bool)>(terminate), self(), true));
 
-    // Catch-up sequentially.
-    current = positions.lower();
+    metrics()->positions_remaining += remaining;
+
+    stopwatch.start();
 
     catchup();
   }
 
   virtual void finalize()
   {
-    catching.discard();
+    foreachvalue (Future<uint64_t> catching, catchings) {
+      catching.discard();
+    }
+
+    // Account for the positions that were not caught up (e.g., due
+    // to a failure).
+    metrics()->positions_remaining -= remaining;
 
-    // TODO(benh): Discard our promise only after 'catching' has
+    // TODO(benh): Discard our promise only after 'catchings' have
     // completed (ready, failed, or discarded).
     promise.discard();
   }
@@ -221,54 +279,110 @@ private:
     catching.discard();
   }
 
+  // Starts catching-up more positions, if allowed.
   void catchup()
   {
-    if (current >= positions.upper()) {
+    if (positions.empty() && catchings.empty()) {
       // Stop the process if there is nothing left to catch-up. This
-      // also handles the case where the input interval is empty.
+      // also handles the case where the input set is empty.
       promise.set(Nothing());
       terminate(self());
       return;
     }
 
-    // Store the future so that we can discard it if the user wants to
-    // cancel the catch-up operation.
-    catching = log::catchup(quorum, replica, network, proposal, current)
-      .onDiscarded(defer(self(), &Self::discarded))
-      .onFailed(defer(self(), &Self::failed))
-      .onReady(defer(self(), &Self::succeeded));
-
-    Timer::create(timeout, lambda::bind(&Self::timedout, catching));
+    while (!acquiring &&
+           !positions.empty() &&
+           catchings.size() < concurrency) {
+      if (limiter.get() != NULL) {
+        acquiring = true;
+        limiter->acquire()
+          .onReady(defer(self(), &Self::acquired));
+        return;
+      }
+
+      catchup(next());
+    }
   }
 
-
-  void discarded()
+  void acquired()
   {
-    LOG(INFO) << "Unable to catch-up position " << current
-              << " in " << timeout << ", retrying";
+    CHECK(acquiring);
+    acquiring = false;
 
+    catchup(next());
     catchup();
   }
 
-  void failed()
+  // Removes and returns the lowest position left to catch-up.
+  uint64_t next()
+  {
+    CHECK(!positions.empty());
+
+    uint64_t position = positions.begin()->lower();
+    positions -= position;
+    return position;
+  }
+
+  // Catches-up a single position.
+  void catchup(uint64_t position)
   {
-    promise.fail(
-        "Failed to catch-up position " + stringify(current) +
-        ": " + catching.failure());
+    // Store the future so that we can discard it if the user wants to
+    // cancel the catch-up operation.
+    Future<uint64_t> catching =
+      log::catchup(quorum, replica, network, proposal, position);
 
-    terminate(self());
+    catchings[position] = catching;
+
+    catching.onAny(defer(self(), &Self::finished, position));
+
+    Timer::create(timeout, lambda::bind(&Self::timedout, catching));
   }
 
-  void succeeded()
+  void finished(uint64_t position)
   {
-    ++current;
+    CHECK(catchings.contains(position));
+
+    const Future<uint64_t> catching = catchings[position];
+    catchings.erase(position);
+
+    if (catching.isDiscarded()) {
+      LOG(INFO) << "Unable to catch-up position " << position
+                << " in " << timeout << ", retrying";
+
+      // Retry once the position is started again, which (like the
+      // first attempt) counts against the rate limit, if any.
+      positions += position;
+      catchup();
+      return;
+    } else if (catching.isFailed()) {
+      promise.fail(
+          "Failed to catch-up position " + stringify(position) +
+          ": " + catching.failure());
+
+      terminate(self());
+      return;
+    }
 
     // The single position catch-up function: 'log::catchup' will
     // return the highest proposal number seen so far. We use this
     // proposal number for the next 'catchup' as it is highly likely
     // that this number is high enough, saving potentially unnecessary
     // proposal number bumps.
-    proposal = catching.get();
+    proposal = std::max(proposal, catching.get());
+
+    remaining--;
+
+    --metrics()->positions_remaining;
+    ++metrics()->positions_caught_up;
+
+    if (remaining == 0 || (total - remaining) % 1000 == 0) {
+      Duration elapsed = stopwatch.elapsed();
+
+      LOG(INFO) << "Caught up " << total - remaining << " of " << total
+                << " positions in " << elapsed << " ("
+                << (total - remaining) / std::max(elapsed.secs(), 1e-6)
+                << " positions/sec)";
+    }
 
     catchup();
   }
@@ -276,24 +390,43 @@ private:
   const size_t quorum;
   const Shared<Replica> replica;
   const Shared<Network> network;
-  const Interval<uint64_t> positions;
   const Duration timeout;
+  const size_t concurrency;
 
   uint64_t proposal;
-  uint64_t current;
+
+  // The positions that have yet to be started.
+  IntervalSet<uint64_t> positions;
+
+  const size_t total;
+  size_t remaining; // Not yet caught up, including the ongoing ones.
+
+  // Rate limits starting single position catch-ups (if requested),
+  // 'acquiring' is true while waiting for a permit.
+  Owned<RateLimiter> limiter;
+  bool acquiring;
+
+  Stopwatch stopwatch;
 
   process::Promise<Nothing> promise;
-  Future<uint64_t> catching;
+  hashmap<uint64_t, Future<uint64_t> > catchings;
 };
 
 
-static Future<Nothing> catchup(
+/////////////////////////////////////////////////
+// Public interfaces below.
+/////////////////////////////////////////////////
+
+
+Future<Nothing> catchup(
     size_t quorum,
     const Shared<Replica>& replica,
     const Shared<Network>& network,
     const Option<uint64_t>& proposal,
-    const Interval<uint64_t>& positions,
-    const Duration& timeout)
+    const IntervalSet<uint64_t>& positions,
+    const Duration& timeout,
+    size_t concurrency,
+    const Option<size_t>& rate)
 {
   BulkCatchUpProcess* process =
     new BulkCatchUpProcess(
@@ -302,53 +435,15 @@ static Future<Nothing> catchup(
         network,
         proposal.get(0),
         positions,
-        timeout);
+        timeout,
+        concurrency,
+        rate);
 
   Future<Nothing> future = process->future();
   spawn(process, true);
   return future;
 }
 
-
-/////////////////////////////////////////////////
-// Public interfaces below.
-/////////////////////////////////////////////////
-
-
-Future<Nothing> catchup(
-    size_t quorum,
-    const Shared<Replica>& replica,
-    const Shared<Network>& network,
-    const Option<uint64_t>& proposal,
-    const IntervalSet<uint64_t>& positions,
-    const Duration& timeout)
-{
-  // Necessary to disambiguate overloaded functions.
-  Future<Nothing> (*f)(
-      size_t quorum,
-      const Shared<Replica>& replica,
-      const Shared<Network>& network,
-      const Option<uint64_t>& proposal,
-      const Interval<uint64_t>& positions,
-      const Duration& timeout) = &catchup;
-
-  Future<Nothing> future = Nothing();
-
-  foreach (const Interval<uint64_t>& interval, positions) {
-    future = future.then(
-        lambda::bind(
-            f,
-            quorum,
-            replica,
-            network,
-            proposal,
-            interval,
-            timeout));
-  }
-
-  return future;
-}
-
 } // namespace log {
 } // namespace internal {
 } // namespace mesos {
@@ -26,6 +26,7 @@
 
 #include <stout/duration.hpp>
 #include <stout/interval.hpp>
+#include <stout/none.hpp>
 #include <stout/nothing.hpp>
 #include <stout/option.hpp>
 
@@ -36,6 +37,10 @@ namespace mesos {
 namespace internal {
 namespace log {
 
+// The default number of positions that are caught up concurrently.
+const size_t DEFAULT_CATCHUP_CONCURRENCY = 16;
+
+
 // Catches-up a set of log positions in the local replica. The user of
 // this function can provide a hint on the proposal number that will
 // be used for Paxos. This could potentially save us a few Paxos
@@ -43,14 +48,18 @@ namespace log {
 // use, he can just use none. We also allow the user to specify a
 // timeout for the catch-up operation on each position and retry the
 // operation if timeout happens. This can help us tolerate network
-// blips.
+// blips. Up to 'concurrency' positions are caught up at a time and,
+// if a 'rate' is specified, at most 'rate' positions are started per
+// second so that catching up doesn't saturate the network or disks.
 extern process::Future<Nothing> catchup(
     size_t quorum,
     const process::Shared<Replica>& replica,
     const process::Shared<Network>& network,
     const Option<uint64_t>& proposal,
     const IntervalSet<uint64_t>& positions,
-    const Duration& timeout = Seconds(10));
+    const Duration& timeout = Seconds(10),
+    size_t concurrency = DEFAULT_CATCHUP_CONCURRENCY,
+    const Option<size_t>& rate = None());
 
 } // namespace log {
 } // namespace internal {
@@ -19,12 +19,15 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <deque>
 
 #include <process/defer.hpp>
 #include <process/dispatch.hpp>
 #include <process/id.hpp>
+#include <process/owned.hpp>
 #include <process/process.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/none.hpp>
 
 #include "common/type_utils.hpp"
@@ -37,12 +40,19 @@
 
 using namespace process;
 
+using std::deque;
 using std::string;
 
 namespace mesos {
 namespace internal {
 namespace log {
 
+// The maximum number of writes (appends and truncates) that a
+// coordinator runs concurrently, any more get queued until earlier
+// writes complete.
+static const size_t MAX_CONCURRENT_WRITES = 32;
+
+
 class CoordinatorProcess : public Process<CoordinatorProcess>
 {
 public:
@@ -56,7 +66,8 @@ public:
       network(_network),
       state(INITIAL),
       proposal(0),
-      index(0) {}
+      index(0),
+      issued(0) {}
 
   virtual ~CoordinatorProcess() {}
 
@@ -70,7 +81,15 @@ protected:
   virtual void finalize()
   {
     electing.discard();
-    writing.discard();
+
+    foreach (const Write& write, writes) {
+      if (write.writing.isSome()) {
+        Future<Option<uint64_t> > writing = write.writing.get();
+        writing.discard();
+      }
+      write.promise->discard();
+    }
+    writes.clear();
   }
 
 private:
@@ -94,16 +113,19 @@ private:
   /////////////////////////////////
 
   Future<Option<uint64_t> > write(const Action& action);
+  void issueWrites();
   Future<WriteResponse> runWritePhase(const Action& action);
   Future<Option<uint64_t> > checkWritePhase(
       const Action& action,
       const WriteResponse& response);
   Future<Nothing> runLearnPhase(const Action& action);
   Future<bool> checkLearnPhase(const Action& action);
-  Future<Option<uint64_t> > updateIndexAfterWritten(bool missing);
+  Future<Option<uint64_t> > getWrittenPosition(
+      const Action& action,
+      bool missing);
   void writingFinished();
-  void writingFailed();
-  void writingAborted();
+  void discardWriting(uint64_t position);
+  void demoteAfterWriting(const Future<Option<uint64_t> >& result);
 
   const size_t quorum;
   const Shared<Replica> replica;
@@ -131,7 +153,22 @@ private:
   uint64_t index;
 
   Future<Option<uint64_t> > electing;
-  Future<Option<uint64_t> > writing;
+
+  // A write (i.e., an append or a truncate) at a position. Writes
+  // are issued in the order of their positions (at most
+  // MAX_CONCURRENT_WRITES at a time) and complete in that order so
+  // that a write only succeeds once all the preceding writes have.
+  struct Write
+  {
+    Action action;
+    Owned<process::Promise<Option<uint64_t> > > promise;
+    Option<Future<Option<uint64_t> > > writing; // None until issued.
+  };
+
+  // The writes that have not yet completed, the first 'issued' of
+  // which are being written.
+  deque<Write> writes;
+  size_t issued;
 };
 
 
@@ -298,12 +335,10 @@ Future<Option<uint64_t> > CoordinatorProcess::append(const string& bytes)
 {
   if (state == INITIAL || state == ELECTING) {
     return None();
-  } else if (state == WRITING) {
-    return Failure("Coordinator is currently writing");
   }
 
   Action action;
-  action.set_position(index);
+  action.set_position(index++);
   action.set_promised(proposal);
   action.set_performed(proposal);
   action.set_type(Action::APPEND);
@@ -318,12 +353,10 @@ Future<Option<uint64_t> > CoordinatorProcess::truncate(uint64_t to)
 {
   if (state == INITIAL || state == ELECTING) {
     return None();
-  } else if (state == WRITING) {
-    return Failure("Coordinator is currently writing");
   }
 
   Action action;
-  action.set_position(index);
+  action.set_position(index++);
   action.set_promised(proposal);
   action.set_performed(proposal);
   action.set_type(Action::TRUNCATE);
@@ -339,18 +372,46 @@ Future<Option<uint64_t> > CoordinatorProcess::write(const Action& action)
   LOG(INFO) << "Coordinator attempting to write " << action.type()
             << " action at position " << action.position();
 
-  CHECK_EQ(state, ELECTED);
+  CHECK(state == ELECTED || state == WRITING);
   CHECK(action.has_performed() && action.has_type());
 
   state = WRITING;
 
-  writing = runWritePhase(action)
-    .then(defer(self(), &Self::checkWritePhase, action, lambda::_1))
-    .onReady(defer(self(), &Self::writingFinished))
-    .onFailed(defer(self(), &Self::writingFailed))
-    .onDiscarded(defer(self(), &Self::writingAborted));
+  Write write;
+  write.action = action;
+  write.promise = Owned<process::Promise<Option<uint64_t> > >(
+      new process::Promise<Option<uint64_t> >());
+
+  writes.push_back(write);
+
+  write.promise->future()
+    .onDiscard(defer(self(), &Self::discardWriting, action.position()));
+
+  issueWrites();
+
+  return write.promise->future();
+}
+
 
-  return writing;
+void CoordinatorProcess::issueWrites()
+{
+  // Since the positions are assigned when the writes are queued we
+  // don't need to wait for the preceding writes to complete before
+  // issuing the next ones (each position is agreed on separately).
+  while (issued < writes.size() && issued < MAX_CONCURRENT_WRITES) {
+    Write& write = writes[issued++];
+
+    // Skip the writes that were discarded before being issued.
+    if (write.writing.isSome()) {
+      continue;
+    }
+
+    write.writing = runWritePhase(write.action)
+      .then(defer(self(), &Self::checkWritePhase, write.action, lambda::_1));
+
+    write.writing.get()
+      .onAny(defer(self(), &Self::writingFinished));
+  }
 }
 
 
@@ -374,7 +435,7 @@ Future<Option<uint64_t> > CoordinatorProcess::checkWritePhase(
 
   return runLearnPhase(action)
     .then(defer(self(), &Self::checkLearnPhase, action))
-    .then(defer(self(), &Self::updateIndexAfterWritten, lambda::_1));
+    .then(defer(self(), &Self::getWrittenPosition, action, lambda::_1));
 }
 
 
@@ -393,39 +454,105 @@ Future<bool> CoordinatorProcess::checkLearnPhase(const Action& action)
 }
 
 
-Future<Option<uint64_t> > CoordinatorProcess::updateIndexAfterWritten(
+Future<Option<uint64_t> > CoordinatorProcess::getWrittenPosition(
+    const Action& action,
     bool missing)
 {
   CHECK(!missing) << "Not expecting local replica to be missing position "
-                  << index << " after the writing is done";
+                  << action.position() << " after the writing is done";
 
-  return index++;
+  return action.position();
 }
 
 
 void CoordinatorProcess::writingFinished()
 {
-  CHECK_EQ(state, WRITING);
-  state = ELECTED;
+  // Complete the writes in order, a write that finishes before the
+  // preceding writes waits for them.
+  while (!writes.empty() &&
+         writes.front().writing.isSome() &&
+         !writes.front().writing.get().isPending()) {
+    const Future<Option<uint64_t> > writing = writes.front().writing.get();
+
+    if (!writing.isReady() || writing.get().isNone()) {
+      // The write failed or was NACKed, and we don't know whether it
+      // was written so we need to be elected again in order to
+      // "catch-up" the position before doing another write.
+      demoteAfterWriting(writing);
+      return;
+    }
+
+    writes.front().promise->set(writing.get());
+    writes.pop_front();
+    issued--;
+  }
+
+  // NOTE: The writes discarded when demoting still finish later, in
+  // which case there's nothing left to do.
+  if (state == WRITING) {
+    if (writes.empty()) {
+      state = ELECTED;
+    } else {
+      issueWrites();
+    }
+  }
 }
 
 
-void CoordinatorProcess::writingFailed()
+void CoordinatorProcess::discardWriting(uint64_t position)
 {
-  CHECK_EQ(state, WRITING);
-  state = INITIAL;
+  foreach (Write& write, writes) {
+    if (write.action.position() != position) {
+      continue;
+    }
+
+    if (write.writing.isSome()) {
+      // Once the write is discarded the coordinator gets demoted (see
+      // 'writingFinished') since we don't actually know the write was
+      // successful or not and we really need to "catch-up" that
+      // position before we try and do another write (see MESOS-1038
+      // for more details).
+      Future<Option<uint64_t> > writing = write.writing.get();
+      writing.discard();
+    } else {
+      // The write has not been issued yet, so don't issue it.
+      process::Promise<Option<uint64_t> > promise;
+      promise.discard();
+      write.writing = promise.future();
+    }
+
+    return;
+  }
 }
 
 
-void CoordinatorProcess::writingAborted()
+void CoordinatorProcess::demoteAfterWriting(
+    const Future<Option<uint64_t> >& result)
 {
   CHECK_EQ(state, WRITING);
+  CHECK(!result.isPending());
 
-  // Demote the coordinator if a write operation is discarded since we
-  // don't actually know the write was successful or not and we really
-  // need to "catch-up" that position before we try and do another
-  // write (see MESOS-1038 for more details).
   state = INITIAL;
+
+  // The outcome of all the outstanding writes is the same as the
+  // write that failed since they can only succeed after it does.
+  foreach (const Write& write, writes) {
+    if (write.writing.isSome()) {
+      Future<Option<uint64_t> > writing = write.writing.get();
+      writing.discard();
+    }
+
+    if (result.isReady()) {
+      write.promise->set(result.get());
+    } else if (result.isFailed()) {
+      write.promise->fail(result.failure());
+    } else {
+      write.promise->discard();
+    }
+  }
+
+  writes.clear();
+  issued = 0;
 }
 
 
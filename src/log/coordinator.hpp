@@ -63,6 +63,12 @@ public:
   // Appends the specified bytes to the end of the log. Returns the
   // position of the appended entry if the operation succeeds or none
   // if the coordinator was demoted.
+  //
+  // Appends (and truncates) don't need to wait for the previous ones
+  // to complete: they are written concurrently at consecutive
+  // positions in the order they were made and complete in that
+  // order. If a write fails (or is discarded) the coordinator gets
+  // demoted and all the writes that follow it fail the same way.
   process::Future<Option<uint64_t> > append(const std::string& bytes);
 
   // Removes all log entries preceding the log entry at the given
@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 
 #include <glog/logging.h>
@@ -24,21 +25,60 @@
 #include <leveldb/write_batch.h>
 
 #include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
 
 #include <stout/check.hpp>
 #include <stout/error.hpp>
-#include <stout/numify.hpp>
+#include <stout/foreach.hpp>
+#include <stout/os.hpp>
 #include <stout/stopwatch.hpp>
 #include <stout/strings.hpp>
 
 #include "log/leveldb.hpp"
 
+using std::list;
 using std::string;
 
 namespace mesos {
 namespace internal {
 namespace log {
 
+// Returns a string representing the specified position. Note that we
+// adjust the actual position by incrementing it by 1 because we
+// reserve 0 for storing the promise record (Record::Promise,
+// DEPRECATED!), or the metadata (Record::Metadata).
+static string encode(uint64_t position, bool adjust = true)
+{
+  // Adjusted represenation is plus 1 of actual position.
+  position = adjust ? position + 1 : position;
+
+  uint8_t bytes[10]; // Maximum size of a varint encoded uint64_t.
+
+  uint8_t* end =
+    google::protobuf::io::CodedOutputStream::WriteVarint64ToArray(
+        position, bytes);
+
+  return string((const char*) bytes, end - bytes);
+}
+
+
+// Returns the (unadjusted) value represented in the specified slice.
+static uint64_t decode(const leveldb::Slice& s)
+{
+  google::protobuf::io::CodedInputStream stream(
+      (const uint8_t*) s.data(), s.size());
+
+  uint64_t value;
+  bool success = stream.ReadVarint64(&value);
+  CHECK(success);
+  return value;
+}
+
+
+// Orders the varint encoded positions numerically (a bytewise
+// comparison of varints doesn't since they are little-endian).
 class Varint64Comparator : public leveldb::Comparator
 {
 public:
@@ -46,13 +86,11 @@ public:
       const leveldb::Slice& a,
       const leveldb::Slice& b) const
   {
-    // TODO(benh): Use varint comparator.
-    LOG(FATAL) << "Unimplemented";
-    // uint64_t left = position(a);
-    // uint64_t right = position(b);
-    // if (left < right) return -1;
-    // if (left == right) return 0;
-    // if (left > right) return 1;
+    uint64_t left = decode(a);
+    uint64_t right = decode(b);
+    if (left < right) return -1;
+    if (left == right) return 0;
+    return 1;
   }
 
   virtual const char* Name() const
@@ -77,53 +115,122 @@ public:
 };
 
 
-// TODO(benh): Use varint comparator.
-// static Varint64Comparator comparator;
+static Varint64Comparator comparator;
 
 
-// Returns a string representing the specified position. Note that we
-// adjust the actual position by incrementing it by 1 because we
-// reserve 0 for storing the promise record (Record::Promise,
-// DEPRECATED!), or the metadata (Record::Metadata).
-static string encode(uint64_t position, bool adjust = true)
+// Returns the key of the specified record.
+static string key(const Record& record)
 {
-  // Adjusted stringified represenation is plus 1 of actual position.
-  position = adjust ? position + 1 : position;
+  if (record.type() == Record::ACTION) {
+    return encode(record.action().position());
+  }
 
-  // TODO(benh): Use varint encoding for VarInt64Comparator!
-  // string s;
-  // google::protobuf::io::StringOutputStream _stream(&s);
-  // google::protobuf::io::CodedOutputStream stream(&_stream);
-  // position = adjust ? position + 1 : position;
-  // stream.WriteVarint64(position);
-  // return s;
-
-  Try<string> s = strings::format("%.*d", 10, position);
-  CHECK_SOME(s);
-  return s.get();
+  // The metadata (and the DEPRECATED promise) record.
+  return encode(0, false);
 }
 
 
-// Returns the position as represented in the specified slice
-// (performing a decrement as necessary to determine the actual
-// position represented).
-// TODO(jieyu): This function is not used (see RB-18252). However, we
-// still want to keep this function in case we need it in the future.
-// We comment it out to silence the warning (unused static function)
-// from the compiler.
-// static uint64_t decode(const leveldb::Slice& s)
-// {
-//   // TODO(benh): Use varint decoding for VarInt64Comparator!
-//   // uint64_t position;
-//   // google::protobuf::io::ArrayInputStream _stream(s.data(), s.size());
-//   // google::protobuf::io::CodedInputStream stream(&_stream);
-//   // bool success = stream.ReadVarint64(&position);
-//   // CHECK(success);
-//   // return position - 1; // Actual position is less 1 of stringified.
-//   Try<uint64_t> position = numify<uint64_t>(string(s.data(), s.size()));
-//   CHECK_SOME(position);
-//   return position.get() - 1; // Actual position is less 1 of stringified.
-// }
+// Rewrites the replica at 'path', which was created before positions
+// were varint encoded (i.e., using the default bytewise comparator),
+// using the varint encoding. The records are first copied to a new
+// database which then replaces the old one so that the replica is
+// left intact if we fail (or crash) while migrating.
+static Try<Nothing> migrate(const string& path)
+{
+  LOG(INFO) << "Migrating the replica at '" << path
+            << "' to varint encoded positions";
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  const string temp = path + ".migrate";
+
+  Try<Nothing> rmdir = os::rmdir(temp);
+  if (rmdir.isError()) {
+    return Error("Failed to remove '" + temp + "': " + rmdir.error());
+  }
+
+  leveldb::DB* legacy = NULL;
+  leveldb::Status status = leveldb::DB::Open(leveldb::Options(), path, &legacy);
+
+  if (!status.ok()) {
+    return Error("Failed to open: " + status.ToString());
+  }
+
+  leveldb::Options options;
+  options.create_if_missing = true;
+  options.error_if_exists = true;
+  options.comparator = &comparator;
+
+  leveldb::DB* db = NULL;
+  status = leveldb::DB::Open(options, temp, &db);
+
+  if (!status.ok()) {
+    delete legacy;
+    return Error("Failed to create '" + temp + "': " + status.ToString());
+  }
+
+  leveldb::Iterator* iterator = legacy->NewIterator(leveldb::ReadOptions());
+
+  // Copy the records in batches, syncing the last batch.
+  leveldb::WriteBatch batch;
+  uint64_t keys = 0;
+
+  for (iterator->SeekToFirst(); status.ok() && iterator->Valid();
+       iterator->Next()) {
+    const leveldb::Slice& slice = iterator->value();
+
+    google::protobuf::io::ArrayInputStream stream(slice.data(), slice.size());
+
+    Record record;
+
+    if (!record.ParseFromZeroCopyStream(&stream)) {
+      status = leveldb::Status::Corruption("Failed to deserialize record");
+      break;
+    }
+
+    batch.Put(key(record), slice);
+
+    if (++keys % 1000 == 0) {
+      status = db->Write(leveldb::WriteOptions(), &batch);
+      batch.Clear();
+    }
+  }
+
+  if (status.ok()) {
+    status = iterator->status();
+  }
+
+  if (status.ok()) {
+    leveldb::WriteOptions sync;
+    sync.sync = true;
+    status = db->Write(sync, &batch);
+  }
+
+  delete iterator;
+  delete legacy;
+  delete db;
+
+  if (!status.ok()) {
+    os::rmdir(temp);
+    return Error("Failed to copy records: " + status.ToString());
+  }
+
+  // NOTE: If we crash after removing the old replica 'restore' finds
+  // the migrated one and finishes the migration.
+  rmdir = os::rmdir(path);
+  if (rmdir.isError()) {
+    return Error("Failed to remove: " + rmdir.error());
+  }
+
+  if (::rename(temp.c_str(), path.c_str()) != 0) {
+    return ErrnoError("Failed to rename '" + temp + "'");
+  }
+
+  LOG(INFO) << "Migrated " << keys << " keys in " << stopwatch.elapsed();
+
+  return Nothing();
+}
 
 
 LevelDBStorage::LevelDBStorage()
@@ -141,31 +248,55 @@ LevelDBStorage::~LevelDBStorage()
 
 Try<Storage::State> LevelDBStorage::restore(const string& path)
 {
+  const string temp = path + ".migrate";
+
+  // Finish or discard a migration that did not complete.
+  if (os::exists(temp)) {
+    if (!os::exists(path)) {
+      if (::rename(temp.c_str(), path.c_str()) != 0) {
+        return ErrnoError("Failed to rename '" + temp + "'");
+      }
+    } else {
+      Try<Nothing> rmdir = os::rmdir(temp);
+      if (rmdir.isError()) {
+        return Error("Failed to remove '" + temp + "': " + rmdir.error());
+      }
+    }
+  }
+
   leveldb::Options options;
   options.create_if_missing = true;
-
-  // TODO(benh): Can't use varint comparator until bug discussed at
-  // groups.google.com/group/leveldb/browse_thread/thread/17eac39168909ba7
-  // gets fixed. For now, we are using the default byte-wise
-  // comparator and *assuming* that the encoding from unsigned long to
-  // string produces a stable ordering. Checks below.
-  // options.comparator = &comparator;
+  options.comparator = &comparator;
 
   const string& one = encode(1);
   const string& two = encode(2);
-  const string& ten = encode(10);
+  const string& big = encode(1000);
 
-  CHECK(leveldb::BytewiseComparator()->Compare(one, two) < 0);
-  CHECK(leveldb::BytewiseComparator()->Compare(two, one) > 0);
-  CHECK(leveldb::BytewiseComparator()->Compare(one, ten) < 0);
-  CHECK(leveldb::BytewiseComparator()->Compare(ten, two) > 0);
-  CHECK(leveldb::BytewiseComparator()->Compare(ten, ten) == 0);
+  CHECK(comparator.Compare(one, two) < 0);
+  CHECK(comparator.Compare(two, one) > 0);
+  CHECK(comparator.Compare(one, big) < 0);
+  CHECK(comparator.Compare(big, two) > 0);
+  CHECK(comparator.Compare(big, big) == 0);
 
   Stopwatch stopwatch;
   stopwatch.start();
 
   leveldb::Status status = leveldb::DB::Open(options, path, &db);
 
+  if (!status.ok() &&
+      strings::contains(
+          status.ToString(), "does not match existing comparator")) {
+    // The replica was created using the legacy encoding.
+    Try<Nothing> migration = migrate(path);
+    if (migration.isError()) {
+      return Error("Failed to migrate: " + migration.error());
+    }
+
+    stopwatch.start(); // Restart the stopwatch.
+
+    status = leveldb::DB::Open(options, path, &db);
+  }
+
   if (!status.ok()) {
     // TODO(benh): Consider trying to repair the DB.
     return Error(status.ToString());
@@ -309,100 +440,137 @@ Try<Nothing> LevelDBStorage::persist(const Metadata& metadata)
 
 
 Try<Nothing> LevelDBStorage::persist(const Action& action)
+{
+  return persist(list<Action>(1, action));
+}
+
+
+Try<Nothing> LevelDBStorage::persist(const list<Action>& actions)
 {
   Stopwatch stopwatch;
   stopwatch.start();
 
-  Record record;
-  record.set_type(Record::ACTION);
-  record.mutable_action()->MergeFrom(action);
+  // Write all the actions with a single (synced) write.
+  leveldb::WriteBatch batch;
+  size_t bytes = 0;
 
-  string value;
+  foreach (const Action& action, actions) {
+    Record record;
+    record.set_type(Record::ACTION);
+    record.mutable_action()->MergeFrom(action);
 
-  if (!record.SerializeToString(&value)) {
-    return Error("Failed to serialize record");
+    string value;
+
+    if (!record.SerializeToString(&value)) {
+      return Error("Failed to serialize record");
+    }
+
+    batch.Put(encode(action.position()), value);
+    bytes += value.size();
   }
 
   leveldb::WriteOptions options;
   options.sync = true;
 
-  leveldb::Status status = db->Put(options, encode(action.position()), value);
+  leveldb::Status status = db->Write(options, &batch);
 
   if (!status.ok()) {
     return Error(status.ToString());
   }
 
-  // Updated the first position. Notice that we use 'min' here instead
-  // of checking 'isNone()' because it's likely that log entries are
-  // written out of order during catch-up (e.g. if a random bulk
-  // catch-up policy is used).
-  first = min(first, action.position());
+  LOG(INFO) << "Persisting " << actions.size() << " action(s) ("
+            << bytes << " bytes) to leveldb took " << stopwatch.elapsed();
+
+  foreach (const Action& action, actions) {
+    // Updated the first position. Notice that we use 'min' here
+    // instead of checking 'isNone()' because it's likely that log
+    // entries are written out of order during catch-up (e.g. if a
+    // random bulk catch-up policy is used).
+    first = min(first, action.position());
+
+    // Delete positions if a truncate action has been *learned*.
+    if (action.has_type() && action.type() == Action::TRUNCATE &&
+        action.has_learned() && action.learned()) {
+      CHECK(action.has_truncate());
+      truncate(action.truncate().to());
+    }
+  }
 
-  LOG(INFO) << "Persisting action (" << value.size()
-            << " bytes) to leveldb took " << stopwatch.elapsed();
+  return Nothing();
+}
 
-  // Delete positions if a truncate action has been *learned*. Note
-  // that we do this in a best-effort fashion (i.e., we ignore any
-  // failures to the database since we can always try again).
-  if (action.has_type() && action.type() == Action::TRUNCATE &&
-      action.has_learned() && action.learned()) {
-    CHECK(action.has_truncate());
 
-    stopwatch.start(); // Restart the stopwatch.
+void LevelDBStorage::truncate(uint64_t to)
+{
+  // Note that we do this in a best-effort fashion (i.e., we ignore
+  // any failures to the database since we can always try again).
+  Stopwatch stopwatch;
+  stopwatch.start();
 
-    // To actually perform the truncation in leveldb we need to remove
-    // all the keys that represent positions no longer in the log. We
-    // do this by attempting to delete all keys that represent the
-    // first position we know is still in leveldb up to (but
-    // excluding) the truncate position. Note that this works because
-    // the semantics of WriteBatch are such that even if the position
-    // doesn't exist (which is possible because this replica has some
-    // holes), we can attempt to delete the key that represents it and
-    // it will just ignore that key. This is *much* cheaper than
-    // actually iterating through the entire database instead (which
-    // was, for posterity, the original implementation). In addition,
-    // caching the "first" position we know is in the database is
-    // cheaper than using an iterator to determine the first position
-    // (which was, for posterity, the second implementation).
-
-    leveldb::WriteBatch batch;
-
-    CHECK_SOME(first);
-
-    // Add positions up to (but excluding) the truncate position to
-    // the batch starting at the first position still in leveldb. It's
-    // likely that the first position is greater than the truncate
-    // position (e.g., during catch-up). In that case, we do nothing
-    // because there is nothing we can truncate.
-    // TODO(jieyu): We might miss a truncation if we do random (i.e.,
-    // out of order) bulk catch-up and the truncate operation is
-    // caught up first.
-    uint64_t index = 0;
-    while ((first.get() + index) < action.truncate().to()) {
-      batch.Delete(encode(first.get() + index));
-      index++;
-    }
+  // To actually perform the truncation in leveldb we need to remove
+  // all the keys that represent positions no longer in the log. We
+  // do this by attempting to delete all keys that represent the
+  // first position we know is still in leveldb up to (but
+  // excluding) the truncate position. Note that this works because
+  // the semantics of WriteBatch are such that even if the position
+  // doesn't exist (which is possible because this replica has some
+  // holes), we can attempt to delete the key that represents it and
+  // it will just ignore that key. This is *much* cheaper than
+  // actually iterating through the entire database instead (which
+  // was, for posterity, the original implementation). In addition,
+  // caching the "first" position we know is in the database is
+  // cheaper than using an iterator to determine the first position
+  // (which was, for posterity, the second implementation).
+
+  leveldb::WriteBatch batch;
+
+  CHECK_SOME(first);
+
+  // Add positions up to (but excluding) the truncate position to
+  // the batch starting at the first position still in leveldb. It's
+  // likely that the first position is greater than the truncate
+  // position (e.g., during catch-up). In that case, we do nothing
+  // because there is nothing we can truncate.
+  // TODO(jieyu): We might miss a truncation if we do random (i.e.,
+  // out of order) bulk catch-up and the truncate operation is
+  // caught up first.
+  uint64_t index = 0;
+  while ((first.get() + index) < to) {
+    batch.Delete(encode(first.get() + index));
+    index++;
+  }
 
-    // If we added any positions, attempt to delete them!
-    if (index > 0) {
-      // We do this write asynchronously (e.g., using default options).
-      leveldb::Status status = db->Write(leveldb::WriteOptions(), &batch);
-
-      if (!status.ok()) {
-        LOG(WARNING) << "Ignoring leveldb batch delete failure: "
-                     << status.ToString();
-      } else {
-        // Save the new first position!
-        CHECK_LT(first.get(), action.truncate().to());
-        first = action.truncate().to();
-
-        LOG(INFO) << "Deleting ~" << index
-                  << " keys from leveldb took " << stopwatch.elapsed();
-      }
+  // If we added any positions, attempt to delete them!
+  if (index > 0) {
+    // We do this write asynchronously (e.g., using default options).
+    leveldb::Status status = db->Write(leveldb::WriteOptions(), &batch);
+
+    if (!status.ok()) {
+      LOG(WARNING) << "Ignoring leveldb batch delete failure: "
+                   << status.ToString();
+    } else {
+      LOG(INFO) << "Deleting ~" << index
+                << " keys from leveldb took " << stopwatch.elapsed();
+
+      stopwatch.start(); // Restart the stopwatch.
+
+      // Compact the range of deleted keys so that the space used by
+      // the truncated positions gets reclaimed now rather than
+      // whenever leveldb gets around to compacting it.
+      const string begin = encode(first.get());
+      const string end = encode(to);
+
+      leveldb::Slice slices[] = { begin, end };
+      db->CompactRange(&slices[0], &slices[1]);
+
+      LOG(INFO) << "Compacting truncated keys in leveldb took "
+                << stopwatch.elapsed();
+
+      // Save the new first position!
+      CHECK_LT(first.get(), to);
+      first = to;
     }
   }
-
-  return Nothing();
 }
 
 
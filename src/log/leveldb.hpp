@@ -23,6 +23,8 @@
 
 #include <stdint.h>
 
+#include <list>
+
 #include <stout/option.hpp>
 
 #include "log/storage.hpp"
@@ -32,6 +34,9 @@ namespace internal {
 namespace log {
 
 // Concrete implementation of the storage interface using leveldb.
+// Positions are stored using varint encoded keys ordered by a custom
+// comparator, replicas created with the legacy (decimal) encoding are
+// migrated when restored.
 class LevelDBStorage : public Storage
 {
 public:
@@ -41,9 +46,13 @@ public:
   virtual Try<State> restore(const std::string& path);
   virtual Try<Nothing> persist(const Metadata& metadata);
   virtual Try<Nothing> persist(const Action& action);
+  virtual Try<Nothing> persist(const std::list<Action>& actions);
   virtual Try<Action> read(uint64_t position);
 
 private:
+  // Deletes (and compacts) the positions before 'to'.
+  void truncate(uint64_t to);
+
   leveldb::DB* db;
 
   // First position still in leveldb, used during truncation.
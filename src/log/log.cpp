@@ -55,7 +55,9 @@ public:
   LogProcess(
       size_t _quorum,
       const string& path,
-      const set<UPID>& pids);
+      const set<UPID>& pids,
+      size_t _catchupConcurrency,
+      const Option<size_t>& _catchupRate);
 
   LogProcess(
       size_t _quorum,
@@ -63,7 +65,9 @@ public:
       const string& servers,
       const Duration& timeout,
       const string& znode,
-      const Option<zookeeper::Authentication>& auth);
+      const Option<zookeeper::Authentication>& auth,
+      size_t _catchupConcurrency,
+      const Option<size_t>& _catchupRate);
 
   // Recovers the log by catching up if needed. Returns a shared
   // pointer to the local replica if the recovery succeeds.
@@ -93,6 +97,8 @@ private:
   Shared<Network> network;
 
   // For replica recovery.
+  const size_t catchupConcurrency;
+  const Option<size_t> catchupRate;
   Option<Future<Owned<Replica> > > recovering;
   process::Promise<Nothing> recovered;
   list<process::Promise<Shared<Replica> >*> promises;
@@ -197,11 +203,15 @@ private:
 LogProcess::LogProcess(
     size_t _quorum,
     const string& path,
-    const set<UPID>& pids)
+    const set<UPID>& pids,
+    size_t _catchupConcurrency,
+    const Option<size_t>& _catchupRate)
   : ProcessBase(ID::generate("log")),
     quorum(_quorum),
     replica(new Replica(path)),
     network(new Network(pids + (UPID) replica->pid())),
+    catchupConcurrency(_catchupConcurrency),
+    catchupRate(_catchupRate),
     group(NULL) {}
 
 
@@ -211,11 +221,15 @@ LogProcess::LogProcess(
     const string& servers,
     const Duration& timeout,
     const string& znode,
-    const Option<zookeeper::Authentication>& auth)
+    const Option<zookeeper::Authentication>& auth,
+    size_t _catchupConcurrency,
+    const Option<size_t>& _catchupRate)
   : ProcessBase(ID::generate("log")),
     quorum(_quorum),
     replica(new Replica(path)),
     network(new ZooKeeperNetwork(servers, timeout, znode, auth)),
+    catchupConcurrency(_catchupConcurrency),
+    catchupRate(_catchupRate),
     group(new zookeeper::Group(servers, timeout, znode, auth)) {}
 
 
@@ -305,7 +319,12 @@ Future<Shared<Replica> > LogProcess::recover()
     // 'release' in Shared which will provide this CHECK internally.
     CHECK(replica.unique());
 
-    recovering = log::recover(quorum, replica.own().get(), network)
+    recovering = log::recover(
+        quorum,
+        replica.own().get(),
+        network,
+        catchupConcurrency,
+        catchupRate)
       .onAny(defer(self(), &Self::_recover));
   }
 
@@ -720,11 +739,14 @@ void LogWriterProcess::failed(const string& message, const string& reason)
 Log::Log(
     int quorum,
     const string& path,
-    const set<UPID>& pids)
+    const set<UPID>& pids,
+    size_t catchupConcurrency,
+    const Option<size_t>& catchupRate)
 {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
-  process = new LogProcess(quorum, path, pids);
+  process =
+    new LogProcess(quorum, path, pids, catchupConcurrency, catchupRate);
   spawn(process);
 }
 
@@ -734,11 +756,21 @@ Log::Log(
     const string& servers,
     const Duration& timeout,
     const string& znode,
-    const Option<zookeeper::Authentication>& auth)
+    const Option<zookeeper::Authentication>& auth,
+    size_t catchupConcurrency,
+    const Option<size_t>& catchupRate)
 {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
-  process = new LogProcess(quorum, path, servers, timeout, znode, auth);
+  process = new LogProcess(
+      quorum,
+      path,
+      servers,
+      timeout,
+      znode,
+      auth,
+      catchupConcurrency,
+      catchupRate);
   spawn(process);
 }
 
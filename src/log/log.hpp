@@ -35,6 +35,8 @@
 #include <stout/none.hpp>
 #include <stout/option.hpp>
 
+#include "log/catchup.hpp"
+
 #include "zookeeper/group.hpp"
 
 namespace mesos {
@@ -172,6 +174,11 @@ public:
     // new ending position of the log or 'none' if this writer has
     // lost it's promise to exclusively write (which can be reacquired
     // by invoking Writer::start).
+    //
+    // NOTE: Appends and truncates may be issued without waiting for
+    // the previous ones to complete, in which case they get written
+    // concurrently in the order they were issued and complete in
+    // that order.
     process::Future<Option<Position> > append(const std::string& data);
 
     // Attempts to truncate the log up to but not including the
@@ -186,10 +193,14 @@ public:
 
   // Creates a new replicated log that assumes the specified quorum
   // size, is backed by a file at the specified path, and coordinates
-  // with other replicas via the set of process PIDs.
+  // with other replicas via the set of process PIDs. When recovering,
+  // up to 'catchupConcurrency' positions are caught up at a time and
+  // at most 'catchupRate' per second, if specified (see catchup.hpp).
   Log(int quorum,
       const std::string& path,
-      const std::set<process::UPID>& pids);
+      const std::set<process::UPID>& pids,
+      size_t catchupConcurrency = DEFAULT_CATCHUP_CONCURRENCY,
+      const Option<size_t>& catchupRate = None());
 
   // Creates a new replicated log that assumes the specified quorum
   // size, is backed by a file at the specified path, and coordinates
@@ -200,7 +211,9 @@ public:
       const std::string& servers,
       const Duration& timeout,
       const std::string& znode,
-      const Option<zookeeper::Authentication>& auth = None());
+      const Option<zookeeper::Authentication>& auth = None(),
+      size_t catchupConcurrency = DEFAULT_CATCHUP_CONCURRENCY,
+      const Option<size_t>& catchupRate = None());
 
   ~Log();
 
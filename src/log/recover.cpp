@@ -27,6 +27,7 @@
 #include <process/process.hpp>
 
 #include <stout/check.hpp>
+#include <stout/duration.hpp>
 #include <stout/foreach.hpp>
 #include <stout/hashmap.hpp>
 #include <stout/lambda.hpp>
@@ -279,11 +280,15 @@ public:
   RecoverProcess(
       size_t _quorum,
       const Owned<Replica>& _replica,
-      const Shared<Network>& _network)
+      const Shared<Network>& _network,
+      size_t _concurrency,
+      const Option<size_t>& _rate)
     : ProcessBase(ID::generate("log-recover")),
       quorum(_quorum),
       replica(_replica),
-      network(_network) {}
+      network(_network),
+      concurrency(_concurrency),
+      rate(_rate) {}
 
   Future<Owned<Replica> > future() { return promise.future(); }
 
@@ -381,7 +386,15 @@ private:
     // Since we do not know what proposal number to use (the log is
     // empty), we use none and leave log::catchup to automatically
     // bump the proposal number.
-    return log::catchup(quorum, shared, network, None(), positions)
+    return log::catchup(
+        quorum,
+        shared,
+        network,
+        None(),
+        positions,
+        Seconds(10),
+        concurrency,
+        rate)
       .then(defer(self(), &Self::getReplicaOwnership, shared))
       .then(defer(self(), &Self::updateReplicaStatus, Metadata::VOTING));
   }
@@ -439,6 +452,8 @@ private:
   const size_t quorum;
   Owned<Replica> replica;
   const Shared<Network> network;
+  const size_t concurrency;
+  const Option<size_t> rate;
 
   Future<Nothing> chain;
 
@@ -449,9 +464,12 @@ private:
 Future<Owned<Replica> > recover(
     size_t quorum,
     const Owned<Replica>& replica,
-    const Shared<Network>& network)
+    const Shared<Network>& network,
+    size_t concurrency,
+    const Option<size_t>& rate)
 {
-  RecoverProcess* process = new RecoverProcess(quorum, replica, network);
+  RecoverProcess* process =
+    new RecoverProcess(quorum, replica, network, concurrency, rate);
   Future<Owned<Replica> > future = process->future();
   spawn(process, true);
   return future;
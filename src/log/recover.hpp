@@ -25,8 +25,11 @@
 #include <process/owned.hpp>
 #include <process/shared.hpp>
 
+#include <stout/none.hpp>
 #include <stout/nothing.hpp>
+#include <stout/option.hpp>
 
+#include "log/catchup.hpp"
 #include "log/network.hpp"
 #include "log/replica.hpp"
 
@@ -46,11 +49,14 @@ namespace log {
 // remaining replicas can restore all the successfully written log
 // entries; 2) its future votes cannot not contradict its lost votes.
 // This function returns an owned pointer to the recovered replica if
-// the recovery is successful.
+// the recovery is successful. The 'concurrency' and 'rate' control how
+// the missing positions are caught up (see 'log::catchup').
 extern process::Future<process::Owned<Replica> > recover(
     size_t quorum,
     const process::Owned<Replica>& replica,
-    const process::Shared<Network>& network);
+    const process::Shared<Network>& network,
+    size_t concurrency = DEFAULT_CATCHUP_CONCURRENCY,
+    const Option<size_t>& rate = None());
 
 } // namespace log {
 } // namespace internal {
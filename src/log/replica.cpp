@@ -19,13 +19,16 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <utility>
 
 #include <process/dispatch.hpp>
 #include <process/id.hpp>
+#include <process/owned.hpp>
 
 #include <stout/check.hpp>
 #include <stout/error.hpp>
 #include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
 #include <stout/none.hpp>
 #include <stout/nothing.hpp>
 #include <stout/result.hpp>
@@ -41,6 +44,7 @@
 using namespace process;
 
 using std::list;
+using std::pair;
 using std::string;
 
 namespace mesos {
@@ -105,10 +109,10 @@ public:
 private:
   // Handles a request from a proposer to promise not to accept writes
   // from any other proposer with lower proposal number.
-  void promise(const PromiseRequest& request);
+  void promise(const UPID& from, const PromiseRequest& request);
 
   // Handles a request from a proposer to write an action.
-  void write(const WriteRequest& request);
+  void write(const UPID& from, const WriteRequest& request);
 
   // Handles a request from a recover process.
   void recover(const RecoverRequest& request);
@@ -117,8 +121,27 @@ private:
   void learned(const Action& action);
 
   // Helper routines that write a record corresponding to the
-  // specified argument. Returns true on success and false otherwise.
-  bool persist(const Action& action);
+  // specified argument. The action is not written right away but as
+  // part of the next batch (see 'commit'), after which the response
+  // (if any) is sent. Until then reading the position returns the
+  // action.
+  void persist(const Action& action);
+  void persist(
+      const Action& action,
+      const UPID& to,
+      const google::protobuf::Message& response);
+
+  // Writes all the actions persisted since the last commit with a
+  // single (synced) write and sends their responses. This is done
+  // after the requests that were already queued when the first of
+  // the actions was persisted have been handled, so that concurrent
+  // writes (e.g., pipelined appends or catch-up) share the cost of
+  // syncing. Any operation that depends on the actions having been
+  // written commits right away.
+  void commit();
+
+  // Updates the positions of the log after persisting the action.
+  void persisted(const Action& action);
 
   // Helper routines that update metadata corresponding to the
   // specified argument. The update will be persisted on the disk.
@@ -146,6 +169,15 @@ private:
 
   // Unlearned positions in the log.
   IntervalSet<uint64_t> unlearned;
+
+  // The actions waiting to be committed in the order they were
+  // persisted, the latest action of each of these positions, and the
+  // responses to send once they are committed.
+  typedef pair<UPID, Owned<google::protobuf::Message> > Reply;
+
+  list<Action> batch;
+  hashmap<uint64_t, Action> pending;
+  list<Reply> replies;
 };
 
 
@@ -185,6 +217,8 @@ Result<Action> ReplicaProcess::read(uint64_t position)
 {
   if (position < begin) {
     return Error("Attempted to read truncated position");
+  } else if (pending.contains(position)) {
+    return pending[position]; // Not yet committed.
   } else if (end < position) {
     return None(); // These semantics are assumed above!
   } else if (holes.contains(position)) {
@@ -208,6 +242,8 @@ Result<Action> ReplicaProcess::read(uint64_t position)
 // the future semantics to not include failures.
 Future<list<Action> > ReplicaProcess::read(uint64_t from, uint64_t to)
 {
+  commit();
+
   if (to < from) {
     process::Promise<list<Action> > promise;
     promise.fail("Bad read range (to < from)");
@@ -242,6 +278,8 @@ Future<list<Action> > ReplicaProcess::read(uint64_t from, uint64_t to)
 
 bool ReplicaProcess::missing(uint64_t position)
 {
+  commit();
+
   if (position < begin) {
     return false; // Truncated positions are treated as learned.
   } else if (position > end) {
@@ -255,6 +293,8 @@ bool ReplicaProcess::missing(uint64_t position)
 // TODO(jieyu): Allow this method to take an Interval.
 IntervalSet<uint64_t> ReplicaProcess::missing(uint64_t from, uint64_t to)
 {
+  commit();
+
   if (from > to) {
     // Empty interval.
     return IntervalSet<uint64_t>();
@@ -282,12 +322,14 @@ IntervalSet<uint64_t> ReplicaProcess::missing(uint64_t from, uint64_t to)
 
 uint64_t ReplicaProcess::beginning()
 {
+  commit();
   return begin;
 }
 
 
 uint64_t ReplicaProcess::ending()
 {
+  commit();
   return end;
 }
 
@@ -306,6 +348,8 @@ uint64_t ReplicaProcess::promised()
 
 bool ReplicaProcess::update(const Metadata::Status& status)
 {
+  commit();
+
   Metadata metadata_;
   metadata_.set_status(status);
   metadata_.set_promised(promised());
@@ -328,6 +372,10 @@ bool ReplicaProcess::update(const Metadata::Status& status)
 
 bool ReplicaProcess::update(uint64_t promised)
 {
+  // Commit the pending actions first so that the promise (and the
+  // last position written, see 'promise') accounts for them.
+  commit();
+
   Metadata metadata_;
   metadata_.set_status(status());
   metadata_.set_promised(promised);
@@ -362,7 +410,7 @@ bool ReplicaProcess::update(uint64_t promised)
 // procedure.
 
 
-void ReplicaProcess::promise(const PromiseRequest& request)
+void ReplicaProcess::promise(const UPID& from, const PromiseRequest& request)
 {
   // Ignore promise requests if this replica is not in VOTING status.
   if (status() != Metadata::VOTING) {
@@ -439,13 +487,11 @@ void ReplicaProcess::promise(const PromiseRequest& request)
         action.set_position(request.position());
         action.set_promised(request.proposal());
 
-        if (persist(action)) {
-          PromiseResponse response;
-          response.set_okay(true);
-          response.set_proposal(request.proposal());
-          response.set_position(request.position());
-          reply(response);
-        }
+        PromiseResponse response;
+        response.set_okay(true);
+        response.set_proposal(request.proposal());
+        response.set_position(request.position());
+        persist(action, from, response);
       }
     } else {
       CHECK_SOME(result);
@@ -461,13 +507,11 @@ void ReplicaProcess::promise(const PromiseRequest& request)
         Action original = action;
         action.set_promised(request.proposal());
 
-        if (persist(action)) {
-          PromiseResponse response;
-          response.set_okay(true);
-          response.set_proposal(request.proposal());
-          response.mutable_action()->MergeFrom(original);
-          reply(response);
-        }
+        PromiseResponse response;
+        response.set_okay(true);
+        response.set_proposal(request.proposal());
+        response.mutable_action()->MergeFrom(original);
+        persist(action, from, response);
       }
     }
   } else {
@@ -496,7 +540,7 @@ void ReplicaProcess::promise(const PromiseRequest& request)
 }
 
 
-void ReplicaProcess::write(const WriteRequest& request)
+void ReplicaProcess::write(const UPID& from, const WriteRequest& request)
 {
   // Ignore write requests if this replica is not in VOTING status.
   if (status() != Metadata::VOTING) {
@@ -545,13 +589,11 @@ void ReplicaProcess::write(const WriteRequest& request)
           LOG(FATAL) << "Unknown Action::Type!";
       }
 
-      if (persist(action)) {
-        WriteResponse response;
-        response.set_okay(true);
-        response.set_proposal(request.proposal());
-        response.set_position(request.position());
-        reply(response);
-      }
+      WriteResponse response;
+      response.set_okay(true);
+      response.set_proposal(request.proposal());
+      response.set_position(request.position());
+      persist(action, from, response);
     }
   } else if (result.isSome()) {
     Action action = result.get();
@@ -609,13 +651,11 @@ void ReplicaProcess::write(const WriteRequest& request)
           LOG(FATAL) << "Unknown Action::Type!";
       }
 
-      if (persist(action)) {
-        WriteResponse response;
-        response.set_okay(true);
-        response.set_proposal(request.proposal());
-        response.set_position(request.position());
-        reply(response);
-      }
+      WriteResponse response;
+      response.set_okay(true);
+      response.set_proposal(request.proposal());
+      response.set_position(request.position());
+      persist(action, from, response);
     }
   }
 }
@@ -645,22 +685,65 @@ void ReplicaProcess::learned(const Action& action)
 
   CHECK(action.learned());
 
-  if (persist(action)) {
-    LOG(INFO) << "Replica learned " << action.type()
-              << " action at position " << action.position();
+  persist(action);
+}
+
+
+void ReplicaProcess::persist(const Action& action)
+{
+  batch.push_back(action);
+  pending[action.position()] = action;
+
+  // Commit once the requests that are already queued are handled.
+  if (batch.size() == 1) {
+    dispatch(self(), &ReplicaProcess::commit);
   }
 }
 
 
-bool ReplicaProcess::persist(const Action& action)
+void ReplicaProcess::persist(
+    const Action& action,
+    const UPID& to,
+    const google::protobuf::Message& response)
 {
-  Try<Nothing> persisted = storage->persist(action);
+  persist(action);
 
-  if (persisted.isError()) {
-    LOG(ERROR) << "Error writing to log: " << persisted.error();
-    return false;
+  Owned<google::protobuf::Message> message(response.New());
+  message->CopyFrom(response);
+  replies.push_back(std::make_pair(to, message));
+}
+
+
+void ReplicaProcess::commit()
+{
+  if (batch.empty()) {
+    return;
   }
 
+  Try<Nothing> written = storage->persist(batch);
+
+  if (written.isError()) {
+    // Like failing to persist a single action, we don't reply (see
+    // the comment above 'ReplicaProcess::promise').
+    LOG(ERROR) << "Error writing to log: " << written.error();
+  } else {
+    foreach (const Action& action, batch) {
+      persisted(action);
+    }
+
+    foreach (const Reply& reply, replies) {
+      send(reply.first, *reply.second);
+    }
+  }
+
+  batch.clear();
+  pending.clear();
+  replies.clear();
+}
+
+
+void ReplicaProcess::persisted(const Action& action)
+{
   LOG(INFO) << "Persisted action at " << action.position();
 
   // No longer a hole here (if there even was one).
@@ -668,6 +751,9 @@ bool ReplicaProcess::persist(const Action& action)
 
   // Update unlearned positions and deal with truncation actions.
   if (action.has_learned() && action.learned()) {
+    LOG(INFO) << "Replica learned " << action.type()
+              << " action at position " << action.position();
+
     unlearned -= action.position();
 
     if (action.has_type() && action.type() == Action::TRUNCATE) {
@@ -697,8 +783,6 @@ bool ReplicaProcess::persist(const Action& action)
 
   // And update the end position.
   end = std::max(end, action.position());
-
-  return true;
 }
 
 
@@ -24,6 +24,7 @@
 
 #include <stout/error.hpp>
 
+#include "log/catchup.hpp"
 #include "log/log.hpp"
 #include "log/tool/initialize.hpp"
 #include "log/tool/replica.hpp"
@@ -64,6 +65,16 @@ Replica::Flags::Flags()
       "Whether to initialize the log",
       true);
 
+  add(&Flags::catchup_concurrency,
+      "catchup_concurrency",
+      "Number of log positions caught up at a time when recovering",
+      DEFAULT_CATCHUP_CONCURRENCY);
+
+  add(&Flags::catchup_rate,
+      "catchup_rate",
+      "Maximum number of log positions caught up per second when\n"
+      "recovering (unlimited if not specified)");
+
   add(&Flags::help,
       "help",
       "Prints the help message",
@@ -136,7 +147,10 @@ Try<Nothing> Replica::execute(int argc, char** argv)
       flags.path.get(),
       flags.servers.get(),
       Seconds(10),
-      flags.znode.get());
+      flags.znode.get(),
+      None(),
+      flags.catchup_concurrency,
+      flags.catchup_rate);
 
   // Loop forever.
   Future<Nothing>().get();
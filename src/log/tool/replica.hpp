@@ -47,6 +47,8 @@ public:
     Option<std::string> servers;
     Option<std::string> znode;
     bool initialize;
+    size_t catchup_concurrency;
+    Option<size_t> catchup_rate;
     bool help;
   };
 
@@ -21,6 +21,7 @@
 #include "master/drf_sorter.hpp"
 
 using std::list;
+using std::pair;
 using std::set;
 using std::string;
 
@@ -44,46 +45,48 @@ bool DRFComparator::operator () (const Client& client1, const Client& client2)
 
 void DRFSorter::add(const string& name, double weight)
 {
-  Client client(name, 0, 0);
-  clients.insert(client);
+  Entry& entry = entries[name] = Entry(weight);
 
-  allocations[name] = Resources();
-  weights[name] = weight;
+  entry.client = clients.insert(Client(name, 0, 0)).first;
+  entry.active = true;
+  sorted = false;
 }
 
 
 void DRFSorter::remove(const string& name)
 {
-  set<Client, DRFComparator>::iterator it = find(name);
+  deactivate(name);
 
-  if (it != clients.end()) {
-    clients.erase(it);
-  }
-
-  allocations.erase(name);
-  weights.erase(name);
+  entries.erase(name);
 }
 
 
 void DRFSorter::activate(const string& name)
 {
-  CHECK(allocations.contains(name));
+  CHECK(entries.contains(name));
 
-  Client client(name, calculateShare(name), 0);
-  clients.insert(client);
+  Entry& entry = entries[name];
+
+  if (!entry.active) {
+    entry.client = clients.insert(Client(name, calculateShare(entry), 0)).first;
+    entry.active = true;
+    sorted = false;
+  }
 }
 
 
 void DRFSorter::deactivate(const string& name)
 {
-  set<Client, DRFComparator>::iterator it = find(name);
+  hashmap<string, Entry>::iterator it = entries.find(name);
 
-  if (it != clients.end()) {
+  if (it != entries.end() && it->second.active) {
     // TODO(benh): Removing the client is an unfortuante strategy
     // because we lose information such as the number of allocations
     // for this client which means the fairness can be gamed by a
     // framework disconnecting and reconnecting.
-    clients.erase(it);
+    clients.erase(it->second.client);
+    it->second.active = false;
+    sorted = false;
   }
 }
 
@@ -92,27 +95,15 @@ void DRFSorter::allocated(
     const string& name,
     const Resources& resources)
 {
-  set<Client, DRFComparator>::iterator it = find(name);
-
-  if (it != clients.end()) { // TODO(benh): This should really be a CHECK.
-    // TODO(benh): Refactor 'update' to be able to reuse it here.
-    Client client(*it);
-
-    // Update the 'allocations' to reflect the allocator decision.
-    client.allocations++;
-
-    // Remove and reinsert it to update the ordering appropriately.
-    clients.erase(it);
-    clients.insert(client);
-  }
+  Entry& entry = entries[name];
 
-  allocations[name] += resources;
+  update(&entry, resources, true);
 
-  // If the total resources have changed, we're going to
-  // recalculate all the shares, so don't bother just
-  // updating this client.
-  if (!dirty) {
-    update(name);
+  // TODO(benh): This should really be a CHECK.
+  if (entry.active) {
+    // Update the 'allocations' to reflect the allocator decision
+    // and the 'share' to get proper sorting.
+    update(&entry, calculateShare(entry), entry.client->allocations + 1);
   }
 }
 
@@ -120,7 +111,7 @@ void DRFSorter::allocated(
 Resources DRFSorter::allocation(
     const string& name)
 {
-  return allocations[name];
+  return entries[name].allocation;
 }
 
 
@@ -128,11 +119,10 @@ void DRFSorter::unallocated(
     const string& name,
     const Resources& resources)
 {
-  allocations[name] -= resources;
+  Entry& entry = entries[name];
 
-  if (!dirty) {
-    update(name);
-  }
+  update(&entry, resources, false);
+  update(&entry);
 }
 
 
@@ -140,115 +130,192 @@ void DRFSorter::add(const Resources& _resources)
 {
   resources += _resources;
 
-  // We have to recalculate all shares when the total resources
-  // change, but we put it off until sort is called
-  // so that if something else changes before the next allocation
-  // we don't recalculate everything twice.
-  dirty = true;
+  totals.clear();
+  foreach (const Resource& resource, resources) {
+    if (resource.type() == Value::SCALAR) {
+      totals.push_back(
+          pair<string, double>(resource.name(), resource.scalar().value()));
+    }
+  }
+
+  // We have to recalculate the shares of the clients that were
+  // allocated any of these resources, but we put it off until sort
+  // is called so that if something else changes before the next
+  // allocation we don't recalculate them twice.
+  foreach (const Resource& resource, _resources) {
+    if (resource.type() == Value::SCALAR) {
+      changed.insert(resource.name());
+    }
+  }
 }
 
 
 void DRFSorter::remove(const Resources& _resources)
 {
   resources -= _resources;
-  dirty = true;
-}
 
+  totals.clear();
+  foreach (const Resource& resource, resources) {
+    if (resource.type() == Value::SCALAR) {
+      totals.push_back(
+          pair<string, double>(resource.name(), resource.scalar().value()));
+    }
+  }
 
-list<string> DRFSorter::sort()
-{
-  if (dirty) {
-    set<Client, DRFComparator> temp;
+  foreach (const Resource& resource, _resources) {
+    if (resource.type() == Value::SCALAR) {
+      changed.insert(resource.name());
+    }
+  }
+}
 
-    set<Client, DRFComparator>::iterator it;
-    for (it = clients.begin(); it != clients.end(); it++) {
-      Client client(*it);
 
-      // Update the 'share' to get proper sorting.
-      client.share = calculateShare(client.name);
+const list<string>& DRFSorter::sort()
+{
+  if (!changed.empty()) {
+    foreachvalue (Entry& entry, entries) {
+      if (!entry.active) {
+        continue;
+      }
 
-      temp.insert(client);
+      typedef pair<string, double> Scalar;
+      foreach (const Scalar& scalar, entry.scalars) {
+        if (scalar.second != 0 && changed.contains(scalar.first)) {
+          update(&entry);
+          break;
+        }
+      }
     }
 
-    clients = temp;
+    changed.clear();
   }
 
-  list<string> result;
+  if (!sorted) {
+    ordering.clear();
+
+    for (Iterator it = clients.begin(); it != clients.end(); it++) {
+      ordering.push_back((*it).name);
+    }
 
-  set<Client, DRFComparator>::iterator it;
-  for (it = clients.begin(); it != clients.end(); it++) {
-    result.push_back((*it).name);
+    sorted = true;
   }
 
-  return result;
+  return ordering;
 }
 
 
 bool DRFSorter::contains(const string& name)
 {
-  return allocations.contains(name);
+  return entries.contains(name);
 }
 
 
 int DRFSorter::count()
 {
-  return allocations.size();
+  return entries.size();
 }
 
 
-void DRFSorter::update(const string& name)
+void DRFSorter::update(Entry* entry, const Resources& resources, bool add)
 {
-  set<Client, DRFComparator>::iterator it = find(name);
+  if (add) {
+    entry->allocation += resources;
+  } else {
+    entry->allocation -= resources;
+  }
+
+  foreach (const Resource& resource, resources) {
+    if (resource.type() != Value::SCALAR) {
+      continue;
+    }
 
-  if (it != clients.end()) {
-    Client client(*it);
+    double value = add
+      ? resource.scalar().value()
+      : -resource.scalar().value();
 
-    // Update the 'share' to get proper sorting.
-    client.share = calculateShare(client.name);
+    bool found = false;
+    for (size_t i = 0; i < entry->scalars.size(); i++) {
+      if (entry->scalars[i].first == resource.name()) {
+        entry->scalars[i].second += value;
+        found = true;
+        break;
+      }
+    }
 
-    // Remove and reinsert it to update the ordering appropriately.
-    clients.erase(it);
-    clients.insert(client);
+    if (!found) {
+      entry->scalars.push_back(pair<string, double>(resource.name(), value));
+    }
   }
 }
 
 
-double DRFSorter::calculateShare(const string& name)
+void DRFSorter::update(Entry* entry)
 {
-  double share = 0;
+  if (entry->active) {
+    update(entry, calculateShare(*entry), entry->client->allocations);
+  }
+}
 
-  // TODO(benh): This implementaion of "dominant resource fairness"
-  // currently does not take into account resources that are not
-  // scalars.
 
-  foreach (const Resource& resource, resources) {
-    if (resource.type() == Value::SCALAR) {
-      double total = resource.scalar().value();
+void DRFSorter::update(Entry* entry, double share, uint64_t count)
+{
+  CHECK(entry->active);
 
-      if (total > 0) {
-        Value::Scalar none;
-        const Value::Scalar& scalar =
-          allocations[name].get(resource.name(), none);
+  Iterator it = entry->client;
 
-        share = std::max(share, scalar.value() / total);
-      }
-    }
+  if (share == (*it).share && count == (*it).allocations) {
+    return;
+  }
+
+  Client client((*it).name, share, count);
+
+  // If the client keeps its position relative to its neighbors we
+  // can update it in place (the fields we change are only used for
+  // ordering). This is common when the total resources change and
+  // the shares of all clients scale alike.
+  DRFComparator comparator;
+
+  Iterator next = it;
+  ++next;
+
+  bool ordered =
+    (it == clients.begin() || comparator(*(--Iterator(it)), client)) &&
+    (next == clients.end() || comparator(client, *next));
+
+  if (ordered) {
+    const_cast<Client&>(*it).share = share;
+    const_cast<Client&>(*it).allocations = count;
+    return;
   }
 
-  return share / weights[name];
+  // Remove and reinsert it to update the ordering appropriately.
+  clients.erase(it);
+  entry->client = clients.insert(client).first;
+  sorted = false;
 }
 
 
-set<Client, DRFComparator>::iterator DRFSorter::find(const string& name)
+double DRFSorter::calculateShare(const Entry& entry)
 {
-  set<Client, DRFComparator>::iterator it;
-  for (it = clients.begin(); it != clients.end(); it++) {
-    if (name == (*it).name) {
-      break;
+  double share = 0;
+
+  // TODO(benh): This implementaion of "dominant resource fairness"
+  // currently does not take into account resources that are not
+  // scalars.
+
+  typedef pair<string, double> Scalar;
+  foreach (const Scalar& total, totals) {
+    if (total.second > 0) {
+      foreach (const Scalar& scalar, entry.scalars) {
+        if (scalar.first == total.first) {
+          share = std::max(share, scalar.second / total.second);
+          break;
+        }
+      }
     }
   }
 
-  return it;
+  return share / entry.weight;
 }
 
 } // namespace allocator {
@@ -19,12 +19,16 @@
 #ifndef __DRF_SORTER_HPP__
 #define __DRF_SORTER_HPP__
 
+#include <list>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <mesos/resources.hpp>
 
 #include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
 
 #include "master/sorter.hpp"
 
@@ -63,6 +67,8 @@ struct DRFComparator
 class DRFSorter : public Sorter
 {
 public:
+  DRFSorter() : sorted(false) {}
+
   virtual ~DRFSorter() {}
 
   virtual void add(const std::string& name, double weight = 1);
@@ -85,38 +91,73 @@ public:
 
   virtual void remove(const Resources& resources);
 
-  virtual std::list<std::string> sort();
+  virtual const std::list<std::string>& sort();
 
   virtual bool contains(const std::string& name);
 
   virtual int count();
 
 private:
+  typedef std::set<Client, DRFComparator>::iterator Iterator;
+
+  // The bookkeeping for a single client.
+  struct Entry
+  {
+    Entry() : weight(1), active(false) {}
+
+    explicit Entry(double _weight) : weight(_weight), active(false) {}
+
+    // The resources this client has been allocated.
+    Resources allocation;
+
+    // The scalar quantities in 'allocation' keyed by resource name,
+    // kept in sync so that shares can be computed without scanning
+    // the protobuf representation.
+    std::vector<std::pair<std::string, double> > scalars;
+
+    // The weight that should be applied to the share.
+    double weight;
+
+    // Whether the client is active, in which case 'client' is its
+    // position in 'clients'.
+    bool active;
+    Iterator client;
+  };
+
+  // Adds (or subtracts) the scalars in 'resources' to the entry.
+  void update(Entry* entry, const Resources& resources, bool add);
+
   // Recalculates the share for the client and moves
   // it in 'clients' accordingly.
-  void update(const std::string& name);
-
-  // Returns the dominant resource share for the client.
-  double calculateShare(const std::string& name);
+  void update(Entry* entry);
 
-  // Returns an iterator to the specified client, if
-  // it exists in this Sorter.
-  std::set<Client, DRFComparator>::iterator find(const std::string& name);
+  // Updates the share and allocation count of the client, only
+  // moving it in 'clients' if its position changes.
+  void update(Entry* entry, double share, uint64_t count);
 
-  // If true, start() will recalculate all shares.
-  bool dirty;
+  // Returns the dominant resource share for the client.
+  double calculateShare(const Entry& entry);
 
   // A set of Clients (names and shares) sorted by share.
   std::set<Client, DRFComparator> clients;
 
-  // Maps client names to the resources they have been allocated.
-  hashmap<std::string, Resources> allocations;
+  // Cached result of 'sort', only valid while 'sorted' is true.
+  std::list<std::string> ordering;
+  bool sorted;
 
-  // Maps client names to the weights that should be applied to their shares.
-  hashmap<std::string, double> weights;
+  // Maps client names to their bookkeeping.
+  hashmap<std::string, Entry> entries;
 
   // Total resources.
   Resources resources;
+
+  // The name and value of each scalar in 'resources'.
+  std::vector<std::pair<std::string, double> > totals;
+
+  // Names of the resources whose totals have changed since the last
+  // call to 'sort'. Only the shares of clients that have been
+  // allocated one of these resources need to be recalculated.
+  hashset<std::string> changed;
 };
 
 } // namespace allocator {
@@ -104,6 +104,14 @@ public:
         " (batch) allocations (e.g., 500ms, 1sec, etc)",
         Seconds(1));
 
+    add(&Flags::incremental_allocation,
+        "incremental_allocation",
+        "Whether batch allocations should only consider the slaves and\n"
+        "frameworks affected by events (recovered resources, added or\n"
+        "reconnected slaves, expired filters, revived offers) since the\n"
+        "previous allocation rather than every framework and slave",
+        false);
+
     add(&Flags::cluster,
         "cluster",
         "Human readable name for the cluster,\n"
@@ -146,6 +154,7 @@ public:
   std::string user_sorter;
   std::string framework_sorter;
   Duration allocation_interval;
+  bool incremental_allocation;
   Option<std::string> cluster;
   Option<std::string> roles;
   Option<std::string> weights;
@@ -19,18 +19,30 @@
 #ifndef __HIERARCHICAL_ALLOCATOR_PROCESS_HPP__
 #define __HIERARCHICAL_ALLOCATOR_PROCESS_HPP__
 
+#include <queue>
+
 #include <mesos/resources.hpp>
 
+#include <process/defer.hpp>
 #include <process/delay.hpp>
 #include <process/id.hpp>
 #include <process/timeout.hpp>
 
+#include <process/metrics/counter.hpp>
+#include <process/metrics/gauge.hpp>
+#include <process/metrics/metrics.hpp>
+#include <process/metrics/timer.hpp>
+
 #include <stout/check.hpp>
 #include <stout/duration.hpp>
 #include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
+#include <stout/option.hpp>
 #include <stout/stopwatch.hpp>
 #include <stout/stringify.hpp>
 
+#include "common/resource_vector.hpp"
+
 #include "master/allocator.hpp"
 #include "master/drf_sorter.hpp"
 #include "master/master.hpp"
@@ -59,7 +71,7 @@ struct Slave
   Slave() {}
 
   explicit Slave(const SlaveInfo& _info)
-    : available(_info.resources()),
+    : available(Resources(_info.resources())),
       connected(true),
       whitelisted(false),
       checkpoint(_info.checkpoint()),
@@ -69,8 +81,10 @@ struct Slave
 
   std::string hostname() const { return info.hostname(); }
 
-  // Contains all of the resources currently free on this slave.
-  Resources available;
+  // Contains all of the resources currently free on this slave. We
+  // keep these as a ResourceVector because they are added to and
+  // subtracted from on every allocation.
+  ResourceVector available;
 
   // Whether the slave is connected. Resources are not offered for
   // disconnected slaves until they reconnect.
@@ -96,8 +110,9 @@ struct Framework
 
   std::string role() const { return info.role(); }
 
-  // Filters that have been added by this framework.
-  hashset<Filter*> filters;
+  // Filters that have been added by this framework, indexed by the
+  // slave they apply to.
+  hashmap<SlaveID, hashset<Filter*> > filters;
 
   bool checkpoint;
 private:
@@ -105,6 +120,33 @@ private:
 };
 
 
+// A filter waiting to expire, see HierarchicalAllocatorProcess::expire.
+struct Expiration
+{
+  Expiration(
+      const FrameworkID& _frameworkId,
+      const SlaveID& _slaveId,
+      Filter* _filter,
+      const process::Timeout& _timeout)
+    : frameworkId(_frameworkId),
+      slaveId(_slaveId),
+      filter(_filter),
+      timeout(_timeout) {}
+
+  // Orders the expirations so that the earliest one is at the top
+  // of a std::priority_queue.
+  bool operator < (const Expiration& that) const
+  {
+    return that.timeout < timeout;
+  }
+
+  FrameworkID frameworkId;
+  SlaveID slaveId;
+  Filter* filter;
+  process::Timeout timeout;
+};
+
+
 // Implements the basic allocator algorithm - first pick a role by
 // some criteria, then pick one of their frameworks to allocate to.
 template <typename RoleSorter, typename FrameworkSorter>
@@ -189,8 +231,29 @@ protected:
   // Allocate resources from the specified slaves.
   void allocate(const hashset<SlaveID>& slaveIds);
 
-  // Remove a filter for the specified framework.
-  void expire(const FrameworkID& frameworkId, Filter* filter);
+  // Allocate resources from the specified slaves to every framework
+  // and, additionally, from the slaves in 'extra' to the framework
+  // they are keyed by ('None' meaning every slave).
+  void allocate(
+      const hashset<SlaveID>& slaveIds,
+      const hashmap<FrameworkID, Option<hashset<SlaveID> > >& extra);
+
+  // Allocate resources only for the slaves and frameworks that have
+  // been marked dirty since the previous allocation.
+  void allocateIncremental();
+
+  // Offers the available resources on the slave to the framework if
+  // they are allocatable and not filtered. Returns the offered
+  // resources that are not reserved for the framework's (interned,
+  // see ResourceVector::intern) role.
+  Option<ResourceVector> allocate(
+      const FrameworkID& frameworkId,
+      uint32_t role,
+      const SlaveID& slaveId,
+      hashmap<SlaveID, Resources>* offerable);
+
+  // Removes (and deletes) all the filters that have expired.
+  void expire();
 
   // Checks whether the slave is whitelisted.
   bool isWhitelisted(const SlaveID& slave);
@@ -202,7 +265,19 @@ protected:
       const SlaveID& slaveId,
       const Resources& resources);
 
-  bool allocatable(const Resources& resources);
+  bool allocatable(const ResourceVector& resources);
+
+  // Marks the slave as needing to be considered by the next
+  // incremental allocation.
+  void dirty(const SlaveID& slaveId);
+
+  // Marks the framework as needing to be considered against every
+  // slave by the next incremental allocation.
+  void dirty(const FrameworkID& frameworkId);
+
+  // Used by the metrics gauges.
+  double _allocation_run_ms();
+  double _allocation_candidates();
 
   bool initialized;
 
@@ -226,6 +301,80 @@ protected:
 
   // Sorter containing all active roles.
   RoleSorter* roleSorter;
+
+  // Every filter ever created, ordered by when it expires. Filters
+  // are only deleted once they are popped from here (even if they
+  // were removed from their framework earlier, e.g., because offers
+  // were revived) so that their addresses can not get reused while
+  // they are still queued.
+  std::priority_queue<Expiration> expirations;
+
+  // State used for incremental allocations (see
+  // 'flags.incremental_allocation'). Slaves whose available resources
+  // or offerability changed, frameworks that need to be considered
+  // against every slave, and framework/slave pairs that became
+  // eligible (e.g., because a filter expired).
+  hashset<SlaveID> dirtySlaves;
+  hashset<FrameworkID> dirtyFrameworks;
+  hashmap<FrameworkID, hashset<SlaveID> > dirtyPairs;
+
+  // Statistics about the most recent allocation.
+  Duration allocationRun;
+  size_t allocationCandidates;
+
+  struct Metrics
+  {
+    explicit Metrics(const process::PID<Self>& allocator)
+      : allocation_runs(
+            "allocator/allocation_runs"),
+        allocation_run_ms(
+            "allocator/allocation_run_ms",
+            defer(allocator, &Self::_allocation_run_ms)),
+        allocation_candidates(
+            "allocator/allocation_candidates",
+            defer(allocator, &Self::_allocation_candidates)),
+        allocation_latency_ms(
+            "allocator/allocation_latency_ms"),
+        slave_allocation_latency_ms(
+            "allocator/slave_allocation_latency_ms")
+    {
+      process::metrics::add(allocation_runs);
+      process::metrics::add(allocation_run_ms);
+      process::metrics::add(allocation_candidates);
+      process::metrics::add(allocation_latency_ms);
+      process::metrics::add(slave_allocation_latency_ms);
+    }
+
+    ~Metrics()
+    {
+      process::metrics::remove(allocation_runs);
+      process::metrics::remove(allocation_run_ms);
+      process::metrics::remove(allocation_candidates);
+      process::metrics::remove(allocation_latency_ms);
+      process::metrics::remove(slave_allocation_latency_ms);
+    }
+
+    // Number of allocations performed.
+    process::metrics::Counter allocation_runs;
+
+    // Duration of the most recent allocation.
+    process::metrics::Gauge allocation_run_ms;
+
+    // Number of framework/slave pairs considered by the most recent
+    // allocation.
+    process::metrics::Gauge allocation_candidates;
+
+    // Distribution of the duration of the (full or incremental)
+    // allocations run every allocation interval.
+    process::metrics::Timer allocation_latency_ms;
+
+    // Distribution of the duration of the allocations for a single
+    // slave (e.g., one that was just added), which are much cheaper
+    // and would otherwise skew the distribution above.
+    process::metrics::Timer slave_allocation_latency_ms;
+  };
+
+  Metrics* metrics;
 };
 
 
@@ -264,12 +413,21 @@ public:
 template <class RoleSorter, class FrameworkSorter>
 HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::HierarchicalAllocatorProcess()
   : ProcessBase(process::ID::generate("hierarchical-allocator")),
-    initialized(false) {}
+    initialized(false),
+    allocationCandidates(0),
+    metrics(NULL) {}
 
 
 template <class RoleSorter, class FrameworkSorter>
 HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::~HierarchicalAllocatorProcess()
-{}
+{
+  while (!expirations.empty()) {
+    delete expirations.top().filter;
+    expirations.pop();
+  }
+
+  delete metrics;
+}
 
 
 template <class RoleSorter, class FrameworkSorter>
@@ -299,6 +457,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::initialize(
     sorters[name] = new FrameworkSorter();
   }
 
+  metrics = new Metrics(self());
+
   VLOG(1) << "Initializing hierarchical allocator process "
           << "with master : " << master;
 
@@ -329,6 +489,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::frameworkAdded(
 
   frameworks[frameworkId] = Framework(frameworkInfo);
 
+  dirty(frameworkId);
+
   LOG(INFO) << "Added framework " << frameworkId;
 
   allocate();
@@ -354,12 +516,14 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::frameworkRemoved(
     sorters[role]->remove(frameworkId.value());
   }
 
-  // Do not delete the filters contained in this
-  // framework's 'filters' hashset yet, see comments in
-  // HierarchicalAllocatorProcess::offersRevived and
-  // HierarchicalAllocatorProcess::expire.
+  // Do not delete the filters contained in this framework's
+  // 'filters' yet, they are deleted once they expire (see
+  // HierarchicalAllocatorProcess::expire).
   frameworks.erase(frameworkId);
 
+  dirtyFrameworks.erase(frameworkId);
+  dirtyPairs.erase(frameworkId);
+
   LOG(INFO) << "Removed framework " << frameworkId;
 }
 
@@ -375,6 +539,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::frameworkActivated(
   const std::string& role = frameworkInfo.role();
   sorters[role]->activate(frameworkId.value());
 
+  dirty(frameworkId);
+
   LOG(INFO) << "Activated framework " << frameworkId;
 
   allocate();
@@ -399,12 +565,13 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::frameworkDeactivated(
   // of the resources that it is using. We might be able to collapse
   // the added/removed and activated/deactivated in the future.
 
-  // Do not delete the filters contained in this
-  // framework's 'filters' hashset yet, see comments in
-  // HierarchicalAllocatorProcess::offersRevived and
-  // HierarchicalAllocatorProcess::expire.
+  // Do not delete the filters contained in this framework's
+  // 'filters' yet, they are deleted once they expire (see
+  // HierarchicalAllocatorProcess::expire).
   frameworks[frameworkId].filters.clear();
 
+  dirtyPairs.erase(frameworkId);
+
   LOG(INFO) << "Deactivated framework " << frameworkId;
 }
 
@@ -442,6 +609,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::slaveAdded(
 
   slaves[slaveId].available = unused;
 
+  dirty(slaveId);
+
   LOG(INFO) << "Added slave " << slaveId << " (" << slaveInfo.hostname()
             << ") with " << slaveInfo.resources() << " (and " << unused
             << " available)";
@@ -462,10 +631,11 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::slaveRemoved(
 
   slaves.erase(slaveId);
 
+  dirtySlaves.erase(slaveId);
+
   // Note that we DO NOT actually delete any filters associated with
-  // this slave, that will occur when the delayed
-  // HierarchicalAllocatorProcess::expire gets invoked (or the framework
-  // that applied the filters gets removed).
+  // this slave, that will occur when they expire (see
+  // HierarchicalAllocatorProcess::expire).
 
   LOG(INFO) << "Removed slave " << slaveId;
 }
@@ -495,6 +665,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::slaveReconnected(
 
   slaves[slaveId].connected = true;
 
+  dirty(slaveId);
+
   LOG(INFO)<< "Slave " << slaveId << " reconnected";
 }
 
@@ -512,7 +684,11 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::updateWhitelist(
     LOG(INFO) << "Updated slave white list: " << stringify(whitelist.get());
 
     foreachkey (const SlaveID& slaveId, slaves) {
-      slaves[slaveId].whitelisted = isWhitelisted(slaveId);
+      bool whitelisted = isWhitelisted(slaveId);
+      if (whitelisted && !slaves[slaveId].whitelisted) {
+        dirty(slaveId);
+      }
+      slaves[slaveId].whitelisted = whitelisted;
     }
   }
 }
@@ -564,6 +740,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::resourcesUnused(
   CHECK(slaves.contains(slaveId));
   slaves[slaveId].available += resources;
 
+  dirty(slaveId);
+
   // Create a refused resources filter.
   Try<Duration> seconds_ = Duration::create(Filters().refuse_seconds());
   CHECK_SOME(seconds_);
@@ -591,13 +769,15 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::resourcesUnused(
               << " filtered slave " << slaveId
               << " for " << seconds;
 
-    // Create a new filter and delay it's expiration.
-    Filter* filter =
-      new RefusedFilter(slaveId, resources, process::Timeout::in(seconds));
+    // Create a new filter and queue its expiration, expired filters
+    // get removed as part of the next allocation.
+    process::Timeout timeout = process::Timeout::in(seconds);
 
-    frameworks[frameworkId].filters.insert(filter);
+    Filter* filter = new RefusedFilter(slaveId, resources, timeout);
 
-    delay(seconds, self(), &Self::expire, frameworkId, filter);
+    frameworks[frameworkId].filters[slaveId].insert(filter);
+
+    expirations.push(Expiration(frameworkId, slaveId, filter, timeout));
   }
 }
 
@@ -634,6 +814,8 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::resourcesRecovered(
   if (slaves.contains(slaveId)) {
     slaves[slaveId].available += resources;
 
+    dirty(slaveId);
+
     LOG(INFO) << "Recovered " << resources.allocatable()
               << " (total allocatable: " << slaves[slaveId].available
               << ") on slave " << slaveId
@@ -651,12 +833,15 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::offersRevived(
 
   frameworks[frameworkId].filters.clear();
 
-  // We delete each actual Filter when
-  // HierarchicalAllocatorProcess::expire gets invoked. If we delete the
-  // Filter here it's possible that the same Filter (i.e., same
-  // address) could get reused and HierarchicalAllocatorProcess::expire
-  // would expire that filter too soon. Note that this only works
-  // right now because ALL Filter types "expire".
+  dirty(frameworkId);
+
+  // We delete each actual Filter when it gets popped from
+  // 'expirations' in HierarchicalAllocatorProcess::expire. If we
+  // delete the Filter here it's possible that the same Filter (i.e.,
+  // same address) could get reused and
+  // HierarchicalAllocatorProcess::expire would expire that filter
+  // too soon. Note that this only works right now because ALL Filter
+  // types "expire".
 
   LOG(INFO) << "Removed filters for framework " << frameworkId;
 
@@ -680,13 +865,69 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocate()
 {
   CHECK(initialized);
 
+  expire();
+
+  if (flags.incremental_allocation) {
+    allocateIncremental();
+    return;
+  }
+
   Stopwatch stopwatch;
   stopwatch.start();
 
   allocate(slaves.keys());
 
+  // Every slave has been considered for every framework so there is
+  // nothing left for a subsequent incremental allocation to do.
+  dirtySlaves.clear();
+  dirtyFrameworks.clear();
+  dirtyPairs.clear();
+
+  allocationRun = stopwatch.elapsed();
+  metrics->allocation_latency_ms.record(allocationRun);
+
   VLOG(1) << "Performed allocation for " << slaves.size() << " slaves in "
-            << stopwatch.elapsed();
+            << allocationRun;
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+void
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocateIncremental()
+{
+  CHECK(initialized);
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  // Frameworks marked dirty are considered against every slave, the
+  // rest only against the dirty slaves and their own dirty pairs.
+  hashmap<FrameworkID, Option<hashset<SlaveID> > > extra;
+
+  foreachpair (const FrameworkID& frameworkId,
+               const hashset<SlaveID>& slaveIds,
+               dirtyPairs) {
+    extra[frameworkId] = slaveIds;
+  }
+
+  foreach (const FrameworkID& frameworkId, dirtyFrameworks) {
+    extra[frameworkId] = None();
+  }
+
+  hashset<SlaveID> slaveIds = dirtySlaves;
+
+  dirtySlaves.clear();
+  dirtyFrameworks.clear();
+  dirtyPairs.clear();
+
+  allocate(slaveIds, extra);
+
+  allocationRun = stopwatch.elapsed();
+  metrics->allocation_latency_ms.record(allocationRun);
+
+  VLOG(1) << "Performed incremental allocation for " << slaveIds.size()
+          << " slaves and " << extra.size() << " frameworks in "
+          << allocationRun;
 }
 
 
@@ -705,6 +946,11 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocate(
 
   allocate(slaveIds);
 
+  // The slave has been considered for every framework.
+  dirtySlaves.erase(slaveId);
+
+  metrics->slave_allocation_latency_ms.record(stopwatch.elapsed());
+
   VLOG(1) << "Performed allocation for slave " << slaveId << " in "
           << stopwatch.elapsed();
 }
@@ -714,60 +960,96 @@ template <class RoleSorter, class FrameworkSorter>
 void
 HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocate(
     const hashset<SlaveID>& slaveIds)
+{
+  allocate(slaveIds, hashmap<FrameworkID, Option<hashset<SlaveID> > >());
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+void
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocate(
+    const hashset<SlaveID>& slaveIds,
+    const hashmap<FrameworkID, Option<hashset<SlaveID> > >& extra)
 {
   CHECK(initialized);
 
+  ++metrics->allocation_runs;
+  allocationCandidates = 0;
+
   if (roleSorter->count() == 0) {
     VLOG(1) << "No roles to allocate resources!";
     return;
   }
 
-  if (slaveIds.empty()) {
+  if (slaveIds.empty() && extra.empty()) {
     VLOG(1) << "No resources available to allocate!";
     return;
   }
 
   foreach (const std::string& role, roleSorter->sort()) {
+    // Intern the role once rather than for every slave below.
+    const uint32_t roleId = ResourceVector::intern(role);
+
     foreach (const std::string& frameworkIdValue, sorters[role]->sort()) {
       FrameworkID frameworkId;
       frameworkId.set_value(frameworkIdValue);
 
-      Resources allocatedResources;
+      ResourceVector allocatedResources;
       hashmap<SlaveID, Resources> offerable;
       foreach (const SlaveID& slaveId, slaveIds) {
-        Resources unreserved = slaves[slaveId].available.extract("*");
-        Resources resources = unreserved;
-
-        if (role != "*") {
-          resources += slaves[slaveId].available.extract(role);
-        }
-
-        // Check whether or not this framework filters this slave.
-        bool filtered = isFiltered(frameworkId, slaveId, resources);
-
-        if (!filtered &&
-            slaves[slaveId].connected &&
-            slaves[slaveId].whitelisted &&
-            allocatable(resources)) {
-          VLOG(1)
-            << "Offering " << resources << " on slave " << slaveId
-            << " to framework " << frameworkId;
-
-          offerable[slaveId] = resources;
-
-          // Update framework and slave resources.
-          slaves[slaveId].available -= resources;
+        Option<ResourceVector> unreserved =
+          allocate(frameworkId, roleId, slaveId, &offerable);
 
+        if (unreserved.isSome()) {
           // We only count resources not reserved for this role
           // in the share the sorter considers.
-          allocatedResources += unreserved;
+          allocatedResources += unreserved.get();
+        }
+      }
+
+      if (extra.contains(frameworkId)) {
+        const Option<hashset<SlaveID> >& others =
+          extra.find(frameworkId)->second;
+
+        if (others.isNone()) {
+          // The framework needs to be considered against every slave.
+          foreachkey (const SlaveID& slaveId, slaves) {
+            if (slaveIds.contains(slaveId)) {
+              continue;
+            }
+
+            Option<ResourceVector> unreserved =
+              allocate(frameworkId, roleId, slaveId, &offerable);
+
+            if (unreserved.isSome()) {
+              allocatedResources += unreserved.get();
+            }
+          }
+        } else {
+          foreach (const SlaveID& slaveId, others.get()) {
+            // Skip slaves that were already considered above or have
+            // been removed since they were marked.
+            if (slaveIds.contains(slaveId) || !slaves.contains(slaveId)) {
+              continue;
+            }
+
+            Option<ResourceVector> unreserved =
+              allocate(frameworkId, roleId, slaveId, &offerable);
+
+            if (unreserved.isSome()) {
+              allocatedResources += unreserved.get();
+            }
+          }
         }
       }
 
       if (!offerable.empty()) {
-        sorters[role]->add(allocatedResources);
-        sorters[role]->allocated(frameworkIdValue, allocatedResources);
-        roleSorter->allocated(role, allocatedResources);
+        // Only convert back to Resources once per framework.
+        Resources allocated = allocatedResources.resources();
+
+        sorters[role]->add(allocated);
+        sorters[role]->allocated(frameworkIdValue, allocated);
+        roleSorter->allocated(role, allocated);
 
         dispatch(master, &Master::offer, frameworkId, offerable);
       }
@@ -777,22 +1059,89 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocate(
 
 
 template <class RoleSorter, class FrameworkSorter>
-void
-HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::expire(
+Option<ResourceVector>
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocate(
     const FrameworkID& frameworkId,
-    Filter* filter)
+    uint32_t role,
+    const SlaveID& slaveId,
+    hashmap<SlaveID, Resources>* offerable)
 {
-  // The filter might have already been removed (e.g., if the
-  // framework no longer exists or in
-  // HierarchicalAllocatorProcess::offersRevived) but not yet deleted (to
-  // keep the address from getting reused possibly causing premature
-  // expiration).
-  if (frameworks.contains(frameworkId) &&
-      frameworks[frameworkId].filters.contains(filter)) {
-    frameworks[frameworkId].filters.erase(filter);
+  CHECK(slaves.contains(slaveId));
+
+  allocationCandidates++;
+
+  // Check the cheap conditions first so that we avoid extracting
+  // the resources of slaves that cannot be offered anyway.
+  if (!slaves[slaveId].connected || !slaves[slaveId].whitelisted) {
+    return None();
+  }
+
+  static const uint32_t UNRESERVED = ResourceVector::intern("*");
+
+  ResourceVector unreserved = slaves[slaveId].available.extract(UNRESERVED);
+  ResourceVector available = unreserved;
+
+  if (role != UNRESERVED) {
+    available += slaves[slaveId].available.extract(role);
   }
 
-  delete filter;
+  if (!allocatable(available)) {
+    return None();
+  }
+
+  // Filters operate on Resources, we only pay for the conversion
+  // once we know the resources could be offered.
+  Resources resources = available.resources();
+
+  // Check whether or not this framework filters this slave.
+  if (isFiltered(frameworkId, slaveId, resources)) {
+    return None();
+  }
+
+  VLOG(1)
+    << "Offering " << resources << " on slave " << slaveId
+    << " to framework " << frameworkId;
+
+  (*offerable)[slaveId] = resources;
+
+  // Update framework and slave resources.
+  slaves[slaveId].available -= available;
+
+  return unreserved;
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+void
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::expire()
+{
+  while (!expirations.empty() && expirations.top().timeout.expired()) {
+    const Expiration expiration = expirations.top();
+    expirations.pop();
+
+    const FrameworkID& frameworkId = expiration.frameworkId;
+    const SlaveID& slaveId = expiration.slaveId;
+
+    // The filter might have already been removed (e.g., if the
+    // framework no longer exists or in
+    // HierarchicalAllocatorProcess::offersRevived).
+    if (frameworks.contains(frameworkId) &&
+        frameworks[frameworkId].filters.contains(slaveId) &&
+        frameworks[frameworkId].filters[slaveId].contains(expiration.filter)) {
+      frameworks[frameworkId].filters[slaveId].erase(expiration.filter);
+
+      if (frameworks[frameworkId].filters[slaveId].empty()) {
+        frameworks[frameworkId].filters.erase(slaveId);
+      }
+
+      // The slave's resources may now be offered to this framework.
+      if (slaves.contains(slaveId)) {
+        dirtyPairs[frameworkId].insert(slaveId);
+      }
+    }
+
+    delete expiration.filter;
+  }
 }
 
 
@@ -830,7 +1179,12 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::isFiltered(
     return true;
   }
 
-  foreach (Filter* filter, frameworks[frameworkId].filters) {
+  // Only the filters for this slave need to be checked.
+  if (!frameworks[frameworkId].filters.contains(slaveId)) {
+    return false;
+  }
+
+  foreach (Filter* filter, frameworks[frameworkId].filters[slaveId]) {
     if (filter->filter(slaveId, resources)) {
       VLOG(1) << "Filtered " << resources
               << " on slave " << slaveId
@@ -845,7 +1199,7 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::isFiltered(
 template <class RoleSorter, class FrameworkSorter>
 bool
 HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocatable(
-    const Resources& resources)
+    const ResourceVector& resources)
 {
   // TODO(benh): For now, only make offers when there is some cpu
   // and memory left. This is an artifact of the original code that
@@ -865,6 +1219,41 @@ HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::allocatable(
   return false;
 }
 
+
+template <class RoleSorter, class FrameworkSorter>
+void
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::dirty(
+    const SlaveID& slaveId)
+{
+  dirtySlaves.insert(slaveId);
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+void
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::dirty(
+    const FrameworkID& frameworkId)
+{
+  dirtyFrameworks.insert(frameworkId);
+  dirtyPairs.erase(frameworkId);
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+double
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::_allocation_run_ms()
+{
+  return allocationRun.ms();
+}
+
+
+template <class RoleSorter, class FrameworkSorter>
+double
+HierarchicalAllocatorProcess<RoleSorter, FrameworkSorter>::_allocation_candidates()
+{
+  return static_cast<double>(allocationCandidates);
+}
+
 } // namespace allocator {
 } // namespace master {
 } // namespace internal {
@@ -16,6 +16,11 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <deque>
 #include <iomanip>
 #include <map>
 #include <sstream>
@@ -24,12 +29,19 @@
 
 #include <boost/array.hpp>
 
+#include <process/defer.hpp>
 #include <process/help.hpp>
+#include <process/id.hpp>
+#include <process/io.hpp>
+#include <process/process.hpp>
 
 #include <stout/foreach.hpp>
+#include <stout/gzip.hpp>
 #include <stout/json.hpp>
+#include <stout/lambda.hpp>
 #include <stout/memory.hpp>
 #include <stout/net.hpp>
+#include <stout/nothing.hpp>
 #include <stout/numify.hpp>
 #include <stout/os.hpp>
 #include <stout/result.hpp>
@@ -61,6 +73,7 @@ using process::http::NotFound;
 using process::http::OK;
 using process::http::TemporaryRedirect;
 
+using std::deque;
 using std::map;
 using std::string;
 using std::vector;
@@ -94,8 +107,10 @@ JSON::Object model(const Offer& offer)
 }
 
 
-// Returns a JSON object modeled on a Framework.
-JSON::Object model(const Framework& framework)
+// Returns a JSON object modeled on a Framework, except that the
+// 'tasks', 'completed_tasks' and 'offers' are left empty (they are
+// streamed separately, see StateProcess below).
+JSON::Object summarize(const Framework& framework)
 {
   JSON::Object object;
   object.values["id"] = framework.id.value();
@@ -115,42 +130,65 @@ JSON::Object model(const Framework& framework)
     object.values["reregistered_time"] = framework.reregisteredTime.secs();
   }
 
-  // Model all of the tasks associated with a framework.
-  {
-    JSON::Array array;
-    foreachvalue (Task* task, framework.tasks) {
-      array.values.push_back(model(*task));
-    }
+  object.values["tasks"] = JSON::Array();
+  object.values["completed_tasks"] = JSON::Array();
+  object.values["offers"] = JSON::Array();
 
-    object.values["tasks"] = array;
-  }
+  return object;
+}
 
-  // Model all of the completed tasks of a framework.
-  {
-    JSON::Array array;
-    foreach (const memory::shared_ptr<Task>& task, framework.completedTasks) {
-      array.values.push_back(model(*task));
-    }
 
-    object.values["completed_tasks"] = array;
-  }
+// A copy of the parts of a slave that are exposed through
+// 'state.json', so that they can be modeled outside of the master.
+struct SlaveState
+{
+  explicit SlaveState(const Slave& slave)
+    : id(slave.id),
+      pid(slave.pid),
+      info(slave.info),
+      registeredTime(slave.registeredTime),
+      reregisteredTime(slave.reregisteredTime) {}
+
+  SlaveID id;
+  process::UPID pid;
+  SlaveInfo info;
+  process::Time registeredTime;
+  Option<process::Time> reregisteredTime;
+};
+
 
-  // Model all of the offers associated with a framework.
+// A copy of the parts of a framework that are exposed through
+// 'state.json'. The framework itself is summarized right away while
+// its tasks and offers are copied to be modeled later.
+struct FrameworkState
+{
+  explicit FrameworkState(const Framework& framework)
+    : object(summarize(framework)),
+      completedTasks(
+          framework.completedTasks.begin(),
+          framework.completedTasks.end())
   {
-    JSON::Array array;
-    foreach (Offer* offer, framework.offers) {
-      array.values.push_back(model(*offer));
+    foreachvalue (Task* task, framework.tasks) {
+      tasks.push_back(*task);
     }
 
-    object.values["offers"] = array;
+    foreach (Offer* offer, framework.offers) {
+      offers.push_back(*offer);
+    }
   }
 
-  return object;
-}
+  JSON::Object object;
+  vector<Task> tasks;
+
+  // Completed tasks never change so they are shared, not copied.
+  vector<memory::shared_ptr<Task> > completedTasks;
+
+  vector<Offer> offers;
+};
 
 
 // Returns a JSON object modeled after a Slave.
-JSON::Object model(const Slave& slave)
+JSON::Object model(const SlaveState& slave)
 {
   JSON::Object object;
   object.values["id"] = slave.id.value();
@@ -402,11 +440,317 @@ Future<Response> Master::Http::stats(const Request& request)
 }
 
 
+// A snapshot of the master's state for 'state.json'.
+struct State
+{
+  // Everything but the slaves and (completed) frameworks, which are
+  // left as empty arrays.
+  JSON::Object object;
+
+  vector<SlaveState> slaves;
+  vector<memory::shared_ptr<FrameworkState> > frameworks;
+  vector<memory::shared_ptr<FrameworkState> > completedFrameworks;
+};
+
+
+// Renders (part of) 'state.json' to the stream.
+typedef lambda::function<void(std::ostream&)> Piece;
+
+
+static void literal(std::ostream& out, const string& s)
+{
+  out << s;
+}
+
+
+template <typename T>
+static void element(std::ostream& out, const T* t, bool first)
+{
+  if (!first) {
+    out << ",";
+  }
+
+  JSON::render(out, model(*t));
+}
+
+
+// Appends the pieces that render 'object' exactly like JSON::render
+// would, except that the values of the keys in 'arrays' (which are
+// expected to be empty arrays in 'object') are rendered by the
+// given pieces.
+static void layout(
+    const JSON::Object& object,
+    const map<string, deque<Piece> >& arrays,
+    deque<Piece>* pieces)
+{
+  std::ostringstream out;
+
+  out << "{";
+
+  map<string, JSON::Value>::const_iterator iterator;
+  for (iterator = object.values.begin();
+       iterator != object.values.end();
+       ++iterator) {
+    if (iterator != object.values.begin()) {
+      out << ",";
+    }
+
+    out << "\"" << iterator->first << "\":";
+
+    map<string, deque<Piece> >::const_iterator array =
+      arrays.find(iterator->first);
+
+    if (array == arrays.end()) {
+      JSON::render(out, iterator->second);
+      continue;
+    }
+
+    out << "[";
+    pieces->push_back(lambda::bind(&literal, lambda::_1, out.str()));
+    pieces->insert(pieces->end(), array->second.begin(), array->second.end());
+    out.str("");
+    out << "]";
+  }
+
+  out << "}";
+
+  pieces->push_back(lambda::bind(&literal, lambda::_1, out.str()));
+}
+
+
+static void layout(const FrameworkState& framework, deque<Piece>* pieces)
+{
+  map<string, deque<Piece> > arrays;
+
+  for (size_t i = 0; i < framework.tasks.size(); i++) {
+    arrays["tasks"].push_back(
+        lambda::bind(
+            &element<Task>, lambda::_1, &framework.tasks[i], i == 0));
+  }
+
+  for (size_t i = 0; i < framework.completedTasks.size(); i++) {
+    arrays["completed_tasks"].push_back(
+        lambda::bind(&element<Task>,
+                     lambda::_1,
+                     framework.completedTasks[i].get(),
+                     i == 0));
+  }
+
+  for (size_t i = 0; i < framework.offers.size(); i++) {
+    arrays["offers"].push_back(
+        lambda::bind(
+            &element<Offer>, lambda::_1, &framework.offers[i], i == 0));
+  }
+
+  layout(framework.object, arrays, pieces);
+}
+
+
+static deque<Piece> layout(
+    const vector<memory::shared_ptr<FrameworkState> >& frameworks)
+{
+  deque<Piece> pieces;
+
+  for (size_t i = 0; i < frameworks.size(); i++) {
+    if (i > 0) {
+      pieces.push_back(lambda::bind(&literal, lambda::_1, ","));
+    }
+
+    layout(*frameworks[i], &pieces);
+  }
+
+  return pieces;
+}
+
+
+// Streams 'state.json' from a snapshot of the master's state into a
+// pipe, which is sent as a chunked response. The JSON is rendered a
+// chunk at a time (while the previous chunk is written) so that it
+// is never held in memory as a whole and the master is not involved
+// in rendering it.
+//
+// NOTE: libprocess only compresses BODY responses, so when 'gzip' is
+// set the chunks are compressed here using a single deflate stream
+// (flushed after each chunk so that the client can decompress the
+// JSON as it arrives).
+class StateProcess : public process::Process<StateProcess>
+{
+public:
+  StateProcess(
+      const memory::shared_ptr<State>& _state,
+      const Option<string>& _jsonp,
+      bool _gzip,
+      int _pipe)
+    : process::ProcessBase(process::ID::generate("__state__")),
+      state(_state),
+      jsonp(_jsonp),
+      gzip(_gzip),
+      pipe(_pipe),
+      finished(false) {}
+
+  virtual ~StateProcess() {}
+
+protected:
+  virtual void initialize()
+  {
+    if (gzip) {
+      stream.zalloc = Z_NULL;
+      stream.zfree = Z_NULL;
+      stream.opaque = Z_NULL;
+
+      int code = deflateInit2(
+          &stream,
+          Z_DEFAULT_COMPRESSION,
+          Z_DEFLATED,
+          MAX_WBITS + 16, // Zlib magic for gzip compression.
+          8,              // Default memLevel value.
+          Z_DEFAULT_STRATEGY);
+
+      if (code != Z_OK) {
+        LOG(WARNING) << "Failed to stream 'state.json': "
+                     << "Failed to initialize zlib";
+        gzip = false;
+        terminate(self());
+        return;
+      }
+    }
+
+    if (jsonp.isSome()) {
+      pieces.push_back(lambda::bind(&literal, lambda::_1, jsonp.get() + "("));
+    }
+
+    map<string, deque<Piece> > arrays;
+
+    for (size_t i = 0; i < state->slaves.size(); i++) {
+      arrays["slaves"].push_back(
+          lambda::bind(
+              &element<SlaveState>, lambda::_1, &state->slaves[i], i == 0));
+    }
+
+    arrays["frameworks"] = layout(state->frameworks);
+    arrays["completed_frameworks"] = layout(state->completedFrameworks);
+
+    layout(state->object, arrays, &pieces);
+
+    if (jsonp.isSome()) {
+      pieces.push_back(lambda::bind(&literal, lambda::_1, ");"));
+    }
+
+    write();
+  }
+
+  virtual void finalize()
+  {
+    if (gzip) {
+      deflateEnd(&stream);
+    }
+
+    os::close(pipe);
+  }
+
+private:
+  void write()
+  {
+    std::ostringstream out;
+
+    while (!pieces.empty() && out.tellp() < CHUNK_SIZE) {
+      pieces.front()(out);
+      pieces.pop_front();
+    }
+
+    string data = out.str();
+
+    if (gzip) {
+      // The last (possibly empty) chunk finishes the gzip stream.
+      if (finished) {
+        terminate(self());
+        return;
+      }
+
+      finished = pieces.empty();
+
+      Try<string> compressed = compress(data, finished);
+      if (compressed.isError()) {
+        LOG(WARNING) << "Failed to stream 'state.json': "
+                     << compressed.error();
+        terminate(self());
+        return;
+      }
+
+      data = compressed.get();
+    } else if (data.empty()) {
+      terminate(self());
+      return;
+    }
+
+    process::io::write(pipe, data)
+      .onAny(defer(self(), &Self::_write, lambda::_1));
+  }
+
+  // Compresses the chunk, flushing the output so that it can be
+  // decompressed without waiting for the next chunk.
+  Try<string> compress(const string& data, bool finish)
+  {
+    stream.next_in =
+      const_cast<Bytef*>(reinterpret_cast<const Bytef*>(data.data()));
+    stream.avail_in = data.length();
+
+    Bytef buffer[GZIP_BUFFER_SIZE];
+    string result;
+
+    int code;
+    do {
+      stream.next_out = buffer;
+      stream.avail_out = GZIP_BUFFER_SIZE;
+      code = deflate(&stream, finish ? Z_FINISH : Z_SYNC_FLUSH);
+
+      if (code != Z_OK && code != Z_STREAM_END && code != Z_BUF_ERROR) {
+        return Error("Failed to compress: " + stringify(code));
+      }
+
+      result.append(
+          reinterpret_cast<char*>(buffer),
+          GZIP_BUFFER_SIZE - stream.avail_out);
+    } while (stream.avail_out == 0);
+
+    return result;
+  }
+
+  void _write(const Future<Nothing>& future)
+  {
+    if (!future.isReady()) {
+      LOG(WARNING) << "Failed to stream 'state.json': "
+                   << (future.isFailed() ? future.failure() : "discarded");
+      terminate(self());
+      return;
+    }
+
+    write();
+  }
+
+  static const std::streamoff CHUNK_SIZE = 64 * 1024;
+
+  const memory::shared_ptr<State> state;
+  const Option<string> jsonp;
+  bool gzip;
+  const int pipe;
+
+  deque<Piece> pieces;
+
+  // The deflate stream when compressing, which is finished along
+  // with the last chunk.
+  z_stream stream;
+  bool finished;
+};
+
+
 Future<Response> Master::Http::state(const Request& request)
 {
   LOG(INFO) << "HTTP request for '" << request.path << "'";
 
-  JSON::Object object;
+  memory::shared_ptr<State> state(new State());
+
+  JSON::Object& object = state->object;
   object.values["version"] = MESOS_VERSION;
 
   if (build::GIT_SHA.isSome()) {
@@ -458,39 +802,59 @@ Future<Response> Master::Http::state(const Request& request)
   }
   object.values["flags"] = flags;
 
-  // Model all of the slaves.
-  {
-    JSON::Array array;
-    foreachvalue (Slave* slave, master.slaves.activated) {
-      array.values.push_back(model(*slave));
-    }
+  // Copy the slaves and frameworks, they are modeled (and the JSON
+  // is rendered) by the StateProcess.
+  foreachvalue (Slave* slave, master.slaves.activated) {
+    state->slaves.push_back(SlaveState(*slave));
+  }
 
-    object.values["slaves"] = array;
+  foreachvalue (Framework* framework, master.frameworks.activated) {
+    state->frameworks.push_back(
+        memory::shared_ptr<FrameworkState>(new FrameworkState(*framework)));
   }
 
-  // Model all of the frameworks.
-  {
-    JSON::Array array;
-    foreachvalue (Framework* framework, master.frameworks.activated) {
-      array.values.push_back(model(*framework));
-    }
+  foreach (const memory::shared_ptr<Framework>& framework,
+           master.frameworks.completed) {
+    state->completedFrameworks.push_back(
+        memory::shared_ptr<FrameworkState>(new FrameworkState(*framework)));
+  }
 
-    object.values["frameworks"] = array;
+  object.values["slaves"] = JSON::Array();
+  object.values["frameworks"] = JSON::Array();
+  object.values["completed_frameworks"] = JSON::Array();
+
+  int pipes[2];
+  if (::pipe(pipes) < 0) {
+    return InternalServerError(
+        string("Failed to create pipe: ") + strerror(errno));
   }
 
-  // Model all of the completed frameworks.
-  {
-    JSON::Array array;
+  // The StateProcess writes asynchronously, the reading end is
+  // handled (and closed) by libprocess.
+  Try<Nothing> nonblock = os::nonblock(pipes[1]);
+  if (nonblock.isError()) {
+    os::close(pipes[0]);
+    os::close(pipes[1]);
+    return InternalServerError(
+        "Failed to set nonblock on pipe: " + nonblock.error());
+  }
 
-    foreach (const memory::shared_ptr<Framework>& framework,
-             master.frameworks.completed) {
-      array.values.push_back(model(*framework));
-    }
+  Option<string> jsonp = request.query.get("jsonp");
+
+  OK response;
+  response.type = Response::PIPE;
+  response.pipe = pipes[0];
+  response.headers["Content-Type"] =
+    jsonp.isSome() ? "text/javascript" : "application/json";
 
-    object.values["completed_frameworks"] = array;
+  const bool gzip = request.accepts("gzip");
+  if (gzip) {
+    response.headers["Content-Encoding"] = "gzip";
   }
 
-  return OK(object, request.query.get("jsonp"));
+  process::spawn(new StateProcess(state, jsonp, gzip, pipes[1]), true);
+
+  return response;
 }
 
 
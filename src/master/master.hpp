@@ -779,6 +779,14 @@ public:
     CHECK(info.has_id()) << "SlaveInfo is missing the 'id' field";
   }
 
+  virtual RegistryMutation mutation() const
+  {
+    RegistryMutation mutation;
+    mutation.set_type(RegistryMutation::ADD_SLAVE);
+    mutation.mutable_slave()->CopyFrom(info);
+    return mutation;
+  }
+
 protected:
   virtual Try<bool> perform(Registry* registry, bool strict)
   {
@@ -812,6 +820,14 @@ public:
     CHECK(info.has_id()) << "SlaveInfo is missing the 'id' field";
   }
 
+  virtual RegistryMutation mutation() const
+  {
+    RegistryMutation mutation;
+    mutation.set_type(RegistryMutation::ADD_SLAVE);
+    mutation.mutable_slave()->CopyFrom(info);
+    return mutation;
+  }
+
 protected:
   virtual Try<bool> perform(Registry* registry, bool strict)
   {
@@ -844,6 +860,14 @@ public:
     CHECK(info.has_id()) << "SlaveInfo is missing the 'id' field";
   }
 
+  virtual RegistryMutation mutation() const
+  {
+    RegistryMutation mutation;
+    mutation.set_type(RegistryMutation::REMOVE_SLAVE);
+    mutation.mutable_slave_id()->CopyFrom(info.id());
+    return mutation;
+  }
+
 protected:
   virtual Try<bool> perform(Registry* registry, bool strict)
   {
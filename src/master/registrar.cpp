@@ -28,6 +28,9 @@
 #include <process/owned.hpp>
 #include <process/process.hpp>
 
+#include <process/metrics/metrics.hpp>
+#include <process/metrics/timer.hpp>
+
 #include <stout/lambda.hpp>
 #include <stout/none.hpp>
 #include <stout/nothing.hpp>
@@ -76,6 +79,7 @@ class RegistrarProcess : public Process<RegistrarProcess>
 public:
   RegistrarProcess(const Flags& _flags, State* _state)
     : ProcessBase(process::ID::generate("registrar")),
+      written(0),
       updating(false),
       flags(_flags),
       state(_state) {}
@@ -104,6 +108,14 @@ private:
   public:
     explicit Recover(const MasterInfo& _info) : info(_info) {}
 
+    virtual RegistryMutation mutation() const
+    {
+      RegistryMutation mutation;
+      mutation.set_type(RegistryMutation::SET_MASTER);
+      mutation.mutable_master()->CopyFrom(info);
+      return mutation;
+    }
+
   protected:
     virtual Try<bool> perform(Registry* registry, bool strict)
     {
@@ -115,7 +127,21 @@ private:
     const MasterInfo info;
   };
 
-  Option<Variable<Registry> > variable;
+  // The Registry is stored as a snapshot (the 'registry' variable)
+  // plus the mutations applied since then (the 'registry.deltas'
+  // variable), so most updates only need to store the deltas.
+  Option<Variable<Registry> > snapshot;
+  Option<Variable<RegistryDeltas> > deltas;
+
+  // The current Registry, i.e., the snapshot with the deltas applied
+  // (along with the operations being stored, if updating, which is
+  // why the '/registry' endpoint replays the stored Registry then).
+  Registry current;
+
+  // Bytes of deltas stored since the last snapshot, used to decide
+  // when storing a new snapshot is cheaper than storing the deltas.
+  size_t written;
+
   deque<Owned<Operation> > operations;
   bool updating; // Used to signify fetching (recovering) or storing.
 
@@ -123,29 +149,102 @@ private:
   void _recover(
       const MasterInfo& info,
       const Future<Variable<Registry> >& recovery);
-  void __recover(const Future<bool>& recover);
+  void __recover(
+      const MasterInfo& info,
+      const Future<Variable<RegistryDeltas> >& recovery);
+  void ___recover(const Future<bool>& recover);
   Future<bool> _apply(Owned<Operation> operation);
 
-  // Helper for updating state (performing store).
+  // Helpers for updating state (performing stores).
   void update();
-  void _update(
+  void _snapshot(
       const Future<Option<Variable<Registry> > >& store,
       deque<Owned<Operation> > operations);
+  void _update(
+      const Future<Option<Variable<RegistryDeltas> > >& store,
+      deque<Owned<Operation> > operations);
+
+  // Returns the Registry from the stored snapshot and deltas.
+  Registry replay() const;
 
   const Flags flags;
   State* state;
 
   // Used to compose our operations with recovery.
   Option<Owned<Promise<Registry> > > recovered;
+
+  struct Metrics
+  {
+    Metrics()
+      : operation_latency_ms("registrar/operation_latency_ms")
+    {
+      process::metrics::add(operation_latency_ms);
+    }
+
+    ~Metrics()
+    {
+      process::metrics::remove(operation_latency_ms);
+    }
+
+    // Time from applying an operation until it has been stored,
+    // including the time spent queued behind other operations.
+    process::metrics::Timer operation_latency_ms;
+  } metrics;
 };
 
 
+// Applies a (persisted) mutation to the registry. This is idempotent
+// (see RegistryMutation) and has the same effect as the operation
+// that performed the mutation.
+static void mutate(Registry* registry, const RegistryMutation& mutation)
+{
+  switch (mutation.type()) {
+    case RegistryMutation::SET_MASTER: {
+      CHECK(mutation.has_master());
+      registry->mutable_master()->mutable_info()->CopyFrom(mutation.master());
+      break;
+    }
+
+    case RegistryMutation::ADD_SLAVE: {
+      CHECK(mutation.has_slave());
+      Registry::Slaves* slaves = registry->mutable_slaves();
+      for (int i = 0; i < slaves->slaves().size(); i++) {
+        if (slaves->slaves(i).info().id() == mutation.slave().id()) {
+          slaves->mutable_slaves(i)->mutable_info()->CopyFrom(
+              mutation.slave());
+          return;
+        }
+      }
+      slaves->add_slaves()->mutable_info()->CopyFrom(mutation.slave());
+      break;
+    }
+
+    case RegistryMutation::REMOVE_SLAVE: {
+      CHECK(mutation.has_slave_id());
+      Registry::Slaves* slaves = registry->mutable_slaves();
+      for (int i = 0; i < slaves->slaves().size(); i++) {
+        if (slaves->slaves(i).info().id() == mutation.slave_id()) {
+          slaves->mutable_slaves()->DeleteSubrange(i, 1);
+          return;
+        }
+      }
+      break;
+    }
+
+    default:
+      LOG(FATAL) << "Unknown registry mutation " << mutation.type();
+  }
+}
+
+
 Future<Response> RegistrarProcess::registry(const Request& request)
 {
   JSON::Object result;
 
-  if (variable.isSome()) {
-    result = JSON::Protobuf(variable.get().get());
+  // While updating, 'current' includes the operations that are still
+  // being stored (and might fail), so serve what has been stored.
+  if (recovered.isSome() && recovered.get()->future().isReady()) {
+    result = JSON::Protobuf(updating ? replay() : current);
   }
 
   return OK(result, request.query.get("jsonp"));
@@ -156,7 +255,7 @@ string RegistrarProcess::registryHelp()
 {
   return HELP(
       TLDR(
-          "Returns the current contents of the Registry in JSON."),
+          "Returns the stored contents of the Registry in JSON."),
       USAGE(
           "/registrar(1)/registry"),
       DESCRIPTION(
@@ -228,32 +327,55 @@ Future<Registry> RegistrarProcess::recover(const MasterInfo& info)
 void RegistrarProcess::_recover(
     const MasterInfo& info,
     const Future<Variable<Registry> >& recovery)
+{
+  CHECK(!recovery.isPending());
+
+  if (!recovery.isReady()) {
+    updating = false;
+    recovered.get()->fail("Failed to recover registrar: " +
+        (recovery.isFailed() ? recovery.failure() : "discarded"));
+  } else {
+    snapshot = recovery.get();
+
+    state->fetch<RegistryDeltas>("registry.deltas")
+      .onAny(defer(self(), &Self::__recover, info, lambda::_1));
+  }
+}
+
+
+void RegistrarProcess::__recover(
+    const MasterInfo& info,
+    const Future<Variable<RegistryDeltas> >& recovery)
 {
   updating = false;
 
   CHECK(!recovery.isPending());
 
   if (!recovery.isReady()) {
-    recovered.get()->fail("Failed to recover registrar: " +
+    recovered.get()->fail("Failed to recover registrar: "
+        "Failed to recover deltas: " +
         (recovery.isFailed() ? recovery.failure() : "discarded"));
   } else {
-    LOG(INFO) << "Successfully recovered registrar";
+    deltas = recovery.get();
+
+    current = replay();
+    written = deltas.get().get().ByteSize();
 
-    // Save the registry.
-    variable = recovery.get();
+    LOG(INFO) << "Successfully recovered registrar ("
+              << deltas.get().get().mutations().size() << " deltas)";
 
     // Perform the Recover operation to add the new MasterInfo.
     Owned<Operation> operation(new Recover(info));
     operations.push_back(operation);
     operation->future()
-      .onAny(defer(self(), &Self::__recover, lambda::_1));
+      .onAny(defer(self(), &Self::___recover, lambda::_1));
 
     update();
   }
 }
 
 
-void RegistrarProcess::__recover(const Future<bool>& recover)
+void RegistrarProcess::___recover(const Future<bool>& recover)
 {
   CHECK(!recover.isPending());
 
@@ -265,11 +387,10 @@ void RegistrarProcess::__recover(const Future<bool>& recover)
     recovered.get()->fail("Failed to recover registrar: "
         "Failed to persist MasterInfo: version mismatch");
   } else {
-    // At this point _update() has updated 'variable' to contain
-    // the Registry with the latest MasterInfo.
+    // At this point _update() has updated 'current' to contain
+    // the latest MasterInfo.
     // Set the promise and un-gate any pending operations.
-    CHECK_SOME(variable);
-    recovered.get()->set(variable.get().get());
+    recovered.get()->set(current);
   }
 }
 
@@ -287,10 +408,10 @@ Future<bool> RegistrarProcess::apply(Owned<Operation> operation)
 
 Future<bool> RegistrarProcess::_apply(Owned<Operation> operation)
 {
-  CHECK_SOME(variable);
+  CHECK_SOME(snapshot);
 
   operations.push_back(operation);
-  Future<bool> future = operation->future();
+  Future<bool> future = metrics.operation_latency_ms.time(operation->future());
   if (!updating) {
     update();
   }
@@ -310,41 +431,90 @@ void RegistrarProcess::update()
 
   LOG(INFO) << "Attempting to update the 'registry'";
 
-  CHECK_SOME(variable);
+  CHECK_SOME(snapshot);
+  CHECK_SOME(deltas);
 
-  Registry registry = variable.get().get();
+  // The operations are performed directly on the current Registry
+  // rather than a copy, which for a large Registry is more expensive
+  // than storing the deltas. If storing fails the current Registry
+  // is replayed from what was stored instead (see _update).
+  RegistryDeltas deltas = this->deltas.get().get();
 
   foreach (Owned<Operation> operation, operations) {
-    // No need to process the result of the operation.
-    (*operation)(&registry, flags.registry_strict);
+    Try<bool> mutated = (*operation)(&current, flags.registry_strict);
+
+    if (mutated.isSome() && mutated.get()) {
+      deltas.add_mutations()->CopyFrom(operation->mutation());
+    }
   }
 
   // TODO(benh): Add a timeout so we don't wait forever.
 
-  // Perform the store!
-  state->store(variable.get().mutate(registry))
-    .onAny(defer(self(), &Self::_update, lambda::_1, operations));
+  // Since the deltas are stored as a whole, each update stores all
+  // of the deltas since the last snapshot. Once the deltas stored
+  // add up to the size of the Registry it's cheaper to store a new
+  // snapshot instead, which bounds the bytes stored per update to
+  // roughly sqrt(2 * registry size * mutation size).
+  if (written + deltas.ByteSize() >= (size_t) current.ByteSize()) {
+    LOG(INFO) << "Storing a snapshot of the 'registry' ("
+              << deltas.mutations().size() << " deltas)";
+
+    state->store(snapshot.get().mutate(current))
+      .onAny(defer(self(), &Self::_snapshot, lambda::_1, operations));
+  } else {
+    state->store(this->deltas.get().mutate(deltas))
+      .onAny(defer(self(), &Self::_update, lambda::_1, operations));
+  }
 
   // Clear the operations, _update will transition the Promises!
   operations.clear();
 }
 
 
-void RegistrarProcess::_update(
+void RegistrarProcess::_snapshot(
     const Future<Option<Variable<Registry> > >& store,
     deque<Owned<Operation> > applied)
+{
+  if (!store.isReady()) {
+    _update(Failure(store.isFailed() ? store.failure() : "discarded"),
+            applied);
+    return;
+  } else if (store.get().isNone()) {
+    // Version mismatch.
+    _update(Option<Variable<RegistryDeltas> >::none(), applied);
+    return;
+  }
+
+  snapshot = store.get().get();
+  written = 0;
+
+  // The snapshot includes the deltas, so clear them. If we fail
+  // before then, the deltas are replayed on top of the snapshot
+  // during recovery, which is fine since mutations are idempotent.
+  state->store(deltas.get().mutate(RegistryDeltas()))
+    .onAny(defer(self(), &Self::_update, lambda::_1, applied));
+}
+
+
+void RegistrarProcess::_update(
+    const Future<Option<Variable<RegistryDeltas> > >& store,
+    deque<Owned<Operation> > applied)
 {
   updating = false;
 
-  // Set the variable if the storage operation succeeded.
+  // Set the deltas if the storage operation succeeded, otherwise
+  // undo the operations by replaying what has been stored.
   if (!store.isReady()) {
     LOG(ERROR) << "Failed to update 'registry': "
                << (store.isFailed() ? store.failure() : "discarded");
+    current = replay();
   } else if (store.get().isNone()) {
     LOG(WARNING) << "Failed to update 'registry': version mismatch";
+    current = replay();
   } else {
     LOG(INFO) << "Successfully updated 'registry'";
-    variable = store.get().get();
+    deltas = store.get().get();
+    written += deltas.get().get().ByteSize();
   }
 
   // Remove the operations.
@@ -372,6 +542,22 @@ void RegistrarProcess::_update(
 }
 
 
+Registry RegistrarProcess::replay() const
+{
+  CHECK_SOME(snapshot);
+  CHECK_SOME(deltas);
+
+  Registry registry = snapshot.get().get();
+  const RegistryDeltas& mutations = deltas.get().get();
+
+  foreach (const RegistryMutation& mutation, mutations.mutations()) {
+    mutate(&registry, mutation);
+  }
+
+  return registry;
+}
+
+
 Registrar::Registrar(const Flags& flags, State* state)
 {
   process = new RegistrarProcess(flags, state);
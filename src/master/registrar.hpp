@@ -58,6 +58,11 @@ public:
   // Sets the promise based on whether the operation was successful.
   bool set() { return process::Promise<bool>::set(success); }
 
+  // Returns the mutation of the Registry performed by the operation
+  // whenever 'perform' mutates it, which the Registrar persists as a
+  // delta instead of storing the entire Registry.
+  virtual RegistryMutation mutation() const = 0;
+
 protected:
   virtual Try<bool> perform(Registry* registry, bool strict) = 0;
 
@@ -68,7 +68,9 @@ public:
 
   // Returns a list of all clients, in the order that they
   // should be allocated to, according to this Sorter's policy.
-  virtual std::list<std::string> sort() = 0;
+  // NOTE: The returned list is owned by the Sorter and is only
+  // valid until the next call to 'sort'.
+  virtual const std::list<std::string>& sort() = 0;
 
   // Returns true if this Sorter contains the specified client,
   // either active or deactivated.
@@ -35,6 +35,7 @@ const double GC_DISK_HEADROOM = 0.1;
 const Duration DISK_WATCH_INTERVAL = Minutes(1);
 const Duration RECOVERY_TIMEOUT = Minutes(15);
 const Duration RESOURCE_MONITORING_INTERVAL = Seconds(1);
+const Duration PROCESS_SNAPSHOT_INTERVAL = Milliseconds(500);
 const uint32_t MAX_COMPLETED_FRAMEWORKS = 50;
 const uint32_t MAX_COMPLETED_EXECUTORS_PER_FRAMEWORK = 150;
 const uint32_t MAX_COMPLETED_TASKS_PER_EXECUTOR = 200;
@@ -42,6 +43,9 @@ const double DEFAULT_CPUS = 1;
 const Bytes DEFAULT_MEM = Gigabytes(1);
 const Bytes DEFAULT_DISK = Gigabytes(10);
 const std::string DEFAULT_PORTS = "[31000-32000]";
+const Bytes STATUS_UPDATE_JOURNAL_COMPACTION_SIZE = Megabytes(8);
+const Duration EXTERNAL_CONTAINERIZER_DAEMON_BACKOFF_MIN = Seconds(1);
+const Duration EXTERNAL_CONTAINERIZER_DAEMON_BACKOFF_MAX = Minutes(1);
 
 } // namespace slave {
 } // namespace internal {
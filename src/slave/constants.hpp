@@ -45,6 +45,10 @@ extern const Duration GC_DELAY;
 extern const Duration DISK_WATCH_INTERVAL;
 extern const Duration RESOURCE_MONITORING_INTERVAL;
 
+// Interval during which the snapshot of the processes used to collect
+// the resource usage of the containers gets shared (see 'pstree').
+extern const Duration PROCESS_SNAPSHOT_INTERVAL;
+
 // Minimum free disk capacity enforced by the garbage collector.
 extern const double GC_DISK_HEADROOM;
 
@@ -69,6 +73,16 @@ extern const Bytes DEFAULT_DISK;
 // Default ports range offered by the slave.
 extern const std::string DEFAULT_PORTS;
 
+// Backoff between restarts of the external containerizer daemon, it
+// is doubled (up to the maximum) each time the daemon is restarted
+// and reset once it responds again.
+extern const Duration EXTERNAL_CONTAINERIZER_DAEMON_BACKOFF_MIN;
+extern const Duration EXTERNAL_CONTAINERIZER_DAEMON_BACKOFF_MAX;
+
+// Minimum size of the status update journal before it gets compacted,
+// after which it gets compacted whenever it doubles in size.
+extern const Bytes STATUS_UPDATE_JOURNAL_COMPACTION_SIZE;
+
 } // namespace slave {
 } // namespace internal {
 } // namespace mesos {
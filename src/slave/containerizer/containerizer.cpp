@@ -16,14 +16,18 @@
  * limitations under the License.
  */
 
+#include <list>
 #include <map>
 #include <vector>
 
+#include <process/collect.hpp>
 #include <process/dispatch.hpp>
 #include <process/owned.hpp>
 
 #include <stout/fs.hpp>
 #include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
+#include <stout/lambda.hpp>
 #include <stout/net.hpp>
 #include <stout/stringify.hpp>
 #include <stout/uuid.hpp>
@@ -46,6 +50,7 @@
 #include "slave/containerizer/isolators/cgroups/mem.hpp"
 #endif // __linux__
 
+using std::list;
 using std::map;
 using std::string;
 using std::vector;
@@ -223,6 +228,24 @@ Try<Containerizer*> Containerizer::create(
 }
 
 
+Future<hashmap<ContainerID, ResourceStatistics> > Containerizer::usage(
+    const hashset<ContainerID>& containerIds)
+{
+  list<ContainerID> ids;
+  list<Future<ResourceStatistics> > futures;
+
+  foreach (const ContainerID& containerId, containerIds) {
+    ids.push_back(containerId);
+    futures.push_back(usage(containerId));
+  }
+
+  // Use await() here so we can return the statistics of the
+  // containers whose usage could be collected.
+  return await(futures)
+    .then(lambda::bind(collectUsage, ids, lambda::_1));
+}
+
+
 map<string, string> executorEnvironment(
     const ExecutorInfo& executorInfo,
     const string& directory,
@@ -283,6 +306,33 @@ map<string, string> executorEnvironment(
   return env;
 }
 
+
+hashmap<ContainerID, ResourceStatistics> collectUsage(
+    const list<ContainerID>& containerIds,
+    const list<Future<ResourceStatistics> >& statistics)
+{
+  CHECK_EQ(containerIds.size(), statistics.size());
+
+  hashmap<ContainerID, ResourceStatistics> result;
+
+  list<ContainerID>::const_iterator containerId = containerIds.begin();
+  list<Future<ResourceStatistics> >::const_iterator statistic =
+    statistics.begin();
+
+  for (; containerId != containerIds.end(); ++containerId, ++statistic) {
+    if (statistic->isReady()) {
+      result[*containerId] = statistic->get();
+    } else {
+      LOG(WARNING) << "Skipping resource statistics for container "
+                   << *containerId << " because: "
+                   << (statistic->isFailed() ? statistic->failure()
+                                             : "discarded");
+    }
+  }
+
+  return result;
+}
+
 } // namespace slave {
 } // namespace internal {
 } // namespace mesos {
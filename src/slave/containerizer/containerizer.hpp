@@ -19,6 +19,7 @@
 #ifndef __CONTAINERIZER_HPP__
 #define __CONTAINERIZER_HPP__
 
+#include <list>
 #include <map>
 
 #include <containerizer.pb.h>
@@ -31,6 +32,8 @@
 #include <process/process.hpp>
 
 #include <stout/duration.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
 #include <stout/option.hpp>
 #include <stout/try.hpp>
 
@@ -90,6 +93,14 @@ public:
   virtual process::Future<ResourceStatistics> usage(
       const ContainerID& containerId) = 0;
 
+  // Get resource usage statistics on all of the given containers at
+  // once, e.g., so they can be sampled at the same point in time.
+  // Containers for which the statistics couldn't be collected are
+  // left out of the result. The default implementation asks for the
+  // usage of each of the containers.
+  virtual process::Future<hashmap<ContainerID, ResourceStatistics> > usage(
+      const hashset<ContainerID>& containerIds);
+
   // Wait on the container's 'Termination'. If the executor terminates, the
   // containerizer should also destroy the containerized context. The future
   // may be failed if an error occurs during termination of the executor or
@@ -114,6 +125,15 @@ std::map<std::string, std::string> executorEnvironment(
     bool checkpoint,
     const Duration& recoveryTimeout);
 
+
+// Helper for implementing the batch usage by collecting the usage
+// statistics of each of the containers (in the same order). The
+// containers whose statistics couldn't be collected are logged and
+// left out.
+hashmap<ContainerID, ResourceStatistics> collectUsage(
+    const std::list<ContainerID>& containerIds,
+    const std::list<process::Future<ResourceStatistics> >& statistics);
+
 } // namespace slave {
 } // namespace internal {
 } // namespace mesos {
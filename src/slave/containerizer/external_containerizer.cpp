@@ -16,6 +16,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <list>
@@ -24,6 +25,7 @@
 #include <poll.h>
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <boost/shared_array.hpp>
 
@@ -35,16 +37,19 @@
 #include <process/reap.hpp>
 
 #include <stout/check.hpp>
+#include <stout/duration.hpp>
 #include <stout/foreach.hpp>
 #include <stout/lambda.hpp>
 #include <stout/nothing.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
+#include <stout/path.hpp>
 #include <stout/strings.hpp>
 #include <stout/uuid.hpp>
 
 #include "common/type_utils.hpp"
 
+#include "slave/constants.hpp"
 #include "slave/paths.hpp"
 
 #include "slave/containerizer/external_containerizer.hpp"
@@ -132,7 +137,23 @@ Future<Nothing> ExternalContainerizer::update(
 Future<ResourceStatistics> ExternalContainerizer::usage(
     const ContainerID& containerId)
 {
-  return dispatch(process, &ExternalContainerizerProcess::usage, containerId);
+  // Need to disambiguate overloaded function.
+  Future<ResourceStatistics> (ExternalContainerizerProcess::*usage)(
+      const ContainerID&) = &ExternalContainerizerProcess::usage;
+
+  return dispatch(process, usage, containerId);
+}
+
+
+Future<hashmap<ContainerID, ResourceStatistics> > ExternalContainerizer::usage(
+    const hashset<ContainerID>& containerIds)
+{
+  // Need to disambiguate overloaded function.
+  Future<hashmap<ContainerID, ResourceStatistics> >
+    (ExternalContainerizerProcess::*usage)(const hashset<ContainerID>&) =
+      &ExternalContainerizerProcess::usage;
+
+  return dispatch(process, usage, containerIds);
 }
 
 
@@ -150,7 +171,11 @@ void ExternalContainerizer::destroy(const ContainerID& containerId)
 
 
 ExternalContainerizerProcess::ExternalContainerizerProcess(
-    const Flags& _flags) : flags(_flags) {}
+    const Flags& _flags)
+  : flags(_flags),
+    nextRequest(0),
+    sending(Nothing()),
+    backoff(EXTERNAL_CONTAINERIZER_DAEMON_BACKOFF_MIN) {}
 
 
 Future<Nothing> ExternalContainerizerProcess::recover(
@@ -200,7 +225,8 @@ Future<Nothing> ExternalContainerizerProcess::recover(
         }
 
         const pid_t pid(run.get().forkedPid.get());
-        containers.put(containerId, Owned<Container>(new Container(pid)));
+        containers.put(containerId, Owned<Container>(new Container()));
+        containers[containerId]->pid = pid;
 
         process::reap(pid)
           .onAny(defer(
@@ -298,7 +324,7 @@ Future<ExecutorInfo> ExternalContainerizerProcess::launch(
   stringstream output;
   external.SerializeToOstream(&output);
 
-  Try<Subprocess> invoked = invoke(
+  Try<Future<ResultFutures> > invoked = invoke(
       "launch",
       containerId,
       output.str(),
@@ -309,15 +335,12 @@ Future<ExecutorInfo> ExternalContainerizerProcess::launch(
       + "' failed (error: " + invoked.error() + ")");
   }
 
-  // Record the process.
-  containers.put(
-      containerId,
-      Owned<Container>(new Container(invoked.get().pid())));
+  // Record the container.
+  containers.put(containerId, Owned<Container>(new Container()));
 
-  VLOG(2) << "Now awaiting data from pipe...";
+  VLOG(2) << "Now awaiting the launch result...";
 
-  // Read from the result-pipe and invoke callbacks when reaching EOF.
-  return await(read(invoked.get().out()), invoked.get().status())
+  return invoked.get()
     .then(defer(
         PID<ExternalContainerizerProcess>(this),
         &ExternalContainerizerProcess::_launch,
@@ -425,7 +448,7 @@ Future<Termination> ExternalContainerizerProcess::wait(
     return Failure("Container '" + containerId.value() + "' not running");
   }
 
-  Try<Subprocess> invoked = invoke("wait", containerId);
+  Try<Future<ResultFutures> > invoked = invoke("wait", containerId);
 
   if (invoked.isError()) {
     LOG(ERROR) << "not running";
@@ -434,9 +457,7 @@ Future<Termination> ExternalContainerizerProcess::wait(
       + "' failed (error: " + invoked.error() + ")");
   }
 
-  // Await both, input from the pipe as well as an exit of the
-  // process.
-  await(read(invoked.get().out()), invoked.get().status())
+  invoked.get()
     .onAny(defer(
         PID<ExternalContainerizerProcess>(this),
         &ExternalContainerizerProcess::_wait,
@@ -463,8 +484,16 @@ void ExternalContainerizerProcess::_wait(
   string result;
   Try<bool> support = commandSupported(future, result);
   if (support.isError()) {
-    container->termination.fail(support.error());
-    return;
+    if (container->pid.isNone()) {
+      container->termination.fail(support.error());
+      return;
+    }
+
+    // Failing to wait doesn't mean the container is gone, e.g., the
+    // daemon might have failed to answer. The reaper reports the
+    // termination once the executor really terminates.
+    LOG(WARNING) << "Wait on container '" << containerId << "' failed: "
+                 << support.error() << "; relying on the reaper instead";
   }
 
   // Final clean up is delayed until someone has waited on the
@@ -473,6 +502,10 @@ void ExternalContainerizerProcess::_wait(
     container->waited.set(true);
   }
 
+  if (support.isError()) {
+    return;
+  }
+
   if (support.get()) {
     VLOG(1) << "Wait supported by external containerizer";
 
@@ -522,7 +555,8 @@ Future<Nothing> ExternalContainerizerProcess::update(
   stringstream output;
   resourceArray.SerializeToOstream(&output);
 
-  Try<Subprocess> invoked = invoke("update", containerId, output.str());
+  Try<Future<ResultFutures> > invoked =
+    invoke("update", containerId, output.str());
 
   if (invoked.isError()) {
     terminate(containerId);
@@ -530,9 +564,7 @@ Future<Nothing> ExternalContainerizerProcess::update(
       + "' failed (error: " + invoked.error() + ")");
   }
 
-  // Await both, input from the pipe as well as an exit of the
-  // process.
-  return await(read(invoked.get().out()), invoked.get().status())
+  return invoked.get()
     .then(defer(
         PID<ExternalContainerizerProcess>(this),
         &ExternalContainerizerProcess::_update,
@@ -592,7 +624,7 @@ Future<ResourceStatistics> ExternalContainerizerProcess::usage(
     return Failure("Container '" + containerId.value() + "'' not running");
   }
 
-  Try<Subprocess> invoked = invoke("usage", containerId);
+  Try<Future<ResultFutures> > invoked = invoke("usage", containerId);
 
   if (invoked.isError()) {
     terminate(containerId);
@@ -600,9 +632,7 @@ Future<ResourceStatistics> ExternalContainerizerProcess::usage(
       + "' failed (error: " + invoked.error() + ")");
   }
 
-  // Await both, input from the pipe as well as an exit of the
-  // process.
-  return await(read(invoked.get().out()), invoked.get().status())
+  return invoked.get()
     .then(defer(
         PID<ExternalContainerizerProcess>(this),
         &ExternalContainerizerProcess::_usage,
@@ -741,6 +771,108 @@ Future<ResourceStatistics> ExternalContainerizerProcess::_usage(
 }
 
 
+Future<hashmap<ContainerID, ResourceStatistics> >
+ExternalContainerizerProcess::usage(const hashset<ContainerID>& containerIds)
+{
+  VLOG(1) << "Usage triggered on " << containerIds.size() << " containers";
+
+  if (!flags.containerizer_daemon) {
+    // A single command only covers a single container so we invoke
+    // the external containerizer for all of them at once.
+    list<ContainerID> ids;
+    list<Future<ResourceStatistics> > futures;
+
+    foreach (const ContainerID& containerId, containerIds) {
+      ids.push_back(containerId);
+      futures.push_back(usage(containerId));
+    }
+
+    return await(futures)
+      .then(lambda::bind(collectUsage, ids, lambda::_1));
+  }
+
+  // Ask the daemon for the usage of all of the containers with a
+  // single request.
+  ExternalUsage message;
+  list<ContainerID> ids;
+
+  foreach (const ContainerID& containerId, containerIds) {
+    if (!containers.contains(containerId)) {
+      LOG(WARNING) << "Skipping resource statistics for container "
+                   << containerId << " because it is not running";
+      continue;
+    }
+
+    message.add_containers()->mutable_container_id()->CopyFrom(containerId);
+    ids.push_back(containerId);
+  }
+
+  if (ids.empty()) {
+    return hashmap<ContainerID, ResourceStatistics>();
+  }
+
+  string output;
+  if (!message.SerializeToString(&output)) {
+    return Failure("Failed to serialize usage protobuf");
+  }
+
+  Owned<Promise<string> > promise(new Promise<string>());
+
+  Try<Nothing> sent = send(promise, "usage", None(), output);
+  if (sent.isError()) {
+    return Failure("Usage on " + stringify(ids.size()) + " containers "
+      + "failed (error: " + sent.error() + ")");
+  }
+
+  return promise->future()
+    .then(defer(
+        PID<ExternalContainerizerProcess>(this),
+        &ExternalContainerizerProcess::__usage,
+        ids,
+        lambda::_1));
+}
+
+
+Future<hashmap<ContainerID, ResourceStatistics> >
+ExternalContainerizerProcess::__usage(
+    const list<ContainerID>& containerIds,
+    const string& result)
+{
+  VLOG(1) << "Usage callback triggered on "
+          << containerIds.size() << " containers";
+
+  ExternalUsage response;
+  if (!response.ParseFromString(result)) {
+    return Failure("Could not parse usage result protobuf (error: "
+      + protobufError(response) + ")");
+  }
+
+  hashmap<ContainerID, string> statistics;
+  foreach (const ExternalUsage::Container& container, response.containers()) {
+    if (container.has_statistics()) {
+      container.statistics().SerializeToString(
+          &statistics[container.container_id()]);
+    }
+  }
+
+  // Let _usage() handle the statistics of each container just like
+  // the result of a single command, an empty one requests the default
+  // implementation.
+  list<Future<ResourceStatistics> > futures;
+
+  foreach (const ContainerID& containerId, containerIds) {
+    const ResultFutures results(
+        statistics.contains(containerId) ? statistics[containerId] : "",
+        Option<int>(0));
+
+    futures.push_back(_usage(containerId, results));
+  }
+
+  return await(futures)
+    .then(lambda::bind(collectUsage, containerIds, lambda::_1));
+}
+
+
 void ExternalContainerizerProcess::destroy(const ContainerID& containerId)
 {
   VLOG(1) << "Destroy triggered on container '" << containerId << "'";
@@ -750,7 +882,7 @@ void ExternalContainerizerProcess::destroy(const ContainerID& containerId)
     return;
   }
 
-  Try<Subprocess> invoked = invoke("destroy", containerId);
+  Try<Future<ResultFutures> > invoked = invoke("destroy", containerId);
 
   if (invoked.isError()) {
     LOG(ERROR) << "Destroy of container '" << containerId
@@ -759,9 +891,7 @@ void ExternalContainerizerProcess::destroy(const ContainerID& containerId)
     return;
   }
 
-  // Await both, input from the pipe as well as an exit of the
-  // process.
-  await(read(invoked.get().out()), invoked.get().status())
+  invoked.get()
     .onAny(defer(
         PID<ExternalContainerizerProcess>(this),
         &ExternalContainerizerProcess::_destroy,
@@ -1031,6 +1161,16 @@ Try<bool> ExternalContainerizerProcess::commandSupported(
 }
 
 
+// Writes a request to the pipe of the external containerizer daemon.
+// NOTE: Takes the daemon rather than its pipe so that the pipe stays
+// open (and its descriptor doesn't get reused) until the write is
+// done, even if the daemon gets restarted in the meantime.
+Future<Nothing> transmit(const Subprocess& daemon, const string& data)
+{
+  return io::write(daemon.in(), data);
+}
+
+
 int setup(const string& directory)
 {
   // Put child into its own process session to prevent slave suicide
@@ -1053,7 +1193,34 @@ int setup(const string& directory)
 }
 
 
-Try<process::Subprocess> ExternalContainerizerProcess::invoke(
+Try<Future<ExternalContainerizerProcess::ResultFutures> >
+ExternalContainerizerProcess::invoke(
+    const string& command,
+    const ContainerID& containerId,
+    const string& output,
+    const map<string, string>& environment)
+{
+  if (flags.containerizer_daemon) {
+    return request(command, containerId, output, environment);
+  }
+
+  Try<Subprocess> external = execute(
+      command,
+      containerId,
+      output,
+      environment);
+
+  if (external.isError()) {
+    return Error(external.error());
+  }
+
+  // Await both, input from the pipe as well as an exit of the
+  // process.
+  return await(read(external.get().out()), external.get().status());
+}
+
+
+Try<process::Subprocess> ExternalContainerizerProcess::execute(
       const string& command,
       const ContainerID& containerId,
       const string& output,
@@ -1156,6 +1323,341 @@ Try<process::Subprocess> ExternalContainerizerProcess::invoke(
 }
 
 
+void ExternalContainerizerProcess::initialize()
+{
+  if (!flags.containerizer_daemon) {
+    return;
+  }
+
+  Try<Nothing> start = this->start();
+  if (start.isError()) {
+    failed("Failed to start external containerizer daemon: " + start.error());
+  }
+}
+
+
+void ExternalContainerizerProcess::restart()
+{
+  CHECK(daemon.isNone());
+
+  Try<Nothing> start = this->start();
+  if (start.isError()) {
+    failed("Failed to restart external containerizer daemon: " +
+           start.error());
+    return;
+  }
+
+  // Reissue the waits that were pending on the terminated daemon.
+  foreachpair (const ContainerID& containerId,
+               const Owned<Promise<string> >& promise,
+               rewaits) {
+    if (!containers.contains(containerId)) {
+      promise->fail("Container '" + containerId.value() + "' not running");
+      continue;
+    }
+
+    Try<Nothing> sent = send(promise, "wait", containerId);
+    if (sent.isError()) {
+      promise->fail(sent.error());
+    }
+  }
+
+  rewaits.clear();
+}
+
+
+Try<Nothing> ExternalContainerizerProcess::start()
+{
+  CHECK(flags.containerizer_path.isSome())
+    << "containerizer_path not set";
+
+  const string execute = flags.containerizer_path.get() + " daemon";
+
+  LOG(INFO) << "Starting external containerizer daemon: " << execute;
+
+  // Run a chdir and a setsid within the child-context, just like for
+  // the invocation of a single command.
+  Try<Subprocess> external = process::subprocess(
+      execute,
+      map<string, string>(),
+      lambda::bind(&setup, flags.work_dir));
+
+  if (external.isError()) {
+    return Error(external.error());
+  }
+
+  // Sync parent and child process.
+  int sync;
+  while (::read(external.get().out(), &sync, sizeof(sync)) == -1
+    && errno == EINTR);
+
+  // The daemon is not tied to a sandbox so we redirect its output
+  // (stderr) to a log file in the work directory.
+  Try<int> err = os::open(
+      path::join(flags.work_dir, "containerizer.stderr"),
+      O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK,
+      S_IRUSR | S_IWUSR | S_IRGRP | S_IRWXO);
+
+  if (err.isError()) {
+    os::killtree(external.get().pid(), SIGKILL, true, true);
+    return Error("Failed to redirect stderr: " + err.error());
+  }
+
+  const int fds[] = {
+    external.get().in(), external.get().out(), external.get().err()
+  };
+
+  foreach (int fd, fds) {
+    Try<Nothing> nonblock = os::nonblock(fd);
+    if (nonblock.isError()) {
+      os::close(err.get());
+      os::killtree(external.get().pid(), SIGKILL, true, true);
+      return Error("Failed to set up the pipes: " + nonblock.error());
+    }
+  }
+
+  io::splice(external.get().err(), err.get())
+    .onAny(bind(&os::close, err.get()));
+
+  daemon = external.get();
+
+  receive();
+
+  return Nothing();
+}
+
+
+void ExternalContainerizerProcess::failed(const string& message)
+{
+  LOG(ERROR) << message << "; restarting it in " << backoff;
+
+  foreachpair (uint64_t id, const Owned<Promise<string> >& promise, requests) {
+    if (waits.contains(id)) {
+      // The containers outlive the daemon, keep waiting on them.
+      rewaits[waits[id]] = promise;
+    } else {
+      promise->fail(message);
+    }
+  }
+
+  requests.clear();
+  waits.clear();
+  received.clear();
+
+  if (daemon.isSome()) {
+    // Make sure the daemon is gone, e.g., it might only have closed
+    // its end of the pipe. Only kill the daemon itself, not the
+    // executors it launched.
+    ::kill(daemon.get().pid(), SIGKILL);
+    daemon = None();
+  }
+
+  // The pending requests were sent to the terminated daemon, don't
+  // make the requests to the restarted one wait on (or fail with)
+  // them.
+  sending = Nothing();
+
+  delay(backoff, self(), &ExternalContainerizerProcess::restart);
+
+  backoff = std::min(backoff * 2, EXTERNAL_CONTAINERIZER_DAEMON_BACKOFF_MAX);
+}
+
+
+Future<ExternalContainerizerProcess::ResultFutures>
+ExternalContainerizerProcess::request(
+    const string& command,
+    const ContainerID& containerId,
+    const string& output,
+    const map<string, string>& environment)
+{
+  Owned<Promise<string> > promise(new Promise<string>());
+
+  Try<Nothing> sent = send(promise, command, containerId, output, environment);
+  if (sent.isError()) {
+    return Failure(sent.error());
+  }
+
+  // The daemon reports errors as part of the response so there is
+  // no exit-code to await, see commandSupported().
+  return await(promise->future(), Future<Option<int> >(Option<int>(0)));
+}
+
+
+Try<Nothing> ExternalContainerizerProcess::send(
+    const Owned<Promise<string> >& promise,
+    const string& command,
+    const Option<ContainerID>& containerId,
+    const string& output,
+    const map<string, string>& environment)
+{
+  if (daemon.isNone()) {
+    return Error("External containerizer daemon is not running");
+  }
+
+  ExternalRequest message;
+
+  if (containerId.isSome()) {
+    CHECK(sandboxes.contains(containerId.get()));
+
+    const Owned<Sandbox>& sandbox = sandboxes[containerId.get()];
+
+    // Re/establish the sandbox conditions for the containerizer.
+    if (sandbox->user.isSome()) {
+      Try<Nothing> chown = os::chown(sandbox->user.get(), sandbox->directory);
+      if (chown.isError()) {
+        return Error("Failed to chown work directory: " + chown.error());
+      }
+    }
+
+    message.mutable_container_id()->CopyFrom(containerId.get());
+    message.set_directory(sandbox->directory);
+  }
+
+  message.set_id(nextRequest++);
+  message.set_command(command);
+
+  if (!output.empty()) {
+    message.set_data(output);
+  }
+
+  foreachpair (const string& name, const string& value, environment) {
+    Environment::Variable* variable =
+      message.mutable_environment()->add_variables();
+    variable->set_name(name);
+    variable->set_value(value);
+  }
+
+  VLOG(1) << "Sending request " << message.id() << " for method '"
+          << command << "'"
+          << (containerId.isSome()
+              ? " of container '" + containerId.get().value() + "'"
+              : "")
+          << " to the external containerizer daemon";
+
+  string data;
+  if (!message.SerializeToString(&data)) {
+    return Error("Failed to serialize request protobuf");
+  }
+
+  // Each request is prefixed by its total size, just like the
+  // protobuf sent to a single command.
+  size_t size = data.size();
+  data.insert(0, (const char*) &size, sizeof(size));
+
+  requests[message.id()] = promise;
+
+  if (command == "wait") {
+    waits[message.id()] = containerId.get();
+  }
+
+  // Send the requests in order so that they don't get interleaved.
+  sending = sending
+    .then(lambda::bind(&transmit, daemon.get(), data));
+
+  sending
+    .onFailed(defer(
+        PID<ExternalContainerizerProcess>(this),
+        &ExternalContainerizerProcess::_request,
+        message.id(),
+        lambda::_1));
+
+  return Nothing();
+}
+
+
+void ExternalContainerizerProcess::_request(
+    uint64_t id,
+    const string& failure)
+{
+  if (waits.contains(id)) {
+    // The daemon can't be written to, i.e., it is terminating. Wait
+    // on the container again once it got restarted.
+    rewaits[waits[id]] = requests[id];
+    waits.erase(id);
+    requests.erase(id);
+  } else if (requests.contains(id)) {
+    requests[id]->fail("Failed to send request to the external "
+                       "containerizer daemon: " + failure);
+    requests.erase(id);
+  }
+
+  // Start over with the next request rather than failing all of the
+  // requests sent from now on.
+  if (sending.isFailed()) {
+    sending = Nothing();
+  }
+}
+
+
+void ExternalContainerizerProcess::receive()
+{
+  CHECK_SOME(daemon);
+
+  boost::shared_array<char> data(new char[4096]);
+
+  io::read(daemon.get().out(), data.get(), 4096)
+    .onAny(defer(
+        PID<ExternalContainerizerProcess>(this),
+        &ExternalContainerizerProcess::_receive,
+        data,
+        lambda::_1));
+}
+
+
+void ExternalContainerizerProcess::_receive(
+    const boost::shared_array<char>& data,
+    const Future<size_t>& length)
+{
+  if (!length.isReady() || length.get() == 0) {
+    failed("External containerizer daemon terminated: " +
+           (length.isFailed() ? length.failure() :
+            length.isDiscarded() ? "discarded" : "end-of-file"));
+    return;
+  }
+
+  received.append(data.get(), length.get());
+
+  // Handle all the complete responses we have received so far.
+  while (received.size() >= sizeof(size_t)) {
+    size_t size;
+    memcpy(&size, received.data(), sizeof(size));
+
+    if (received.size() < sizeof(size) + size) {
+      break;
+    }
+
+    ExternalResponse response;
+    if (!response.ParseFromArray(received.data() + sizeof(size), size)) {
+      LOG(ERROR) << "Could not parse response protobuf from the external "
+                 << "containerizer daemon (error: "
+                 << protobufError(response) << ")";
+    } else if (!requests.contains(response.id())) {
+      LOG(WARNING) << "Ignoring response to unknown request "
+                   << response.id();
+    } else {
+      VLOG(1) << "Received response to request " << response.id()
+              << " from the external containerizer daemon";
+
+      if (response.has_error()) {
+        requests[response.id()]->fail(response.error());
+      } else {
+        requests[response.id()]->set(response.data());
+      }
+
+      requests.erase(response.id());
+      waits.erase(response.id());
+    }
+
+    // The daemon is up and running again.
+    backoff = EXTERNAL_CONTAINERIZER_DAEMON_BACKOFF_MIN;
+
+    received.erase(0, sizeof(size) + size);
+  }
+
+  receive();
+}
+
+
 ExecutorInfo containerExecutorInfo(
     const Flags& flags,
     const TaskInfo& task,
@@ -19,14 +19,21 @@
 #ifndef __EXTERNAL_CONTAINERIZER_HPP__
 #define __EXTERNAL_CONTAINERIZER_HPP__
 
+#include <stdint.h>
+
 #include <list>
 #include <sstream>
 #include <string>
 
+#include <boost/shared_array.hpp>
+
 #include <process/owned.hpp>
 #include <process/subprocess.hpp>
 
+#include <stout/duration.hpp>
 #include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
+#include <stout/nothing.hpp>
 #include <stout/try.hpp>
 #include <stout/tuple.hpp>
 
@@ -52,6 +59,28 @@ namespace slave {
 // readable logging. The embedded message does not have to adhere to
 // any scheme but must not be empty for valid results.
 
+// When run as a daemon (--containerizer_daemon), the external
+// containerizer is only started once, as
+//
+// daemon < ExternalRequest* > ExternalResponse*
+//
+// and serves the above commands for all containers. Each request
+// carries the name of the command and the protobuf the command would
+// otherwise receive on stdin. Each response carries the id of its
+// request and the protobuf the command would otherwise deliver on
+// stdout (an empty one requests the default implementation) or an
+// error in place of a non-zero exit-code. Both are prefixed by their
+// size and responses may be sent in any order, e.g., a 'wait' stays
+// pending until the container terminates. The containers outlive the
+// daemon: should it terminate, the pending waits are sent again to
+// the restarted one.
+//
+// The daemon also serves the usage of several containers at once,
+//
+// usage < ExternalUsage > ExternalUsage
+//
+// i.e., a 'usage' request without a container.
+
 // For debugging purposes of an external containerizer, it might be
 // helpful to enable verbose logging on the slave (GLOG_v=2).
 
@@ -84,6 +113,9 @@ public:
   virtual process::Future<ResourceStatistics> usage(
       const ContainerID& containerId);
 
+  virtual process::Future<hashmap<ContainerID, ResourceStatistics> > usage(
+      const hashset<ContainerID>& containerIds);
+
   virtual process::Future<Termination> wait(const ContainerID& containerId);
 
   virtual void destroy(const ContainerID& containerId);
@@ -122,12 +154,26 @@ public:
   // Gather resource usage statistics for the containerized executor.
   process::Future<ResourceStatistics> usage(const ContainerID& containerId);
 
+  // Gather resource usage statistics for all of the given containers,
+  // with a single request to the daemon or otherwise by invoking the
+  // external containerizer for each of them at once.
+  process::Future<hashmap<ContainerID, ResourceStatistics> > usage(
+      const hashset<ContainerID>& containerIds);
+
   // Get a future on the containerized executor's Termination.
   process::Future<Termination> wait(const ContainerID& containerId);
 
   // Terminate the containerized executor.
   void destroy(const ContainerID& containerId);
 
+  // Restarts the external containerizer daemon after it terminated
+  // (or failed to start) and reissues the waits that were pending.
+  void restart();
+
+protected:
+  // Starts the external containerizer daemon, if requested.
+  virtual void initialize();
+
 private:
   // Startup flags.
   const Flags flags;
@@ -143,12 +189,6 @@ private:
   // Information describing a running container.
   struct Container
   {
-    Container(pid_t containerPid)
-      : containerPid(containerPid) {}
-
-    // External containerizer pid.
-    const pid_t containerPid;
-
     // Containerized executor pid. This is an option as the external
     // containerizer might fail to transmit it on 'launch'.
     Option<pid_t> pid;
@@ -199,6 +239,10 @@ private:
       const ContainerID& containerId,
       const process::Future<ResultFutures>& future);
 
+  process::Future<hashmap<ContainerID, ResourceStatistics> > __usage(
+      const std::list<ContainerID>& containerIds,
+      const std::string& result);
+
   void _destroy(
       const ContainerID& containerId,
       const process::Future<ResultFutures>& future);
@@ -232,13 +276,81 @@ private:
   // in the container.
   void cleanup(const ContainerID& containerId);
 
-  Try<process::Subprocess> invoke(
+  // Invokes a command of the external containerizer for the given
+  // container, either by executing it or by sending a request to the
+  // daemon.
+  Try<process::Future<ResultFutures> > invoke(
       const std::string& command,
       const ContainerID& containerId,
       const std::string& output
         = std::string(),
       const std::map<std::string, std::string>& environment
         = std::map<std::string, std::string>());
+
+  Try<process::Subprocess> execute(
+      const std::string& command,
+      const ContainerID& containerId,
+      const std::string& output,
+      const std::map<std::string, std::string>& environment);
+
+  process::Future<ResultFutures> request(
+      const std::string& command,
+      const ContainerID& containerId,
+      const std::string& output,
+      const std::map<std::string, std::string>& environment);
+
+  // Sends a request to the daemon, satisfying the promise with its
+  // response.
+  Try<Nothing> send(
+      const process::Owned<process::Promise<std::string> >& promise,
+      const std::string& command,
+      const Option<ContainerID>& containerId,
+      const std::string& output = std::string(),
+      const std::map<std::string, std::string>& environment
+        = std::map<std::string, std::string>());
+
+  void _request(uint64_t id, const std::string& failure);
+
+  // Starts the external containerizer daemon and starts receiving
+  // its responses.
+  Try<Nothing> start();
+
+  // Fails the requests sent to the daemon that terminated (or failed
+  // to start), except for the waits which get reissued once the
+  // daemon is restarted, and schedules restarting it.
+  void failed(const std::string& message);
+
+  // Reads (the next chunk of) the responses from the daemon.
+  void receive();
+
+  void _receive(
+      const boost::shared_array<char>& data,
+      const process::Future<size_t>& length);
+
+  // The external containerizer daemon, if it is running.
+  Option<process::Subprocess> daemon;
+
+  // Requests sent to the daemon that are awaiting their response.
+  hashmap<uint64_t, process::Owned<process::Promise<std::string> > > requests;
+
+  // The containers the outstanding 'wait' requests are waiting on.
+  hashmap<uint64_t, ContainerID> waits;
+
+  // The waits to reissue once the daemon is restarted.
+  hashmap<ContainerID, process::Owned<process::Promise<std::string> > >
+    rewaits;
+
+  uint64_t nextRequest;
+
+  // Data received from the daemon that doesn't make up a complete
+  // response yet.
+  std::string received;
+
+  // Used to send the requests to the daemon one after the other.
+  process::Future<Nothing> sending;
+
+  // Delay before restarting the daemon the next time it terminates.
+  Duration backoff;
 };
 
 
@@ -16,8 +16,15 @@
  * limitations under the License.
  */
 
+#include <process/collect.hpp>
 #include <process/dispatch.hpp>
 
+#include <stout/foreach.hpp>
+#include <stout/lambda.hpp>
+
+#include "common/type_utils.hpp"
+
+#include "slave/containerizer/containerizer.hpp"
 #include "slave/containerizer/isolator.hpp"
 
 using namespace process;
@@ -90,7 +97,23 @@ Future<Nothing> Isolator::update(
 Future<ResourceStatistics> Isolator::usage(
     const ContainerID& containerId) const
 {
-  return dispatch(process.get(), &IsolatorProcess::usage, containerId);
+  // Need to disambiguate overloaded function.
+  Future<ResourceStatistics> (IsolatorProcess::*usage)(const ContainerID&) =
+    &IsolatorProcess::usage;
+
+  return dispatch(process.get(), usage, containerId);
+}
+
+
+Future<hashmap<ContainerID, ResourceStatistics> > Isolator::usage(
+    const hashset<ContainerID>& containerIds) const
+{
+  // Need to disambiguate overloaded function.
+  Future<hashmap<ContainerID, ResourceStatistics> >
+    (IsolatorProcess::*usage)(const hashset<ContainerID>&) =
+      &IsolatorProcess::usage;
+
+  return dispatch(process.get(), usage, containerIds);
 }
 
 
@@ -99,6 +122,22 @@ Future<Nothing> Isolator::cleanup(const ContainerID& containerId)
   return dispatch(process.get(), &IsolatorProcess::cleanup, containerId);
 }
 
+
+Future<hashmap<ContainerID, ResourceStatistics> > IsolatorProcess::usage(
+    const hashset<ContainerID>& containerIds)
+{
+  list<ContainerID> ids;
+  list<Future<ResourceStatistics> > futures;
+
+  foreach (const ContainerID& containerId, containerIds) {
+    ids.push_back(containerId);
+    futures.push_back(usage(containerId));
+  }
+
+  return await(futures)
+    .then(lambda::bind(collectUsage, ids, lambda::_1));
+}
+
 } // namespace slave {
 } // namespace internal {
 } // namespace mesos {
@@ -27,6 +27,8 @@
 #include <process/owned.hpp>
 #include <process/process.hpp>
 
+#include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
 #include <stout/try.hpp>
 
 #include "slave/flags.hpp"
@@ -95,6 +97,12 @@ public:
   process::Future<ResourceStatistics> usage(
       const ContainerID& containerId) const;
 
+  // Gather resource usage statistics for all of the given containers.
+  // Containers for which the statistics couldn't be gathered are left
+  // out of the result.
+  process::Future<hashmap<ContainerID, ResourceStatistics> > usage(
+      const hashset<ContainerID>& containerIds) const;
+
   // Clean up a terminated container. This is called after the executor and all
   // processes in the container have terminated.
   process::Future<Nothing> cleanup(const ContainerID& containerId);
@@ -133,6 +141,11 @@ public:
   virtual process::Future<ResourceStatistics> usage(
       const ContainerID& containerId) = 0;
 
+  // The default implementation gathers the usage of each of the
+  // containers in turn, all within a single dispatch to the isolator.
+  virtual process::Future<hashmap<ContainerID, ResourceStatistics> > usage(
+      const hashset<ContainerID>& containerIds);
+
   virtual process::Future<Nothing> cleanup(const ContainerID& containerId) = 0;
 };
 
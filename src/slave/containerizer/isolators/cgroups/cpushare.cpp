@@ -365,8 +365,42 @@ Future<ResourceStatistics> CgroupsCpushareIsolatorProcess::usage(
     return Failure("Unknown container");
   }
 
-  Info* info = CHECK_NOTNULL(infos[containerId]);
+  Try<ResourceStatistics> usage = _usage(CHECK_NOTNULL(infos[containerId]));
+  if (usage.isError()) {
+    return Failure(usage.error());
+  }
+
+  return usage.get();
+}
+
+
+Future<hashmap<ContainerID, ResourceStatistics> >
+CgroupsCpushareIsolatorProcess::usage(
+    const hashset<ContainerID>& containerIds)
+{
+  hashmap<ContainerID, ResourceStatistics> result;
+
+  foreach (const ContainerID& containerId, containerIds) {
+    if (!infos.contains(containerId)) {
+      continue;
+    }
+
+    Try<ResourceStatistics> usage = _usage(CHECK_NOTNULL(infos[containerId]));
+    if (usage.isError()) {
+      LOG(WARNING) << "Skipping resource statistics for container "
+                   << containerId << " because: " << usage.error();
+      continue;
+    }
+
+    result[containerId] = usage.get();
+  }
+
+  return result;
+}
+
 
+Try<ResourceStatistics> CgroupsCpushareIsolatorProcess::_usage(Info* info)
+{
   ResourceStatistics result;
 
   // Get the number of clock ticks, used for cpu accounting.
@@ -375,17 +409,35 @@ Future<ResourceStatistics> CgroupsCpushareIsolatorProcess::usage(
   PCHECK(ticks > 0) << "Failed to get sysconf(_SC_CLK_TCK)";
 
   // Add the cpuacct.stat information.
-  Try<hashmap<string, uint64_t> > stat =
-    cgroups::stat(hierarchies["cpuacct"], info->cgroup, "cpuacct.stat");
+  if (info->cpuacctStat.get() == NULL) {
+    Try<cgroups::Control*> control = cgroups::Control::create(
+        hierarchies["cpuacct"], info->cgroup, "cpuacct.stat");
+
+    if (control.isError()) {
+      return Error("Failed to open cpuacct.stat: " + control.error());
+    }
+
+    info->cpuacctStat.reset(control.get());
+  }
+
+  static vector<string>* cpuacctNames = NULL;
+  if (cpuacctNames == NULL) {
+    cpuacctNames = new vector<string>();
+    cpuacctNames->push_back("user");
+    cpuacctNames->push_back("system");
+  }
+
+  Try<vector<Option<uint64_t> > > stat =
+    info->cpuacctStat->stat(*cpuacctNames);
 
   if (stat.isError()) {
-    return Failure("Failed to read cpuacct.stat: " + stat.error());
+    return Error("Failed to read cpuacct.stat: " + stat.error());
   }
 
   // TODO(bmahler): Add namespacing to cgroups to enforce the expected
   // structure, e.g., cgroups::cpuacct::stat.
-  Option<uint64_t> user = stat.get().get("user");
-  Option<uint64_t> system = stat.get().get("system");
+  Option<uint64_t> user = stat.get()[0];
+  Option<uint64_t> system = stat.get()[1];
 
   if (user.isSome() && system.isSome()) {
     result.set_cpus_user_time_secs((double) user.get() / (double) ticks);
@@ -393,23 +445,42 @@ Future<ResourceStatistics> CgroupsCpushareIsolatorProcess::usage(
   }
 
   // Add the cpu.stat information.
-  stat = cgroups::stat(hierarchies["cpu"], info->cgroup, "cpu.stat");
+  if (info->cpuStat.get() == NULL) {
+    Try<cgroups::Control*> control = cgroups::Control::create(
+        hierarchies["cpu"], info->cgroup, "cpu.stat");
+
+    if (control.isError()) {
+      return Error("Failed to open cpu.stat: " + control.error());
+    }
+
+    info->cpuStat.reset(control.get());
+  }
+
+  static vector<string>* cpuNames = NULL;
+  if (cpuNames == NULL) {
+    cpuNames = new vector<string>();
+    cpuNames->push_back("nr_periods");
+    cpuNames->push_back("nr_throttled");
+    cpuNames->push_back("throttled_time");
+  }
+
+  stat = info->cpuStat->stat(*cpuNames);
 
   if (stat.isError()) {
-    return Failure("Failed to read cpu.stat: " + stat.error());
+    return Error("Failed to read cpu.stat: " + stat.error());
   }
 
-  Option<uint64_t> nr_periods = stat.get().get("nr_periods");
+  Option<uint64_t> nr_periods = stat.get()[0];
   if (nr_periods.isSome()) {
     result.set_cpus_nr_periods(nr_periods.get());
   }
 
-  Option<uint64_t> nr_throttled = stat.get().get("nr_throttled");
+  Option<uint64_t> nr_throttled = stat.get()[1];
   if (nr_throttled.isSome()) {
     result.set_cpus_nr_throttled(nr_throttled.get());
   }
 
-  Option<uint64_t> throttled_time = stat.get().get("throttled_time");
+  Option<uint64_t> throttled_time = stat.get()[2];
   if (throttled_time.isSome()) {
     result.set_cpus_throttled_time_secs(
         Nanoseconds(throttled_time.get()).secs());
@@ -22,10 +22,14 @@
 #include <mesos/resources.hpp>
 
 #include <process/future.hpp>
+#include <process/owned.hpp>
 
 #include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
 #include <stout/try.hpp>
 
+#include "linux/cgroups.hpp"
+
 #include "slave/containerizer/isolator.hpp"
 
 #include "slave/flags.hpp"
@@ -67,6 +71,11 @@ public:
   virtual process::Future<ResourceStatistics> usage(
       const ContainerID& containerId);
 
+  // Reads the statistics of all the containers in turn rather than
+  // going through a future per container (the reads are synchronous).
+  virtual process::Future<hashmap<ContainerID, ResourceStatistics> > usage(
+      const hashset<ContainerID>& containerIds);
+
   virtual process::Future<Nothing> cleanup(
       const ContainerID& containerId);
 
@@ -87,8 +96,15 @@ private:
     Option<pid_t> pid;
 
     process::Promise<Limitation> limitation;
+
+    // Handles on the stat files read by 'usage', opened on first use.
+    process::Owned<cgroups::Control> cpuacctStat;
+    process::Owned<cgroups::Control> cpuStat;
   };
 
+  // Reads the statistics of the container.
+  Try<ResourceStatistics> _usage(Info* info);
+
   const Flags flags;
 
   // Map from subsystem to hierarchy.
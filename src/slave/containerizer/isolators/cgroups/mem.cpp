@@ -35,7 +35,9 @@
 #include <stout/hashset.hpp>
 #include <stout/lambda.hpp>
 #include <stout/nothing.hpp>
+#include <stout/numify.hpp>
 #include <stout/stringify.hpp>
+#include <stout/strings.hpp>
 #include <stout/try.hpp>
 
 #include "common/type_utils.hpp"
@@ -315,40 +317,109 @@ Future<ResourceStatistics> CgroupsMemIsolatorProcess::usage(
     return Failure("Unknown container");
   }
 
-  Info* info = CHECK_NOTNULL(infos[containerId]);
+  Try<ResourceStatistics> usage = _usage(CHECK_NOTNULL(infos[containerId]));
+  if (usage.isError()) {
+    return Failure(usage.error());
+  }
+
+  return usage.get();
+}
+
+
+Future<hashmap<ContainerID, ResourceStatistics> >
+CgroupsMemIsolatorProcess::usage(
+    const hashset<ContainerID>& containerIds)
+{
+  hashmap<ContainerID, ResourceStatistics> result;
+
+  foreach (const ContainerID& containerId, containerIds) {
+    if (!infos.contains(containerId)) {
+      continue;
+    }
+
+    Try<ResourceStatistics> usage = _usage(CHECK_NOTNULL(infos[containerId]));
+    if (usage.isError()) {
+      LOG(WARNING) << "Skipping resource statistics for container "
+                   << containerId << " because: " << usage.error();
+      continue;
+    }
+
+    result[containerId] = usage.get();
+  }
+
+  return result;
+}
+
 
+Try<ResourceStatistics> CgroupsMemIsolatorProcess::_usage(Info* info)
+{
   ResourceStatistics result;
 
+  if (info->usageInBytes.get() == NULL) {
+    Try<cgroups::Control*> control = cgroups::Control::create(
+        hierarchy, info->cgroup, "memory.usage_in_bytes");
+
+    if (control.isError()) {
+      return Error(
+          "Failed to open memory.usage_in_bytes: " + control.error());
+    }
+
+    info->usageInBytes.reset(control.get());
+  }
+
   // The rss from memory.stat is wrong in two dimensions:
   //   1. It does not include child cgroups.
   //   2. It does not include any file backed pages.
-  Try<Bytes> usage = cgroups::memory::usage_in_bytes(hierarchy, info->cgroup);
+  Try<string> read = info->usageInBytes->read();
+  if (read.isError()) {
+    return Error("Failed to read memory.usage_in_bytes: " + read.error());
+  }
+
+  Try<uint64_t> usage = numify<uint64_t>(strings::trim(read.get()));
   if (usage.isError()) {
-    return Failure("Failed to parse memory.usage_in_bytes: " + usage.error());
+    return Error("Failed to parse memory.usage_in_bytes: " + usage.error());
   }
 
   // TODO(bmahler): Add namespacing to cgroups to enforce the expected
   // structure, e.g, cgroups::memory::stat.
-  result.set_mem_rss_bytes(usage.get().bytes());
+  result.set_mem_rss_bytes(usage.get());
+
+  if (info->memoryStat.get() == NULL) {
+    Try<cgroups::Control*> control = cgroups::Control::create(
+        hierarchy, info->cgroup, "memory.stat");
+
+    if (control.isError()) {
+      return Error("Failed to open memory.stat: " + control.error());
+    }
+
+    info->memoryStat.reset(control.get());
+  }
+
+  static vector<string>* names = NULL;
+  if (names == NULL) {
+    names = new vector<string>();
+    names->push_back("total_cache");
+    names->push_back("total_rss");
+    names->push_back("total_mapped_file");
+  }
 
-  Try<hashmap<string, uint64_t> > stat =
-    cgroups::stat(hierarchy, info->cgroup, "memory.stat");
+  Try<vector<Option<uint64_t> > > stat = info->memoryStat->stat(*names);
 
   if (stat.isError()) {
-    return Failure("Failed to read memory.stat: " + stat.error());
+    return Error("Failed to read memory.stat: " + stat.error());
   }
 
-  Option<uint64_t> total_cache = stat.get().get("total_cache");
+  Option<uint64_t> total_cache = stat.get()[0];
   if (total_cache.isSome()) {
     result.set_mem_file_bytes(total_cache.get());
   }
 
-  Option<uint64_t> total_rss = stat.get().get("total_rss");
+  Option<uint64_t> total_rss = stat.get()[1];
   if (total_rss.isSome()) {
     result.set_mem_anon_bytes(total_rss.get());
   }
 
-  Option<uint64_t> total_mapped_file = stat.get().get("total_mapped_file");
+  Option<uint64_t> total_mapped_file = stat.get()[2];
   if (total_mapped_file.isSome()) {
     result.set_mem_mapped_file_bytes(total_mapped_file.get());
   }
@@ -24,12 +24,17 @@
 #include <mesos/resources.hpp>
 
 #include <process/future.hpp>
+#include <process/owned.hpp>
 
+#include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
 #include <stout/nothing.hpp>
 #include <stout/try.hpp>
 
 #include "mesos/resources.hpp"
 
+#include "linux/cgroups.hpp"
+
 #include "slave/containerizer/isolator.hpp"
 
 #include "slave/flags.hpp"
@@ -67,6 +72,11 @@ public:
   virtual process::Future<ResourceStatistics> usage(
       const ContainerID& containerId);
 
+  // Reads the statistics of all the containers in turn rather than
+  // going through a future per container (the reads are synchronous).
+  virtual process::Future<hashmap<ContainerID, ResourceStatistics> > usage(
+      const hashset<ContainerID>& containerIds);
+
   virtual process::Future<Nothing> cleanup(
       const ContainerID& containerId);
 
@@ -88,8 +98,15 @@ private:
 
     // Used to cancel the OOM listening.
     process::Future<uint64_t> oomNotifier;
+
+    // Handles on the files read by 'usage', opened on first use.
+    process::Owned<cgroups::Control> usageInBytes;
+    process::Owned<cgroups::Control> memoryStat;
   };
 
+  // Reads the statistics of the container.
+  Try<ResourceStatistics> _usage(Info* info);
+
   // Start listening on OOM events. This function will create an
   // eventfd and start polling on it.
   void oomListen(const ContainerID& containerId);
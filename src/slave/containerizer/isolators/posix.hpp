@@ -20,11 +20,13 @@
 #define __POSIX_ISOLATOR_HPP__
 
 #include <stout/hashmap.hpp>
+#include <stout/lambda.hpp>
 #include <stout/os/pstree.hpp>
 
 #include <process/future.hpp>
 
 #include "slave/containerizer/isolator.hpp"
+#include "slave/containerizer/pstree.hpp"
 
 namespace mesos {
 namespace internal {
@@ -147,6 +149,8 @@ public:
     return new Isolator(process);
   }
 
+  using IsolatorProcess::usage;
+
   virtual process::Future<ResourceStatistics> usage(
       const ContainerID& containerId)
   {
@@ -156,9 +160,16 @@ public:
       return ResourceStatistics();
     }
 
-    Try<os::ProcessTree> tree = os::pstree(pids.get(containerId).get());
+    return pstree(pids.get(containerId).get())
+      .then(lambda::bind(&PosixCpuIsolatorProcess::_usage, lambda::_1));
+  }
+
+private:
+  PosixCpuIsolatorProcess() {}
 
-    if (!tree.isSome()) {
+  static ResourceStatistics _usage(const Option<os::ProcessTree>& tree)
+  {
+    if (tree.isNone()) {
       return ResourceStatistics();
     }
 
@@ -187,9 +198,6 @@ public:
 
     return result;
   }
-
-private:
-  PosixCpuIsolatorProcess() {}
 };
 
 
@@ -203,6 +211,8 @@ public:
     return new Isolator(process);
   }
 
+  using IsolatorProcess::usage;
+
   virtual process::Future<ResourceStatistics> usage(
       const ContainerID& containerId)
   {
@@ -212,9 +222,16 @@ public:
       return ResourceStatistics();
     }
 
-    Try<os::ProcessTree> tree = os::pstree(pids.get(containerId).get());
+    return pstree(pids.get(containerId).get())
+      .then(lambda::bind(&PosixMemIsolatorProcess::_usage, lambda::_1));
+  }
+
+private:
+  PosixMemIsolatorProcess() {}
 
-    if (!tree.isSome()) {
+  static ResourceStatistics _usage(const Option<os::ProcessTree>& tree)
+  {
+    if (tree.isNone()) {
       return ResourceStatistics();
     }
 
@@ -239,9 +256,6 @@ public:
 
     return result;
   }
-
-private:
-  PosixMemIsolatorProcess() {}
 };
 
 
@@ -150,7 +150,23 @@ Future<Nothing> MesosContainerizer::update(
 Future<ResourceStatistics> MesosContainerizer::usage(
     const ContainerID& containerId)
 {
-  return dispatch(process, &MesosContainerizerProcess::usage, containerId);
+  // Need to disambiguate overloaded function.
+  Future<ResourceStatistics> (MesosContainerizerProcess::*usage)(
+      const ContainerID&) = &MesosContainerizerProcess::usage;
+
+  return dispatch(process, usage, containerId);
+}
+
+
+Future<hashmap<ContainerID, ResourceStatistics> > MesosContainerizer::usage(
+    const hashset<ContainerID>& containerIds)
+{
+  // Need to disambiguate overloaded function.
+  Future<hashmap<ContainerID, ResourceStatistics> >
+    (MesosContainerizerProcess::*usage)(const hashset<ContainerID>&) =
+      &MesosContainerizerProcess::usage;
+
+  return dispatch(process, usage, containerIds);
 }
 
 
@@ -844,6 +860,95 @@ Future<ResourceStatistics> MesosContainerizerProcess::usage(
 }
 
 
+// Like _usage() but for the statistics of several containers which
+// all get the same timestamp. The resources only contain the
+// containers for which they are known (see above).
+Future<hashmap<ContainerID, ResourceStatistics> > _usages(
+    const hashset<ContainerID>& containerIds,
+    const hashmap<ContainerID, Resources>& resources,
+    const list<Future<hashmap<ContainerID, ResourceStatistics> > >& statistics)
+{
+  hashmap<ContainerID, ResourceStatistics> result;
+
+  // Set the timestamp now we have all statistics.
+  double timestamp = Clock::now().secs();
+
+  foreach (const ContainerID& containerId, containerIds) {
+    result[containerId].set_timestamp(timestamp);
+  }
+
+  list<Future<hashmap<ContainerID, ResourceStatistics> > >::const_iterator
+    statistic = statistics.begin();
+
+  for (; statistic != statistics.end(); ++statistic) {
+    if (!statistic->isReady()) {
+      LOG(WARNING) << "Skipping resource statistics for "
+                   << containerIds.size() << " containers because: "
+                   << (statistic->isFailed() ? statistic->failure()
+                                             : "discarded");
+      continue;
+    }
+
+    foreachpair (const ContainerID& containerId,
+                 const ResourceStatistics& usage,
+                 statistic->get()) {
+      if (result.contains(containerId)) {
+        result[containerId].MergeFrom(usage);
+      }
+    }
+  }
+
+  foreachpair (const ContainerID& containerId,
+               const Resources& allocation,
+               resources) {
+    // Set the resource allocations.
+    Option<Bytes> mem = allocation.mem();
+    if (mem.isSome()) {
+      result[containerId].set_mem_limit_bytes(mem.get().bytes());
+    }
+
+    Option<double> cpus = allocation.cpus();
+    if (cpus.isSome()) {
+      result[containerId].set_cpus_limit(cpus.get());
+    }
+  }
+
+  return result;
+}
+
+
+Future<hashmap<ContainerID, ResourceStatistics> >
+MesosContainerizerProcess::usage(const hashset<ContainerID>& containerIds)
+{
+  hashset<ContainerID> known;
+  hashmap<ContainerID, Resources> limits;
+
+  foreach (const ContainerID& containerId, containerIds) {
+    if (!promises.contains(containerId)) {
+      LOG(WARNING) << "Skipping resource statistics for unknown container "
+                   << containerId;
+      continue;
+    }
+
+    known.insert(containerId);
+
+    if (resources.contains(containerId)) {
+      limits[containerId] = resources[containerId];
+    }
+  }
+
+  // Ask each isolator once for the usage of all of the containers.
+  list<Future<hashmap<ContainerID, ResourceStatistics> > > futures;
+  foreach (const Owned<Isolator>& isolator, isolators) {
+    futures.push_back(isolator->usage(known));
+  }
+
+  // Use await() here so we can return partial usage statistics.
+  return await(futures)
+    .then(lambda::bind(_usages, known, limits, lambda::_1));
+}
+
+
 void MesosContainerizerProcess::destroy(const ContainerID& containerId)
 {
   if (!promises.contains(containerId)) {
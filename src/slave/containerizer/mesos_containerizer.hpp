@@ -23,6 +23,7 @@
 #include <vector>
 
 #include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
 #include <stout/lambda.hpp>
 #include <stout/multihashmap.hpp>
 
@@ -68,6 +69,9 @@ public:
   virtual process::Future<ResourceStatistics> usage(
       const ContainerID& containerId);
 
+  virtual process::Future<hashmap<ContainerID, ResourceStatistics> > usage(
+      const hashset<ContainerID>& containerIds);
+
   virtual process::Future<containerizer::Termination> wait(
       const ContainerID& containerId);
 
@@ -113,6 +117,11 @@ public:
   process::Future<ResourceStatistics> usage(
       const ContainerID& containerId);
 
+  // Gathers the usage of all of the containers from each isolator at
+  // once and timestamps them together.
+  process::Future<hashmap<ContainerID, ResourceStatistics> > usage(
+      const hashset<ContainerID>& containerIds);
+
   process::Future<containerizer::Termination> wait(
       const ContainerID& containerId);
 
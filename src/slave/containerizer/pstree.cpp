@@ -0,0 +1,190 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <deque>
+#include <list>
+
+#include <process/clock.hpp>
+#include <process/dispatch.hpp>
+#include <process/id.hpp>
+#include <process/once.hpp>
+#include <process/process.hpp>
+#include <process/time.hpp>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/os.hpp>
+#include <stout/stringify.hpp>
+
+#include <stout/os/pstree.hpp>
+
+#include "slave/constants.hpp"
+
+#include "slave/containerizer/pstree.hpp"
+
+using namespace process;
+
+using std::deque;
+using std::list;
+
+namespace mesos {
+namespace internal {
+namespace slave {
+
+Try<ProcessSnapshot> ProcessSnapshot::create()
+{
+  Try<list<os::Process> > processes = os::processes();
+
+  if (processes.isError()) {
+    return Error("Failed to get the processes: " + processes.error());
+  }
+
+  return ProcessSnapshot(processes.get());
+}
+
+
+ProcessSnapshot::ProcessSnapshot(const list<os::Process>& _processes)
+{
+  foreach (const os::Process& process, _processes) {
+    processes.put(process.pid, process);
+    children.put(process.parent, process.pid);
+  }
+}
+
+
+Try<os::ProcessTree> ProcessSnapshot::pstree(pid_t pid) const
+{
+  if (!processes.contains(pid)) {
+    return Error("No process found at " + stringify(pid));
+  }
+
+  // Only pass the processes in the subtree to 'os::pstree' since it
+  // goes through all of the processes it's given for every process
+  // in the tree.
+  list<os::Process> subtree;
+
+  deque<pid_t> pids;
+  pids.push_back(pid);
+
+  while (!pids.empty()) {
+    Option<os::Process> process = processes.get(pids.front());
+    pids.pop_front();
+
+    if (process.isSome()) {
+      subtree.push_back(process.get());
+      foreach (pid_t child, children.get(process.get().pid)) {
+        pids.push_back(child);
+      }
+    }
+  }
+
+  return os::pstree(pid, subtree);
+}
+
+
+class ProcessSnapshotProcess : public Process<ProcessSnapshotProcess>
+{
+public:
+  ProcessSnapshotProcess()
+    : ProcessBase(ID::generate("process-snapshot")),
+      rescanned(false) {}
+
+  Future<Option<os::ProcessTree> > pstree(pid_t pid)
+  {
+    // Use the current snapshot if it was taken during this interval,
+    // otherwise take a new one.
+    const bool current =
+      snapshot.isSome() && interval(taken) == interval(Clock::now());
+
+    if (current) {
+      Try<os::ProcessTree> tree = snapshot.get().pstree(pid);
+      if (tree.isSome()) {
+        return Option<os::ProcessTree>(tree.get());
+      }
+
+      // The pid might have been forked since the snapshot was taken
+      // (e.g., a container that was just launched), or it might have
+      // exited. Rescan at most once per interval for such pids so that
+      // asking for exited ones doesn't scan /proc on every call.
+      if (rescanned) {
+        return None();
+      }
+    }
+
+    Try<ProcessSnapshot> _snapshot = ProcessSnapshot::create();
+
+    if (_snapshot.isError()) {
+      return Failure(_snapshot.error());
+    }
+
+    VLOG(2) << "Took a snapshot of " << _snapshot.get().size()
+            << " processes";
+
+    snapshot = _snapshot.get();
+    taken = Clock::now();
+    rescanned = current;
+
+    Try<os::ProcessTree> tree = snapshot.get().pstree(pid);
+
+    if (tree.isError()) {
+      return None();
+    }
+
+    return Option<os::ProcessTree>(tree.get());
+  }
+
+private:
+  // Returns the interval (since the epoch) the time falls into, i.e.,
+  // snapshots are shared by everyone asking during the same interval.
+  static int64_t interval(const Time& time)
+  {
+    return time.duration().ns() / PROCESS_SNAPSHOT_INTERVAL.ns();
+  }
+
+  Option<ProcessSnapshot> snapshot;
+  Time taken;
+
+  // Whether the snapshot was retaken during its interval because of
+  // a pid that was not in it.
+  bool rescanned;
+};
+
+
+// Global process snapshot object.
+static ProcessSnapshotProcess* snapshotter = NULL;
+
+
+Future<Option<os::ProcessTree> > pstree(pid_t pid)
+{
+  static Once* initialized = new Once();
+
+  if (!initialized->once()) {
+    snapshotter = new ProcessSnapshotProcess();
+    spawn(snapshotter);
+    initialized->done();
+  }
+
+  CHECK_NOTNULL(snapshotter);
+
+  return dispatch(snapshotter, &ProcessSnapshotProcess::pstree, pid);
+}
+
+} // namespace slave {
+} // namespace internal {
+} // namespace mesos {
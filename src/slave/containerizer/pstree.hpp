@@ -0,0 +1,78 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef __SLAVE_CONTAINERIZER_PSTREE_HPP__
+#define __SLAVE_CONTAINERIZER_PSTREE_HPP__
+
+#include <sys/types.h>
+
+#include <list>
+
+#include <process/future.hpp>
+
+#include <stout/hashmap.hpp>
+#include <stout/multihashmap.hpp>
+#include <stout/option.hpp>
+#include <stout/try.hpp>
+
+#include <stout/os/process.hpp>
+
+namespace mesos {
+namespace internal {
+namespace slave {
+
+// A snapshot of all the processes on the system (i.e., a single scan
+// of /proc) indexed by parent pid so that the process tree of any pid
+// can be built without going through all of the processes.
+class ProcessSnapshot
+{
+public:
+  // Takes a snapshot of all the processes on the system.
+  static Try<ProcessSnapshot> create();
+
+  explicit ProcessSnapshot(const std::list<os::Process>& processes);
+
+  // Returns the process tree rooted at the specified pid (or an error
+  // if there was no such process when the snapshot was taken).
+  Try<os::ProcessTree> pstree(pid_t pid) const;
+
+  // Returns the number of processes in the snapshot.
+  size_t size() const { return processes.size(); }
+
+private:
+  hashmap<pid_t, os::Process> processes;
+  multihashmap<pid_t, pid_t> children; // Parent to children.
+};
+
+
+// Returns the process tree rooted at the specified pid (or none if
+// there is no such process) using a slave-wide snapshot of the
+// processes. A new snapshot is only taken once per
+// PROCESS_SNAPSHOT_INTERVAL (plus at most once more during the
+// interval when a pid isn't in the current snapshot, e.g., for a
+// container that was just launched) so that collecting the resource
+// usage of every container scans /proc once rather than once per
+// container (and isolator).
+process::Future<Option<os::ProcessTree> > pstree(pid_t pid);
+
+} // namespace slave {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __SLAVE_CONTAINERIZER_PSTREE_HPP__
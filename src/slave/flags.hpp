@@ -210,6 +210,15 @@ public:
         "The path to the external containerizer executable used when\n"
         "external isolation is activated (--isolation=external).\n");
 
+    add(&Flags::containerizer_daemon,
+        "containerizer_daemon",
+        "Whether to start the external containerizer executable once as a\n"
+        "long-lived daemon serving the requests for all containers, rather\n"
+        "than executing it for every single command\n"
+        "(see --containerizer_path). The daemon is restarted (with\n"
+        "backoff) whenever it terminates.",
+        false);
+
     add(&Flags::default_container_image,
         "default_container_image",
         "The default container image to use if not specified by a task,\n"
@@ -244,6 +253,7 @@ public:
   Option<std::string> slave_subsystems;
 #endif
   Option<std::string> containerizer_path;
+  bool containerizer_daemon;
   Option<std::string> default_container_image;
 };
 
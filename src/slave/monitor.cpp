@@ -16,9 +16,16 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <limits>
 #include <list>
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
 
 #include <mesos/mesos.hpp>
 
@@ -30,10 +37,14 @@
 #include <process/help.hpp>
 #include <process/http.hpp>
 #include <process/process.hpp>
-#include <process/statistics.hpp>
+#include <process/time.hpp>
 
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
 #include <stout/json.hpp>
 #include <stout/lambda.hpp>
+#include <stout/numify.hpp>
 #include <stout/protobuf.hpp>
 
 #include "slave/containerizer/containerizer.hpp"
@@ -44,7 +55,9 @@ using namespace process;
 using std::list;
 using std::make_pair;
 using std::map;
+using std::pair;
 using std::string;
+using std::vector;
 
 namespace mesos {
 namespace internal {
@@ -60,6 +73,296 @@ const size_t MONITORING_TIME_SERIES_CAPACITY = 1000;
 const size_t MONITORING_ARCHIVED_TIME_SERIES = 25;
 
 
+// Returns the fields of ResourceStatistics stored as columns, i.e.,
+// all of its (numeric) fields. Any other fields (e.g., added to
+// ResourceStatistics later on) are not kept in the time series.
+static const vector<const google::protobuf::FieldDescriptor*>& fields()
+{
+  static vector<const google::protobuf::FieldDescriptor*>* fields = NULL;
+
+  if (fields == NULL) {
+    fields = new vector<const google::protobuf::FieldDescriptor*>();
+
+    const google::protobuf::Descriptor* descriptor =
+      ResourceStatistics::descriptor();
+
+    for (int i = 0; i < descriptor->field_count(); i++) {
+      const google::protobuf::FieldDescriptor* field = descriptor->field(i);
+
+      switch (field->cpp_type()) {
+        case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+        case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+          if (!field->is_repeated()) {
+            fields->push_back(field);
+            continue;
+          }
+          break;
+        default:
+          break;
+      }
+
+      LOG(WARNING) << "Not keeping field '" << field->name()
+                   << "' of ResourceStatistics in the time series";
+    }
+  }
+
+  return *fields;
+}
+
+
+// Index of the 'timestamp' field in 'fields()'.
+static size_t timestampColumn()
+{
+  static size_t column = fields().size();
+
+  if (column == fields().size()) {
+    for (size_t i = 0; i < fields().size(); i++) {
+      if (fields()[i]->number() == ResourceStatistics::kTimestampFieldNumber) {
+        column = i;
+      }
+    }
+  }
+
+  CHECK_LT(column, fields().size());
+  return column;
+}
+
+
+ResourceStatisticsTimeSeries::ResourceStatisticsTimeSeries(
+    const Duration& _window,
+    size_t _capacity)
+  : window(_window),
+    // Downsampling requires at least 3 samples.
+    capacity(std::max((size_t) 3, _capacity)),
+    columns(fields().size()),
+    head(0),
+    count(0) {}
+
+
+Time ResourceStatisticsTimeSeries::time(size_t index) const
+{
+  // NOTE: We use Time::create (rather than comparing the timestamps
+  // directly) since it accounts for the clock being advanced.
+  Try<Time> time = Time::create(columns[timestampColumn()][slot(index)]);
+  CHECK_SOME(time);
+  return time.get();
+}
+
+
+void ResourceStatisticsTimeSeries::append(const ResourceStatistics& statistics)
+{
+  if (Time::create(statistics.timestamp()).isError()) {
+    LOG(ERROR) << "Ignoring statistics with invalid timestamp "
+               << statistics.timestamp();
+    return;
+  }
+
+  if (!empty() &&
+      statistics.timestamp() <= columns[timestampColumn()][slot(count - 1)]) {
+    return;
+  }
+
+  // Downsample the older half of the time series if we're at the
+  // capacity, by dropping every other sample (keeping the oldest).
+  // This frees up a quarter of the capacity, so the cost of moving
+  // the samples is amortized over the appends until the next time.
+  if (count == capacity) {
+    const size_t half = count / 2;
+
+    size_t kept = 0;
+    for (size_t index = 0; index < count; index++) {
+      if (index < half && index % 2 == 1) {
+        continue;
+      }
+
+      if (kept != index) {
+        for (size_t i = 0; i < columns.size(); i++) {
+          columns[i][slot(kept)] = columns[i][slot(index)];
+        }
+      }
+
+      kept++;
+    }
+
+    count = kept;
+  }
+
+  const google::protobuf::Reflection* reflection = statistics.GetReflection();
+
+  // NOTE: The columns only grow while the ring buffer hasn't wrapped
+  // around yet, in which case the next slot is at the end.
+  const size_t next = slot(count);
+
+  for (size_t i = 0; i < columns.size(); i++) {
+    const google::protobuf::FieldDescriptor* field = fields()[i];
+
+    double value = std::numeric_limits<double>::quiet_NaN();
+
+    if (reflection->HasField(statistics, field)) {
+      switch (field->cpp_type()) {
+        case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+          value = reflection->GetDouble(statistics, field);
+          break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+          value = reflection->GetFloat(statistics, field);
+          break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+          value = reflection->GetInt32(statistics, field);
+          break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+          value = reflection->GetInt64(statistics, field);
+          break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+          value = reflection->GetUInt32(statistics, field);
+          break;
+        case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+          value = reflection->GetUInt64(statistics, field);
+          break;
+        default:
+          break;
+      }
+    }
+
+    if (next == columns[i].size()) {
+      columns[i].push_back(value);
+    } else {
+      columns[i][next] = value;
+    }
+  }
+
+  count++;
+
+  // Drop the samples outside of the window, keeping at least one.
+  const Time expired = Clock::now() - window;
+  while (count > 1 && time(0) < expired) {
+    head = (head + 1) % capacity;
+    count--;
+  }
+}
+
+
+ResourceStatistics ResourceStatisticsTimeSeries::get(size_t index) const
+{
+  CHECK_LT(index, count);
+
+  ResourceStatistics statistics;
+
+  const google::protobuf::Reflection* reflection = statistics.GetReflection();
+
+  for (size_t i = 0; i < columns.size(); i++) {
+    const google::protobuf::FieldDescriptor* field = fields()[i];
+    const double value = columns[i][slot(index)];
+
+    if (value != value) { // NaN, i.e., not set.
+      continue;
+    }
+
+    switch (field->cpp_type()) {
+      case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE:
+        reflection->SetDouble(&statistics, field, value);
+        break;
+      case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT:
+        reflection->SetFloat(&statistics, field, value);
+        break;
+      case google::protobuf::FieldDescriptor::CPPTYPE_INT32:
+        reflection->SetInt32(&statistics, field, value);
+        break;
+      case google::protobuf::FieldDescriptor::CPPTYPE_INT64:
+        reflection->SetInt64(&statistics, field, value);
+        break;
+      case google::protobuf::FieldDescriptor::CPPTYPE_UINT32:
+        reflection->SetUInt32(&statistics, field, value);
+        break;
+      case google::protobuf::FieldDescriptor::CPPTYPE_UINT64:
+        reflection->SetUInt64(&statistics, field, value);
+        break;
+      default:
+        break;
+    }
+  }
+
+  return statistics;
+}
+
+
+Option<ResourceStatistics> ResourceStatisticsTimeSeries::latest() const
+{
+  if (empty()) {
+    return None();
+  }
+
+  return get(count - 1);
+}
+
+
+pair<size_t, size_t> ResourceStatisticsTimeSeries::range(
+    const Option<Time>& start,
+    const Option<Time>& stop) const
+{
+  // The samples are ordered by their timestamps so we can binary
+  // search for the first sample at or after 'start' and the first
+  // sample after 'stop'.
+  size_t begin = 0;
+  if (start.isSome()) {
+    size_t high = count;
+    while (begin < high) {
+      size_t middle = begin + (high - begin) / 2;
+      if (time(middle) < start.get()) {
+        begin = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+  }
+
+  size_t end = count;
+  if (stop.isSome()) {
+    size_t low = begin;
+    while (low < end) {
+      size_t middle = low + (end - low) / 2;
+      if (time(middle) <= stop.get()) {
+        low = middle + 1;
+      } else {
+        end = middle;
+      }
+    }
+  }
+
+  return make_pair(begin, std::max(begin, end));
+}
+
+
+JSON::Array ResourceStatisticsTimeSeries::json(
+    const Option<Time>& start,
+    const Option<Time>& stop) const
+{
+  JSON::Array array;
+
+  const pair<size_t, size_t> indices = range(start, stop);
+
+  for (size_t index = indices.first; index < indices.second; index++) {
+    JSON::Object object;
+
+    for (size_t i = 0; i < columns.size(); i++) {
+      const double value = columns[i][slot(index)];
+
+      if (value == value) { // Skip NaN, i.e., not set.
+        object.values[fields()[i]->name()] = value;
+      }
+    }
+
+    array.values.push_back(object);
+  }
+
+  return array;
+}
+
+
+
 Future<Nothing> ResourceMonitorProcess::start(
     const ContainerID& containerId,
     const ExecutorInfo& executorInfo,
@@ -71,11 +374,17 @@ Future<Nothing> ResourceMonitorProcess::start(
 
   monitored[containerId] =
       MonitoringInfo(executorInfo,
+                     interval,
                      MONITORING_TIME_SERIES_WINDOW,
                      MONITORING_TIME_SERIES_CAPACITY);
 
-  // Schedule the resource collection.
-  delay(interval, self(), &Self::collect, containerId, interval);
+  // Schedule the resource collection, unless it's already scheduled
+  // for another container monitored at the same interval, in which
+  // case this container gets picked up by its next collection.
+  if (intervals.count(interval) == 0) {
+    intervals.insert(interval);
+    delay(interval, self(), &Self::collect, interval);
+  }
 
   return Nothing();
 }
@@ -89,89 +398,73 @@ Future<Nothing> ResourceMonitorProcess::stop(
   }
 
   // Add the monitoring information to the archive.
-  archive.push_back(monitored[containerId]);
+  archived.push_back(monitored[containerId]);
   monitored.erase(containerId);
 
   return Nothing();
 }
 
 
-void ResourceMonitorProcess::collect(
-    const ContainerID& containerId,
-    const Duration& interval)
+void ResourceMonitorProcess::collect(const Duration& interval)
 {
-  // Has monitoring stopped?
-  if (!monitored.contains(containerId)) {
+  hashset<ContainerID> containerIds;
+
+  foreachpair (const ContainerID& containerId,
+               const MonitoringInfo& info,
+               monitored) {
+    if (info.interval == interval) {
+      containerIds.insert(containerId);
+    }
+  }
+
+  // Has monitoring stopped for all the containers?
+  if (containerIds.empty()) {
+    intervals.erase(interval);
     return;
   }
 
-  containerizer->usage(containerId)
-    .onAny(defer(self(),
-                 &Self::_collect,
-                 lambda::_1,
-                 containerId,
-                 interval));
+  containerizer->usage(containerIds)
+    .onAny(defer(self(), &Self::_collect, lambda::_1, interval));
 }
 
 
 void ResourceMonitorProcess::_collect(
-    const Future<ResourceStatistics>& statistics,
-    const ContainerID& containerId,
+    const Future<hashmap<ContainerID, ResourceStatistics> >& statistics,
     const Duration& interval)
 {
-  // Has monitoring been stopped?
-  if (!monitored.contains(containerId)) {
-    return;
-  }
-
-  const ExecutorID& executorId =
-    monitored[containerId].executorInfo.executor_id();
-  const FrameworkID& frameworkId =
-    monitored[containerId].executorInfo.framework_id();
-
   if (statistics.isDiscarded()) {
-    VLOG(1) << "Ignoring discarded future collecting resource usage for"
-            << " container '" << containerId
-            << "' for executor '" << executorId
-            << "' of framework '" << frameworkId << "'";
+    VLOG(1) << "Ignoring discarded future collecting resource usage";
   } else if (statistics.isFailed()) {
-    // TODO(bmahler): Have the Containerizer discard the result when the
-    // executor was killed or completed.
-    VLOG(1)
-      << "Failed to collect resource usage for"
-      << " container '" << containerId
-      << "' for executor '" << executorId
-      << "' of framework '" << frameworkId << "': " << statistics.failure();
+    VLOG(1) << "Failed to collect resource usage: " << statistics.failure();
   } else {
-    Try<Time> time = Time::create(statistics.get().timestamp());
+    foreachpair (const ContainerID& containerId,
+                 const ResourceStatistics& usage,
+                 statistics.get()) {
+      // Has monitoring been stopped?
+      if (!monitored.contains(containerId)) {
+        continue;
+      }
+
+      Try<Time> time = Time::create(usage.timestamp());
+
+      if (time.isError()) {
+        LOG(ERROR) << "Invalid timestamp " << usage.timestamp()
+                   << " for container '" << containerId
+                   << "' for executor '"
+                   << monitored[containerId].executorInfo.executor_id()
+                   << "' of framework '"
+                   << monitored[containerId].executorInfo.framework_id()
+                   << ": " << time.error();
+        continue;
+      }
 
-    if (time.isError()) {
-      LOG(ERROR) << "Invalid timestamp " << statistics.get().timestamp()
-                 << " for container '" << containerId
-                 << "' for executor '" << executorId
-                 << "' of framework '" << frameworkId << ": " << time.error();
-    } else {
       // Add the statistics to the time series.
-      monitored[containerId].statistics.set(
-          statistics.get(), time.get());
+      monitored[containerId].statistics.append(usage);
     }
   }
 
   // Schedule the next collection.
-  delay(interval, self(), &Self::collect, containerId, interval);
-}
-
-
-ResourceMonitorProcess::Usage ResourceMonitorProcess::usage(
-    const ContainerID& containerId,
-    const ExecutorInfo& executorInfo)
-{
-  Usage usage;
-  usage.containerId = containerId;
-  usage.executorInfo = executorInfo;
-  usage.statistics = containerizer->usage(containerId);
-
-  return usage;
+  delay(interval, self(), &Self::collect, interval);
 }
 
 
@@ -186,46 +479,42 @@ Future<http::Response> ResourceMonitorProcess::statistics(
 Future<http::Response> ResourceMonitorProcess::_statistics(
     const http::Request& request)
 {
-  list<Usage> usages;
-  list<Future<ResourceStatistics> > futures;
+  hashmap<ContainerID, ExecutorInfo> executors;
 
   foreachpair (const ContainerID& containerId,
                const MonitoringInfo& info,
                monitored) {
-    // TODO(bmahler): Consider a batch usage API on the Containerizer.
-    usages.push_back(usage(containerId, info.executorInfo));
-    futures.push_back(usages.back().statistics);
+    executors[containerId] = info.executorInfo;
   }
 
-  return process::await(futures)
-    .then(defer(self(), &Self::__statistics, usages, request));
+  return containerizer->usage(executors.keys())
+    .then(defer(self(), &Self::__statistics, executors, lambda::_1, request));
 }
 
 
 Future<http::Response> ResourceMonitorProcess::__statistics(
-    const list<ResourceMonitorProcess::Usage>& usages,
+    const hashmap<ContainerID, ExecutorInfo>& executors,
+    const hashmap<ContainerID, ResourceStatistics>& statistics,
     const http::Request& request)
 {
   JSON::Array result;
 
-  foreach (const Usage& usage, usages) {
-    if (usage.statistics.isFailed()) {
-      LOG(WARNING) << "Failed to get resource usage for "
-                   << " container " << usage.containerId
-                   << " for executor " << usage.executorInfo.executor_id()
-                   << " of framework " << usage.executorInfo.framework_id()
-                   << ": " << usage.statistics.failure();
-      continue;
-    } else if (usage.statistics.isDiscarded()) {
+  foreachpair (const ContainerID& containerId,
+               const ExecutorInfo& executorInfo,
+               executors) {
+    // The containerizer has already logged why the usage of a
+    // container couldn't be collected.
+    if (!statistics.contains(containerId)) {
       continue;
     }
 
     JSON::Object entry;
-    entry.values["framework_id"] = usage.executorInfo.framework_id().value();
-    entry.values["executor_id"] = usage.executorInfo.executor_id().value();
-    entry.values["executor_name"] = usage.executorInfo.name();
-    entry.values["source"] = usage.executorInfo.source();
-    entry.values["statistics"] = JSON::Protobuf(usage.statistics.get());
+    entry.values["framework_id"] = executorInfo.framework_id().value();
+    entry.values["executor_id"] = executorInfo.executor_id().value();
+    entry.values["executor_name"] = executorInfo.name();
+    entry.values["source"] = executorInfo.source();
+    entry.values["statistics"] =
+      JSON::Protobuf(statistics.get(containerId).get());
 
     result.values.push_back(entry);
   }
@@ -234,6 +523,73 @@ Future<http::Response> ResourceMonitorProcess::__statistics(
 }
 
 
+// Returns the JSON for the time series of an executor.
+static JSON::Object archive(
+    const ExecutorInfo& executorInfo,
+    const ResourceStatisticsTimeSeries& statistics,
+    const Option<Time>& start,
+    const Option<Time>& stop)
+{
+  JSON::Object entry;
+  entry.values["framework_id"] = executorInfo.framework_id().value();
+  entry.values["executor_id"] = executorInfo.executor_id().value();
+  entry.values["executor_name"] = executorInfo.name();
+  entry.values["source"] = executorInfo.source();
+  entry.values["statistics"] = statistics.json(start, stop);
+  return entry;
+}
+
+
+Future<http::Response> ResourceMonitorProcess::archive(
+    const http::Request& request)
+{
+  Option<Time> start = None();
+  Option<Time> stop = None();
+
+  if (request.query.get("start").isSome()) {
+    Try<double> seconds = numify<double>(request.query.get("start").get());
+    if (seconds.isError()) {
+      return http::BadRequest("Invalid 'start': " + seconds.error() + ".\n");
+    }
+
+    Try<Time> time = Time::create(seconds.get());
+    if (time.isError()) {
+      return http::BadRequest("Invalid 'start': " + time.error() + ".\n");
+    }
+
+    start = time.get();
+  }
+
+  if (request.query.get("stop").isSome()) {
+    Try<double> seconds = numify<double>(request.query.get("stop").get());
+    if (seconds.isError()) {
+      return http::BadRequest("Invalid 'stop': " + seconds.error() + ".\n");
+    }
+
+    Try<Time> time = Time::create(seconds.get());
+    if (time.isError()) {
+      return http::BadRequest("Invalid 'stop': " + time.error() + ".\n");
+    }
+
+    stop = time.get();
+  }
+
+  JSON::Array result;
+
+  foreachvalue (const MonitoringInfo& info, monitored) {
+    result.values.push_back(
+        slave::archive(info.executorInfo, info.statistics, start, stop));
+  }
+
+  foreach (const MonitoringInfo& info, archived) {
+    result.values.push_back(
+        slave::archive(info.executorInfo, info.statistics, start, stop));
+  }
+
+  return http::OK(result, request.query.get("jsonp"));
+}
+
+
 const string ResourceMonitorProcess::STATISTICS_HELP = HELP(
     TLDR(
         "Retrieve resource monitoring information."),
@@ -270,6 +626,44 @@ const string ResourceMonitorProcess::STATISTICS_HELP = HELP(
         "```"));
 
 
+const string ResourceMonitorProcess::ARCHIVE_HELP = HELP(
+    TLDR(
+        "Retrieve the history of the resource monitoring information."),
+    USAGE(
+        "/archive.json"),
+    DESCRIPTION(
+        "Returns the time series of the resource consumption data for",
+        "the containers running under this slave, as well as for the most",
+        "recently completed containers.",
+        "",
+        "Query parameters:",
+        "",
+        ">        start=VALUE          Only include data from this time on",
+        ">                             (in seconds since the Epoch).",
+        ">        stop=VALUE           Only include data up to this time",
+        ">                             (in seconds since the Epoch).",
+        "",
+        "Example:",
+        "",
+        "```",
+        "[{",
+        "    \"executor_id\":\"executor\",",
+        "    \"executor_name\":\"name\",",
+        "    \"framework_id\":\"framework\",",
+        "    \"source\":\"source\",",
+        "    \"statistics\":",
+        "    [{",
+        "        \"cpus_limit\":8.25,",
+        "        \"cpus_system_time_secs\":34501.45,",
+        "        \"cpus_user_time_secs\":96348.84,",
+        "        \"mem_limit_bytes\":7650410496,",
+        "        \"mem_rss_bytes\":5105614848,",
+        "        \"timestamp\":1388534400.0",
+        "    }]",
+        "}]",
+        "```"));
+
+
 ResourceMonitor::ResourceMonitor(Containerizer* containerizer)
 {
   process = new ResourceMonitorProcess(containerizer);
@@ -20,7 +20,10 @@
 #define __SLAVE_MONITOR_HPP__
 
 #include <map>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <boost/circular_buffer.hpp>
 
@@ -28,11 +31,12 @@
 
 #include <process/future.hpp>
 #include <process/limiter.hpp>
-#include <process/statistics.hpp>
+#include <process/time.hpp>
 
 #include <stout/cache.hpp>
 #include <stout/duration.hpp>
 #include <stout/hashmap.hpp>
+#include <stout/json.hpp>
 #include <stout/nothing.hpp>
 #include <stout/option.hpp>
 #include <stout/try.hpp>
@@ -55,9 +59,70 @@ const extern size_t MONITORING_TIME_SERIES_CAPACITY;
 const extern size_t MONITORING_ARCHIVED_TIME_SERIES;
 
 
+// A time series of the resource usage of a container over a window
+// (like process::TimeSeries). The samples are stored in a fixed
+// capacity ring buffer with a column per field of ResourceStatistics
+// rather than as a copy of each message, so appending a sample is
+// O(1) and doesn't allocate once the capacity has been reached. When
+// the capacity is exceeded the older half of the time series is
+// downsampled by dropping every other sample, so recent samples keep
+// their granularity while older ones get coarser.
+class ResourceStatisticsTimeSeries
+{
+public:
+  ResourceStatisticsTimeSeries(
+      const Duration& window = MONITORING_TIME_SERIES_WINDOW,
+      size_t capacity = MONITORING_TIME_SERIES_CAPACITY);
+
+  // Appends a sample at the time of its timestamp, dropping the
+  // samples that fell out of the window. Samples which are not more
+  // recent than the latest sample (or have an invalid timestamp) are
+  // ignored.
+  void append(const ResourceStatistics& statistics);
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  // Returns the sample at the given index, the oldest sample being at
+  // index 0.
+  ResourceStatistics get(size_t index) const;
+
+  Option<ResourceStatistics> latest() const;
+
+  // Returns the indices [begin, end) of the samples within the
+  // (optional) time range.
+  std::pair<size_t, size_t> range(
+      const Option<process::Time>& start = None(),
+      const Option<process::Time>& stop = None()) const;
+
+  // Returns the samples within the (optional) time range formatted
+  // like JSON::Protobuf(ResourceStatistics), straight from the
+  // columns.
+  JSON::Array json(
+      const Option<process::Time>& start = None(),
+      const Option<process::Time>& stop = None()) const;
+
+private:
+  size_t slot(size_t index) const { return (head + index) % capacity; }
+  process::Time time(size_t index) const;
+
+  // Non-const for assignability.
+  Duration window;
+  size_t capacity;
+
+  // A column per field of ResourceStatistics (see 'fields' in the
+  // implementation) where NaN means the field was not set. Columns
+  // grow up to the capacity and then wrap around.
+  std::vector<std::vector<double> > columns;
+
+  size_t head;  // Slot of the oldest sample.
+  size_t count; // Number of samples.
+};
+
+
 // Provides resource monitoring for containers. Resource usage time
-// series are stored using the Statistics module. Usage information
-// is also exported via a JSON endpoint.
+// series are kept for each container (see above). Usage information
+// is also exported via JSON endpoints.
 // TODO(bmahler): Forward usage information to the master.
 // TODO(bmahler): Consider pulling out the resource collection into
 // a Collector abstraction. The monitor can then become a true
@@ -96,7 +161,7 @@ public:
     : ProcessBase("monitor"),
       containerizer(_containerizer),
       limiter(2, Seconds(1)), // 2 permits per second.
-      archive(MONITORING_ARCHIVED_TIME_SERIES) {}
+      archived(MONITORING_ARCHIVED_TIME_SERIES) {}
 
   virtual ~ResourceMonitorProcess() {}
 
@@ -115,33 +180,20 @@ protected:
           STATISTICS_HELP,
           &ResourceMonitorProcess::statistics);
 
-    // TODO(bmahler): Add a archive.json endpoint that exposes
-    // historical information, once we have path parameters for
-    // routes.
+    route("/archive.json",
+          ARCHIVE_HELP,
+          &ResourceMonitorProcess::archive);
   }
 
 private:
-  void collect(
-      const ContainerID& containerId,
-      const Duration& interval);
+  // Collects the usage of all of the containers that are monitored
+  // at the given interval at once so that their samples line up.
+  void collect(const Duration& interval);
   void _collect(
-      const process::Future<ResourceStatistics>& statistics,
-      const ContainerID& containerId,
+      const process::Future<hashmap<ContainerID, ResourceStatistics> >&
+        statistics,
       const Duration& interval);
 
-  // This is a convenience struct for bundling usage information.
-  struct Usage
-  {
-    ContainerID containerId;
-    ExecutorInfo executorInfo;
-    process::Future<ResourceStatistics> statistics;
-  };
-
-  // Helper for returning the usage for a particular executor.
-  Usage usage(
-      const ContainerID& containerId,
-      const ExecutorInfo& executorInfo);
-
   // HTTP Endpoints.
   // Returns the monitoring statistics. Requests have no parameters.
   process::Future<process::http::Response> statistics(
@@ -149,10 +201,18 @@ private:
   process::Future<process::http::Response> _statistics(
       const process::http::Request& request);
   process::Future<process::http::Response> __statistics(
-      const std::list<Usage>& usages,
+      const hashmap<ContainerID, ExecutorInfo>& executors,
+      const hashmap<ContainerID, ResourceStatistics>& statistics,
+      const process::http::Request& request);
+
+  // Returns the time series of the monitored and the archived
+  // containers, optionally within the time range given by the 'start'
+  // and 'stop' query parameters (in seconds since the Epoch).
+  process::Future<process::http::Response> archive(
       const process::http::Request& request);
 
   static const std::string STATISTICS_HELP;
+  static const std::string ARCHIVE_HELP;
 
   Containerizer* containerizer;
 
@@ -165,19 +225,26 @@ private:
     MonitoringInfo() {}
 
     MonitoringInfo(const ExecutorInfo& _executorInfo,
+                   const Duration& _interval,
                    const Duration& window,
                    size_t capacity)
-      : executorInfo(_executorInfo), statistics(window, capacity) {}
+      : executorInfo(_executorInfo),
+        interval(_interval),
+        statistics(window, capacity) {}
 
     ExecutorInfo executorInfo;   // Non-const for assignability.
-    process::TimeSeries<ResourceStatistics> statistics;
+    Duration interval;           // Non-const for assignability.
+    ResourceStatisticsTimeSeries statistics;
   };
 
   // The monitoring info is stored for each monitored container.
   hashmap<ContainerID, MonitoringInfo> monitored;
 
+  // The intervals for which a collection is currently scheduled.
+  std::set<Duration> intervals;
+
   // Fixed-size history of monitoring information.
-  boost::circular_buffer<MonitoringInfo> archive;
+  boost::circular_buffer<MonitoringInfo> archived;
 };
 
 } // namespace slave {
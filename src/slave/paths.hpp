@@ -54,6 +54,7 @@ const std::string EXECUTOR_SENTINEL_FILE = "executor.sentinel";
 const std::string FORKED_PID_FILE = "forked.pid";
 const std::string TASK_INFO_FILE = "task.info";
 const std::string TASK_UPDATES_FILE = "task.updates";
+const std::string STATUS_UPDATES_JOURNAL_FILE = "status_updates.journal";
 
 // Path layout templates.
 const std::string ROOT_PATH = "%s";
@@ -65,6 +66,8 @@ const std::string BOOT_ID_PATH =
   path::join(ROOT_PATH, BOOT_ID_FILE);
 const std::string SLAVE_INFO_PATH =
   path::join(SLAVE_PATH, SLAVE_INFO_FILE);
+const std::string STATUS_UPDATES_JOURNAL_PATH =
+  path::join(SLAVE_PATH, STATUS_UPDATES_JOURNAL_FILE);
 const std::string FRAMEWORK_PATH =
   path::join(SLAVE_PATH, "frameworks", "%s");
 const std::string FRAMEWORK_PID_PATH =
@@ -135,6 +138,14 @@ inline std::string getSlavePath(
 }
 
 
+inline std::string getStatusUpdatesJournalPath(
+    const std::string& rootDir,
+    const SlaveID& slaveId)
+{
+  return strings::format(STATUS_UPDATES_JOURNAL_PATH, rootDir, slaveId).get();
+}
+
+
 inline std::string getFrameworkPath(
     const std::string& rootDir,
     const SlaveID& slaveId,
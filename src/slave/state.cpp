@@ -150,10 +150,130 @@ Try<SlaveState> SlaveState::recover(
     state.errors += framework.get().errors;
   }
 
+  // Read the status update journal.
+  Try<Nothing> journal = recoverStatusUpdates(rootDir, slaveId, strict, &state);
+  if (journal.isError()) {
+    return Error(journal.error());
+  }
+
   return state;
 }
 
 
+Try<Nothing> SlaveState::recoverStatusUpdates(
+    const string& rootDir,
+    const SlaveID& slaveId,
+    bool strict,
+    SlaveState* state)
+{
+  string message;
+
+  const string& path = paths::getStatusUpdatesJournalPath(rootDir, slaveId);
+  if (!os::exists(path)) {
+    // This could happen if the slave died before it checkpointed any
+    // status updates.
+    VLOG(1) << "Failed to find status update journal '" << path << "'";
+    return Nothing();
+  }
+
+  // Open the journal for reading and writing (for truncating).
+  Try<int> fd = os::open(path, O_RDWR);
+
+  if (fd.isError()) {
+    message = "Failed to open status update journal '" + path +
+              "': " + fd.error();
+
+    if (strict) {
+      return Error(message);
+    } else {
+      LOG(WARNING) << message;
+      state->errors++;
+      return Nothing();
+    }
+  }
+
+  // Now, read the records and add them to the status updates of
+  // their tasks, which is the same as if each task had their own
+  // status updates file (see TaskState::recover).
+  Result<StatusUpdateJournalRecord> record = None();
+  while (true) {
+    // Ignore errors due to partial protobuf read and enable undoing
+    // failed reads by reverting to the previous seek position.
+    record = ::protobuf::read<StatusUpdateJournalRecord>(fd.get(), true, true);
+
+    if (!record.isSome()) {
+      break;
+    }
+
+    const FrameworkID& frameworkId = record.get().framework_id();
+    const ExecutorID& executorId = record.get().executor_id();
+    const ContainerID& containerId = record.get().container_id();
+    const TaskID& taskId = record.get().task_id();
+
+    // Skip the records of the tasks we didn't recover (e.g., the
+    // checkpointed state of the task has been garbage collected).
+    if (!state->frameworks.contains(frameworkId) ||
+        !state->frameworks[frameworkId].executors.contains(executorId) ||
+        !state->frameworks[frameworkId].executors[executorId]
+          .runs.contains(containerId) ||
+        !state->frameworks[frameworkId].executors[executorId]
+          .runs[containerId].tasks.contains(taskId)) {
+      continue;
+    }
+
+    TaskState& task = state->frameworks[frameworkId].executors[executorId]
+      .runs[containerId].tasks[taskId];
+
+    if (record.get().record().type() == StatusUpdateRecord::UPDATE) {
+      task.updates.push_back(record.get().record().update());
+    } else {
+      task.acks.insert(UUID::fromBytes(record.get().record().uuid()));
+    }
+  }
+
+  // Always truncate the journal to contain only valid records (so
+  // the slave can append to it again).
+  if (ftruncate(fd.get(), lseek(fd.get(), 0, SEEK_CUR)) != 0) {
+    os::close(fd.get());
+    return ErrnoError(
+        "Failed to truncate status update journal '" + path + "'");
+  }
+
+  // After reading a non-corrupted journal, 'record' should be 'none'.
+  if (record.isError()) {
+    os::close(fd.get());
+
+    message = "Failed to read status update journal '" + path +
+              "': " + record.error();
+
+    if (strict) {
+      return Error(message);
+    } else {
+      LOG(WARNING) << message;
+      state->errors++;
+      return Nothing();
+    }
+  }
+
+  // Close the journal.
+  Try<Nothing> close = os::close(fd.get());
+
+  if (close.isError()) {
+    message = "Failed to close status update journal '" + path +
+              "': " + close.error();
+
+    if (strict) {
+      return Error(message);
+    } else {
+      LOG(WARNING) << message;
+      state->errors++;
+    }
+  }
+
+  return Nothing();
+}
+
+
 Try<FrameworkState> FrameworkState::recover(
     const string& rootDir,
     const SlaveID& slaveId,
@@ -549,13 +669,12 @@ Try<TaskState> TaskState::recover(
 
   state.info = task.get();
 
-  // Read the status updates.
+  // Read the status updates file written by older slaves, the status
+  // updates are now checkpointed to the status update journal of the
+  // slave instead (see SlaveState::recoverStatusUpdates).
   path = paths::getTaskUpdatesPath(
       rootDir, slaveId, frameworkId, executorId, containerId, taskId);
   if (!os::exists(path)) {
-    // This could happen if the slave died before it checkpointed
-    // any status updates for this task.
-    LOG(WARNING) << "Failed to find status updates file '" << path << "'";
     return state;
   }
 
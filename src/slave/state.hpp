@@ -28,6 +28,7 @@
 #include <stout/foreach.hpp>
 #include <stout/hashmap.hpp>
 #include <stout/hashset.hpp>
+#include <stout/nothing.hpp>
 #include <stout/protobuf.hpp>
 #include <stout/strings.hpp>
 #include <stout/utils.hpp>
@@ -88,6 +89,14 @@ struct SlaveState
       const SlaveID& slaveId,
       bool strict);
 
+  // Adds the records of the status update journal of the slave to
+  // the recovered tasks (see StatusUpdateJournal).
+  static Try<Nothing> recoverStatusUpdates(
+      const std::string& rootDir,
+      const SlaveID& slaveId,
+      bool strict,
+      SlaveState* state);
+
   SlaveID id;
   Option<SlaveInfo> info;
   hashmap<FrameworkID, FrameworkState> frameworks;
@@ -0,0 +1,334 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <process/dispatch.hpp>
+
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/os.hpp>
+#include <stout/protobuf.hpp>
+
+#include "common/type_utils.hpp"
+
+#include "logging/logging.hpp"
+
+#include "slave/constants.hpp"
+#include "slave/paths.hpp"
+#include "slave/status_update_journal.hpp"
+
+using namespace process;
+
+using process::wait; // Necessary on some OS's to disambiguate.
+
+using std::string;
+using std::vector;
+
+namespace mesos {
+namespace internal {
+namespace slave {
+
+StatusUpdateJournalProcess::StatusUpdateJournalProcess(
+    const string& _rootDir,
+    const SlaveID& _slaveId,
+    const Bytes& _compactionSize,
+    int _fd,
+    off_t _size)
+  : rootDir(_rootDir),
+    slaveId(_slaveId),
+    compactionSize(_compactionSize),
+    path(paths::getStatusUpdatesJournalPath(_rootDir, _slaveId)),
+    fd(_fd),
+    size(_size),
+    compacted(_size) {}
+
+
+StatusUpdateJournalProcess::~StatusUpdateJournalProcess()
+{
+  foreach (const Owned<Promise<Nothing> >& promise, promises) {
+    promise->fail("Status update journal closed");
+  }
+
+  Try<Nothing> close = os::close(fd);
+  if (close.isError()) {
+    LOG(ERROR) << "Failed to close status update journal '" << path << "': "
+               << close.error();
+  }
+}
+
+
+Future<Nothing> StatusUpdateJournalProcess::append(
+    const StatusUpdateJournalRecord& record)
+{
+  if (error.isSome()) {
+    return Failure(error.get());
+  }
+
+  // Frame the record the same way as '::protobuf::write' so that the
+  // journal can be read back using '::protobuf::read'.
+  string bytes;
+  if (!record.SerializeToString(&bytes)) {
+    return Failure("Failed to serialize status update record");
+  }
+
+  uint32_t length = bytes.size();
+  buffer.append((char*) &length, sizeof(length));
+  buffer.append(bytes);
+
+  Owned<Promise<Nothing> > promise(new Promise<Nothing>());
+  promises.push_back(promise);
+
+  // Commit after the records that have already been appended (i.e.,
+  // that are queued behind this one) rather than right away, so that
+  // all of them get synced together.
+  if (promises.size() == 1) {
+    dispatch(self(), &StatusUpdateJournalProcess::commit);
+  }
+
+  return promise->future();
+}
+
+
+void StatusUpdateJournalProcess::commit()
+{
+  if (promises.empty()) {
+    return;
+  }
+
+  VLOG(1) << "Committing " << promises.size()
+          << " status update records to '" << path << "'";
+
+  Try<Nothing> write = os::write(fd, buffer);
+
+  if (write.isSome() && fsync(fd) != 0) {
+    write = ErrnoError("Failed to sync");
+  }
+
+  if (write.isError()) {
+    // We don't know how much of the batch made it to disk, so refuse
+    // to append anything else (recovery discards partial records).
+    error = "Failed to write status update records to '" + path + "': " +
+            write.error();
+
+    foreach (const Owned<Promise<Nothing> >& promise, promises) {
+      promise->fail(error.get());
+    }
+  } else {
+    foreach (const Owned<Promise<Nothing> >& promise, promises) {
+      promise->set(Nothing());
+    }
+  }
+
+  size += buffer.size();
+
+  buffer.clear();
+  promises.clear();
+
+  if (error.isNone() &&
+      size >= std::max(compacted * 2, (off_t) compactionSize.bytes())) {
+    Try<Nothing> compact = this->compact();
+    if (compact.isError()) {
+      LOG(ERROR) << "Failed to compact status update journal '" << path
+                 << "': " << compact.error();
+
+      // Don't try again until the journal doubles in size again.
+      compacted = size;
+    }
+  }
+}
+
+
+Try<Nothing> StatusUpdateJournalProcess::compact()
+{
+  Try<int> in = os::open(path, O_RDONLY);
+  if (in.isError()) {
+    return Error("Failed to open: " + in.error());
+  }
+
+  const string temp = path + ".compact";
+
+  Try<int> out = os::open(
+      temp,
+      O_CREAT | O_WRONLY | O_TRUNC,
+      S_IRUSR | S_IWUSR | S_IRGRP | S_IRWXO);
+
+  if (out.isError()) {
+    os::close(in.get());
+    return Error("Failed to open '" + temp + "': " + out.error());
+  }
+
+  // Keep the records of the tasks whose directories are still around
+  // since they are needed to recover the tasks.
+  size_t kept = 0;
+  size_t dropped = 0;
+
+  Result<StatusUpdateJournalRecord> record = None();
+  while (true) {
+    record = ::protobuf::read<StatusUpdateJournalRecord>(in.get());
+    if (!record.isSome()) {
+      break;
+    }
+
+    const string& task = paths::getTaskPath(
+        rootDir,
+        slaveId,
+        record.get().framework_id(),
+        record.get().executor_id(),
+        record.get().container_id(),
+        record.get().task_id());
+
+    if (!os::exists(task)) {
+      dropped++;
+      continue;
+    }
+
+    Try<Nothing> write = ::protobuf::write(out.get(), record.get());
+    if (write.isError()) {
+      record = Error(write.error());
+      break;
+    }
+
+    kept++;
+  }
+
+  os::close(in.get());
+
+  if (record.isError() || fsync(out.get()) != 0) {
+    os::close(out.get());
+    os::rm(temp);
+    return Error(record.isError() ? record.error() : "Failed to sync");
+  }
+
+  off_t length = lseek(out.get(), 0, SEEK_CUR);
+
+  os::close(out.get());
+
+  if (::rename(temp.c_str(), path.c_str()) != 0) {
+    ErrnoError rename("Failed to rename '" + temp + "'");
+    os::rm(temp);
+    return rename;
+  }
+
+  // Sync the directory so that the rename is durable before we
+  // append anything else to the new journal.
+  Try<int> directory = os::open(os::dirname(path).get(), O_RDONLY);
+  if (directory.isError()) {
+    return Error("Failed to open directory: " + directory.error());
+  }
+
+  fsync(directory.get());
+  os::close(directory.get());
+
+  Try<int> fd = os::open(path, O_WRONLY | O_APPEND);
+  if (fd.isError()) {
+    // Without a journal to append to we can no longer checkpoint.
+    error = "Failed to reopen status update journal '" + path + "': " +
+            fd.error();
+    return Error(error.get());
+  }
+
+  os::close(this->fd);
+  this->fd = fd.get();
+
+  size = compacted = length;
+
+  LOG(INFO) << "Compacted status update journal '" << path << "' keeping "
+            << kept << " and dropping " << dropped << " records";
+
+  return Nothing();
+}
+
+
+Try<StatusUpdateJournal*> StatusUpdateJournal::create(
+    const string& rootDir,
+    const SlaveID& slaveId,
+    const Bytes& compactionSize)
+{
+  const string& path = paths::getStatusUpdatesJournalPath(rootDir, slaveId);
+
+  // Create the slave directory, if it doesn't exist.
+  Try<Nothing> directory = os::mkdir(os::dirname(path).get());
+  if (directory.isError()) {
+    return Error("Failed to create '" + os::dirname(path).get() + "': " +
+                 directory.error());
+  }
+
+  // NOTE: Any partially written record at the end of the journal has
+  // already been truncated during recovery (see slave/state.cpp).
+  Try<int> fd = os::open(
+      path,
+      O_CREAT | O_WRONLY | O_APPEND,
+      S_IRUSR | S_IWUSR | S_IRGRP | S_IRWXO);
+
+  if (fd.isError()) {
+    return Error("Failed to open '" + path + "': " + fd.error());
+  }
+
+  off_t size = lseek(fd.get(), 0, SEEK_END);
+  if (size < 0) {
+    os::close(fd.get());
+    return ErrnoError("Failed to seek '" + path + "'");
+  }
+
+  return new StatusUpdateJournal(
+      new StatusUpdateJournalProcess(
+          rootDir, slaveId, compactionSize, fd.get(), size));
+}
+
+
+StatusUpdateJournal::StatusUpdateJournal(StatusUpdateJournalProcess* _process)
+  : process(_process)
+{
+  spawn(process);
+}
+
+
+StatusUpdateJournal::~StatusUpdateJournal()
+{
+  // Commit the records that have already been appended.
+  terminate(process, false);
+  wait(process);
+  delete process;
+}
+
+
+Future<Nothing> StatusUpdateJournal::append(
+    const FrameworkID& frameworkId,
+    const ExecutorID& executorId,
+    const ContainerID& containerId,
+    const TaskID& taskId,
+    const StatusUpdateRecord& record)
+{
+  StatusUpdateJournalRecord journal;
+  journal.mutable_framework_id()->CopyFrom(frameworkId);
+  journal.mutable_executor_id()->CopyFrom(executorId);
+  journal.mutable_container_id()->CopyFrom(containerId);
+  journal.mutable_task_id()->CopyFrom(taskId);
+  journal.mutable_record()->CopyFrom(record);
+
+  return dispatch(process, &StatusUpdateJournalProcess::append, journal);
+}
+
+} // namespace slave {
+} // namespace internal {
+} // namespace mesos {
@@ -0,0 +1,136 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SLAVE_STATUS_UPDATE_JOURNAL_HPP__
+#define __SLAVE_STATUS_UPDATE_JOURNAL_HPP__
+
+#include <string>
+#include <vector>
+
+#include <mesos/mesos.hpp>
+
+#include <process/future.hpp>
+#include <process/owned.hpp>
+#include <process/process.hpp>
+
+#include <stout/bytes.hpp>
+#include <stout/nothing.hpp>
+#include <stout/option.hpp>
+#include <stout/try.hpp>
+
+#include "messages/messages.hpp"
+
+#include "slave/constants.hpp"
+
+namespace mesos {
+namespace internal {
+namespace slave {
+
+// Forward declarations.
+class StatusUpdateJournalProcess;
+
+// The status update journal is a per-slave append-only file holding
+// the checkpointed status update records of all the tasks (rather
+// than a synchronously written file per task). Records are appended
+// asynchronously and made durable using group commit: the records
+// appended while the journal is syncing the previous batch are
+// written and synced together with a single fsync. This amortizes
+// the cost of syncing across all the status update streams of the
+// slave.
+//
+// The journal is read during recovery (see slave/state.cpp) and is
+// compacted as it grows by dropping the records of the tasks whose
+// checkpointed state has since been garbage collected.
+class StatusUpdateJournal
+{
+public:
+  // Opens the journal of the slave under the meta directory
+  // 'rootDir', creating it if necessary. The journal is compacted
+  // once it is at least 'compactionSize' large and has doubled in
+  // size since the last compaction.
+  static Try<StatusUpdateJournal*> create(
+      const std::string& rootDir,
+      const SlaveID& slaveId,
+      const Bytes& compactionSize = STATUS_UPDATE_JOURNAL_COMPACTION_SIZE);
+
+  ~StatusUpdateJournal();
+
+  // Appends the record of the task to the journal. The future is
+  // ready once the record (and all the records appended before it)
+  // are durable and failed if the record could not be written.
+  process::Future<Nothing> append(
+      const FrameworkID& frameworkId,
+      const ExecutorID& executorId,
+      const ContainerID& containerId,
+      const TaskID& taskId,
+      const StatusUpdateRecord& record);
+
+private:
+  explicit StatusUpdateJournal(StatusUpdateJournalProcess* process);
+
+  StatusUpdateJournalProcess* process;
+};
+
+
+class StatusUpdateJournalProcess
+  : public process::Process<StatusUpdateJournalProcess>
+{
+public:
+  StatusUpdateJournalProcess(
+      const std::string& rootDir,
+      const SlaveID& slaveId,
+      const Bytes& compactionSize,
+      int fd,
+      off_t size);
+
+  virtual ~StatusUpdateJournalProcess();
+
+  process::Future<Nothing> append(const StatusUpdateJournalRecord& record);
+
+private:
+  // Writes and syncs all the records appended since the last commit.
+  void commit();
+
+  // Rewrites the journal without the records of the tasks whose
+  // directories no longer exist.
+  Try<Nothing> compact();
+
+  const std::string rootDir;
+  const SlaveID slaveId;
+  const Bytes compactionSize;
+  const std::string path;
+
+  int fd;
+
+  // Size of the journal, and its size after the last compaction.
+  off_t size;
+  off_t compacted;
+
+  // Serialized records (and their promises) waiting to be committed.
+  std::string buffer;
+  std::vector<process::Owned<process::Promise<Nothing> > > promises;
+
+  // Set if a commit failed, after which no records can be appended.
+  Option<std::string> error;
+};
+
+} // namespace slave {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __SLAVE_STATUS_UPDATE_JOURNAL_HPP__
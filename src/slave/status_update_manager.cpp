@@ -20,6 +20,9 @@
 #include <process/process.hpp>
 #include <process/timer.hpp>
 
+#include <process/metrics/metrics.hpp>
+#include <process/metrics/timer.hpp>
+
 #include <stout/check.hpp>
 #include <stout/foreach.hpp>
 #include <stout/hashmap.hpp>
@@ -33,8 +36,10 @@
 
 #include "slave/constants.hpp"
 #include "slave/flags.hpp"
+#include "slave/paths.hpp"
 #include "slave/slave.hpp"
 #include "slave/state.hpp"
+#include "slave/status_update_journal.hpp"
 #include "slave/status_update_manager.hpp"
 
 using std::string;
@@ -115,10 +120,25 @@ private:
   // ACK (e.g updates from the executor).
   Timeout forward(const StatusUpdate& update, const Duration& duration);
 
+  // Forwards the next pending status update of the task once it has
+  // been checkpointed, so that the master never learns about an
+  // update the slave could lose if it failed.
+  void forward(
+      const TaskID& taskId,
+      const FrameworkID& frameworkId,
+      const Duration& duration);
+
+  // Continuation of 'forward' once the stream's pending checkpoint
+  // completes.
+  void _forward(
+      const TaskID& taskId,
+      const FrameworkID& frameworkId,
+      const Duration& duration);
+
   // Helper functions.
 
-  // Creates a new status update stream (opening the updates file, if path is
-  // present) and adds it to streams.
+  // Creates a new status update stream (opening the status update
+  // journal, if checkpointing) and adds it to streams.
   StatusUpdateStream* createStatusUpdateStream(
       const TaskID& taskId,
       const FrameworkID& frameworkId,
@@ -135,13 +155,42 @@ private:
       const TaskID& taskId,
       const FrameworkID& frameworkId);
 
+  // Returns the status update journal of the slave, opening it if
+  // necessary, or NULL if it can not be opened.
+  StatusUpdateJournal* getStatusUpdateJournal(const SlaveID& slaveId);
+
   UPID master;
   Flags flags;
   PID<Slave> slave;
   hashmap<FrameworkID, hashmap<TaskID, StatusUpdateStream*> > streams;
+  hashmap<SlaveID, StatusUpdateJournal*> journals;
+
+  struct Metrics
+  {
+    Metrics()
+      : checkpoint_latency_ms("slave/status_update_checkpoint_latency_ms")
+    {
+      process::metrics::add(checkpoint_latency_ms);
+    }
+
+    ~Metrics()
+    {
+      process::metrics::remove(checkpoint_latency_ms);
+    }
+
+    // Time from receiving a status update until it is checkpointed.
+    process::metrics::Timer checkpoint_latency_ms;
+  } metrics;
 };
 
 
+// Continuation of 'acknowledgement' once the ACK is checkpointed.
+static bool _acknowledgement(bool result)
+{
+  return result;
+}
+
+
 StatusUpdateManagerProcess::~StatusUpdateManagerProcess()
 {
   foreachkey (const FrameworkID& frameworkId, streams) {
@@ -150,6 +199,12 @@ StatusUpdateManagerProcess::~StatusUpdateManagerProcess()
     }
   }
   streams.clear();
+
+  // Deleting the journals waits for the appended records to commit.
+  foreachvalue (StatusUpdateJournal* journal, journals) {
+    delete journal;
+  }
+  journals.clear();
 }
 
 
@@ -176,7 +231,9 @@ void StatusUpdateManagerProcess::flush()
 {
   foreachkey (const FrameworkID& frameworkId, streams) {
     foreachvalue (StatusUpdateStream* stream, streams[frameworkId]) {
-      if (!stream->pending.empty()) {
+      // Skip the streams whose next update is still being
+      // checkpointed, it's forwarded (to the new master) afterwards.
+      if (!stream->pending.empty() && stream->timeout.isSome()) {
         const StatusUpdate& update = stream->pending.front();
         LOG(WARNING) << "Resending status update " << update;
         stream->timeout = forward(update, STATUS_UPDATE_RETRY_INTERVAL_MIN);
@@ -348,6 +405,16 @@ Future<Nothing> StatusUpdateManagerProcess::_update(
     return Nothing();
   }
 
+  // NOTE: We only let the slave know (i.e., so that it ACKs the
+  // executor) and forward the update (below) once it has been
+  // checkpointed. If the slave fails before then the executor
+  // resends the update.
+  Future<Nothing> checkpointed = stream->checkpointed;
+
+  if (checkpoint) {
+    metrics.checkpoint_latency_ms.time(checkpointed);
+  }
+
   // Forward the status update to the master if this is the first in the stream.
   // Subsequent status updates will get sent in 'acknowledgement()'.
   if (stream->pending.size() == 1) {
@@ -358,10 +425,10 @@ Future<Nothing> StatusUpdateManagerProcess::_update(
     }
 
     CHECK_SOME(next);
-    stream->timeout = forward(next.get(), STATUS_UPDATE_RETRY_INTERVAL_MIN);
+    forward(taskId, frameworkId, STATUS_UPDATE_RETRY_INTERVAL_MIN);
   }
 
-  return Nothing();
+  return checkpointed;
 }
 
 
@@ -390,6 +457,63 @@ Timeout StatusUpdateManagerProcess::forward(
 }
 
 
+void StatusUpdateManagerProcess::forward(
+    const TaskID& taskId,
+    const FrameworkID& frameworkId,
+    const Duration& duration)
+{
+  StatusUpdateStream* stream = getStatusUpdateStream(taskId, frameworkId);
+  CHECK_NOTNULL(stream);
+
+  const Result<StatusUpdate>& next = stream->next();
+  if (next.isError()) {
+    LOG(ERROR) << "Failed to forward the next status update for task "
+               << taskId << " of framework " << frameworkId << ": "
+               << next.error();
+    return;
+  } else if (next.isNone()) {
+    return;
+  }
+
+  // NOTE: The journal commits records in order so once the last
+  // record of the stream is checkpointed so is the next update.
+  if (stream->checkpointed.isPending()) {
+    stream->checkpointed
+      .onAny(defer(self(),
+                   &StatusUpdateManagerProcess::_forward,
+                   taskId,
+                   frameworkId,
+                   duration));
+    return;
+  } else if (!stream->checkpointed.isReady()) {
+    LOG(ERROR) << "Not forwarding status update " << next.get()
+               << " because it failed to be checkpointed: "
+               << (stream->checkpointed.isFailed()
+                   ? stream->checkpointed.failure() : "discarded");
+    return;
+  }
+
+  stream->timeout = forward(next.get(), duration);
+}
+
+
+void StatusUpdateManagerProcess::_forward(
+    const TaskID& taskId,
+    const FrameworkID& frameworkId,
+    const Duration& duration)
+{
+  StatusUpdateStream* stream = getStatusUpdateStream(taskId, frameworkId);
+
+  // The stream might have been cleaned up in the meantime, or the
+  // update forwarded by an earlier continuation.
+  if (stream == NULL || stream->timeout.isSome()) {
+    return;
+  }
+
+  forward(taskId, frameworkId, duration);
+}
+
+
 Future<bool> StatusUpdateManagerProcess::acknowledgement(
     const TaskID& taskId,
     const FrameworkID& frameworkId,
@@ -436,6 +560,8 @@ Future<bool> StatusUpdateManagerProcess::acknowledgement(
     return Failure("Duplicate acknowledgement");
   }
 
+  Future<Nothing> checkpointed = stream->checkpointed;
+
   // Reset the timeout.
   stream->timeout = None();
 
@@ -456,10 +582,11 @@ Future<bool> StatusUpdateManagerProcess::acknowledgement(
     cleanupStatusUpdateStream(taskId, frameworkId);
   } else if (next.isSome()) {
     // Forward the next queued status update.
-    stream->timeout = forward(next.get(), STATUS_UPDATE_RETRY_INTERVAL_MIN);
+    forward(taskId, frameworkId, STATUS_UPDATE_RETRY_INTERVAL_MIN);
   }
 
-  return !terminated;
+  return checkpointed
+    .then(lambda::bind(&_acknowledgement, !terminated));
 }
 
 
@@ -470,8 +597,9 @@ void StatusUpdateManagerProcess::timeout(const Duration& duration)
   foreachkey (const FrameworkID& frameworkId, streams) {
     foreachvalue (StatusUpdateStream* stream, streams[frameworkId]) {
       CHECK_NOTNULL(stream);
-      if (!stream->pending.empty()) {
-        CHECK(stream->timeout.isSome());
+      // NOTE: There is no timeout while the next pending update is
+      // still being checkpointed (see 'forward').
+      if (!stream->pending.empty() && stream->timeout.isSome()) {
         if (stream->timeout.get().expired()) {
           const StatusUpdate& update = stream->pending.front();
           LOG(WARNING) << "Resending status update " << update;
@@ -499,8 +627,17 @@ StatusUpdateStream* StatusUpdateManagerProcess::createStatusUpdateStream(
   VLOG(1) << "Creating StatusUpdate stream for task " << taskId
           << " of framework " << frameworkId;
 
+  StatusUpdateJournal* journal =
+    checkpoint ? getStatusUpdateJournal(slaveId) : NULL;
+
   StatusUpdateStream* stream = new StatusUpdateStream(
-      taskId, frameworkId, slaveId, flags, checkpoint, executorId, containerId);
+      taskId,
+      frameworkId,
+      slaveId,
+      checkpoint,
+      executorId,
+      containerId,
+      journal);
 
   streams[frameworkId][taskId] = stream;
   return stream;
@@ -548,6 +685,26 @@ void StatusUpdateManagerProcess::cleanupStatusUpdateStream(
 }
 
 
+StatusUpdateJournal* StatusUpdateManagerProcess::getStatusUpdateJournal(
+    const SlaveID& slaveId)
+{
+  if (!journals.contains(slaveId)) {
+    Try<StatusUpdateJournal*> journal = StatusUpdateJournal::create(
+        paths::getMetaRootDir(flags.work_dir), slaveId);
+
+    if (journal.isError()) {
+      LOG(ERROR) << "Failed to open the status update journal: "
+                 << journal.error();
+      return NULL;
+    }
+
+    journals[slaveId] = journal.get();
+  }
+
+  return journals[slaveId];
+}
+
+
 StatusUpdateManager::StatusUpdateManager()
 {
   process = new StatusUpdateManagerProcess();
@@ -24,6 +24,7 @@
 #include <string>
 #include <utility>
 
+#include <process/future.hpp>
 #include <process/pid.hpp>
 #include <process/process.hpp>
 #include <process/protobuf.hpp>
@@ -47,6 +48,7 @@
 #include "messages/messages.hpp"
 
 #include "slave/flags.hpp"
+#include "slave/status_update_journal.hpp"
 
 namespace mesos {
 namespace internal {
@@ -135,72 +137,40 @@ private:
 
 
 // StatusUpdateStream handles the status updates and acknowledgements
-// of a task, checkpointing them if necessary. It also holds the information
-// about received, acknowledged and pending status updates.
+// of a task, checkpointing them to the status update journal if
+// necessary. It also holds the information about received,
+// acknowledged and pending status updates.
 // NOTE: A task is expected to have a globally unique ID across the lifetime
 // of a framework. In other words the tuple (taskId, frameworkId) should be
 // always unique.
 struct StatusUpdateStream
 {
+  // NOTE: The journal is required if checkpointing, where NULL means
+  // the journal could not be opened.
   StatusUpdateStream(const TaskID& _taskId,
                      const FrameworkID& _frameworkId,
                      const SlaveID& _slaveId,
-                     const Flags& _flags,
                      bool _checkpoint,
-                     const Option<ExecutorID>& executorId,
-                     const Option<ContainerID>& containerId)
+                     const Option<ExecutorID>& _executorId,
+                     const Option<ContainerID>& _containerId,
+                     StatusUpdateJournal* _journal)
     : checkpoint(_checkpoint),
       terminated(false),
+      checkpointed(Nothing()),
       taskId(_taskId),
       frameworkId(_frameworkId),
       slaveId(_slaveId),
-      flags(_flags),
+      executorId(_executorId),
+      containerId(_containerId),
+      journal(_journal),
       error(None())
   {
     if (checkpoint) {
       CHECK_SOME(executorId);
       CHECK_SOME(containerId);
 
-      path = paths::getTaskUpdatesPath(
-          paths::getMetaRootDir(flags.work_dir),
-          slaveId,
-          frameworkId,
-          executorId.get(),
-          containerId.get(),
-          taskId);
-
-      // Create the base updates directory, if it doesn't exist.
-      Try<Nothing> directory = os::mkdir(os::dirname(path.get()).get());
-      if (directory.isError()) {
-        error = "Failed to create " + os::dirname(path.get()).get();
-        return;
-      }
-
-      // Open the updates file.
-      Try<int> result = os::open(
-          path.get(),
-          O_CREAT | O_WRONLY | O_APPEND | O_SYNC,
-          S_IRUSR | S_IWUSR | S_IRGRP | S_IRWXO);
-
-      if (result.isError()) {
-        error = "Failed to open '" + path.get() + "' for status updates";
-        return;
-      }
-
-      // We keep the file open through the lifetime of the task, because it
-      // makes it easy to append status update records to the file.
-      fd = result.get();
-    }
-  }
-
-  ~StatusUpdateStream()
-  {
-    if (fd.isSome()) {
-      Try<Nothing> close = os::close(fd.get());
-      if (close.isError()) {
-        CHECK_SOME(path);
-        LOG(ERROR) << "Failed to close file '" << path.get() << "': "
-                   << close.error();
+      if (journal == NULL) {
+        error = "Failed to open the status update journal";
       }
     }
   }
@@ -324,13 +294,16 @@ struct StatusUpdateStream
   Option<process::Timeout> timeout; // Timeout for resending status update.
   std::queue<StatusUpdate> pending;
 
+  // Ready once the last handled update or ACK is checkpointed (the
+  // journal commits records in order, so all the earlier ones are
+  // checkpointed too), or failed if checkpointing failed.
+  process::Future<Nothing> checkpointed;
+
 private:
-  // Handles the status update and writes it to disk, if necessary.
-  // TODO(vinod): The write has to be asynchronous to avoid status updates that
-  // are being checkpointed, blocking the processing of other updates.
-  // One solution is to wrap the protobuf::write inside async, but its probably
-  // too much of an overhead to spin up a new libprocess per status update?
-  // A better solution might be to be have async write capability for file io.
+  // Handles the status update and appends it to the journal, if
+  // necessary. The update is handled right away while the write to
+  // the journal happens asynchronously (see 'checkpointed') so that
+  // checkpointing doesn't block the processing of other updates.
   Try<Nothing> handle(
       const StatusUpdate& update,
       const StatusUpdateRecord::Type& type)
@@ -341,7 +314,7 @@ private:
     if (checkpoint) {
       LOG(INFO) << "Checkpointing " << type << " for status update " << update;
 
-      CHECK_SOME(fd);
+      CHECK_NOTNULL(journal);
 
       StatusUpdateRecord record;
       record.set_type(type);
@@ -352,12 +325,12 @@ private:
         record.set_uuid(update.uuid());
       }
 
-      Try<Nothing> write = ::protobuf::write(fd.get(), record);
-      if (write.isError()) {
-        error = "Failed to write status update " + stringify(update) +
-                " to '" + path.get() + "': " + write.error();
-        return Error(error.get());
-      }
+      checkpointed = journal->append(
+          frameworkId,
+          executorId.get(),
+          containerId.get(),
+          taskId,
+          record);
     }
 
     // Now actually handle the update.
@@ -392,14 +365,13 @@ private:
   const TaskID taskId;
   const FrameworkID frameworkId;
   const SlaveID slaveId;
-
-  const Flags flags;
+  const Option<ExecutorID> executorId;
+  const Option<ContainerID> containerId;
 
   hashset<UUID> received;
   hashset<UUID> acknowledged;
 
-  Option<std::string> path; // File path of the update stream.
-  Option<int> fd; // File descriptor to the update stream.
+  StatusUpdateJournal* journal; // Not owned.
 
   Option<std::string> error; // Potential non-retryable error.
 };
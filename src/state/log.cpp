@@ -6,17 +6,23 @@
 #include <set>
 #include <string>
 
+#include <process/collect.hpp>
 #include <process/defer.hpp>
+#include <process/delay.hpp>
 #include <process/dispatch.hpp>
 #include <process/future.hpp>
 #include <process/mutex.hpp>
 #include <process/process.hpp>
 
+#include <stout/cache.hpp>
+#include <stout/duration.hpp>
+#include <stout/error.hpp>
 #include <stout/foreach.hpp>
 #include <stout/lambda.hpp>
 #include <stout/hashmap.hpp>
 #include <stout/nothing.hpp>
 #include <stout/option.hpp>
+#include <stout/try.hpp>
 #include <stout/uuid.hpp>
 
 #include "log/log.hpp"
@@ -41,8 +47,10 @@ namespace state {
 //
 // All operations are gated by 'start()' which makes sure that a
 // Log::Writer has been started and all positions in the log have been
-// read and cached in memory. All reads are performed by this cache
-// (for now). If the Log::Writer gets demoted (i.e., because another
+// read and indexed in memory. Only the name, UUID, and position of
+// each snapshot are kept in the index, the entries themselves are
+// kept in a (bounded) LRU cache and read back from the log on a
+// cache miss. If the Log::Writer gets demoted (i.e., because another
 // writer started) then the current operation will return false
 // implying the operation was not atomic and subsequent operations
 // will re-'start()' which will again read all positions to make sure
@@ -54,7 +62,10 @@ namespace state {
 class LogStorageProcess : public Process<LogStorageProcess>
 {
 public:
-  LogStorageProcess(Log* log);
+  LogStorageProcess(
+      Log* log,
+      size_t cache,
+      const Option<Duration>& compaction);
 
   virtual ~LogStorageProcess();
 
@@ -65,6 +76,7 @@ public:
   Future<std::set<string> > names();
 
 protected:
+  virtual void initialize();
   virtual void finalize();
 
 private:
@@ -84,8 +96,25 @@ private:
       const Log::Position& minimum,
       const Option<Log::Position>& position);
 
+  // Helper for performing compaction, i.e., appending the snapshots
+  // that haven't been updated recently again so that they don't keep
+  // the log from getting truncated.
+  void compact();
+  Future<Nothing> _compact();
+  Future<Nothing> __compact();
+  Future<Nothing> ___compact(
+      const string& name,
+      const list<Log::Entry>& entries);
+  Future<Nothing> ____compact(
+      const string& name,
+      const Option<Log::Position>& position);
+
   // Continuations.
   Future<Option<state::Entry> > _get(const string& name);
+  Future<Option<state::Entry> > __get(
+      const string& name,
+      const Log::Position& position,
+      const list<Log::Entry>& entries);
 
   Future<bool> _set(const state::Entry& entry, const UUID& uuid);
   Future<bool> __set(const state::Entry& entry, const UUID& uuid);
@@ -104,6 +133,8 @@ private:
   Log::Reader reader;
   Log::Writer writer;
 
+  const Option<Duration> compaction;
+
   // Used to serialize Log::Writer::append/truncate operations.
   Mutex mutex;
 
@@ -116,38 +147,83 @@ private:
   // Last position in the log up to which we've truncated.
   Option<Log::Position> truncated;
 
+  // Value of 'index' as of the last compaction, snapshots before this
+  // position haven't been updated since then.
+  Option<Log::Position> checkpoint;
+
+  // Number of snapshot and expunge operations read or written since
+  // the last compaction.
+  size_t operations;
+
   // Note that while it would be nice to just use Operation::Snapshot
   // modified to include a required field called 'position' we don't
   // know the position (nor can we determine it) before we've done the
   // actual appending of the data.
   struct Snapshot
   {
-    Snapshot(const Log::Position& position, const state::Entry& entry)
-      : position(position), entry(entry) {}
+    Snapshot(const Log::Position& position, const UUID& uuid)
+      : position(position), uuid(uuid) {}
 
     const Log::Position position;
-
-    // TODO(benh): Rather than storing the entire state::Entry we
-    // should just store the position, name, and UUID and cache the
-    // data so we don't use too much memory.
-    const state::Entry entry;
+    const UUID uuid;
   };
 
   // All known snapshots indexed by name. Note that 'hashmap::get'
   // must be used instead of 'operator []' since Snapshot doesn't have
   // a default/empty constructor.
   hashmap<string, Snapshot> snapshots;
+
+  // The most recently used entries, the rest get read from the log
+  // (at the position of their snapshot) when needed.
+  Cache<string, state::Entry> cache;
 };
 
 
-LogStorageProcess::LogStorageProcess(Log* log)
+static Future<Nothing> _nothing() { return Nothing(); }
+
+
+// Helper for parsing an Operation from a Log::Entry.
+static Try<Operation> parse(const Log::Entry& entry)
+{
+  Operation operation;
+
+  google::protobuf::io::ArrayInputStream stream(
+      entry.data.data(),
+      entry.data.size());
+
+  if (!operation.ParseFromZeroCopyStream(&stream)) {
+    return Error("Failed to deserialize Operation");
+  }
+
+  return operation;
+}
+
+
+LogStorageProcess::LogStorageProcess(
+    Log* log,
+    size_t _cache,
+    const Option<Duration>& _compaction)
   : reader(log),
-    writer(log) {}
+    writer(log),
+    compaction(_compaction),
+    operations(0),
+    cache(_cache)
+{
+  CHECK_GT(_cache, 0u);
+}
 
 
 LogStorageProcess::~LogStorageProcess() {}
 
 
+void LogStorageProcess::initialize()
+{
+  if (compaction.isSome()) {
+    delay(compaction.get(), self(), &Self::compact);
+  }
+}
+
+
 void LogStorageProcess::finalize()
 {
   if (starting.isSome()) {
@@ -222,37 +298,38 @@ Future<Nothing> LogStorageProcess::apply(const list<Log::Entry>& entries)
   foreach (const Log::Entry& entry, entries) {
     if (index.isNone() || index.get() < entry.position) {
       // Parse the Operation from the Log::Entry.
-      Operation operation;
+      Try<Operation> operation = parse(entry);
 
-      google::protobuf::io::ArrayInputStream stream(
-          entry.data.data(),
-          entry.data.size());
-
-      if (!operation.ParseFromZeroCopyStream(&stream)) {
-        return Failure("Failed to deserialize Operation");
+      if (operation.isError()) {
+        return Failure(operation.error());
       }
 
-      switch (operation.type()) {
+      switch (operation.get().type()) {
         case Operation::SNAPSHOT: {
-          CHECK(operation.has_snapshot());
+          CHECK(operation.get().has_snapshot());
 
-          // Add or update the snapshot.
-          Snapshot snapshot(entry.position, operation.snapshot().entry());
-          snapshots.put(snapshot.entry.name(), snapshot);
+          // Add or update the snapshot (and the cached entry).
+          const state::Entry& _entry = operation.get().snapshot().entry();
+          Snapshot snapshot(entry.position, UUID::fromBytes(_entry.uuid()));
+          snapshots.put(_entry.name(), snapshot);
+          cache.put(_entry.name(), _entry);
           break;
         }
 
         case Operation::EXPUNGE: {
-          CHECK(operation.has_expunge());
-          snapshots.erase(operation.expunge().name());
+          CHECK(operation.get().has_expunge());
+          snapshots.erase(operation.get().expunge().name());
+          cache.erase(operation.get().expunge().name());
           break;
         }
 
         default:
-          return Failure("Unknown operation: " + stringify(operation.type()));
+          return Failure(
+              "Unknown operation: " + stringify(operation.get().type()));
       }
 
       index = entry.position;
+      operations++;
     }
   }
 
@@ -263,11 +340,10 @@ Future<Nothing> LogStorageProcess::apply(const list<Log::Entry>& entries)
 // TODO(benh): Truncation could be optimized by saving the "oldest"
 // snapshot and only doing a truncation if/when we update that
 // snapshot.
-// TODO(benh): Truncation is not enough to keep the log size small as
-// the log could get very fragmented. We'll need a way to defragment
-// the log as some state entries might not get set over a long period
-// of time and their associated snapshots are causing the log to grow
-// very big.
+// NOTE: Truncation alone is not enough to keep the log size small as
+// some state entries might not get set over a long period of time
+// and their associated snapshots would keep the log from getting
+// truncated, see 'compact()' for how we deal with that.
 void LogStorageProcess::truncate()
 {
   // We lock the truncation since it includes a call to
@@ -321,6 +397,115 @@ Future<Nothing> LogStorageProcess::__truncate(
 }
 
 
+void LogStorageProcess::compact()
+{
+  CHECK_SOME(compaction);
+
+  // We lock the compaction since it appends to the log (and it also
+  // needs the snapshots to stay put while it appends them again).
+  mutex.lock()
+    .then(defer(self(), &Self::_compact))
+    .onAny(lambda::bind(&Mutex::unlock, mutex));
+
+  delay(compaction.get(), self(), &Self::compact);
+}
+
+
+Future<Nothing> LogStorageProcess::_compact()
+{
+  // Don't start the writer just for compacting, e.g., if we've been
+  // demoted then some other writer is now appending to the log.
+  if (starting.isNone()) {
+    return Nothing();
+  }
+
+  return start()
+    .then(defer(self(), &Self::__compact));
+}
+
+
+Future<Nothing> LogStorageProcess::__compact()
+{
+  // Every snapshot before the last 'checkpoint' hasn't been updated
+  // during the last compaction interval and keeps the log from being
+  // truncated past it, so we append it again. To bound the cost of
+  // compaction we only do this once there have been at least as
+  // many operations since the last compaction as there are
+  // snapshots, i.e., compaction at most doubles the appends and the
+  // log never holds more than a few times the number of snapshots
+  // plus the operations in a compaction interval.
+  Option<Log::Position> checkpoint = this->checkpoint;
+
+  if (checkpoint.isSome() && operations < snapshots.size()) {
+    return Nothing();
+  }
+
+  this->checkpoint = index;
+  operations = 0;
+
+  if (checkpoint.isNone()) {
+    return Nothing();
+  }
+
+  list<Future<Nothing> > futures;
+
+  foreachpair (const string& name, const Snapshot& snapshot, snapshots) {
+    if (snapshot.position < checkpoint.get()) {
+      futures.push_back(reader.read(snapshot.position, snapshot.position)
+        .then(defer(self(), &Self::___compact, name, lambda::_1)));
+    }
+  }
+
+  if (futures.empty()) {
+    return Nothing();
+  }
+
+  VLOG(1) << "Compacting the log by appending " << futures.size()
+          << " of " << snapshots.size() << " snapshots again";
+
+  // Truncate once we're done (i.e., after the mutex gets unlocked).
+  truncate();
+
+  return collect(futures)
+    .then(lambda::bind(&_nothing));
+}
+
+
+Future<Nothing> LogStorageProcess::___compact(
+    const string& name,
+    const list<Log::Entry>& entries)
+{
+  if (entries.size() != 1) {
+    return Failure("Expecting a single log entry for snapshot '" + name + "'");
+  }
+
+  // Append the operation as is, since the snapshots can't change
+  // while we hold the mutex it's still the latest one for 'name'.
+  return writer.append(entries.front().data)
+    .then(defer(self(), &Self::____compact, name, lambda::_1));
+}
+
+
+Future<Nothing> LogStorageProcess::____compact(
+    const string& name,
+    const Option<Log::Position>& position)
+{
+  if (position.isNone()) {
+    starting = None(); // Reset 'starting' so we try again.
+    return Failure("Demoted while compacting");
+  }
+
+  CHECK(snapshots.contains(name));
+
+  Snapshot snapshot(position.get(), snapshots.get(name).get().uuid);
+  snapshots.put(name, snapshot);
+
+  index = max(index, position);
+
+  return Nothing();
+}
+
+
 Future<Option<state::Entry> > LogStorageProcess::get(const string& name)
 {
   return start()
@@ -336,7 +521,49 @@ Future<Option<state::Entry> > LogStorageProcess::_get(const string& name)
     return None();
   }
 
-  return snapshot.get().entry;
+  Option<state::Entry> entry = cache.get(name);
+
+  if (entry.isSome()) {
+    return entry;
+  }
+
+  const Log::Position& position = snapshot.get().position;
+
+  return reader.read(position, position)
+    .then(defer(self(), &Self::__get, name, position, lambda::_1));
+}
+
+
+Future<Option<state::Entry> > LogStorageProcess::__get(
+    const string& name,
+    const Log::Position& position,
+    const list<Log::Entry>& entries)
+{
+  // The snapshot might have been updated (or expunged) while we were
+  // reading it from the log, in which case we just try again.
+  Option<Snapshot> snapshot = snapshots.get(name);
+
+  if (snapshot.isNone() || !(snapshot.get().position == position)) {
+    return _get(name);
+  }
+
+  if (entries.size() != 1) {
+    return Failure("Expecting a single log entry for snapshot '" + name + "'");
+  }
+
+  Try<Operation> operation = parse(entries.front());
+
+  if (operation.isError()) {
+    return Failure(operation.error());
+  } else if (operation.get().type() != Operation::SNAPSHOT) {
+    return Failure("Expecting a snapshot operation for '" + name + "'");
+  }
+
+  const state::Entry& entry = operation.get().snapshot().entry();
+
+  cache.put(name, entry);
+
+  return entry;
 }
 
 
@@ -367,7 +594,7 @@ Future<bool> LogStorageProcess::__set(
   Option<Snapshot> snapshot = snapshots.get(entry.name());
 
   if (snapshot.isSome()) {
-    if (UUID::fromBytes(snapshot.get().entry.uuid()) != uuid) {
+    if (snapshot.get().uuid != uuid) {
       return false;
     }
   }
@@ -401,12 +628,14 @@ Future<bool> LogStorageProcess::___set(
   CHECK(!snapshots.contains(entry.name()) ||
         snapshots.get(entry.name()).get().position < position.get());
 
-  Snapshot snapshot(position.get(), entry);
-  snapshots.put(snapshot.entry.name(), snapshot);
+  Snapshot snapshot(position.get(), UUID::fromBytes(entry.uuid()));
+  snapshots.put(entry.name(), snapshot);
+  cache.put(entry.name(), entry);
   truncate();
 
   // Update index so we don't bother with this position again.
   index = max(index, position);
+  operations++;
 
   return true;
 }
@@ -436,8 +665,7 @@ Future<bool> LogStorageProcess::__expunge(const state::Entry& entry)
   }
 
   // Check the version first.
-  if (UUID::fromBytes(snapshot.get().entry.uuid()) !=
-      UUID::fromBytes(entry.uuid())) {
+  if (snapshot.get().uuid != UUID::fromBytes(entry.uuid())) {
     return false;
   }
 
@@ -468,8 +696,11 @@ Future<bool> LogStorageProcess::___expunge(
   // Remove from snapshots and truncate the log if possible.
   CHECK(snapshots.contains(entry.name()));
   snapshots.erase(entry.name());
+  cache.erase(entry.name());
   truncate();
 
+  operations++;
+
   return true;
 }
 
@@ -488,9 +719,12 @@ Future<std::set<string> > LogStorageProcess::_names()
 }
 
 
-LogStorage::LogStorage(Log* log)
+LogStorage::LogStorage(
+    Log* log,
+    size_t cache,
+    const Option<Duration>& compaction)
 {
-  process = new LogStorageProcess(log);
+  process = new LogStorageProcess(log, cache, compaction);
   spawn(process);
 }
 
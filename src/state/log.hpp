@@ -6,6 +6,7 @@
 
 #include <process/future.hpp>
 
+#include <stout/duration.hpp>
 #include <stout/option.hpp>
 #include <stout/uuid.hpp>
 
@@ -24,7 +25,18 @@ class LogStorageProcess;
 class LogStorage : public Storage
 {
 public:
-  LogStorage(log::Log* log);
+  // Only the name, UUID, and log position of each entry are kept in
+  // memory, the data of the 'cache' most recently used entries is
+  // cached and the rest is read back from the log when needed. If a
+  // 'compaction' interval is given then the entries that have not
+  // been updated during the previous interval get appended to the
+  // log again so that the log can be truncated past their old
+  // positions (i.e., the log doesn't grow without bound because of
+  // entries that rarely get updated).
+  LogStorage(
+      log::Log* log,
+      size_t cache = 1024,
+      const Option<Duration>& compaction = None());
 
   virtual ~LogStorage();
 
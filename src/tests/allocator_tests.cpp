@@ -333,6 +333,169 @@ TEST_F(DRFAllocatorTest, DRFAllocatorProcess)
 }
 
 
+// Checks that with incremental allocation enabled, resources that
+// are declined are reoffered once the refusal filter expires even
+// though nothing else in the cluster changes.
+TEST_F(DRFAllocatorTest, IncrementalAllocation)
+{
+  MockAllocatorProcess<HierarchicalDRFAllocatorProcess> allocator;
+
+  EXPECT_CALL(allocator, initialize(_, _, _));
+
+  master::Flags masterFlags = CreateMasterFlags();
+  masterFlags.allocation_interval = Milliseconds(50);
+  masterFlags.incremental_allocation = true;
+  Try<PID<Master> > master = StartMaster(&allocator, masterFlags);
+  ASSERT_SOME(master);
+
+  slave::Flags flags = CreateSlaveFlags();
+  flags.resources = Option<string>("cpus:2;mem:1024;disk:0");
+
+  EXPECT_CALL(allocator, slaveAdded(_, _, _));
+
+  Try<PID<Slave> > slave = StartSlave(flags);
+  ASSERT_SOME(slave);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(
+      &sched, DEFAULT_FRAMEWORK_INFO, master.get(), DEFAULT_CREDENTIAL);
+
+  EXPECT_CALL(allocator, frameworkAdded(_, _, _));
+
+  EXPECT_CALL(sched, registered(_, _, _));
+
+  // Decline the first offer with a short filter; the slave is then
+  // only reconsidered for this framework when the filter expires.
+  EXPECT_CALL(allocator, resourcesUnused(_, _, _, _))
+    .WillOnce(InvokeUnusedWithFilters(&allocator, 0.1));
+
+  Future<vector<Offer> > offers2;
+  EXPECT_CALL(sched, resourceOffers(_, OfferEq(2, 1024)))
+    .WillOnce(DeclineOffers())
+    .WillOnce(FutureArg<1>(&offers2));
+
+  driver.start();
+
+  AWAIT_READY(offers2);
+
+  // Shut everything down.
+  EXPECT_CALL(allocator, resourcesRecovered(_, _, _))
+    .WillRepeatedly(DoDefault());
+
+  EXPECT_CALL(allocator, frameworkDeactivated(_))
+    .Times(AtMost(1));
+
+  EXPECT_CALL(allocator, frameworkRemoved(_))
+    .Times(AtMost(1));
+
+  driver.stop();
+  driver.join();
+
+  EXPECT_CALL(allocator, slaveRemoved(_))
+    .Times(AtMost(1));
+
+  Shutdown();
+}
+
+
+// Checks that refusal filters are tracked per slave and expire
+// independently: resources declined with a filter are re-offered
+// once (and only once) their own filter has expired.
+TEST_F(DRFAllocatorTest, FilterExpiry)
+{
+  Clock::pause();
+
+  MockAllocatorProcess<HierarchicalDRFAllocatorProcess> allocator;
+
+  EXPECT_CALL(allocator, initialize(_, _, _));
+
+  Try<PID<Master> > master = StartMaster(&allocator);
+  ASSERT_SOME(master);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(
+      &sched, DEFAULT_FRAMEWORK_INFO, master.get(), DEFAULT_CREDENTIAL);
+
+  EXPECT_CALL(allocator, frameworkAdded(_, _, _));
+
+  Future<Nothing> registered;
+  EXPECT_CALL(sched, registered(_, _, _))
+    .WillOnce(FutureSatisfy(&registered));
+
+  driver.start();
+
+  AWAIT_READY(registered);
+
+  // The first slave is declined for 10 seconds, the second one for
+  // 20 seconds.
+  EXPECT_CALL(allocator, resourcesUnused(_, _, _, _))
+    .WillOnce(InvokeUnusedWithFilters(&allocator, 10))
+    .WillOnce(InvokeUnusedWithFilters(&allocator, 20));
+
+  EXPECT_CALL(allocator, slaveAdded(_, _, _))
+    .Times(2);
+
+  Future<vector<Offer> > offers2;
+  EXPECT_CALL(sched, resourceOffers(_, OfferEq(2, 1024)))
+    .WillOnce(DeclineOffers())
+    .WillOnce(FutureArg<1>(&offers2));
+
+  slave::Flags flags1 = CreateSlaveFlags();
+  flags1.resources = Option<string>("cpus:2;mem:1024;disk:0");
+
+  Try<PID<Slave> > slave1 = StartSlave(flags1);
+  ASSERT_SOME(slave1);
+
+  Clock::settle();
+
+  Future<vector<Offer> > offers4;
+  EXPECT_CALL(sched, resourceOffers(_, OfferEq(3, 512)))
+    .WillOnce(DeclineOffers())
+    .WillOnce(FutureArg<1>(&offers4));
+
+  slave::Flags flags2 = CreateSlaveFlags();
+  flags2.resources = Option<string>("cpus:3;mem:512;disk:0");
+
+  Try<PID<Slave> > slave2 = StartSlave(flags2);
+  ASSERT_SOME(slave2);
+
+  Clock::settle();
+
+  // Only the filter for the first slave has expired.
+  Clock::advance(Seconds(15));
+  Clock::settle();
+
+  AWAIT_READY(offers2);
+  EXPECT_TRUE(offers4.isPending());
+
+  // Now the filter for the second slave has expired too.
+  Clock::advance(Seconds(10));
+  Clock::settle();
+
+  AWAIT_READY(offers4);
+
+  Clock::resume();
+
+  // Shut everything down.
+  EXPECT_CALL(allocator, resourcesRecovered(_, _, _))
+    .WillRepeatedly(DoDefault());
+
+  EXPECT_CALL(allocator, frameworkDeactivated(_))
+    .Times(AtMost(1));
+
+  EXPECT_CALL(allocator, frameworkRemoved(_))
+    .Times(AtMost(1));
+
+  driver.stop();
+  driver.join();
+
+  EXPECT_CALL(allocator, slaveRemoved(_))
+    .Times(AtMost(2));
+
+  Shutdown();
+}
+
+
 class ReservationAllocatorTest : public MesosTest
 {
 public:
@@ -36,12 +36,14 @@
 #include <gmock/gmock.h>
 
 #include <process/gtest.hpp>
+#include <process/owned.hpp>
 
 #include <stout/gtest.hpp>
 #include <stout/hashmap.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
 #include <stout/path.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/stringify.hpp>
 #include <stout/strings.hpp>
 
@@ -490,6 +492,87 @@ TEST_F(CgroupsAnyHierarchyWithCpuAcctMemoryTest, ROOT_CGROUPS_Stat)
 }
 
 
+TEST_F(CgroupsAnyHierarchyWithCpuAcctMemoryTest, ROOT_CGROUPS_Control)
+{
+  EXPECT_ERROR(
+      cgroups::Control::create(baseHierarchy, TEST_CGROUPS_ROOT, "invalid"));
+
+  const std::string hierarchy = path::join(baseHierarchy, "memory");
+
+  Try<cgroups::Control*> control =
+    cgroups::Control::create(hierarchy, "/", "memory.stat");
+  ASSERT_SOME(control);
+
+  Owned<cgroups::Control> stat(control.get());
+
+  std::vector<std::string> names;
+  names.push_back("rss");
+  names.push_back("invalid");
+  names.push_back("cache");
+
+  // Read twice to check that the control file is read from the
+  // beginning each time.
+  for (int i = 0; i < 2; i++) {
+    Try<std::vector<Option<uint64_t> > > values = stat->stat(names);
+    ASSERT_SOME(values);
+    ASSERT_EQ(3u, values.get().size());
+    ASSERT_SOME(values.get()[0]);
+    EXPECT_GT(values.get()[0].get(), 0llu);
+    EXPECT_NONE(values.get()[1]);
+    EXPECT_SOME(values.get()[2]);
+  }
+
+  Try<std::string> read = stat->read();
+  ASSERT_SOME(read);
+  EXPECT_SOME_EQ(read.get(), cgroups::read(hierarchy, "/", "memory.stat"));
+}
+
+
+// Measures reading a stat file with 'cgroups::stat' versus reading it
+// through a 'cgroups::Control' which keeps the file open.
+TEST_F(CgroupsAnyHierarchyWithCpuAcctMemoryTest, ROOT_CGROUPS_BENCHMARK_Stat)
+{
+  const size_t count = 10000;
+
+  const std::string hierarchy = path::join(baseHierarchy, "memory");
+
+  Stopwatch watch;
+  watch.start();
+
+  for (size_t i = 0; i < count; i++) {
+    Try<hashmap<std::string, uint64_t> > stat =
+      cgroups::stat(hierarchy, "/", "memory.stat");
+    ASSERT_SOME(stat);
+    ASSERT_TRUE(stat.get().contains("total_rss"));
+  }
+
+  LOG(INFO) << "Read memory.stat " << count << " times using cgroups::stat "
+            << "in " << watch.elapsed();
+
+  Try<cgroups::Control*> control =
+    cgroups::Control::create(hierarchy, "/", "memory.stat");
+  ASSERT_SOME(control);
+
+  Owned<cgroups::Control> stat(control.get());
+
+  std::vector<std::string> names;
+  names.push_back("total_cache");
+  names.push_back("total_rss");
+  names.push_back("total_mapped_file");
+
+  watch.start();
+
+  for (size_t i = 0; i < count; i++) {
+    Try<std::vector<Option<uint64_t> > > values = stat->stat(names);
+    ASSERT_SOME(values);
+    ASSERT_SOME(values.get()[1]);
+  }
+
+  LOG(INFO) << "Read memory.stat " << count << " times using a "
+            << "cgroups::Control in " << watch.elapsed();
+}
+
+
 TEST_F(CgroupsAnyHierarchyWithCpuMemoryTest, ROOT_CGROUPS_Listen)
 {
   std::string hierarchy = path::join(baseHierarchy, "memory");
@@ -93,6 +93,8 @@ public:
       update,
       process::Future<Nothing>(const ContainerID&, const Resources&));
 
+  using slave::Containerizer::usage;
+
   MOCK_METHOD1(
       usage,
       process::Future<ResourceStatistics>(const ContainerID&));
@@ -20,6 +20,8 @@
 
 #include <gmock/gmock.h>
 
+#include <list>
+#include <set>
 #include <string>
 #include <vector>
 #include <map>
@@ -28,8 +30,12 @@
 
 #include <process/future.hpp>
 
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
 #include <stout/os.hpp>
 #include <stout/path.hpp>
+#include <stout/strings.hpp>
 
 #include "master/master.hpp"
 #include "master/detector.hpp"
@@ -52,6 +58,8 @@ using mesos::internal::master::Master;
 using mesos::internal::slave::Containerizer;
 using mesos::internal::slave::Slave;
 
+using std::list;
+using std::set;
 using std::string;
 using std::vector;
 
@@ -63,7 +71,13 @@ using testing::SaveArg;
 // TODO(tillt): Update and enhance the ExternalContainerizer tests,
 // possibly following some of the patterns used within the
 // IsolatorTests.
-class ExternalContainerizerTest : public MesosTest {};
+class ExternalContainerizerTest : public MesosTest
+{
+protected:
+  // Launches a task using the test-containerizer and checks the
+  // usage it reports (see the Launch tests below).
+  void launch(bool daemon);
+};
 
 
 class TestExternalContainerizer : public slave::ExternalContainerizer
@@ -120,7 +134,7 @@ private:
 };
 
 
-TEST_F(ExternalContainerizerTest, Launch)
+void ExternalContainerizerTest::launch(bool daemon)
 {
   Try<PID<Master> > master = this->StartMaster();
   ASSERT_SOME(master);
@@ -132,6 +146,7 @@ TEST_F(ExternalContainerizerTest, Launch)
   flags.isolation = "external";
   flags.containerizer_path =
       string(testFlags.build_dir) + "/src/examples/python/test-containerizer";
+  flags.containerizer_daemon = daemon;
 
   TestExternalContainerizer testContainerizer(flags);
 
@@ -239,6 +254,26 @@ TEST_F(ExternalContainerizerTest, Launch)
   EXPECT_GE(statistics.mem_rss_bytes(), 1024u);
   EXPECT_EQ(statistics.mem_limit_bytes(), mem.get().bytes());
 
+  // Also gather the usage of all containers at once, i.e., with a
+  // single request when using the daemon.
+  Try<ContainerID> containerId =
+    testContainerizer.getContainer(frameworkId.get(), executorId);
+  ASSERT_SOME(containerId);
+
+  hashset<ContainerID> containerIds;
+  containerIds.insert(containerId.get());
+
+  Future<hashmap<ContainerID, ResourceStatistics> > usages =
+    testContainerizer.usage(containerIds);
+  AWAIT_READY(usages);
+
+  Option<ResourceStatistics> collected =
+    usages.get().get(containerId.get());
+  ASSERT_SOME(collected);
+
+  EXPECT_EQ(cpus.get(), collected.get().cpus_limit());
+  EXPECT_EQ(mem.get().bytes(), collected.get().mem_limit_bytes());
+
   EXPECT_CALL(sched, statusUpdate(&driver, _))
     .WillOnce(FutureArg<1>(&status));
 
@@ -253,3 +288,259 @@ TEST_F(ExternalContainerizerTest, Launch)
 
   this->Shutdown();
 }
+
+
+TEST_F(ExternalContainerizerTest, Launch)
+{
+  launch(false);
+}
+
+
+// Same as above but with the test-containerizer running as a daemon
+// that serves all of the commands.
+TEST_F(ExternalContainerizerTest, LaunchDaemon)
+{
+  launch(true);
+}
+
+
+// Returns the children of this process running the test-containerizer
+// daemon.
+static set<pid_t> daemons()
+{
+  set<pid_t> pids;
+
+  Try<list<os::Process> > processes = os::processes();
+  CHECK_SOME(processes);
+
+  foreach (const os::Process& process, processes.get()) {
+    if (process.parent == getpid() &&
+        !process.zombie &&
+        strings::contains(process.command, "test-containerizer daemon")) {
+      pids.insert(process.pid);
+    }
+  }
+
+  return pids;
+}
+
+
+// Returns the daemons started since the previous ones, waiting up to
+// ten seconds for them.
+static set<pid_t> started(const set<pid_t>& previous)
+{
+  set<pid_t> pids;
+  Duration waited = Duration::zero();
+  do {
+    foreach (pid_t pid, daemons()) {
+      if (previous.count(pid) == 0) {
+        pids.insert(pid);
+      }
+    }
+
+    if (!pids.empty()) {
+      break;
+    }
+
+    os::sleep(Milliseconds(10));
+    waited += Milliseconds(10);
+  } while (waited < Seconds(10));
+
+  return pids;
+}
+
+
+// Checks that the daemon gets restarted after it terminated and that
+// tasks can be launched again afterwards.
+TEST_F(ExternalContainerizerTest, RestartDaemon)
+{
+  Try<PID<Master> > master = StartMaster();
+  ASSERT_SOME(master);
+
+  Flags testFlags;
+
+  slave::Flags flags = CreateSlaveFlags();
+
+  flags.isolation = "external";
+  flags.containerizer_path =
+      string(testFlags.build_dir) + "/src/examples/python/test-containerizer";
+  flags.containerizer_daemon = true;
+
+  // The daemons of previous tests might still be terminating.
+  const set<pid_t> previous = daemons();
+
+  TestExternalContainerizer testContainerizer(flags);
+
+  // Wait for the daemon to be started.
+  const set<pid_t> pids = started(previous);
+  ASSERT_FALSE(pids.empty());
+
+  Try<PID<Slave> > slave = StartSlave(&testContainerizer, flags);
+  ASSERT_SOME(slave);
+
+  Future<Nothing> restart =
+    FUTURE_DISPATCH(_, &slave::ExternalContainerizerProcess::restart);
+
+  foreach (pid_t pid, pids) {
+    ASSERT_SOME(os::killtree(pid, SIGKILL, true, true));
+  }
+
+  AWAIT_READY(restart);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(
+      &sched, DEFAULT_FRAMEWORK_INFO, master.get(), DEFAULT_CREDENTIAL);
+
+  EXPECT_CALL(sched, registered(&driver, _, _));
+
+  Future<vector<Offer> > offers;
+  EXPECT_CALL(sched, resourceOffers(&driver, _))
+    .WillOnce(FutureArg<1>(&offers))
+    .WillRepeatedly(Return()); // Ignore subsequent offers.
+
+  driver.start();
+
+  AWAIT_READY(offers);
+  EXPECT_NE(0u, offers.get().size());
+
+  TaskInfo task;
+  task.set_name("test-task");
+  task.mutable_task_id()->set_value("1");
+  task.mutable_slave_id()->MergeFrom(offers.get()[0].slave_id());
+  task.mutable_resources()->MergeFrom(offers.get()[0].resources());
+  task.mutable_command()->set_value("sleep 60");
+
+  vector<TaskInfo> tasks;
+  tasks.push_back(task);
+
+  Future<TaskStatus> status;
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .WillOnce(FutureArg<1>(&status));
+
+  driver.launchTasks(offers.get()[0].id(), tasks);
+
+  AWAIT_READY(status);
+  EXPECT_EQ(TASK_RUNNING, status.get().state());
+
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .WillOnce(FutureArg<1>(&status));
+
+  driver.killTask(task.task_id());
+
+  AWAIT_READY(status);
+  EXPECT_EQ(TASK_KILLED, status.get().state());
+
+  driver.stop();
+  driver.join();
+
+  Shutdown();
+}
+
+
+// Checks that the tasks keep running when the daemon terminates,
+// i.e., that the waits on their containers which were pending on the
+// terminated daemon don't report them as terminated.
+TEST_F(ExternalContainerizerTest, RestartDaemonWhileRunning)
+{
+  Try<PID<Master> > master = StartMaster();
+  ASSERT_SOME(master);
+
+  Flags testFlags;
+
+  slave::Flags flags = CreateSlaveFlags();
+
+  flags.isolation = "external";
+  flags.containerizer_path =
+      string(testFlags.build_dir) + "/src/examples/python/test-containerizer";
+  flags.containerizer_daemon = true;
+
+  // The daemons of previous tests might still be terminating.
+  const set<pid_t> previous = daemons();
+
+  TestExternalContainerizer testContainerizer(flags);
+
+  const set<pid_t> pids = started(previous);
+  ASSERT_FALSE(pids.empty());
+
+  Try<PID<Slave> > slave = StartSlave(&testContainerizer, flags);
+  ASSERT_SOME(slave);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(
+      &sched, DEFAULT_FRAMEWORK_INFO, master.get(), DEFAULT_CREDENTIAL);
+
+  Future<FrameworkID> frameworkId;
+  EXPECT_CALL(sched, registered(&driver, _, _))
+    .WillOnce(FutureArg<1>(&frameworkId));
+
+  Future<vector<Offer> > offers;
+  EXPECT_CALL(sched, resourceOffers(&driver, _))
+    .WillOnce(FutureArg<1>(&offers))
+    .WillRepeatedly(Return()); // Ignore subsequent offers.
+
+  driver.start();
+
+  AWAIT_READY(frameworkId);
+  AWAIT_READY(offers);
+  EXPECT_NE(0u, offers.get().size());
+
+  TaskInfo task;
+  task.set_name("test-task");
+  task.mutable_task_id()->set_value("1");
+  task.mutable_slave_id()->MergeFrom(offers.get()[0].slave_id());
+  task.mutable_resources()->MergeFrom(offers.get()[0].resources());
+  task.mutable_command()->set_value("sleep 60");
+
+  vector<TaskInfo> tasks;
+  tasks.push_back(task);
+
+  Future<TaskStatus> status;
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .WillOnce(FutureArg<1>(&status));
+
+  driver.launchTasks(offers.get()[0].id(), tasks);
+
+  AWAIT_READY(status);
+  EXPECT_EQ(TASK_RUNNING, status.get().state());
+
+  // The task must not be reported as terminated.
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .Times(0);
+
+  Future<Nothing> restart =
+    FUTURE_DISPATCH(_, &slave::ExternalContainerizerProcess::restart);
+
+  // Only kill the daemon, not the executor it launched.
+  foreach (pid_t pid, pids) {
+    ASSERT_EQ(0, ::kill(pid, SIGKILL));
+  }
+
+  AWAIT_READY(restart);
+
+  // The restarted daemon answers the requests in order, i.e., once
+  // it reported the usage it has answered the reissued wait.
+  ExecutorID executorId;
+  executorId.set_value(task.task_id().value());
+
+  Try<ContainerID> containerId =
+    testContainerizer.getContainer(frameworkId.get(), executorId);
+  ASSERT_SOME(containerId);
+
+  AWAIT_READY(testContainerizer.usage(containerId.get()));
+
+  // Give a (wrongly) failed wait the chance to be noticed.
+  os::sleep(Milliseconds(100));
+
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .WillOnce(FutureArg<1>(&status));
+
+  driver.killTask(task.task_id());
+
+  AWAIT_READY(status);
+  EXPECT_EQ(TASK_KILLED, status.get().state());
+
+  driver.stop();
+  driver.join();
+
+  Shutdown();
+}
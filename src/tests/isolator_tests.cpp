@@ -16,25 +16,37 @@
  * limitations under the License.
  */
 
+#include <signal.h>
 #include <unistd.h>
 
+#include <sys/types.h>
+#include <sys/wait.h>
+
 #include <gmock/gmock.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include <mesos/resources.hpp>
 
+#include <process/clock.hpp>
 #include <process/future.hpp>
 #include <process/owned.hpp>
 #include <process/reap.hpp>
 
+#include <stout/foreach.hpp>
+#include <stout/gtest.hpp>
 #include <stout/os.hpp>
 #include <stout/path.hpp>
+#include <stout/stopwatch.hpp>
+
+#include <stout/os/pstree.hpp>
 
 #include "master/master.hpp"
 #include "master/detector.hpp"
 
+#include "slave/constants.hpp"
 #include "slave/flags.hpp"
 #include "slave/slave.hpp"
 
@@ -43,6 +55,7 @@
 #endif // __linux__
 #include "slave/containerizer/isolator.hpp"
 #include "slave/containerizer/launcher.hpp"
+#include "slave/containerizer/pstree.hpp"
 
 #include "slave/containerizer/isolators/posix.hpp"
 #ifdef __linux__
@@ -71,6 +84,7 @@ using mesos::internal::slave::Launcher;
 using mesos::internal::slave::PosixLauncher;
 using mesos::internal::slave::PosixCpuIsolatorProcess;
 using mesos::internal::slave::PosixMemIsolatorProcess;
+using mesos::internal::slave::ProcessSnapshot;
 using mesos::internal::slave::Flags;
 
 using std::string;
@@ -576,3 +590,160 @@ TYPED_TEST(MemIsolatorTest, MemUsage)
   delete isolator.get();
   delete launcher.get();
 }
+
+
+class ProcessSnapshotTest : public ::testing::Test
+{
+protected:
+  // Kills the children, including when a test fails part way.
+  virtual void TearDown()
+  {
+    foreach (pid_t child, children) {
+      ::kill(child, SIGKILL);
+      ::waitpid(child, NULL, 0);
+    }
+
+    children.clear();
+  }
+
+  // Forks a child which waits (forever) to get killed.
+  pid_t fork()
+  {
+    pid_t pid = ::fork();
+
+    if (pid == 0) {
+      while (true) {
+        ::pause();
+      }
+    } else if (pid > 0) {
+      children.push_back(pid);
+    }
+
+    return pid;
+  }
+
+  void kill(pid_t pid)
+  {
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, NULL, 0);
+
+    children.erase(std::remove(children.begin(), children.end(), pid),
+                   children.end());
+  }
+
+  vector<pid_t> children;
+};
+
+
+TEST_F(ProcessSnapshotTest, Pstree)
+{
+  // Pause the clock so that the slave-wide snapshot is only refreshed
+  // when the test advances the clock past the snapshot interval.
+  Clock::pause();
+
+  pid_t child = fork();
+  ASSERT_NE(-1, child);
+
+  Try<ProcessSnapshot> snapshot = ProcessSnapshot::create();
+  ASSERT_SOME(snapshot);
+
+  Try<os::ProcessTree> tree = snapshot.get().pstree(getpid());
+  ASSERT_SOME(tree);
+  EXPECT_EQ(getpid(), tree.get().process.pid);
+  EXPECT_TRUE(tree.get().contains(child));
+
+  tree = snapshot.get().pstree(child);
+  ASSERT_SOME(tree);
+  EXPECT_EQ(child, tree.get().process.pid);
+  EXPECT_TRUE(tree.get().children.empty());
+
+  // The slave-wide snapshot should include the child as well.
+  Future<Option<os::ProcessTree> > future = slave::pstree(child);
+  AWAIT_READY(future);
+  ASSERT_SOME(future.get());
+  EXPECT_EQ(child, future.get().get().process.pid);
+
+  kill(child);
+
+  // The snapshot still includes the child until the next interval.
+  future = slave::pstree(child);
+  AWAIT_READY(future);
+  ASSERT_SOME(future.get());
+
+  Clock::advance(slave::PROCESS_SNAPSHOT_INTERVAL);
+
+  future = slave::pstree(child);
+  AWAIT_READY(future);
+  EXPECT_NONE(future.get());
+
+  // A pid that isn't in the snapshot gets it retaken, e.g., for a
+  // container that was just launched ...
+  pid_t child1 = fork();
+  ASSERT_NE(-1, child1);
+
+  future = slave::pstree(child1);
+  AWAIT_READY(future);
+  ASSERT_SOME(future.get());
+  EXPECT_EQ(child1, future.get().get().process.pid);
+
+  // ... but only once per interval, so asking for a pid that isn't
+  // there (e.g., of a container that exited) doesn't rescan /proc
+  // every time.
+  pid_t child2 = fork();
+  ASSERT_NE(-1, child2);
+
+  future = slave::pstree(child2);
+  AWAIT_READY(future);
+  EXPECT_NONE(future.get());
+
+  future = slave::pstree(child);
+  AWAIT_READY(future);
+  EXPECT_NONE(future.get());
+
+  Clock::advance(slave::PROCESS_SNAPSHOT_INTERVAL);
+
+  future = slave::pstree(child2);
+  AWAIT_READY(future);
+  ASSERT_SOME(future.get());
+  EXPECT_EQ(child2, future.get().get().process.pid);
+
+  Clock::resume();
+}
+
+
+class ProcessSnapshot_BENCHMARK_Test : public ProcessSnapshotTest {};
+
+
+// Measures getting the process trees of a number of "containers" by
+// scanning all of the processes for every container (like the posix
+// isolators used to) versus using the slave-wide process snapshot.
+TEST_F(ProcessSnapshot_BENCHMARK_Test, Pstree)
+{
+  const size_t count = 200;
+
+  // NOTE: The children are killed by the fixture.
+  for (size_t i = 0; i < count; i++) {
+    ASSERT_NE(-1, fork());
+  }
+
+  Stopwatch watch;
+  watch.start();
+
+  foreach (pid_t child, children) {
+    ASSERT_SOME(os::pstree(child));
+  }
+
+  LOG(INFO) << "Scanned the processes of " << count << " containers in "
+            << watch.elapsed();
+
+  watch.start();
+
+  foreach (pid_t child, children) {
+    Future<Option<os::ProcessTree> > tree = slave::pstree(child);
+    AWAIT_READY(tree);
+    ASSERT_SOME(tree.get());
+  }
+
+  LOG(INFO) << "Used a snapshot of the processes for " << count
+            << " containers in " << watch.elapsed();
+}
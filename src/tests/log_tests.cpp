@@ -34,12 +34,15 @@
 #include <process/protobuf.hpp>
 #include <process/shared.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/gtest.hpp>
 #include <stout/none.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
 #include <stout/path.hpp>
 #include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
 #include <stout/try.hpp>
 
 #include "log/catchup.hpp"
@@ -315,6 +318,181 @@ TYPED_TEST(LogStorageTest, TruncateWithManyHoles)
 }
 
 
+TYPED_TEST(LogStorageTest, PersistBatch)
+{
+  TypeParam storage;
+
+  Try<Storage::State> state = storage.restore(os::getcwd() + "/.log");
+  ASSERT_SOME(state);
+
+  // Append from position 0 to position 9 and truncate to position 3
+  // (at position 10) with a single batch.
+  list<Action> actions;
+
+  for (uint64_t i = 0; i < 10; i++) {
+    Action action;
+    action.set_position(i);
+    action.set_promised(1);
+    action.set_performed(1);
+    action.set_learned(true);
+    action.set_type(Action::APPEND);
+    action.mutable_append()->set_bytes(stringify(i));
+    actions.push_back(action);
+  }
+
+  Action truncate;
+  truncate.set_position(10);
+  truncate.set_promised(1);
+  truncate.set_performed(1);
+  truncate.set_learned(true);
+  truncate.set_type(Action::TRUNCATE);
+  truncate.mutable_truncate()->set_to(3);
+  actions.push_back(truncate);
+
+  ASSERT_SOME(storage.persist(actions));
+
+  for (uint64_t i = 0; i < 11; i++) {
+    Try<Action> action = storage.read(i);
+
+    if (i < 3) {
+      // Position 0, 1 and 2 have been truncated.
+      EXPECT_ERROR(action);
+    } else if (i == 10) {
+      ASSERT_SOME(action);
+      EXPECT_EQ(Action::TRUNCATE, action.get().type());
+      ASSERT_TRUE(action.get().has_truncate());
+      EXPECT_EQ(3u, action.get().truncate().to());
+    } else {
+      ASSERT_SOME(action);
+      EXPECT_EQ(i, action.get().position());
+      EXPECT_EQ(Action::APPEND, action.get().type());
+      ASSERT_TRUE(action.get().has_append());
+      EXPECT_EQ(stringify(i), action.get().append().bytes());
+    }
+  }
+}
+
+
+class LevelDBStorageTest : public TemporaryDirectoryTest {};
+
+
+// Verifies that a replica created when positions were encoded as
+// (zero padded) decimal strings gets migrated when restored.
+TEST_F(LevelDBStorageTest, Migrate)
+{
+  const string path = os::getcwd() + "/.log";
+
+  {
+    leveldb::Options options;
+    options.create_if_missing = true;
+
+    leveldb::DB* db = NULL;
+    ASSERT_TRUE(leveldb::DB::Open(options, path, &db).ok());
+
+    Record record;
+    record.set_type(Record::METADATA);
+    record.mutable_metadata()->set_status(Metadata::VOTING);
+    record.mutable_metadata()->set_promised(2);
+
+    string value;
+    ASSERT_TRUE(record.SerializeToString(&value));
+
+    Try<string> key = strings::format("%.*d", 10, 0);
+    ASSERT_SOME(key);
+    ASSERT_TRUE(db->Put(leveldb::WriteOptions(), key.get(), value).ok());
+
+    // Enough positions for the (decimal) keys to be out of order had
+    // they been varint encoded.
+    for (uint64_t i = 1; i <= 300; i++) {
+      record.Clear();
+      record.set_type(Record::ACTION);
+      record.mutable_action()->set_position(i);
+      record.mutable_action()->set_promised(2);
+      record.mutable_action()->set_performed(2);
+      record.mutable_action()->set_learned(i != 300);
+      record.mutable_action()->set_type(Action::APPEND);
+      record.mutable_action()->mutable_append()->set_bytes(stringify(i));
+
+      ASSERT_TRUE(record.SerializeToString(&value));
+
+      key = strings::format("%.*d", 10, i + 1);
+      ASSERT_SOME(key);
+      ASSERT_TRUE(db->Put(leveldb::WriteOptions(), key.get(), value).ok());
+    }
+
+    delete db;
+  }
+
+  LevelDBStorage storage;
+
+  Try<Storage::State> state = storage.restore(path);
+  ASSERT_SOME(state);
+
+  EXPECT_EQ(Metadata::VOTING, state.get().metadata.status());
+  EXPECT_EQ(2u, state.get().metadata.promised());
+  EXPECT_EQ(0u, state.get().begin);
+  EXPECT_EQ(300u, state.get().end);
+  EXPECT_EQ(299u, state.get().learned.size());
+  EXPECT_TRUE(state.get().unlearned.contains(300));
+
+  for (uint64_t i = 1; i <= 300; i++) {
+    Try<Action> action = storage.read(i);
+    ASSERT_SOME(action);
+    EXPECT_EQ(i, action.get().position());
+    EXPECT_EQ(stringify(i), action.get().append().bytes());
+  }
+
+  EXPECT_FALSE(os::exists(path + ".migrate"));
+}
+
+
+class LevelDBStorage_BENCHMARK_Test : public TemporaryDirectoryTest {};
+
+
+// Measures persisting actions one at a time (each with its own synced
+// write) versus in batches, like a replica does for concurrent writes.
+TEST_F(LevelDBStorage_BENCHMARK_Test, Persist)
+{
+  const size_t count = 1000;
+  const string bytes(1024, 'x');
+
+  const size_t sizes[] = { 1, 8, 32, 128 };
+
+  foreach (size_t size, sizes) {
+    LevelDBStorage storage;
+
+    ASSERT_SOME(storage.restore(os::getcwd() + "/.log" + stringify(size)));
+
+    Stopwatch watch;
+    watch.start();
+
+    list<Action> actions;
+
+    for (uint64_t i = 0; i < count; i++) {
+      Action action;
+      action.set_position(i);
+      action.set_promised(1);
+      action.set_performed(1);
+      action.set_type(Action::APPEND);
+      action.mutable_append()->set_bytes(bytes);
+      actions.push_back(action);
+
+      if (actions.size() == size) {
+        ASSERT_SOME(storage.persist(actions));
+        actions.clear();
+      }
+    }
+
+    if (!actions.empty()) {
+      ASSERT_SOME(storage.persist(actions));
+    }
+
+    LOG(INFO) << "Persisted " << count << " actions in batches of "
+              << size << " in " << watch.elapsed();
+  }
+}
+
+
 class ReplicaTest : public TemporaryDirectoryTest
 {
 protected:
@@ -1195,6 +1373,117 @@ TEST_F(CoordinatorTest, MultipleAppends)
 }
 
 
+// Verifies that appends can be made without waiting for the previous
+// ones (more than the coordinator writes concurrently) and that they
+// are written and complete in order.
+TEST_F(CoordinatorTest, PipelinedAppends)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  Shared<Replica> replica1(new Replica(path1));
+  Shared<Replica> replica2(new Replica(path2));
+
+  set<UPID> pids;
+  pids.insert(replica1->pid());
+  pids.insert(replica2->pid());
+
+  Shared<Network> network(new Network(pids));
+
+  Coordinator coord(2, replica1, network);
+
+  {
+    Future<Option<uint64_t> > electing = coord.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  list<Future<Option<uint64_t> > > appendings;
+  for (uint64_t position = 1; position <= 100; position++) {
+    appendings.push_back(coord.append(stringify(position)));
+  }
+
+  uint64_t position = 1;
+  foreach (const Future<Option<uint64_t> >& appending, appendings) {
+    AWAIT_READY(appending);
+    EXPECT_SOME_EQ(position++, appending.get());
+  }
+
+  {
+    Future<list<Action> > actions = replica1->read(1, 100);
+    AWAIT_READY(actions);
+    EXPECT_EQ(100u, actions.get().size());
+    foreach (const Action& action, actions.get()) {
+      ASSERT_TRUE(action.has_type());
+      ASSERT_EQ(Action::APPEND, action.type());
+      EXPECT_EQ(stringify(action.position()), action.append().bytes());
+    }
+  }
+}
+
+
+// Verifies that if a write fails because the coordinator has been
+// demoted then all the writes following it fail too.
+TEST_F(CoordinatorTest, PipelinedAppendsDemoted)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  Shared<Replica> replica1(new Replica(path1));
+  Shared<Replica> replica2(new Replica(path2));
+
+  set<UPID> pids;
+  pids.insert(replica1->pid());
+  pids.insert(replica2->pid());
+
+  Shared<Network> network1(new Network(pids));
+
+  Coordinator coord1(2, replica1, network1);
+
+  {
+    Future<Option<uint64_t> > electing = coord1.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  Shared<Network> network2(new Network(pids));
+
+  Coordinator coord2(2, replica2, network2);
+
+  {
+    Future<Option<uint64_t> > electing = coord2.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  list<Future<Option<uint64_t> > > appendings;
+  for (int i = 0; i < 10; i++) {
+    appendings.push_back(coord1.append(stringify(i)));
+  }
+
+  foreach (const Future<Option<uint64_t> >& appending, appendings) {
+    AWAIT_READY(appending);
+    EXPECT_NONE(appending.get());
+  }
+
+  {
+    Future<Option<uint64_t> > appending = coord1.append("hello world");
+    AWAIT_READY(appending);
+    EXPECT_NONE(appending.get());
+  }
+}
+
+
 TEST_F(CoordinatorTest, MultipleAppendsNotLearnedFill)
 {
   const string path1 = os::getcwd() + "/.log1";
@@ -1504,6 +1793,78 @@ TEST_F(CoordinatorTest, TruncateLearnedFill)
 }
 
 
+class Coordinator_BENCHMARK_Test : public TemporaryDirectoryTest
+{
+protected:
+  // For initializing the log.
+  tool::Initialize initializer;
+};
+
+
+// Measures the throughput of appends to a log with three (in-process)
+// replicas when waiting for each append before making the next one
+// versus pipelining them.
+TEST_F(Coordinator_BENCHMARK_Test, Append)
+{
+  set<UPID> pids;
+  list<Shared<Replica> > replicas;
+
+  for (int i = 1; i <= 3; i++) {
+    const string path = os::getcwd() + "/.log" + stringify(i);
+    initializer.flags.path = path;
+    initializer.execute();
+
+    Shared<Replica> replica(new Replica(path));
+    pids.insert(replica->pid());
+    replicas.push_back(replica);
+  }
+
+  Shared<Network> network(new Network(pids));
+
+  Coordinator coord(2, replicas.front(), network);
+
+  {
+    Future<Option<uint64_t> > electing = coord.elect();
+    AWAIT_READY(electing);
+    ASSERT_SOME(electing.get());
+  }
+
+  const size_t count = 1000;
+  const string bytes(1024, 'x');
+
+  Stopwatch watch;
+  watch.start();
+
+  for (size_t i = 0; i < count; i++) {
+    Future<Option<uint64_t> > appending = coord.append(bytes);
+    AWAIT_READY(appending);
+    ASSERT_SOME(appending.get());
+  }
+
+  Duration elapsed = watch.elapsed();
+
+  LOG(INFO) << "Appended " << count << " entries one at a time in "
+            << elapsed << " (" << count / elapsed.secs() << " appends/sec)";
+
+  watch.start();
+
+  list<Future<Option<uint64_t> > > appendings;
+  for (size_t i = 0; i < count; i++) {
+    appendings.push_back(coord.append(bytes));
+  }
+
+  foreach (const Future<Option<uint64_t> >& appending, appendings) {
+    AWAIT_READY(appending);
+    ASSERT_SOME(appending.get());
+  }
+
+  elapsed = watch.elapsed();
+
+  LOG(INFO) << "Appended " << count << " pipelined entries in "
+            << elapsed << " (" << count / elapsed.secs() << " appends/sec)";
+}
+
+
 class RecoverTest : public TemporaryDirectoryTest
 {
 protected:
@@ -1698,6 +2059,70 @@ TEST_F(RecoverTest, CatchupRetry)
 }
 
 
+// Verifies that catching up concurrently (and rate limited) learns
+// all the positions in the local replica.
+TEST_F(RecoverTest, CatchupConcurrently)
+{
+  const string path1 = os::getcwd() + "/.log1";
+  initializer.flags.path = path1;
+  initializer.execute();
+
+  const string path2 = os::getcwd() + "/.log2";
+  initializer.flags.path = path2;
+  initializer.execute();
+
+  const string path3 = os::getcwd() + "/.log3";
+
+  Shared<Replica> replica1(new Replica(path1));
+  Shared<Replica> replica2(new Replica(path2));
+
+  set<UPID> pids;
+  pids.insert(replica1->pid());
+  pids.insert(replica2->pid());
+
+  Shared<Network> network1(new Network(pids));
+
+  Coordinator coord(2, replica1, network1);
+
+  {
+    Future<Option<uint64_t> > electing = coord.elect();
+    AWAIT_READY(electing);
+    EXPECT_SOME_EQ(0u, electing.get());
+  }
+
+  IntervalSet<uint64_t> positions;
+
+  for (uint64_t position = 1; position <= 100; position++) {
+    Future<Option<uint64_t> > appending = coord.append(stringify(position));
+    AWAIT_READY(appending);
+    EXPECT_SOME_EQ(position, appending.get());
+    positions += position;
+  }
+
+  Shared<Replica> replica3(new Replica(path3));
+
+  pids.insert(replica3->pid());
+
+  Shared<Network> network2(new Network(pids));
+
+  Future<Nothing> catching =
+    catchup(2, replica3, network2, None(), positions, Seconds(10), 8, 1000);
+
+  AWAIT_READY(catching);
+
+  Future<list<Action> > actions = replica3->read(1, 100);
+  AWAIT_READY(actions);
+  ASSERT_EQ(100u, actions.get().size());
+
+  foreach (const Action& action, actions.get()) {
+    ASSERT_TRUE(action.has_learned());
+    EXPECT_TRUE(action.learned());
+    ASSERT_EQ(Action::APPEND, action.type());
+    EXPECT_EQ(stringify(action.position()), action.append().bytes());
+  }
+}
+
+
 class LogTest : public TemporaryDirectoryTest
 {
 protected:
@@ -20,6 +20,7 @@
 
 #include <gmock/gmock.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -29,11 +30,16 @@
 #include <process/clock.hpp>
 #include <process/future.hpp>
 #include <process/gmock.hpp>
+#include <process/gtest.hpp>
+#include <process/http.hpp>
 #include <process/owned.hpp>
 #include <process/pid.hpp>
 
+#include <stout/json.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
 #include <stout/try.hpp>
 
 #include "master/flags.hpp"
@@ -68,6 +74,9 @@ using process::Future;
 using process::Owned;
 using process::PID;
 
+using process::http::OK;
+using process::http::Response;
+
 using std::string;
 using std::vector;
 
@@ -1259,6 +1268,156 @@ TEST_F(MasterTest, LaunchDuplicateOfferTest)
 }
 
 
+// The master streams state.json in chunks from a snapshot; this
+// checks that the streamed body is the same document that would have
+// been rendered in one go, with and without a jsonp callback.
+TEST_F(MasterTest, StateJson)
+{
+  Try<PID<Master> > master = StartMaster();
+  ASSERT_SOME(master);
+
+  MockExecutor exec(DEFAULT_EXECUTOR_ID);
+
+  TestContainerizer containerizer(&exec);
+
+  Try<PID<Slave> > slave = StartSlave(&containerizer);
+  ASSERT_SOME(slave);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(
+      &sched, DEFAULT_FRAMEWORK_INFO, master.get(), DEFAULT_CREDENTIAL);
+
+  EXPECT_CALL(sched, registered(&driver, _, _))
+    .Times(1);
+
+  Future<vector<Offer> > offers;
+  EXPECT_CALL(sched, resourceOffers(&driver, _))
+    .WillOnce(FutureArg<1>(&offers))
+    .WillRepeatedly(Return()); // Ignore subsequent offers.
+
+  driver.start();
+
+  AWAIT_READY(offers);
+  EXPECT_NE(0u, offers.get().size());
+
+  Future<Response> response = process::http::get(master.get(), "state.json");
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(OK().status, response);
+  AWAIT_EXPECT_RESPONSE_HEADER_EQ(
+      "application/json",
+      "Content-Type",
+      response);
+
+  Try<JSON::Value> parse = JSON::parse(response.get().body);
+  ASSERT_SOME(parse);
+  EXPECT_EQ(stringify(parse.get()), response.get().body);
+
+  JSON::Object state = parse.get().as<JSON::Object>();
+  EXPECT_EQ(1u, state.values["slaves"].as<JSON::Array>().values.size());
+
+  JSON::Array frameworks = state.values["frameworks"].as<JSON::Array>();
+  ASSERT_EQ(1u, frameworks.values.size());
+
+  JSON::Object framework = frameworks.values.front().as<JSON::Object>();
+  EXPECT_EQ(
+      offers.get().size(),
+      framework.values["offers"].as<JSON::Array>().values.size());
+
+  // Launch two tasks, one of which finishes right away.
+  vector<TaskInfo> tasks;
+  for (int i = 1; i <= 2; i++) {
+    TaskInfo task;
+    task.set_name("");
+    task.mutable_task_id()->set_value(stringify(i));
+    task.mutable_slave_id()->MergeFrom(offers.get()[0].slave_id());
+    task.mutable_resources()->MergeFrom(
+        Resources::parse("cpus:1;mem:512").get());
+    task.mutable_executor()->MergeFrom(DEFAULT_EXECUTOR_INFO);
+
+    tasks.push_back(task);
+  }
+
+  EXPECT_CALL(exec, registered(_, _, _, _))
+    .Times(1);
+
+  EXPECT_CALL(exec, launchTask(_, _))
+    .WillOnce(SendStatusUpdateFromTask(TASK_RUNNING))
+    .WillOnce(SendStatusUpdateFromTask(TASK_FINISHED));
+
+  Future<TaskStatus> status1;
+  Future<TaskStatus> status2;
+  EXPECT_CALL(sched, statusUpdate(&driver, _))
+    .WillOnce(FutureArg<1>(&status1))
+    .WillOnce(FutureArg<1>(&status2));
+
+  driver.launchTasks(offers.get()[0].id(), tasks);
+
+  AWAIT_READY(status1);
+  AWAIT_READY(status2);
+
+  // The updates of the two tasks can arrive in either order.
+  TaskStatus running = status1.get();
+  TaskStatus finished = status2.get();
+  if (running.task_id().value() != "1") {
+    std::swap(running, finished);
+  }
+
+  EXPECT_EQ(TASK_RUNNING, running.state());
+  EXPECT_EQ(TASK_FINISHED, finished.state());
+
+  response = process::http::get(master.get(), "state.json");
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(OK().status, response);
+
+  parse = JSON::parse(response.get().body);
+  ASSERT_SOME(parse);
+
+  state = parse.get().as<JSON::Object>();
+  frameworks = state.values["frameworks"].as<JSON::Array>();
+  ASSERT_EQ(1u, frameworks.values.size());
+
+  framework = frameworks.values.front().as<JSON::Object>();
+
+  JSON::Array array = framework.values["tasks"].as<JSON::Array>();
+  ASSERT_EQ(1u, array.values.size());
+
+  JSON::Object task = array.values.front().as<JSON::Object>();
+  EXPECT_EQ("1", task.values["id"].as<JSON::String>().value);
+  EXPECT_EQ("TASK_RUNNING", task.values["state"].as<JSON::String>().value);
+
+  array = framework.values["completed_tasks"].as<JSON::Array>();
+  ASSERT_EQ(1u, array.values.size());
+
+  task = array.values.front().as<JSON::Object>();
+  EXPECT_EQ("2", task.values["id"].as<JSON::String>().value);
+  EXPECT_EQ("TASK_FINISHED", task.values["state"].as<JSON::String>().value);
+
+  response = process::http::get(master.get(), "state.json", "jsonp=callback");
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(OK().status, response);
+  AWAIT_EXPECT_RESPONSE_HEADER_EQ(
+      "text/javascript",
+      "Content-Type",
+      response);
+
+  const string& body = response.get().body;
+  ASSERT_TRUE(strings::startsWith(body, "callback("));
+  ASSERT_TRUE(strings::endsWith(body, ");"));
+
+  parse = JSON::parse(body.substr(9, body.size() - 11));
+  ASSERT_SOME(parse);
+  EXPECT_EQ("callback(" + stringify(parse.get()) + ");", body);
+
+  EXPECT_CALL(exec, shutdown(_))
+    .Times(AtMost(1));
+
+  driver.stop();
+  driver.join();
+
+  Shutdown(); // Must shutdown before 'containerizer' gets deallocated.
+}
+
+
 #ifdef MESOS_HAS_JAVA
 class MasterZooKeeperTest : public MesosTest
 {
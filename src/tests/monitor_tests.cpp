@@ -31,7 +31,10 @@
 #include <process/pid.hpp>
 #include <process/process.hpp>
 
+#include <stout/gtest.hpp>
+#include <stout/json.hpp>
 #include <stout/nothing.hpp>
+#include <stout/protobuf.hpp>
 
 #include "slave/constants.hpp"
 #include "slave/monitor.hpp"
@@ -167,6 +170,236 @@ TEST(MonitorTest, Collection)
 }
 
 
+// This test verifies that the time series of a container is archived
+// once the container is no longer monitored.
+TEST(MonitorTest, Archive)
+{
+  ContainerID containerId;
+  containerId.set_value("container");
+
+  ExecutorInfo executorInfo;
+  executorInfo.mutable_executor_id()->set_value("executor");
+  executorInfo.mutable_framework_id()->set_value("framework");
+
+  // Use whole seconds so that the timestamps are exact when
+  // converted to process::Time (nanoseconds).
+  const double now =
+    static_cast<double>(static_cast<int64_t>(process::Clock::now().secs()));
+
+  ResourceStatistics statistics1;
+  statistics1.set_cpus_user_time_secs(4);
+  statistics1.set_cpus_system_time_secs(1);
+  statistics1.set_timestamp(now);
+
+  ResourceStatistics statistics2;
+  statistics2.CopyFrom(statistics1);
+  statistics2.set_timestamp(
+      now + slave::RESOURCE_MONITORING_INTERVAL.secs());
+
+  TestContainerizer containerizer;
+
+  Future<Nothing> usage1, usage2;
+  EXPECT_CALL(containerizer, usage(containerId))
+    .WillOnce(DoAll(FutureSatisfy(&usage1),
+                    Return(statistics1)))
+    .WillOnce(DoAll(FutureSatisfy(&usage2),
+                    Return(statistics2)));
+
+  slave::ResourceMonitor monitor(&containerizer);
+
+  process::Clock::pause();
+
+  monitor.start(
+      containerId,
+      executorInfo,
+      slave::RESOURCE_MONITORING_INTERVAL);
+
+  process::Clock::settle();
+
+  process::Clock::advance(slave::RESOURCE_MONITORING_INTERVAL);
+  process::Clock::settle();
+
+  AWAIT_READY(usage1);
+
+  process::Clock::settle();
+
+  process::Clock::advance(slave::RESOURCE_MONITORING_INTERVAL);
+  process::Clock::settle();
+
+  AWAIT_READY(usage2);
+
+  process::Clock::settle();
+
+  monitor.stop(containerId);
+
+  process::Clock::settle();
+
+  process::UPID upid("monitor", process::ip(), process::port());
+
+  Future<Response> response = process::http::get(upid, "archive.json");
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(OK().status, response);
+
+  Try<JSON::Array> archive = JSON::parse<JSON::Array>(response.get().body);
+  ASSERT_SOME(archive);
+  ASSERT_EQ(1u, archive.get().values.size());
+
+  JSON::Object entry = archive.get().values.front().as<JSON::Object>();
+  EXPECT_EQ(JSON::Value(JSON::String("executor")),
+            entry.values["executor_id"]);
+
+  JSON::Array samples = entry.values["statistics"].as<JSON::Array>();
+  ASSERT_EQ(2u, samples.values.size());
+  EXPECT_EQ(JSON::Value(JSON::Protobuf(statistics1)), samples.values.front());
+  EXPECT_EQ(JSON::Value(JSON::Protobuf(statistics2)), samples.values.back());
+}
+
+
+TEST(MonitorTest, TimeSeries)
+{
+  // Use whole seconds so that the timestamps are exact when
+  // converted to process::Time (nanoseconds).
+  const double now =
+    static_cast<double>(static_cast<int64_t>(process::Clock::now().secs()));
+
+  slave::ResourceStatisticsTimeSeries series(Weeks(1), 10);
+  EXPECT_TRUE(series.empty());
+  EXPECT_NONE(series.latest());
+
+  ResourceStatistics statistics;
+  statistics.set_cpus_limit(1.0);
+
+  for (int i = 0; i < 10; i++) {
+    statistics.set_timestamp(now + i);
+    statistics.set_mem_rss_bytes(i);
+    series.append(statistics);
+  }
+
+  ASSERT_EQ(10u, series.size());
+  EXPECT_EQ(now, series.get(0).timestamp());
+  EXPECT_EQ(5u, series.get(5).mem_rss_bytes());
+  EXPECT_FALSE(series.get(5).has_mem_limit_bytes());
+  ASSERT_SOME(series.latest());
+  EXPECT_EQ(now + 9, series.latest().get().timestamp());
+
+  // Samples older than the latest sample are ignored.
+  statistics.set_timestamp(now + 5);
+  series.append(statistics);
+  EXPECT_EQ(10u, series.size());
+
+  // Exceeding the capacity drops every other sample from the older
+  // half of the time series.
+  statistics.set_timestamp(now + 10);
+  series.append(statistics);
+
+  ASSERT_EQ(9u, series.size());
+  EXPECT_EQ(now, series.get(0).timestamp());
+  EXPECT_EQ(now + 2, series.get(1).timestamp());
+  EXPECT_EQ(now + 4, series.get(2).timestamp());
+  EXPECT_EQ(now + 5, series.get(3).timestamp());
+  EXPECT_EQ(now + 10, series.get(8).timestamp());
+
+  // Range queries.
+  std::pair<size_t, size_t> range = series.range(
+      process::Time::create(now + 3).get(),
+      process::Time::create(now + 6).get());
+  EXPECT_EQ(2u, range.first);
+  EXPECT_EQ(5u, range.second);
+
+  range = series.range(process::Time::create(now + 11).get());
+  EXPECT_EQ(range.first, range.second);
+
+  JSON::Array array = series.json(process::Time::create(now + 9).get());
+  ASSERT_EQ(2u, array.values.size());
+  EXPECT_EQ(JSON::Value(JSON::Protobuf(series.get(7))), array.values.front());
+
+  // Samples outside of the window get dropped.
+  slave::ResourceStatisticsTimeSeries window(Seconds(10), 10);
+
+  statistics.set_timestamp(now - Weeks(1).secs());
+  window.append(statistics);
+  EXPECT_EQ(1u, window.size());
+
+  statistics.set_timestamp(now);
+  window.append(statistics);
+  ASSERT_EQ(1u, window.size());
+  EXPECT_EQ(now, window.get(0).timestamp());
+}
+
+
+// This test verifies that the containers monitored at the same
+// interval get collected together, even when they were started at
+// different times.
+TEST(MonitorTest, AlignedCollection)
+{
+  ExecutorInfo executorInfo;
+  executorInfo.mutable_executor_id()->set_value("executor");
+  executorInfo.mutable_framework_id()->set_value("framework");
+
+  ContainerID containerId1;
+  containerId1.set_value("container1");
+
+  ContainerID containerId2;
+  containerId2.set_value("container2");
+
+  ResourceStatistics statistics;
+  statistics.set_cpus_user_time_secs(4);
+  statistics.set_cpus_system_time_secs(1);
+  statistics.set_timestamp(0);
+
+  TestContainerizer containerizer;
+
+  Future<Nothing> usage1, usage2;
+  EXPECT_CALL(containerizer, usage(containerId1))
+    .WillOnce(DoAll(FutureSatisfy(&usage1),
+                    Return(statistics)));
+  EXPECT_CALL(containerizer, usage(containerId2))
+    .WillOnce(DoAll(FutureSatisfy(&usage2),
+                    Return(statistics)));
+
+  slave::ResourceMonitor monitor(&containerizer);
+
+  process::Clock::pause();
+
+  monitor.start(
+      containerId1,
+      executorInfo,
+      slave::RESOURCE_MONITORING_INTERVAL);
+
+  process::Clock::settle();
+
+  // Start monitoring the second container halfway through the
+  // interval of the first one.
+  process::Clock::advance(slave::RESOURCE_MONITORING_INTERVAL / 2);
+
+  monitor.start(
+      containerId2,
+      executorInfo,
+      slave::RESOURCE_MONITORING_INTERVAL);
+
+  process::Clock::settle();
+
+  // Both containers should be collected at the end of the interval
+  // of the first one.
+  process::Clock::advance(slave::RESOURCE_MONITORING_INTERVAL / 2);
+  process::Clock::settle();
+
+  AWAIT_READY(usage1);
+  AWAIT_READY(usage2);
+
+  monitor.stop(containerId1);
+  monitor.stop(containerId2);
+
+  process::Clock::settle();
+
+  EXPECT_CALL(containerizer, usage(_))
+    .Times(0);
+
+  process::Clock::advance(slave::RESOURCE_MONITORING_INTERVAL);
+  process::Clock::settle();
+}
+
+
 TEST(MonitorTest, Statistics)
 {
   FrameworkID frameworkId;
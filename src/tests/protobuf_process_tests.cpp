@@ -0,0 +1,341 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+
+#include <mesos/resources.hpp>
+
+#include <process/dispatch.hpp>
+#include <process/future.hpp>
+#include <process/gtest.hpp>
+#include <process/pid.hpp>
+#include <process/process.hpp>
+#include <process/protobuf.hpp>
+
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+
+#include "common/protobuf_utils.hpp"
+
+#include "messages/messages.hpp"
+
+using namespace mesos;
+using namespace mesos::internal;
+
+using google::protobuf::RepeatedPtrField;
+
+using process::Future;
+using process::PID;
+using process::UPID;
+
+using std::string;
+using std::vector;
+
+
+// The different ways a handler can receive a ResourceOffersMessage.
+enum HandlerType
+{
+  VECTORS,  // Each repeated field copied into a vector.
+  FIELDS,   // The repeated fields by reference.
+  MESSAGE   // The whole message by reference.
+};
+
+
+class OffersProcess : public ProtobufProcess<OffersProcess>
+{
+public:
+  explicit OffersProcess(HandlerType _type)
+    : type(_type), updates(0) {}
+
+  // Returns the ids of all offers received so far.
+  vector<string> offers()
+  {
+    return offerIds;
+  }
+
+  size_t statusUpdates()
+  {
+    return updates;
+  }
+
+protected:
+  virtual void initialize()
+  {
+    switch (type) {
+      case VECTORS:
+        install<ResourceOffersMessage>(
+            &OffersProcess::vectors,
+            &ResourceOffersMessage::offers,
+            &ResourceOffersMessage::pids);
+        break;
+      case FIELDS:
+        install<ResourceOffersMessage>(
+            &OffersProcess::fields,
+            &ResourceOffersMessage::offers,
+            &ResourceOffersMessage::pids);
+        break;
+      case MESSAGE:
+        install<ResourceOffersMessage>(&OffersProcess::message);
+        break;
+    }
+
+    install<StatusUpdateMessage>(
+        &OffersProcess::statusUpdate,
+        &StatusUpdateMessage::update,
+        &StatusUpdateMessage::pid);
+  }
+
+private:
+  void vectors(
+      const UPID& from,
+      const vector<Offer>& offers,
+      const vector<string>& pids)
+  {
+    CHECK_EQ(offers.size(), pids.size());
+    for (size_t i = 0; i < offers.size(); i++) {
+      offerIds.push_back(offers[i].id().value());
+    }
+  }
+
+  void fields(
+      const UPID& from,
+      const RepeatedPtrField<Offer>& offers,
+      const RepeatedPtrField<string>& pids)
+  {
+    CHECK_EQ(offers.size(), pids.size());
+    for (int i = 0; i < offers.size(); i++) {
+      offerIds.push_back(offers.Get(i).id().value());
+    }
+  }
+
+  void message(const UPID& from, const ResourceOffersMessage& message)
+  {
+    fields(from, message.offers(), message.pids());
+  }
+
+  void statusUpdate(
+      const UPID& from,
+      const StatusUpdate& update,
+      const UPID& pid)
+  {
+    updates++;
+  }
+
+  const HandlerType type;
+
+  vector<string> offerIds;
+  size_t updates;
+};
+
+
+static ResourceOffersMessage createResourceOffersMessage(
+    size_t offerCount,
+    size_t start = 0)
+{
+  Resources resources = Resources::parse(
+      "cpus:24;mem:65536;disk:1048576;ports:[31000-32000]").get();
+
+  ResourceOffersMessage message;
+
+  for (size_t i = start; i < start + offerCount; i++) {
+    Offer* offer = message.add_offers();
+    offer->mutable_id()->set_value("offer" + stringify(i));
+    offer->mutable_framework_id()->set_value("framework");
+    offer->mutable_slave_id()->set_value("slave" + stringify(i));
+    offer->set_hostname("host" + stringify(i));
+    offer->mutable_resources()->MergeFrom(resources);
+
+    message.add_pids("slave(1)@127.0.0.1:" + stringify(5051 + i));
+  }
+
+  return message;
+}
+
+
+TEST(ProtobufProcessTest, Handlers)
+{
+  const HandlerType types[] = { VECTORS, FIELDS, MESSAGE };
+
+  foreach (HandlerType type, types) {
+    OffersProcess process(type);
+    PID<OffersProcess> pid = spawn(process);
+
+    // The second (smaller) message reuses the memory of the first
+    // one but should not include any of its offers.
+    process::post(pid, createResourceOffersMessage(2));
+    process::post(pid, createResourceOffersMessage(1, 2));
+
+    Future<vector<string> > offers = dispatch(pid, &OffersProcess::offers);
+
+    AWAIT_READY(offers);
+    ASSERT_EQ(3u, offers.get().size());
+    EXPECT_EQ("offer0", offers.get()[0]);
+    EXPECT_EQ("offer1", offers.get()[1]);
+    EXPECT_EQ("offer2", offers.get()[2]);
+
+    terminate(process);
+    wait(process);
+  }
+}
+
+
+// Messages with missing required fields are not handed to the
+// handlers.
+TEST(ProtobufProcessTest, Uninitialized)
+{
+  OffersProcess process(MESSAGE);
+  PID<OffersProcess> pid = spawn(process);
+
+  FrameworkID frameworkId;
+  frameworkId.set_value("framework");
+
+  SlaveID slaveId;
+  slaveId.set_value("slave");
+
+  TaskID taskId;
+  taskId.set_value("task");
+
+  StatusUpdateMessage message;
+  message.mutable_update()->MergeFrom(
+      protobuf::createStatusUpdate(
+          frameworkId, slaveId, taskId, TASK_RUNNING));
+
+  // An empty body parses into a message without an update.
+  process::post(pid, message);
+  process::post(pid, message.GetTypeName());
+  process::post(pid, message);
+
+  Future<size_t> updates = dispatch(pid, &OffersProcess::statusUpdates);
+
+  AWAIT_READY(updates);
+  EXPECT_EQ(2u, updates.get());
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Messages that fail to parse are not handed to the handlers.
+TEST(ProtobufProcessTest, Malformed)
+{
+  OffersProcess process(MESSAGE);
+  PID<OffersProcess> pid = spawn(process);
+
+  ResourceOffersMessage message = createResourceOffersMessage(1);
+
+  // A length delimited field (the first offer) that is truncated.
+  const string data = "\x0a\x10";
+
+  process::post(pid, message.GetTypeName(), data.data(), data.size());
+  process::post(pid, message);
+
+  Future<vector<string> > offers = dispatch(pid, &OffersProcess::offers);
+
+  AWAIT_READY(offers);
+  ASSERT_EQ(1u, offers.get().size());
+  EXPECT_EQ("offer0", offers.get()[0]);
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Measures the cost of dispatching resource offers and status
+// updates to ProtobufProcess handlers for each way a handler can
+// take the message.
+TEST(ProtobufProcess_BENCHMARK_Test, Dispatch)
+{
+  const size_t messageCount = 1000;
+  const size_t offerCount = 100;
+  const size_t updateCount = 100000;
+
+  const HandlerType types[] = { VECTORS, FIELDS, MESSAGE };
+  const string names[] = { "vectors", "fields", "message" };
+
+  const ResourceOffersMessage offers = createResourceOffersMessage(offerCount);
+
+  string data;
+  offers.SerializeToString(&data);
+
+  for (size_t i = 0; i < 3; i++) {
+    OffersProcess process(types[i]);
+    PID<OffersProcess> pid = spawn(process);
+
+    Stopwatch watch;
+    watch.start();
+
+    for (size_t j = 0; j < messageCount; j++) {
+      process::post(pid, offers.GetTypeName(), data.data(), data.size());
+    }
+
+    Future<vector<string> > received = dispatch(pid, &OffersProcess::offers);
+
+    AWAIT_READY(received);
+    EXPECT_EQ(messageCount * offerCount, received.get().size());
+
+    LOG(INFO) << "Dispatched " << messageCount << " messages with "
+              << offerCount << " offers (" << data.size() << " bytes) to '"
+              << names[i] << "' handlers in " << watch.elapsed()
+              << " (" << watch.elapsed() / messageCount << " per message)";
+
+    terminate(process);
+    wait(process);
+  }
+
+  FrameworkID frameworkId;
+  frameworkId.set_value("framework");
+
+  SlaveID slaveId;
+  slaveId.set_value("slave");
+
+  TaskID taskId;
+  taskId.set_value("task");
+
+  StatusUpdateMessage update;
+  update.mutable_update()->MergeFrom(
+      protobuf::createStatusUpdate(
+          frameworkId, slaveId, taskId, TASK_RUNNING));
+  update.set_pid("slave(1)@127.0.0.1:5051");
+
+  update.SerializeToString(&data);
+
+  OffersProcess process(MESSAGE);
+  PID<OffersProcess> pid = spawn(process);
+
+  Stopwatch watch;
+  watch.start();
+
+  for (size_t i = 0; i < updateCount; i++) {
+    process::post(pid, update.GetTypeName(), data.data(), data.size());
+  }
+
+  Future<size_t> updates = dispatch(pid, &OffersProcess::statusUpdates);
+
+  AWAIT_READY(updates);
+  EXPECT_EQ(updateCount, updates.get());
+
+  LOG(INFO) << "Dispatched " << updateCount << " status updates in "
+            << watch.elapsed() << " ("
+            << watch.elapsed() / updateCount << " per message)";
+
+  terminate(process);
+  wait(process);
+}
@@ -46,6 +46,8 @@ using namespace mesos::internal;
 
 using namespace process;
 
+using mesos::internal::state::protobuf::Variable;
+
 using std::map;
 using std::string;
 using std::vector;
@@ -285,6 +287,89 @@ TEST_P(RegistrarTest, bootstrap)
 }
 
 
+TEST_P(RegistrarTest, deltas)
+{
+  vector<SlaveInfo> infos;
+  for (int i = 0; i < 10; i++) {
+    SlaveInfo info;
+    info.set_hostname("localhost");
+    info.mutable_id()->set_value(stringify(i));
+    infos.push_back(info);
+  }
+
+  // Run 1 admits the slaves one at a time and removes one of them,
+  // which stores a mix of snapshots and deltas.
+  {
+    Registrar registrar(flags, state);
+    AWAIT_READY(registrar.recover(master));
+
+    foreach (const SlaveInfo& info, infos) {
+      AWAIT_EQ(true, registrar.apply(Owned<Operation>(new AdmitSlave(info))));
+    }
+
+    AWAIT_EQ(true,
+             registrar.apply(Owned<Operation>(new RemoveSlave(infos[2]))));
+  }
+
+  // Add deltas that are already included in the Registry, as if the
+  // registrar failed after storing a snapshot but before clearing
+  // the deltas, replaying them should not change the Registry.
+  Future<Variable<RegistryDeltas> > deltas =
+    state->fetch<RegistryDeltas>("registry.deltas");
+  AWAIT_READY(deltas);
+
+  RegistryDeltas mutations = deltas.get().get();
+
+  RegistryMutation* mutation = mutations.add_mutations();
+  mutation->set_type(RegistryMutation::ADD_SLAVE);
+  mutation->mutable_slave()->CopyFrom(infos[0]);
+
+  mutation = mutations.add_mutations();
+  mutation->set_type(RegistryMutation::REMOVE_SLAVE);
+  mutation->mutable_slave_id()->CopyFrom(infos[2].id());
+
+  AWAIT_READY(state->store(deltas.get().mutate(mutations)));
+
+  // Run 2 should recover all but the removed slave, in order.
+  {
+    Registrar registrar(flags, state);
+
+    Future<Registry> registry = registrar.recover(master);
+    AWAIT_READY(registry);
+
+    infos.erase(infos.begin() + 2);
+
+    ASSERT_EQ(infos.size(), (size_t) registry.get().slaves().slaves().size());
+    for (size_t i = 0; i < infos.size(); i++) {
+      EXPECT_EQ(infos[i], registry.get().slaves().slaves(i).info());
+    }
+  }
+}
+
+
+// Returns 'count' slaves that simulate real slave information.
+static vector<SlaveInfo> createSlaveInfos(size_t count)
+{
+  vector<SlaveInfo> infos;
+
+  Attributes attributes = Attributes::parse("foo:bar;baz:quux");
+  Resources resources =
+    Resources::parse("cpus(*):1.0;mem(*):512;disk(*):2048").get();
+
+  for (size_t i = 0; i < count; ++i) {
+    SlaveInfo info;
+    info.set_hostname("localhost");
+    info.mutable_id()->set_value(
+        std::string("201310101658-2280333834-5050-48574-") + stringify(i));
+    info.mutable_resources()->MergeFrom(resources);
+    info.mutable_attributes()->MergeFrom(attributes);
+    infos.push_back(info);
+  }
+
+  return infos;
+}
+
+
 // We are not inheriting from RegistrarTest because this test fixture
 // derives from a different instantiation of the TestWithParam template.
 class Registrar_BENCHMARK_Test : public ::testing::TestWithParam<size_t>
@@ -340,25 +425,10 @@ TEST_P(Registrar_BENCHMARK_Test, performance)
   Registrar registrar(flags, state);
   AWAIT_READY(registrar.recover(master));
 
-  vector<SlaveInfo> infos;
-
-  Attributes attributes = Attributes::parse("foo:bar;baz:quux");
-  Resources resources =
-    Resources::parse("cpus(*):1.0;mem(*):512;disk(*):2048").get();
-
   size_t slaveCount = GetParam();
 
   // Create slaves.
-  for (size_t i = 0; i < slaveCount; ++i) {
-    // Simulate real slave information.
-    SlaveInfo info;
-    info.set_hostname("localhost");
-    info.mutable_id()->set_value(
-        std::string("201310101658-2280333834-5050-48574-") + stringify(i));
-    info.mutable_resources()->MergeFrom(resources);
-    info.mutable_attributes()->MergeFrom(attributes);
-    infos.push_back(info);
-  }
+  vector<SlaveInfo> infos = createSlaveInfos(slaveCount);
 
   // Admit slaves.
   Stopwatch watch;
@@ -407,6 +477,48 @@ TEST_P(Registrar_BENCHMARK_Test, performance)
   LOG(INFO) << "Removed " << slaveCount << " slaves in " << watch.elapsed();
 }
 
+
+// Measures the rate of (unbatched) operations as the Registry grows,
+// which is dominated by how much is stored per operation.
+TEST_P(Registrar_BENCHMARK_Test, throughput)
+{
+  Registrar registrar(flags, state);
+  AWAIT_READY(registrar.recover(master));
+
+  size_t slaveCount = GetParam();
+
+  vector<SlaveInfo> infos = createSlaveInfos(slaveCount);
+
+  Future<bool> result;
+  foreach (const SlaveInfo& info, infos) {
+    result = registrar.apply(Owned<Operation>(new AdmitSlave(info)));
+  }
+  AWAIT_READY_FOR(result, Minutes(5));
+
+  Registry registry;
+  foreach (const SlaveInfo& info, infos) {
+    registry.mutable_slaves()->add_slaves()->mutable_info()->CopyFrom(info);
+  }
+
+  // Remove and readmit slaves one operation at a time.
+  const size_t count = 1000;
+
+  Stopwatch watch;
+  watch.start();
+  for (size_t i = 0; i < count; i++) {
+    const SlaveInfo& info = infos[i % infos.size()];
+    AWAIT_EQ(true, registrar.apply(Owned<Operation>(new RemoveSlave(info))));
+    AWAIT_EQ(true, registrar.apply(Owned<Operation>(new AdmitSlave(info))));
+  }
+
+  Duration elapsed = watch.elapsed();
+
+  LOG(INFO) << "Applied " << 2 * count << " operations to a registry of "
+            << slaveCount << " slaves (" << Bytes(registry.ByteSize())
+            << ") in " << elapsed << " ("
+            << (2 * count) / elapsed.secs() << " operations/sec)";
+}
+
 } // namespace master {
 } // namespace internal {
 } // namespace mesos {
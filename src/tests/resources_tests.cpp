@@ -23,6 +23,11 @@
 
 #include <stout/bytes.hpp>
 #include <stout/gtest.hpp>
+#include <stout/stopwatch.hpp>
+
+#include "common/resource_vector.hpp"
+
+#include "logging/logging.hpp"
 
 #include "master/master.hpp"
 
@@ -770,3 +775,167 @@ TEST(ResourcesTest, Find)
 
   EXPECT_NONE(resources4.find(toFind1, "role1"));
 }
+
+
+TEST(ResourceVectorTest, Conversion)
+{
+  Resources resources = Resources::parse(
+      "cpus:2;mem(role1):1024;ports:[31000-32000];disks:{sda1, sda2}").get();
+
+  ResourceVector vector = resources;
+
+  EXPECT_EQ(4u, vector.size());
+  EXPECT_EQ(resources, vector.resources());
+
+  EXPECT_SOME_EQ(2.0, vector.cpus());
+  EXPECT_SOME_EQ(Megabytes(1024), vector.mem());
+  EXPECT_NONE(vector.disk());
+
+  EXPECT_TRUE(ResourceVector().empty());
+  EXPECT_TRUE(ResourceVector().resources().size() == 0);
+}
+
+
+TEST(ResourceVectorTest, Arithmetic)
+{
+  Resources r1 = Resources::parse(
+      "cpus:2;mem:1024;ports:[31000-31500];disks:{sda1}").get();
+  Resources r2 = Resources::parse(
+      "cpus:1;mem(role1):512;ports:[31501-32000];disks:{sda2}").get();
+
+  ResourceVector v1 = r1;
+  ResourceVector v2 = r2;
+
+  EXPECT_EQ(r1 + r2, (v1 + v2).resources());
+  EXPECT_EQ(r1, (v1 + v2 - v2).resources());
+  EXPECT_EQ(r1 - r2, (v1 - v2).resources());
+
+  ResourceVector sum = v1;
+  sum += v2;
+  EXPECT_EQ(v1 + v2, sum);
+
+  sum -= v1;
+  EXPECT_EQ(v2, sum);
+
+  // Subtracting everything leaves nothing behind.
+  sum -= v2;
+  EXPECT_TRUE(sum.empty());
+
+  // Subtracting part of a range splits it.
+  ResourceVector ports = Resources::parse("ports:[1-10]").get();
+  ports -= Resources::parse("ports:[4-6]").get();
+  EXPECT_EQ(Resources::parse("ports:[1-3, 7-10]").get(), ports.resources());
+}
+
+
+TEST(ResourceVectorTest, Subset)
+{
+  ResourceVector v1 = Resources::parse(
+      "cpus:1;mem:512;ports:[31000-31100];disks:{sda1}").get();
+  ResourceVector v2 = Resources::parse(
+      "cpus:2;mem:1024;ports:[31000-32000];disks:{sda1, sda2}").get();
+
+  EXPECT_TRUE(v1 <= v2);
+  EXPECT_FALSE(v2 <= v1);
+  EXPECT_TRUE(v1 <= v1);
+
+  // Resources with a different role are not comparable.
+  ResourceVector v3 = Resources::parse("cpus(role1):1").get();
+  EXPECT_FALSE(v3 <= v2);
+}
+
+
+TEST(ResourceVectorTest, Extract)
+{
+  Resources resources = Resources::parse(
+      "cpus(role1):2;mem(role1):5;cpus:1;mem:7;ports(role1):[1-10]").get();
+
+  ResourceVector vector = resources;
+
+  EXPECT_EQ(resources.extract("role1"), vector.extract("role1").resources());
+  EXPECT_EQ(resources.extract("*"), vector.extract("*").resources());
+  EXPECT_TRUE(vector.extract("role2").empty());
+
+  uint32_t role1 = ResourceVector::intern("role1");
+  EXPECT_EQ(vector.extract("role1"), vector.extract(role1));
+}
+
+
+TEST(ResourceVectorTest, Allocatable)
+{
+  ResourceVector vector =
+    Resources::parse("cpus:1;mem:0;ports:[1-10]").get();
+
+  EXPECT_EQ(Resources::parse("cpus:1;ports:[1-10]").get(),
+            vector.allocatable().resources());
+}
+
+
+// Compares the arithmetic done by the allocator on every allocation
+// using Resources and ResourceVector.
+TEST(Resources_BENCHMARK_Test, Arithmetic)
+{
+  const size_t iterations = 100000;
+
+  Resources total = Resources::parse(
+      "cpus:32;mem:65536;disk:1048576;ports:[31000-32000];"
+      "cpus(role1):8;mem(role1):16384").get();
+
+  Resources offer = Resources::parse(
+      "cpus:1;mem:128;disk:1024;ports:[31000-31000]").get();
+
+  Stopwatch watch;
+
+  {
+    Resources available = total;
+
+    watch.start();
+    for (size_t i = 0; i < iterations; i++) {
+      Resources resources = available.extract("*");
+      resources += available.extract("role1");
+      if (resources.cpus().isSome() && resources.mem().isSome() &&
+          offer <= resources) {
+        available -= offer;
+        available += offer;
+      }
+    }
+    watch.stop();
+
+    LOG(INFO) << "Performed " << iterations << " allocations with "
+              << "Resources in " << watch.elapsed();
+  }
+
+  {
+    ResourceVector available = total;
+    ResourceVector vector = offer;
+
+    // Like the allocator, intern the roles once.
+    uint32_t unreserved = ResourceVector::intern("*");
+    uint32_t role1 = ResourceVector::intern("role1");
+
+    watch.start();
+    for (size_t i = 0; i < iterations; i++) {
+      ResourceVector resources = available.extract(unreserved);
+      resources += available.extract(role1);
+      if (resources.cpus().isSome() && resources.mem().isSome() &&
+          vector <= resources) {
+        available -= vector;
+        available += vector;
+      }
+    }
+    watch.stop();
+
+    LOG(INFO) << "Performed " << iterations << " allocations with "
+              << "ResourceVector in " << watch.elapsed();
+  }
+
+  watch.start();
+  for (size_t i = 0; i < iterations; i++) {
+    ResourceVector vector = offer;
+    vector.resources();
+  }
+  watch.stop();
+
+  LOG(INFO) << "Performed " << iterations << " conversions to and from "
+            << "ResourceVector in " << watch.elapsed();
+}
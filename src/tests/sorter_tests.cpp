@@ -21,6 +21,11 @@
 
 #include <gmock/gmock.h>
 
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+
+#include "logging/logging.hpp"
+
 #include "master/drf_sorter.hpp"
 #include "master/sorter.hpp"
 
@@ -175,3 +180,73 @@ TEST(SorterTest, WDRFSorter)
 
   checkSorter(sorter, 3, "c", "d", "e");
 }
+
+
+// Measures the cost of keeping a sorter with many clients up to date
+// while slaves are added and removed (which changes the total
+// resources) and allocations are made in between sorts, similar to
+// what the allocator does on every allocation pass.
+TEST(Sorter_BENCHMARK_Test, DRFSorter)
+{
+  const size_t clientCount = 10000;
+  const size_t slaveCount = 1000;
+
+  DRFSorter sorter;
+
+  Resources slaveResources = Resources::parse("cpus:24;mem:65536").get();
+  Resources taskResources = Resources::parse("cpus:1;mem:512").get();
+
+  Stopwatch watch;
+  watch.start();
+
+  for (size_t i = 0; i < clientCount; i++) {
+    const string name = "framework" + stringify(i);
+    sorter.add(name);
+    sorter.allocated(name, taskResources);
+  }
+
+  LOG(INFO) << "Added " << clientCount << " clients in " << watch.elapsed();
+
+  // Add slaves (changing the total) with a sort in between.
+  watch.start();
+
+  for (size_t i = 0; i < slaveCount; i++) {
+    sorter.add(slaveResources);
+    EXPECT_EQ(clientCount, sorter.sort().size());
+  }
+
+  LOG(INFO) << "Added " << slaveCount << " slaves and sorted "
+            << clientCount << " clients in " << watch.elapsed();
+
+  // Allocate to the first client in the ordering, as the allocator
+  // does, and sort again.
+  watch.start();
+
+  for (size_t i = 0; i < slaveCount; i++) {
+    const string name = sorter.sort().front();
+    sorter.allocated(name, taskResources);
+  }
+
+  LOG(INFO) << "Performed " << slaveCount << " allocations and sorts in "
+            << watch.elapsed();
+
+  // Sorting without any changes should not need to rebuild anything.
+  watch.start();
+
+  for (size_t i = 0; i < slaveCount; i++) {
+    EXPECT_EQ(clientCount, sorter.sort().size());
+  }
+
+  LOG(INFO) << "Performed " << slaveCount << " sorts without changes in "
+            << watch.elapsed();
+
+  watch.start();
+
+  for (size_t i = 0; i < slaveCount; i++) {
+    sorter.remove(slaveResources);
+    sorter.sort();
+  }
+
+  LOG(INFO) << "Removed " << slaveCount << " slaves and sorted "
+            << clientCount << " clients in " << watch.elapsed();
+}
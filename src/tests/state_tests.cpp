@@ -18,6 +18,7 @@
 
 #include <gmock/gmock.h>
 
+#include <list>
 #include <set>
 #include <string>
 
@@ -31,6 +32,7 @@
 #include <stout/gtest.hpp>
 #include <stout/option.hpp>
 #include <stout/os.hpp>
+#include <stout/stringify.hpp>
 #include <stout/try.hpp>
 
 #include "common/type_utils.hpp"
@@ -557,6 +559,92 @@ TEST_F(LogStateTest, Names)
 }
 
 
+// Stores 'hostname' as the only slave in 'variable'.
+Future<Option<Variable<Slaves> > > store(
+    State* state,
+    const Variable<Slaves>& variable,
+    const string& hostname)
+{
+  Slaves slaves;
+  slaves.add_slaves()->mutable_info()->set_hostname(hostname);
+  return state->store(variable.mutate(slaves));
+}
+
+
+TEST_F(LogStateTest, Compaction)
+{
+  // Use a storage that only caches a single entry and compacts the
+  // log every minute instead.
+  delete state;
+  delete storage;
+
+  Clock::pause();
+
+  storage = new state::LogStorage(log, 1, Minutes(1));
+  state = new State(storage);
+
+  // Store a "cold" variable once and update a "hot" one repeatedly.
+  Future<Variable<Slaves> > cold = state->fetch<Slaves>("cold");
+  AWAIT_READY(cold);
+
+  Future<Option<Variable<Slaves> > > stored = store(state, cold.get(), "cold");
+  AWAIT_READY(stored);
+  ASSERT_SOME(stored.get());
+
+  Future<Variable<Slaves> > hot = state->fetch<Slaves>("hot");
+  AWAIT_READY(hot);
+
+  Variable<Slaves> variable = hot.get();
+
+  for (int i = 0; i < 20; i++) {
+    // The first compaction only remembers how far the log got, the
+    // second one appends the "cold" variable again.
+    if (i == 10) {
+      Clock::advance(Minutes(1));
+      Clock::settle();
+    }
+
+    stored = store(state, variable, "hot" + stringify(i));
+    AWAIT_READY(stored);
+    ASSERT_SOME(stored.get());
+
+    variable = stored.get().get();
+  }
+
+  Clock::advance(Minutes(1));
+  Clock::settle();
+
+  // Storing again waits for the compaction (and the truncation).
+  stored = store(state, variable, "hot");
+  AWAIT_READY(stored);
+  ASSERT_SOME(stored.get());
+
+  // Now only the "cold" and the latest "hot" snapshots are left.
+  log::Log::Reader reader(log);
+
+  Future<log::Log::Position> beginning = reader.beginning();
+  Future<log::Log::Position> ending = reader.ending();
+
+  AWAIT_READY(beginning);
+  AWAIT_READY(ending);
+
+  Future<std::list<log::Log::Entry> > entries =
+    reader.read(beginning.get(), ending.get());
+
+  AWAIT_READY(entries);
+  EXPECT_EQ(2u, entries.get().size());
+
+  // The "cold" variable isn't cached so it gets read from the log.
+  cold = state->fetch<Slaves>("cold");
+  AWAIT_READY(cold);
+
+  ASSERT_EQ(1, cold.get().get().slaves().size());
+  EXPECT_EQ("cold", cold.get().get().slaves(0).info().hostname());
+
+  Clock::resume();
+}
+
+
 Future<Option<Variable<Slaves> > > timeout(
     Future<Option<Variable<Slaves> > > future)
 {
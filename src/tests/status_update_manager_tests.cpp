@@ -35,16 +35,22 @@
 #include <stout/protobuf.hpp>
 #include <stout/result.hpp>
 #include <stout/try.hpp>
+#include <stout/uuid.hpp>
+
+#include "common/protobuf_utils.hpp"
 
 #include "master/master.hpp"
 
 #include "slave/constants.hpp"
 #include "slave/paths.hpp"
 #include "slave/slave.hpp"
+#include "slave/state.hpp"
+#include "slave/status_update_journal.hpp"
 
 #include "messages/messages.hpp"
 
 #include "tests/mesos.hpp"
+#include "tests/utils.hpp"
 
 using namespace mesos;
 using namespace mesos::internal;
@@ -54,6 +60,9 @@ using namespace mesos::internal::slave::paths;
 using mesos::internal::master::Master;
 
 using mesos::internal::slave::Slave;
+using mesos::internal::slave::StatusUpdateJournal;
+
+using mesos::internal::slave::state::SlaveState;
 
 using process::Clock;
 using process::Future;
@@ -145,7 +154,8 @@ TEST_F(StatusUpdateManagerTest, CheckpointStatusUpdate)
 
   // Ensure that both the status update and its acknowledgement are
   // correctly checkpointed.
-  Try<list<string> > found = os::find(flags.work_dir, TASK_UPDATES_FILE);
+  Try<list<string> > found =
+    os::find(flags.work_dir, STATUS_UPDATES_JOURNAL_FILE);
   ASSERT_SOME(found);
   ASSERT_EQ(1u, found.get().size());
 
@@ -155,20 +165,23 @@ TEST_F(StatusUpdateManagerTest, CheckpointStatusUpdate)
   int updates = 0;
   int acks = 0;
   string uuid;
-  Result<StatusUpdateRecord> record = None();
+  Result<StatusUpdateJournalRecord> record = None();
   while (true) {
-    record = ::protobuf::read<StatusUpdateRecord>(fd.get());
+    record = ::protobuf::read<StatusUpdateJournalRecord>(fd.get());
     ASSERT_FALSE(record.isError());
     if (record.isNone()) { // Reached EOF.
       break;
     }
 
-    if (record.get().type() == StatusUpdateRecord::UPDATE) {
-      EXPECT_EQ(TASK_RUNNING, record.get().update().status().state());
-      uuid = record.get().update().uuid();
+    EXPECT_EQ("1", record.get().task_id().value());
+
+    if (record.get().record().type() == StatusUpdateRecord::UPDATE) {
+      EXPECT_EQ(TASK_RUNNING,
+                record.get().record().update().status().state());
+      uuid = record.get().record().update().uuid();
       updates++;
     } else {
-      EXPECT_EQ(uuid, record.get().uuid());
+      EXPECT_EQ(uuid, record.get().record().uuid());
       acks++;
     }
   }
@@ -780,3 +793,171 @@ TEST_F(StatusUpdateManagerTest, DuplicateUpdateBeforeAck)
 
   Shutdown();
 }
+
+
+class StatusUpdateJournalTest : public TemporaryDirectoryTest
+{
+protected:
+  virtual void SetUp()
+  {
+    TemporaryDirectoryTest::SetUp();
+
+    rootDir = getMetaRootDir(os::getcwd());
+
+    slaveId.set_value("slave");
+    frameworkId.set_value("framework");
+    executorId.set_value("executor");
+    containerId.set_value("container");
+  }
+
+  StatusUpdateRecord update(const TaskID& taskId)
+  {
+    StatusUpdateRecord record;
+    record.set_type(StatusUpdateRecord::UPDATE);
+    record.mutable_update()->CopyFrom(internal::protobuf::createStatusUpdate(
+        frameworkId, slaveId, taskId, TASK_RUNNING, "", executorId));
+    return record;
+  }
+
+  StatusUpdateRecord ack(const StatusUpdateRecord& update)
+  {
+    StatusUpdateRecord record;
+    record.set_type(StatusUpdateRecord::ACK);
+    record.set_uuid(update.update().uuid());
+    return record;
+  }
+
+  Future<Nothing> append(
+      StatusUpdateJournal* journal,
+      const TaskID& taskId,
+      const StatusUpdateRecord& record)
+  {
+    return journal->append(
+        frameworkId, executorId, containerId, taskId, record);
+  }
+
+  string rootDir;
+  SlaveID slaveId;
+  FrameworkID frameworkId;
+  ExecutorID executorId;
+  ContainerID containerId;
+};
+
+
+// Checks that recovery hands the records of the journal to the
+// recovered tasks, skips the records of the tasks that weren't
+// recovered and truncates a partially written record.
+TEST_F(StatusUpdateJournalTest, Recover)
+{
+  TaskID taskId1;
+  taskId1.set_value("task1");
+
+  TaskID taskId2;
+  taskId2.set_value("task2");
+
+  Try<StatusUpdateJournal*> journal =
+    StatusUpdateJournal::create(rootDir, slaveId);
+  ASSERT_SOME(journal);
+
+  StatusUpdateRecord update1 = update(taskId1);
+  StatusUpdateRecord update2 = update(taskId2);
+
+  AWAIT_READY(append(journal.get(), taskId1, update1));
+  AWAIT_READY(append(journal.get(), taskId1, ack(update1)));
+  AWAIT_READY(append(journal.get(), taskId2, update2));
+
+  delete journal.get();
+
+  const string& path = getStatusUpdatesJournalPath(rootDir, slaveId);
+
+  Try<string> contents = os::read(path);
+  ASSERT_SOME(contents);
+
+  // Simulate the slave failing while writing a record.
+  Try<int> fd = os::open(path, O_WRONLY | O_APPEND);
+  ASSERT_SOME(fd);
+  ASSERT_SOME(os::write(fd.get(), "\x10\x00\x00\x00\x0a"));
+  close(fd.get());
+
+  // Only the first task is recovered.
+  SlaveState state;
+  state.id = slaveId;
+  state.frameworks[frameworkId].executors[executorId]
+    .runs[containerId].tasks[taskId1].id = taskId1;
+
+  ASSERT_SOME(SlaveState::recoverStatusUpdates(rootDir, slaveId, true, &state));
+
+  const hashmap<TaskID, slave::state::TaskState>& tasks =
+    state.frameworks[frameworkId].executors[executorId]
+      .runs[containerId].tasks;
+
+  ASSERT_TRUE(tasks.contains(taskId1));
+  EXPECT_FALSE(tasks.contains(taskId2));
+
+  const slave::state::TaskState& task = tasks.get(taskId1).get();
+  ASSERT_EQ(1u, task.updates.size());
+  EXPECT_EQ(update1.update().uuid(), task.updates.front().uuid());
+  EXPECT_TRUE(task.acks.contains(UUID::fromBytes(update1.update().uuid())));
+
+  // The partial record is gone.
+  EXPECT_SOME_EQ(contents.get(), os::read(path));
+}
+
+
+// Checks that compacting the journal drops the records of the tasks
+// whose checkpointed state no longer exists and that records can
+// still be appended afterwards.
+TEST_F(StatusUpdateJournalTest, Compact)
+{
+  TaskID taskId1;
+  taskId1.set_value("task1");
+
+  TaskID taskId2;
+  taskId2.set_value("task2");
+
+  // Only the first task still has its checkpointed state, e.g., the
+  // state of the second one has been garbage collected.
+  ASSERT_SOME(os::mkdir(getTaskPath(
+      rootDir, slaveId, frameworkId, executorId, containerId, taskId1)));
+
+  // Compact the journal after every commit.
+  Try<StatusUpdateJournal*> journal =
+    StatusUpdateJournal::create(rootDir, slaveId, Bytes(1));
+  ASSERT_SOME(journal);
+
+  StatusUpdateRecord update1 = update(taskId1);
+
+  AWAIT_READY(append(journal.get(), taskId1, update1));
+  AWAIT_READY(append(journal.get(), taskId2, update(taskId2)));
+  AWAIT_READY(append(journal.get(), taskId1, ack(update1)));
+
+  // Wait for the last commit (and compaction) to finish.
+  delete journal.get();
+
+  const string& path = getStatusUpdatesJournalPath(rootDir, slaveId);
+
+  Try<int> fd = os::open(path, O_RDONLY);
+  ASSERT_SOME(fd);
+
+  vector<StatusUpdateRecord> records;
+  Result<StatusUpdateJournalRecord> record = None();
+  while (true) {
+    record = ::protobuf::read<StatusUpdateJournalRecord>(fd.get());
+    ASSERT_FALSE(record.isError());
+    if (record.isNone()) { // Reached EOF.
+      break;
+    }
+
+    EXPECT_EQ(taskId1, record.get().task_id());
+    records.push_back(record.get().record());
+  }
+
+  close(fd.get());
+
+  ASSERT_EQ(2u, records.size());
+  EXPECT_EQ(StatusUpdateRecord::UPDATE, records[0].type());
+  EXPECT_EQ(StatusUpdateRecord::ACK, records[1].type());
+  EXPECT_EQ(update1.update().uuid(), records[1].uuid());
+
+  EXPECT_FALSE(os::exists(path + ".compact"));
+}